@@ -0,0 +1,563 @@
+/**
+ * Copyright 2017 Tomas Frisberg & Ola Bjorsne
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http ://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Throughput and latency of synthetic flows built from test nodes.
+ *
+ * chain:    source -> relays -> sink
+ * fanout:   source -> hub -> sinks, the hub clones each message to every sink
+ * fanin:    sources -> sink
+ * prio:     a high and a low priority chain sharing the workers, reported apart
+ * evtstorm: a driver thread sets events on many nodes as fast as it can
+ *
+ * Sources are nodes. They send rounds of BENCH_BURST messages each and keep at most
+ * BENCH_WINDOW rounds in flight, sinks give credit back with an event. Latency is from
+ * send at the source to receive at the sink, for events from the first pending set to
+ * recv_evt. Peak heap is sampled by the sources after each round, when the most
+ * messages are in flight.
+ *
+ * One JSON object per line and flow, counts are fixed so runs compare across commits.
+ *
+ * usage: nrc_bench_flow [workers] [scale]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <assert.h>
+#include <sys/resource.h>
+
+#include "nrc_port.h"
+#include "nrc_os.h"
+
+#define BENCH_SCHEMA        (1)
+#define BENCH_BURST         (64)
+#define BENCH_WINDOW        (4)
+#define BENCH_MAX_OUT       (16)
+#define BENCH_MAX_SOURCES   (16)
+#define BENCH_MAX_NODES     (64)
+#define BENCH_TIMEOUT_NS    (60ULL * 1000000000ULL)
+
+enum bench_role {
+    BENCH_ROLE_SOURCE = 0,
+    BENCH_ROLE_RELAY,
+    BENCH_ROLE_SINK,
+    BENCH_ROLE_EVT
+};
+
+struct bench_msg {
+    struct nrc_msg_hdr  hdr;
+    u64_t               sent_ns;
+};
+
+struct bench_node;
+
+struct bench_flow {
+    const char          *name;
+    u32_t               node_count;
+    u32_t               round_msgs;     // Deliveries at sinks per round
+    u32_t               rounds;
+    u32_t               expected;
+    volatile u32_t      delivered;
+    volatile u32_t      rounds_done;
+    u64_t               *samples;
+    volatile u32_t      sample_count;
+    u64_t               peak_heap;
+    u64_t               start_ns;
+    u64_t               done_ns;        // Set by the sink that delivers the last message
+    struct bench_node   *source[BENCH_MAX_SOURCES];
+    u32_t               source_count;
+};
+
+struct bench_node {
+    struct nrc_node_hdr hdr;            // Must be first
+    nrc_node_id_t       id;
+    enum bench_role     role;
+    struct bench_flow   *flow;
+    nrc_node_id_t       out[BENCH_MAX_OUT];
+    u32_t               out_count;
+    s8_t                prio;
+    u32_t               rounds_sent;
+    u64_t               pending_since;  // Event nodes, set by the driver
+    s8_t                name[16];
+};
+
+struct bench_heap {
+    u64_t               allocs;
+    u64_t               in_use;
+};
+
+static u32_t _bench_node_seq;
+static u32_t _bench_workers = 1;
+
+static u64_t bench_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((u64_t)ts.tv_sec * 1000000000ULL) + (u64_t)ts.tv_nsec;
+}
+
+static void bench_heap_read(struct bench_heap *heap)
+{
+    struct nrc_port_heap_stats  stats;
+    u32_t                       size_class;
+
+    heap->allocs = 0;
+    heap->in_use = 0;
+
+    for (size_class = 0; nrc_port_heap_fast_stats(size_class, &stats) == NRC_PORT_RES_OK; size_class++) {
+        heap->allocs += stats.alloc_count;
+        heap->in_use += stats.in_use_bytes;
+    }
+}
+
+static void bench_heap_peak(struct bench_flow *flow)
+{
+    struct bench_heap   heap;
+    u64_t               peak = __atomic_load_n(&flow->peak_heap, __ATOMIC_RELAXED);
+
+    bench_heap_read(&heap);
+
+    while ((heap.in_use > peak) &&
+           !__atomic_compare_exchange_n(&flow->peak_heap, &peak, heap.in_use, FALSE, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+static void bench_record(struct bench_flow *flow, u64_t latency_ns)
+{
+    u32_t index = nrc_port_atomic_add(&flow->sample_count, 1);
+
+    if (index < flow->expected) {
+        flow->samples[index] = latency_ns;
+    }
+}
+
+// Counts a delivery at a sink, a completed round gives the sources credit for another
+static void bench_delivered(struct bench_flow *flow)
+{
+    u32_t delivered = nrc_port_atomic_add(&flow->delivered, 1) + 1;
+    u32_t i;
+
+    if (delivered == flow->expected) {
+        flow->done_ns = bench_now_ns();
+    }
+    if ((delivered % flow->round_msgs) == 0) {
+        nrc_port_atomic_add(&flow->rounds_done, 1);
+
+        for (i = 0; i < flow->source_count; i++) {
+            nrc_os_set_evt(flow->source[i]->id, 1, flow->source[i]->prio);
+        }
+    }
+}
+
+static s32_t bench_node_init(struct nrc_node_hdr *self, nrc_node_id_t id)
+{
+    return NRC_PORT_RES_OK;
+}
+
+static s32_t bench_node_nop(struct nrc_node_hdr *self)
+{
+    return NRC_PORT_RES_OK;
+}
+
+static s32_t bench_node_recv_msg(struct nrc_node_hdr *self, struct nrc_msg_hdr *msg)
+{
+    struct bench_node   *node = (struct bench_node*)self;
+    u32_t               i;
+
+    switch (node->role) {
+    case BENCH_ROLE_RELAY:
+        for (i = 1; i < node->out_count; i++) {
+            nrc_os_send_msg(node->out[i], nrc_os_msg_clone(msg), node->prio);
+        }
+        nrc_os_send_msg(node->out[0], msg, node->prio);
+        break;
+
+    case BENCH_ROLE_SINK:
+        bench_record(node->flow, bench_now_ns() - ((struct bench_msg*)msg)->sent_ns);
+        nrc_os_msg_free(msg);
+        bench_delivered(node->flow);
+        break;
+
+    default:
+        nrc_os_msg_free(msg);
+        break;
+    }
+
+    return NRC_PORT_RES_OK;
+}
+
+static s32_t bench_node_recv_evt(struct nrc_node_hdr *self, u32_t event_mask)
+{
+    struct bench_node   *node = (struct bench_node*)self;
+    struct bench_flow   *flow = node->flow;
+    struct bench_msg    *msg;
+    u64_t               since;
+    u32_t               i;
+
+    switch (node->role) {
+    case BENCH_ROLE_SOURCE:
+        while ((node->rounds_sent < flow->rounds) &&
+               (node->rounds_sent < nrc_port_atomic_load(&flow->rounds_done) + BENCH_WINDOW)) {
+            for (i = 0; i < BENCH_BURST; i++) {
+                msg = (struct bench_msg*)nrc_os_msg_alloc(sizeof(struct bench_msg));
+                assert(msg != 0);
+                msg->sent_ns = bench_now_ns();
+                nrc_os_send_msg(node->out[0], &msg->hdr, node->prio);
+            }
+            node->rounds_sent++;
+            bench_heap_peak(flow);
+        }
+        break;
+
+    case BENCH_ROLE_EVT:
+        // The driver only sets it from 0, clear it after the sample is stored
+        since = __atomic_load_n(&node->pending_since, __ATOMIC_ACQUIRE);
+        if (since != 0) {
+            bench_record(flow, bench_now_ns() - since);
+            __atomic_store_n(&node->pending_since, 0, __ATOMIC_RELEASE);
+        }
+        nrc_port_atomic_add(&flow->delivered, 1);
+        break;
+
+    default:
+        break;
+    }
+
+    return NRC_PORT_RES_OK;
+}
+
+static struct nrc_node_api _bench_api = {
+    bench_node_init,
+    bench_node_nop,
+    bench_node_nop,
+    bench_node_nop,
+    bench_node_recv_msg,
+    bench_node_recv_evt,
+    0
+};
+
+static struct bench_node* bench_node_new(struct bench_flow *flow, enum bench_role role, s8_t prio)
+{
+    struct bench_node *node = (struct bench_node*)nrc_os_node_alloc(sizeof(struct bench_node));
+
+    assert(node != 0);
+
+    // Only the node header is cleared by the kernel
+    memset(node, 0, sizeof(struct bench_node));
+    node->role = role;
+    node->flow = flow;
+    node->prio = prio;
+    snprintf((char*)node->name, sizeof(node->name), "bench%u", _bench_node_seq++);
+
+    if ((nrc_os_register_node(&node->hdr, &_bench_api, node->name) != NRC_PORT_RES_OK) ||
+        (nrc_os_get_node_id(node->name, &node->id) != NRC_PORT_RES_OK)) {
+        fprintf(stderr, "failed to register %s\n", node->name);
+        exit(1);
+    }
+
+    if (role == BENCH_ROLE_SOURCE) {
+        assert(flow->source_count < BENCH_MAX_SOURCES);
+        flow->source[flow->source_count++] = node;
+    }
+    flow->node_count++;
+
+    return node;
+}
+
+// Flows live as long as their nodes, which is the whole run. A late credit event can reach a finished source.
+static struct bench_flow* bench_flow_new(const char *name, u32_t rounds, u32_t round_msgs)
+{
+    struct bench_flow *flow = (struct bench_flow*)calloc(1, sizeof(struct bench_flow));
+
+    assert(flow != 0);
+
+    flow->name = name;
+    flow->rounds = rounds;
+    flow->round_msgs = round_msgs;
+    flow->expected = rounds * round_msgs;
+    flow->samples = (u64_t*)calloc(flow->expected, sizeof(u64_t));
+    assert(flow->samples != 0);
+
+    return flow;
+}
+
+// Builds source -> relays -> sink, gives the source
+static void bench_build_chain(struct bench_flow *flow, u32_t relays, s8_t prio)
+{
+    struct bench_node   *source = bench_node_new(flow, BENCH_ROLE_SOURCE, prio);
+    struct bench_node   *prev = source;
+    struct bench_node   *node;
+    u32_t               i;
+
+    for (i = 0; i < relays; i++) {
+        node = bench_node_new(flow, BENCH_ROLE_RELAY, prio);
+        prev->out[prev->out_count++] = node->id;
+        prev = node;
+    }
+
+    node = bench_node_new(flow, BENCH_ROLE_SINK, prio);
+    prev->out[prev->out_count++] = node->id;
+}
+
+static int bench_cmp_u64(const void *a, const void *b)
+{
+    u64_t va = *(const u64_t*)a;
+    u64_t vb = *(const u64_t*)b;
+
+    return (va < vb) ? -1 : ((va > vb) ? 1 : 0);
+}
+
+static u64_t bench_percentile(const u64_t *sorted, u32_t count, u32_t per_mille)
+{
+    u64_t index = ((u64_t)count * per_mille) / 1000;
+
+    if (count == 0) {
+        return 0;
+    }
+    if (index >= count) {
+        index = count - 1;
+    }
+
+    return sorted[index];
+}
+
+// Waits until all flows are delivered, gives the allocations made meanwhile
+static u64_t bench_wait(struct bench_flow **flows, u32_t flow_count, u64_t start_ns, struct bench_heap *before)
+{
+    struct bench_heap   heap;
+    bool_t              done = FALSE;
+    u32_t               i;
+
+    while (done == FALSE) {
+        usleep(100);
+
+        done = TRUE;
+        for (i = 0; i < flow_count; i++) {
+            if (nrc_port_atomic_load(&flows[i]->delivered) < flows[i]->expected) {
+                done = FALSE;
+            }
+        }
+
+        if (bench_now_ns() - start_ns > BENCH_TIMEOUT_NS) {
+            fprintf(stderr, "timeout in %s\n", flows[0]->name);
+            exit(1);
+        }
+    }
+
+    bench_heap_read(&heap);
+
+    return heap.allocs - before->allocs;
+}
+
+// Allocations are for all flows that ran together, total_msgs is their message count
+static void bench_report(struct bench_flow *flow, u64_t allocs, u64_t total_msgs)
+{
+    struct rusage   usage;
+    u32_t           count = flow->sample_count;
+    double          seconds = (double)(__atomic_load_n(&flow->done_ns, __ATOMIC_ACQUIRE) - flow->start_ns) / 1e9;
+
+    if (count > flow->expected) {
+        count = flow->expected;
+    }
+    qsort(flow->samples, count, sizeof(u64_t), bench_cmp_u64);
+    getrusage(RUSAGE_SELF, &usage);
+
+    printf("{\"bench\":\"%s\",\"schema\":%d,\"workers\":%u,\"nodes\":%u,\"msgs\":%u,"
+        "\"seconds\":%.6f,\"msgs_per_sec\":%.0f,"
+        "\"p50_ns\":%llu,\"p99_ns\":%llu,\"p999_ns\":%llu,"
+        "\"allocs_per_msg\":%.3f,\"peak_heap_bytes\":%llu,\"max_rss_kb\":%ld}\n",
+        flow->name, BENCH_SCHEMA, _bench_workers, flow->node_count, flow->expected,
+        seconds, (double)flow->expected / seconds,
+        bench_percentile(flow->samples, count, 500),
+        bench_percentile(flow->samples, count, 990),
+        bench_percentile(flow->samples, count, 999),
+        (total_msgs != 0) ? (double)allocs / (double)total_msgs : 0.0,
+        flow->peak_heap, usage.ru_maxrss);
+    fflush(stdout);
+
+    free(flow->samples);
+    flow->samples = 0;
+}
+
+static void bench_run_flows(struct bench_flow **flows, u32_t flow_count, bool_t report)
+{
+    struct bench_heap   before;
+    u64_t               total_msgs = 0;
+    u64_t               allocs;
+    u64_t               start;
+    u32_t               i;
+    u32_t               j;
+
+    bench_heap_read(&before);
+    start = bench_now_ns();
+
+    for (i = 0; i < flow_count; i++) {
+        flows[i]->peak_heap = before.in_use;
+        flows[i]->start_ns = start;
+        total_msgs += flows[i]->expected;
+        for (j = 0; j < flows[i]->source_count; j++) {
+            nrc_os_set_evt(flows[i]->source[j]->id, 1, flows[i]->source[j]->prio);
+        }
+    }
+
+    allocs = bench_wait(flows, flow_count, start, &before);
+
+    for (i = 0; i < flow_count; i++) {
+        if (report) {
+            bench_report(flows[i], allocs, total_msgs);
+        }
+        else {
+            free(flows[i]->samples);
+        }
+    }
+}
+
+static void bench_chain(u32_t scale, u32_t relays, bool_t report)
+{
+    struct bench_flow *flow = bench_flow_new("chain", 2000 * scale, BENCH_BURST);
+
+    bench_build_chain(flow, relays, 0);
+    bench_run_flows(&flow, 1, report);
+}
+
+static void bench_fanout(u32_t scale, u32_t width)
+{
+    struct bench_flow   *flow = bench_flow_new("fanout", 500 * scale, BENCH_BURST * width);
+    struct bench_node   *source;
+    struct bench_node   *hub;
+    struct bench_node   *sink;
+    u32_t               i;
+
+    source = bench_node_new(flow, BENCH_ROLE_SOURCE, 0);
+    hub = bench_node_new(flow, BENCH_ROLE_RELAY, 0);
+    source->out[source->out_count++] = hub->id;
+
+    for (i = 0; i < width; i++) {
+        sink = bench_node_new(flow, BENCH_ROLE_SINK, 0);
+        hub->out[hub->out_count++] = sink->id;
+    }
+
+    bench_run_flows(&flow, 1, TRUE);
+}
+
+static void bench_fanin(u32_t scale, u32_t width)
+{
+    struct bench_flow   *flow = bench_flow_new("fanin", 500 * scale, BENCH_BURST * width);
+    struct bench_node   *source;
+    struct bench_node   *sink;
+    u32_t               i;
+
+    sink = bench_node_new(flow, BENCH_ROLE_SINK, 0);
+    for (i = 0; i < width; i++) {
+        source = bench_node_new(flow, BENCH_ROLE_SOURCE, 0);
+        source->out[source->out_count++] = sink->id;
+    }
+
+    bench_run_flows(&flow, 1, TRUE);
+}
+
+static void bench_prio(u32_t scale, u32_t relays)
+{
+    struct bench_flow *flows[2];
+
+    flows[0] = bench_flow_new("prio_high", 1000 * scale, BENCH_BURST);
+    flows[1] = bench_flow_new("prio_low", 1000 * scale, BENCH_BURST);
+    bench_build_chain(flows[0], relays, -64);
+    bench_build_chain(flows[1], relays, 64);
+    bench_run_flows(flows, 2, TRUE);
+}
+
+static void bench_evtstorm(u32_t scale, u32_t width)
+{
+    struct bench_flow   *flow = bench_flow_new("evtstorm", 1, 200000 * scale);
+    struct bench_node   *node[BENCH_MAX_NODES];
+    struct bench_node   *target;
+    struct bench_heap   before;
+    struct bench_heap   after;
+    u64_t               zero;
+    u32_t               i;
+
+    assert(width <= BENCH_MAX_NODES);
+
+    for (i = 0; i < width; i++) {
+        node[i] = bench_node_new(flow, BENCH_ROLE_EVT, 0);
+    }
+
+    bench_heap_read(&before);
+    flow->peak_heap = before.in_use;
+    flow->start_ns = bench_now_ns();
+
+    for (i = 0; i < flow->expected; i++) {
+        target = node[(i * 7) % width];
+
+        zero = 0;
+        __atomic_compare_exchange_n(&target->pending_since, &zero, bench_now_ns(), FALSE, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+        nrc_os_set_evt(target->id, 1U << (i % 32), 0);
+    }
+
+    // Events coalesce, so the storm is done when no node has one pending rather than at a count
+    for (i = 0; i < width; i++) {
+        while (__atomic_load_n(&node[i]->pending_since, __ATOMIC_ACQUIRE) != 0) {
+            usleep(10);
+        }
+    }
+
+    flow->done_ns = bench_now_ns();
+    bench_heap_read(&after);
+    bench_heap_peak(flow);
+
+    bench_report(flow, after.allocs - before.allocs, flow->expected);
+}
+
+int main(int argc, char *argv[])
+{
+    u32_t scale = 1;
+
+    if (argc > 1) {
+        _bench_workers = (u32_t)atoi(argv[1]);
+    }
+    if (argc > 2) {
+        scale = (u32_t)atoi(argv[2]);
+    }
+    if ((_bench_workers == 0) || (scale == 0)) {
+        fprintf(stderr, "usage: %s [workers] [scale]\n", argv[0]);
+        return 1;
+    }
+
+    nrc_port_init();
+    nrc_os_init();
+    if (nrc_os_set_workers(_bench_workers) != NRC_PORT_RES_OK) {
+        fprintf(stderr, "invalid worker count %u\n", _bench_workers);
+        return 1;
+    }
+    nrc_os_start();
+
+    // Warm up heap slabs, thread caches and branch predictors
+    bench_chain(1, 8, FALSE);
+
+    bench_chain(scale, 8, TRUE);
+    bench_fanout(scale, 16);
+    bench_fanin(scale, 16);
+    bench_prio(scale, 4);
+    bench_evtstorm(scale, 64);
+
+    return 0;
+}
@@ -0,0 +1,559 @@
+/**
+ * Copyright 2017 Tomas Frisberg & Ola Bjorsne
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http ://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * JSON parse and stringify on telemetry payloads.
+ *
+ * sensor:  one device reading with nested battery and location objects
+ * batch:   a gateway upload of 64 readings from different devices
+ * series:  a device's samples, long arrays of numbers
+ * events:  log events with free text, escapes and unicode
+ *
+ * Each payload is parsed into an object message by every stage one the CPU
+ * supports and by a naive parser, a recursive descent over the characters
+ * into a tree of heap nodes that is then copied into a message, the usual
+ * way before this node. All parsers must give the same message, checked by
+ * stringifying them. Then the parsed message is stringified.
+ *
+ * One JSON object per line and payload and parser, payloads are generated
+ * from a fixed seed so runs compare across commits.
+ *
+ * usage: nrc_bench_json [scale]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+
+#include "nrc_port.h"
+#include "nrc_os.h"
+#include "nrc_msg_obj.h"
+#include "nrc_json.h"
+
+#define BENCH_SCHEMA        (1)
+#define BENCH_BYTES         (64ULL * 1024 * 1024)  // Parsed per run and scale
+#define BENCH_TEXT_MAX      (256 * 1024)
+
+struct bench_text {
+    char    *buf;
+    u32_t   len;
+};
+
+// Naive parser, a heap node per value
+struct naive_value {
+    u32_t               type;       // NRC_MSG_OBJ_*
+    nrc_msg_key_t       key;
+    s64_t               i;
+    double              f;
+    char                *str;
+    u32_t               len;        // Bytes of str, fields of a table
+    struct naive_value  *child;
+    struct naive_value  *next;
+};
+
+static u32_t _bench_seed = 12345;
+
+static u64_t bench_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((u64_t)ts.tv_sec * 1000000000ULL) + (u64_t)ts.tv_nsec;
+}
+
+static u32_t bench_rand(void)
+{
+    _bench_seed = (_bench_seed * 1103515245U) + 12345U;
+
+    return _bench_seed >> 8;
+}
+
+static double bench_uniform(double low, double high)
+{
+    return low + ((high - low) * (double)(bench_rand() & 0xFFFF) / 65535.0);
+}
+
+static void bench_append(struct bench_text *text, const char *format, ...)
+{
+    va_list args;
+    int     n;
+
+    va_start(args, format);
+    n = vsnprintf(text->buf + text->len, BENCH_TEXT_MAX - text->len, format, args);
+    va_end(args);
+
+    if ((n < 0) || (text->len + (u32_t)n >= BENCH_TEXT_MAX)) {
+        fprintf(stderr, "payload too large\n");
+        exit(1);
+    }
+    text->len += (u32_t)n;
+}
+
+static void bench_reading(struct bench_text *text, u32_t device, u64_t ts)
+{
+    bench_append(text,
+        "{\"deviceId\":\"sensor-%04u\",\"ts\":%llu,\"type\":\"environment\",\"fw\":\"2.4.%u\","
+        "\"temperature\":%.2f,\"humidity\":%.1f,\"pressure\":%.2f,\"co2\":%u,"
+        "\"battery\":{\"voltage\":%.3f,\"level\":%u,\"charging\":%s},"
+        "\"location\":{\"lat\":%.5f,\"lon\":%.5f,\"alt\":%.1f},"
+        "\"tags\":[\"indoor\",\"floor-%u\",\"lab\"],\"ok\":true,\"error\":null}",
+        device, (unsigned long long)ts, device % 7,
+        bench_uniform(-10.0, 35.0), bench_uniform(10.0, 90.0), bench_uniform(980.0, 1040.0), 400 + (bench_rand() % 1600),
+        bench_uniform(3.2, 4.2), bench_rand() % 101, ((bench_rand() & 1) != 0) ? "true" : "false",
+        bench_uniform(55.0, 60.0), bench_uniform(11.0, 19.0), bench_uniform(0.0, 120.0),
+        device % 9);
+}
+
+static void bench_payload_sensor(struct bench_text *text)
+{
+    bench_reading(text, 42, 1700000000123ULL);
+}
+
+static void bench_payload_batch(struct bench_text *text)
+{
+    u32_t i;
+
+    bench_append(text, "{\"gateway\":\"gw-stockholm-01\",\"seq\":98122,\"readings\":[");
+    for (i = 0; i < 64; i++) {
+        if (i != 0) {
+            bench_append(text, ",\n  ");
+        }
+        bench_reading(text, i * 13, 1700000000000ULL + (i * 250));
+    }
+    bench_append(text, "]}");
+}
+
+static void bench_payload_series(struct bench_text *text)
+{
+    static const char   *name[] = { "accel_x", "accel_y", "accel_z", "current" };
+    u32_t               i;
+    u32_t               j;
+
+    bench_append(text, "{\"deviceId\":\"vib-0007\",\"start\":1700000000000,\"interval_ms\":4,\"samples\":{");
+    for (i = 0; i < 4; i++) {
+        bench_append(text, "%s\"%s\":[", (i != 0) ? "," : "", name[i]);
+        for (j = 0; j < 256; j++) {
+            bench_append(text, "%s%.4f", (j != 0) ? "," : "", bench_uniform(-2.0, 2.0));
+        }
+        bench_append(text, "]");
+    }
+    bench_append(text, "},\"counts\":[");
+    for (j = 0; j < 256; j++) {
+        bench_append(text, "%s%u", (j != 0) ? "," : "", bench_rand() % 100000);
+    }
+    bench_append(text, "]}");
+}
+
+static void bench_payload_events(struct bench_text *text)
+{
+    static const char *message[] = {
+        "Door \\\"north\\\" opened by badge 0042",
+        "Threshold exceeded:\\n  temperature 41.2 > 40.0",
+        "Path C:\\\\data\\\\logs rotated",
+        "Caf\\u00e9 sensor back online \\u2713",
+        "Firmware update 2.4.1 -> 2.4.2 scheduled for 02:00 UTC"
+    };
+    u32_t i;
+
+    bench_append(text, "{\"site\":\"plant-3\",\"events\":[");
+    for (i = 0; i < 32; i++) {
+        bench_append(text, "%s{\"id\":%u,\"level\":\"%s\",\"source\":\"node-%u\",\"msg\":\"%s\",\"ack\":%s}",
+            (i != 0) ? "," : "", 5000 + i, ((i % 4) == 0) ? "warn" : "info", i % 11,
+            message[i % 5], ((i % 3) == 0) ? "true" : "false");
+    }
+    bench_append(text, "]}");
+}
+
+/**
+ * Naive parser.
+ */
+
+static void naive_skip(const char **p)
+{
+    while ((**p == ' ') || (**p == '\t') || (**p == '\n') || (**p == '\r')) {
+        (*p)++;
+    }
+}
+
+static struct naive_value* naive_new(u32_t type)
+{
+    struct naive_value *value = (struct naive_value*)calloc(1, sizeof(struct naive_value));
+
+    value->type = type;
+
+    return value;
+}
+
+static void naive_free(struct naive_value *value)
+{
+    struct naive_value *next;
+
+    while (value != 0) {
+        next = value->next;
+        naive_free(value->child);
+        free(value->str);
+        free(value);
+        value = next;
+    }
+}
+
+static u32_t naive_hex(const char *p)
+{
+    char    digits[5];
+
+    memcpy(digits, p, 4);
+    digits[4] = 0;
+
+    return (u32_t)strtoul(digits, 0, 16);
+}
+
+// Unescaped copy, p is after the opening quote and left after the closing one
+static char* naive_string(const char **p, u32_t *len)
+{
+    u32_t   size = 16;
+    u32_t   n = 0;
+    char    *out = (char*)malloc(size);
+    u32_t   code;
+    char    c;
+
+    while (((c = *(*p)++) != '"') && (c != 0)) {
+        if (n + 4 >= size) {
+            size *= 2;
+            out = (char*)realloc(out, size);
+        }
+
+        if (c != '\\') {
+            out[n++] = c;
+            continue;
+        }
+
+        switch (c = *(*p)++) {
+        case 'n': out[n++] = '\n'; break;
+        case 't': out[n++] = '\t'; break;
+        case 'r': out[n++] = '\r'; break;
+        case 'b': out[n++] = '\b'; break;
+        case 'f': out[n++] = '\f'; break;
+        case 'u':
+            code = naive_hex(*p);
+            *p += 4;
+            if (code < 0x80) {
+                out[n++] = (char)code;
+            }
+            else if (code < 0x800) {
+                out[n++] = (char)(0xC0 | (code >> 6));
+                out[n++] = (char)(0x80 | (code & 0x3F));
+            }
+            else {
+                out[n++] = (char)(0xE0 | (code >> 12));
+                out[n++] = (char)(0x80 | ((code >> 6) & 0x3F));
+                out[n++] = (char)(0x80 | (code & 0x3F));
+            }
+            break;
+        default:
+            out[n++] = c;
+            break;
+        }
+    }
+
+    out[n] = 0;
+    *len = n;
+
+    return out;
+}
+
+static struct naive_value* naive_parse(const char **p)
+{
+    struct naive_value  *value = 0;
+    struct naive_value  **tail;
+    struct naive_value  *field;
+    const char          *start;
+    char                *key;
+    u32_t               key_len;
+    bool_t              integral = TRUE;
+
+    naive_skip(p);
+
+    if ((**p == '{') || (**p == '[')) {
+        value = naive_new((**p == '{') ? NRC_MSG_OBJ_OBJECT : NRC_MSG_OBJ_ARRAY);
+        tail = &value->child;
+        (*p)++;
+        naive_skip(p);
+
+        while ((**p != '}') && (**p != ']') && (**p != 0)) {
+            key_len = 0;
+            key = 0;
+            if (value->type == NRC_MSG_OBJ_OBJECT) {
+                (*p)++;
+                key = naive_string(p, &key_len);
+                naive_skip(p);
+                (*p)++;
+            }
+
+            field = naive_parse(p);
+            if (key != 0) {
+                field->key = nrc_msg_key_n(key, key_len);
+                free(key);
+            }
+            *tail = field;
+            tail = &field->next;
+            value->len++;
+
+            naive_skip(p);
+            if (**p == ',') {
+                (*p)++;
+                naive_skip(p);
+            }
+        }
+        (*p)++;
+    }
+    else if (**p == '"') {
+        value = naive_new(NRC_MSG_OBJ_STR);
+        (*p)++;
+        value->str = naive_string(p, &value->len);
+    }
+    else if (strncmp(*p, "true", 4) == 0) {
+        value = naive_new(NRC_MSG_OBJ_BOOL);
+        value->i = 1;
+        *p += 4;
+    }
+    else if (strncmp(*p, "false", 5) == 0) {
+        value = naive_new(NRC_MSG_OBJ_BOOL);
+        *p += 5;
+    }
+    else if (strncmp(*p, "null", 4) == 0) {
+        value = naive_new(NRC_MSG_OBJ_NULL);
+        *p += 4;
+    }
+    else {
+        for (start = *p; strchr("+-0123456789.eE", **p) != 0 && (**p != 0); (*p)++) {
+            if ((**p == '.') || (**p == 'e') || (**p == 'E')) {
+                integral = FALSE;
+            }
+        }
+        value = naive_new(integral ? NRC_MSG_OBJ_INT : NRC_MSG_OBJ_FLOAT);
+        if (integral) {
+            value->i = strtoll(start, 0, 10);
+        }
+        else {
+            value->f = strtod(start, 0);
+        }
+    }
+
+    return value;
+}
+
+static u32_t naive_size(const struct naive_value *value)
+{
+    const struct naive_value    *field;
+    u32_t                       size = 0;
+
+    if ((value->type == NRC_MSG_OBJ_OBJECT) || (value->type == NRC_MSG_OBJ_ARRAY)) {
+        size = nrc_msg_obj_table_size(value->len, (value->type == NRC_MSG_OBJ_OBJECT));
+        for (field = value->child; field != 0; field = field->next) {
+            size += naive_size(field);
+        }
+    }
+    else if (value->type == NRC_MSG_OBJ_STR) {
+        size = nrc_msg_obj_str_size(value->len);
+    }
+
+    return size;
+}
+
+static void naive_put(struct nrc_msg_obj_builder *builder, nrc_msg_key_t key, const struct naive_value *value)
+{
+    const struct naive_value *field;
+
+    switch (value->type) {
+    case NRC_MSG_OBJ_NULL:
+        nrc_msg_obj_put_null(builder, key);
+        break;
+    case NRC_MSG_OBJ_BOOL:
+        nrc_msg_obj_put_bool(builder, key, (value->i != 0));
+        break;
+    case NRC_MSG_OBJ_INT:
+        nrc_msg_obj_put_int(builder, key, value->i);
+        break;
+    case NRC_MSG_OBJ_FLOAT:
+        nrc_msg_obj_put_float(builder, key, value->f);
+        break;
+    case NRC_MSG_OBJ_STR:
+        nrc_msg_obj_put_str(builder, key, value->str, value->len);
+        break;
+    default:
+        if (value->type == NRC_MSG_OBJ_OBJECT) {
+            nrc_msg_obj_begin_object(builder, key, value->len);
+        }
+        else {
+            nrc_msg_obj_begin_array(builder, key, value->len);
+        }
+        for (field = value->child; field != 0; field = field->next) {
+            naive_put(builder, field->key, field);
+        }
+        nrc_msg_obj_end(builder);
+        break;
+    }
+}
+
+static struct nrc_msg_obj* naive_parse_msg(const char *text, nrc_msg_key_t key)
+{
+    struct nrc_msg_obj_builder  builder;
+    struct nrc_msg_obj          *msg;
+    struct naive_value          *value;
+    const char                  *p = text;
+
+    value = naive_parse(&p);
+    msg = nrc_msg_obj_alloc(nrc_msg_obj_table_size(1, TRUE) + naive_size(value));
+
+    nrc_msg_obj_build(&builder, msg, 1);
+    naive_put(&builder, key, value);
+    nrc_msg_obj_finish(&builder);
+
+    naive_free(value);
+
+    return msg;
+}
+
+/**
+ * Runs.
+ */
+
+static const char* bench_scan_name(u32_t scan)
+{
+    return (scan == NRC_JSON_SCAN_AVX2) ? "avx2" : ((scan == NRC_JSON_SCAN_SSE42) ? "sse42" : "scalar");
+}
+
+static struct nrc_msg_str* bench_stringify(struct nrc_json_parser *parser, struct nrc_msg_obj *msg)
+{
+    struct nrc_msg_obj_value    value;
+    struct nrc_msg_str          *str = 0;
+
+    value.type = NRC_MSG_OBJ_OBJECT;
+    value.v.table = nrc_msg_obj_root(msg);
+    nrc_json_stringify(parser, msg, &value, &str);
+
+    return str;
+}
+
+static void bench_report(const char *payload, const char *op, const char *parser, u32_t bytes, u32_t iterations, u64_t ns)
+{
+    double seconds = (double)ns / 1e9;
+
+    printf("{\"bench\":\"%s\",\"schema\":%d,\"payload\":\"%s\",\"parser\":\"%s\",\"bytes\":%u,\"iterations\":%u,"
+        "\"seconds\":%.6f,\"mb_per_s\":%.1f,\"ns_per_msg\":%.0f}\n",
+        op, BENCH_SCHEMA, payload, parser, bytes, iterations,
+        seconds, ((double)bytes * iterations) / (seconds * 1e6), (double)ns / iterations);
+}
+
+static void bench_payload(const char *name, void (*generate)(struct bench_text *text), u32_t scale, nrc_msg_key_t key)
+{
+    struct nrc_json_parser  parser;
+    struct bench_text       text;
+    struct nrc_msg_obj      *msg;
+    struct nrc_msg_str      *expected;
+    struct nrc_msg_str      *str;
+    u32_t                   iterations;
+    u32_t                   scan;
+    u32_t                   i;
+    u64_t                   start;
+
+    text.buf = (char*)malloc(BENCH_TEXT_MAX);
+    text.len = 0;
+    generate(&text);
+
+    iterations = (u32_t)((BENCH_BYTES * scale) / text.len) + 1;
+
+    // The naive parser's message is the reference
+    nrc_json_parser_init(&parser, NRC_JSON_SCAN_SCALAR);
+    msg = naive_parse_msg(text.buf, key);
+    expected = bench_stringify(&parser, msg);
+    nrc_os_msg_free(&msg->hdr);
+
+    start = bench_now_ns();
+    for (i = 0; i < iterations; i++) {
+        msg = naive_parse_msg(text.buf, key);
+        nrc_os_msg_free(&msg->hdr);
+    }
+    bench_report(name, "json_parse", "naive", text.len, iterations, bench_now_ns() - start);
+
+    for (scan = NRC_JSON_SCAN_SCALAR; scan <= nrc_json_scan_best(); scan++) {
+        nrc_json_parser_init(&parser, scan);
+
+        if (nrc_json_parse(&parser, text.buf, text.len, key, &msg) != NRC_PORT_RES_OK) {
+            fprintf(stderr, "%s: %s parse failed\n", name, bench_scan_name(scan));
+            exit(1);
+        }
+        str = bench_stringify(&parser, msg);
+        if (strcmp(str->str, expected->str) != 0) {
+            fprintf(stderr, "%s: %s differs from naive\n", name, bench_scan_name(scan));
+            exit(1);
+        }
+        nrc_os_msg_free(&str->hdr);
+        nrc_os_msg_free(&msg->hdr);
+
+        start = bench_now_ns();
+        for (i = 0; i < iterations; i++) {
+            nrc_json_parse(&parser, text.buf, text.len, key, &msg);
+            nrc_os_msg_free(&msg->hdr);
+        }
+        bench_report(name, "json_parse", bench_scan_name(scan), text.len, iterations, bench_now_ns() - start);
+
+        nrc_json_parser_deinit(&parser);
+    }
+
+    nrc_json_parser_init(&parser, nrc_json_scan_best());
+    nrc_json_parse(&parser, text.buf, text.len, key, &msg);
+
+    start = bench_now_ns();
+    for (i = 0; i < iterations; i++) {
+        str = bench_stringify(&parser, msg);
+        nrc_os_msg_free(&str->hdr);
+    }
+    bench_report(name, "json_stringify", "nrc_json", text.len, iterations, bench_now_ns() - start);
+
+    nrc_os_msg_free(&msg->hdr);
+    nrc_os_msg_free(&expected->hdr);
+    nrc_json_parser_deinit(&parser);
+    free(text.buf);
+}
+
+int main(int argc, char *argv[])
+{
+    u32_t           scale = 1;
+    nrc_msg_key_t   key;
+
+    if (argc > 1) {
+        scale = (u32_t)atoi(argv[1]);
+    }
+    if (scale == 0) {
+        fprintf(stderr, "usage: %s [scale]\n", argv[0]);
+        return 1;
+    }
+
+    nrc_port_init();
+    nrc_os_init();
+    key = nrc_msg_key("payload");
+
+    bench_payload("sensor", bench_payload_sensor, scale, key);
+    bench_payload("batch", bench_payload_batch, scale, key);
+    bench_payload("series", bench_payload_series, scale, key);
+    bench_payload("events", bench_payload_events, scale, key);
+
+    return 0;
+}
@@ -0,0 +1,282 @@
+/**
+ * Copyright 2017 Tomas Frisberg & Ola Bjorsne
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http ://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Compares the priority queue used by nrc_os_send_msg with the sorted
+ * linked list it replaced, at different queue depths.
+ *
+ * fill+drain: enqueue depth messages in a burst and dequeue them all
+ * steady:     queue held at depth, one enqueue and one dequeue per op
+ *
+ * The list fill is quadratic and skipped above BENCH_LIST_FILL_MAX. Before
+ * timing, the queue order and remove, as used to boost a queued node, are checked.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#include "nrc_prioq.h"
+
+#define BENCH_PRIO_LEVELS   (16)
+#define BENCH_WORK_LIMIT    (20000000ULL)   // Bounds list steady runs at large depths
+#define BENCH_LIST_FILL_MAX (10000)
+
+struct bench_msg {
+    struct nrc_prioq_link   link;   // Must be first
+    struct bench_msg        *next;
+    s8_t                    prio;
+    u32_t                   seq;
+};
+
+struct bench_list {
+    struct bench_msg        *head;
+};
+
+static u64_t bench_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((u64_t)ts.tv_sec * 1000000000ULL) + (u64_t)ts.tv_nsec;
+}
+
+// The insertion nrc_os_send_msg used before the priority queue
+static void bench_list_put(struct bench_list *list, struct bench_msg *msg)
+{
+    if ((list->head == 0) || (msg->prio < list->head->prio)) {
+        msg->next = list->head;
+        list->head = msg;
+    }
+    else {
+        struct bench_msg *it = list->head;
+
+        while ((it->next != 0) && (msg->prio >= it->next->prio)) {
+            it = it->next;
+        }
+        msg->next = it->next;
+        it->next = msg;
+    }
+}
+
+static struct bench_msg* bench_list_get(struct bench_list *list)
+{
+    struct bench_msg *msg = list->head;
+
+    if (msg != 0) {
+        list->head = msg->next;
+    }
+
+    return msg;
+}
+
+static void bench_init_msgs(struct bench_msg *msgs, u32_t count)
+{
+    u32_t i;
+
+    srand(4711);
+
+    for (i = 0; i < count; i++) {
+        msgs[i].prio = (s8_t)(rand() % BENCH_PRIO_LEVELS);
+        msgs[i].seq = i;
+    }
+}
+
+// Both implementations must produce the same order, FIFO within a priority
+static void bench_verify(struct bench_msg *msgs, u32_t count)
+{
+    struct nrc_prioq    queue;
+    struct bench_list   list = { 0 };
+    u32_t               i;
+
+    nrc_prioq_init(&queue);
+
+    for (i = 0; i < count; i++) {
+        nrc_prioq_put(&queue, &msgs[i].link, msgs[i].prio);
+        bench_list_put(&list, &msgs[i]);
+    }
+    for (i = 0; i < count; i++) {
+        struct bench_msg *a = (struct bench_msg*)nrc_prioq_get(&queue, 0);
+        struct bench_msg *b = bench_list_get(&list);
+
+        if (a != b) {
+            printf("verify failed at %u\n", i);
+            exit(1);
+        }
+    }
+}
+
+// Boosts items of one level from the middle, the tail and the head, as a promoted node is moved
+static void bench_verify_remove(struct bench_msg *msgs)
+{
+    static const u32_t  boosted[] = { 2, 4, 0 };
+    static const u32_t  order[] = { 2, 4, 0, 1, 3 };
+    struct nrc_prioq    queue;
+    struct bench_msg    *msg;
+    s8_t                msg_prio;
+    u32_t               i;
+
+    nrc_prioq_init(&queue);
+
+    for (i = 0; i < 5; i++) {
+        nrc_prioq_put(&queue, &msgs[i].link, 5);
+    }
+    for (i = 0; i < sizeof(boosted) / sizeof(boosted[0]); i++) {
+        nrc_prioq_remove(&queue, &msgs[boosted[i]].link, 5);
+        nrc_prioq_put(&queue, &msgs[boosted[i]].link, 1);
+    }
+    for (i = 0; i < 5; i++) {
+        msg = (struct bench_msg*)nrc_prioq_get(&queue, &msg_prio);
+
+        if ((msg != &msgs[order[i]]) || (msg_prio != ((i < 3) ? 1 : 5))) {
+            printf("verify remove failed at %u\n", i);
+            exit(1);
+        }
+    }
+
+    // The only item of a level, the level is empty after
+    nrc_prioq_put(&queue, &msgs[0].link, 7);
+    nrc_prioq_remove(&queue, &msgs[0].link, 7);
+    if ((queue.count != 0) || nrc_prioq_peek_prio(&queue, &msg_prio) || (nrc_prioq_get(&queue, 0) != 0)) {
+        printf("verify remove failed, queue not empty\n");
+        exit(1);
+    }
+}
+
+static void bench_depth_run(struct bench_msg *msgs, u32_t depth, bool_t report)
+{
+    struct nrc_prioq    queue;
+    struct bench_list   list = { 0 };
+    struct bench_msg    *msg;
+    struct bench_msg    *tail;
+    s8_t                msg_prio;
+    u64_t               ops;
+    u64_t               list_ops;
+    u64_t               i;
+    u64_t               start;
+    double              prioq_fill;
+    double              list_fill = -1.0;
+    double              prioq_steady;
+    double              list_steady;
+
+    nrc_prioq_init(&queue);
+
+    ops = 1000000;
+    list_ops = BENCH_WORK_LIMIT / depth;
+    if (list_ops > ops) {
+        list_ops = ops;
+    }
+    if (list_ops < 1000) {
+        list_ops = 1000;
+    }
+
+    // Burst fill and drain
+    start = bench_now_ns();
+    for (i = 0; i < depth; i++) {
+        nrc_prioq_put(&queue, &msgs[i].link, msgs[i].prio);
+    }
+    while (nrc_prioq_get(&queue, 0) != 0) {
+    }
+    prioq_fill = (double)(bench_now_ns() - start) / depth;
+
+    if (depth <= BENCH_LIST_FILL_MAX) {
+        start = bench_now_ns();
+        for (i = 0; i < depth; i++) {
+            bench_list_put(&list, &msgs[i]);
+        }
+        while (bench_list_get(&list) != 0) {
+        }
+        list_fill = (double)(bench_now_ns() - start) / depth;
+    }
+
+    // Steady state at depth, the dequeued message is enqueued again
+    for (i = 0; i < depth; i++) {
+        nrc_prioq_put(&queue, &msgs[i].link, msgs[i].prio);
+    }
+    start = bench_now_ns();
+    for (i = 0; i < ops; i++) {
+        msg = (struct bench_msg*)nrc_prioq_get(&queue, 0);
+        nrc_prioq_put(&queue, &msg->link, msgs[i % depth].prio);
+    }
+    prioq_steady = (double)(bench_now_ns() - start) / ops;
+
+    // Build the sorted list in linear time from the queue order
+    tail = 0;
+    while ((msg = (struct bench_msg*)nrc_prioq_get(&queue, &msg_prio)) != 0) {
+        msg->prio = msg_prio;
+        msg->next = 0;
+        if (tail == 0) {
+            list.head = msg;
+        }
+        else {
+            tail->next = msg;
+        }
+        tail = msg;
+    }
+
+    start = bench_now_ns();
+    for (i = 0; i < list_ops; i++) {
+        msg = bench_list_get(&list);
+        msg->prio = msgs[i % depth].prio;
+        bench_list_put(&list, msg);
+    }
+    list_steady = (double)(bench_now_ns() - start) / list_ops;
+
+    if (report == FALSE) {
+        return;
+    }
+    if (list_fill < 0.0) {
+        printf("%8u  %12.1f  %12s  %12.1f  %12.1f\n",
+            depth, prioq_fill, "-", prioq_steady, list_steady);
+    }
+    else {
+        printf("%8u  %12.1f  %12.1f  %12.1f  %12.1f\n",
+            depth, prioq_fill, list_fill, prioq_steady, list_steady);
+    }
+}
+
+int main(void)
+{
+    static const u32_t  depths[] = { 10, 1000, 100000 };
+    u32_t               max_depth = 100000;
+    u32_t               i;
+    struct bench_msg    *msgs;
+
+    msgs = (struct bench_msg*)calloc(max_depth, sizeof(struct bench_msg));
+    assert(msgs != 0);
+
+    bench_init_msgs(msgs, max_depth);
+    bench_verify(msgs, 10000);
+    bench_verify_remove(msgs);
+    bench_init_msgs(msgs, max_depth);
+
+    // Warm up caches and branch predictors
+    bench_depth_run(msgs, depths[0], FALSE);
+
+    printf("ns per message, %d priority levels in use\n", BENCH_PRIO_LEVELS);
+    printf("%8s  %12s  %12s  %12s  %12s\n", "depth", "prioq fill", "list fill", "prioq steady", "list steady");
+
+    for (i = 0; i < sizeof(depths) / sizeof(depths[0]); i++) {
+        bench_depth_run(msgs, depths[i], TRUE);
+    }
+
+    free(msgs);
+
+    return 0;
+}
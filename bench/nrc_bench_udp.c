@@ -0,0 +1,488 @@
+/**
+ * Copyright 2017 Tomas Frisberg & Ola Bjorsne
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http ://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * UDP node throughput on loopback, telemetry sized datagrams.
+ *
+ * udp_in:  the main thread sends to a udp in node wired to a counting sink.
+ *          Batch 1 is a receive call per datagram, the cost before recvmmsg.
+ *          With gro the sender hands the kernel 64 datagrams per send with
+ *          UDP_SEGMENT and the node gets them coalesced.
+ * udp_out: the main thread sends messages to a udp out node and receives the
+ *          datagrams. Batch 1 is a send call per message.
+ *
+ * The main thread keeps at most BENCH_WINDOW datagrams in flight so none are
+ * lost in the socket. CPU per packet is the time of every thread but the main
+ * one, the workers and the reactor, per datagram through the node.
+ *
+ * One JSON object per line and case, counts are fixed so runs compare across commits.
+ *
+ * usage: nrc_bench_udp [scale] [port]
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+
+#include "nrc_port.h"
+#include "nrc_os.h"
+#include "nrc_cfg.h"
+#include "nrc_udp.h"
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT         (103)
+#endif
+
+#define BENCH_SCHEMA        (1)
+#define BENCH_PACKETS       (1000000)   // Per case and scale
+#define BENCH_PAYLOAD       (64)
+#define BENCH_BURST         (64)
+#define BENCH_WINDOW        (2048)
+#define BENCH_TIMEOUT_NS    (30ULL * 1000000000ULL)
+#define BENCH_CFG_SIZE      (4096)
+#define BENCH_DEFAULT_PORT  (47100)
+#define BENCH_MAX_NODES     (16)
+
+struct bench_case {
+    const char  *bench;
+    const char  *cfg_id;
+    u32_t       batch;
+    bool_t      gro;
+};
+
+struct bench_sink {
+    struct nrc_node_hdr hdr;                // Must be first
+    s8_t                cfg_id[NRC_MAX_CFG_NAME_LEN];
+    volatile u64_t      packets;
+};
+
+struct bench_time {
+    u64_t   wall_ns;
+    u64_t   cpu_ns;                         // Of the process
+    u64_t   main_cpu_ns;
+};
+
+static const struct bench_case _bench_in[] = {
+    { "udp_in", "in1", 1, FALSE },
+    { "udp_in", "in64", 64, FALSE },
+    { "udp_in", "ingro", 64, TRUE }
+};
+
+static const struct bench_case _bench_out[] = {
+    { "udp_out", "out1", 1, FALSE },
+    { "udp_out", "out64", 64, FALSE }
+};
+
+static char _bench_cfg[BENCH_CFG_SIZE];
+static struct nrc_node_hdr *_bench_node[BENCH_MAX_NODES];
+static u32_t _bench_node_count;
+static u32_t _bench_port = BENCH_DEFAULT_PORT;
+
+static u64_t bench_clock_ns(clockid_t clock)
+{
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+
+    return ((u64_t)ts.tv_sec * 1000000000ULL) + (u64_t)ts.tv_nsec;
+}
+
+static void bench_time_read(struct bench_time *time)
+{
+    time->wall_ns = bench_clock_ns(CLOCK_MONOTONIC);
+    time->cpu_ns = bench_clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+    time->main_cpu_ns = bench_clock_ns(CLOCK_THREAD_CPUTIME_ID);
+}
+
+static struct nrc_node_hdr* bench_record(struct nrc_node_hdr *node);
+
+static s32_t bench_sink_init(struct nrc_node_hdr *self, nrc_node_id_t id)
+{
+    return NRC_PORT_RES_OK;
+}
+
+static s32_t bench_sink_none(struct nrc_node_hdr *self)
+{
+    return NRC_PORT_RES_OK;
+}
+
+static s32_t bench_sink_recv_msg(struct nrc_node_hdr *self, struct nrc_msg_hdr *msg)
+{
+    struct bench_sink *sink = (struct bench_sink*)self;
+
+    nrc_os_msg_free(msg);
+    __atomic_store_n(&sink->packets, sink->packets + 1, __ATOMIC_RELEASE);
+
+    return NRC_PORT_RES_OK;
+}
+
+static s32_t bench_sink_recv_evt(struct nrc_node_hdr *self, u32_t event_mask)
+{
+    return NRC_PORT_RES_OK;
+}
+
+static struct nrc_node_api _bench_sink_api = {
+    bench_sink_init,
+    bench_sink_none,
+    bench_sink_none,
+    bench_sink_none,
+    bench_sink_recv_msg,
+    bench_sink_recv_evt,
+    0
+};
+
+static struct nrc_node_hdr* bench_sink_alloc(const s8_t *cfg_type, const s8_t *cfg_id, const s8_t *cfg_name)
+{
+    struct bench_sink   *sink = (struct bench_sink*)nrc_os_node_alloc(sizeof(struct bench_sink));
+    struct nrc_node_hdr *hdr = 0;
+
+    if (sink != 0) {
+        memset(sink, 0, sizeof(struct bench_sink));
+        strncpy(sink->cfg_id, cfg_id, NRC_MAX_CFG_NAME_LEN - 1);
+        sink->hdr.cfg_id = sink->cfg_id;
+        hdr = bench_record(&sink->hdr);
+    }
+
+    return hdr;
+}
+
+// Nodes as made by deploy, found by cfg id
+static struct nrc_node_hdr* bench_record(struct nrc_node_hdr *node)
+{
+    if ((node != 0) && (_bench_node_count < BENCH_MAX_NODES)) {
+        _bench_node[_bench_node_count++] = node;
+    }
+
+    return node;
+}
+
+static struct nrc_node_hdr* bench_udp_in_alloc(const s8_t *cfg_type, const s8_t *cfg_id, const s8_t *cfg_name)
+{
+    return bench_record(nrc_udp_in_node_alloc(cfg_type, cfg_id, cfg_name));
+}
+
+static struct nrc_node_hdr* bench_udp_out_alloc(const s8_t *cfg_type, const s8_t *cfg_id, const s8_t *cfg_name)
+{
+    return bench_record(nrc_udp_out_node_alloc(cfg_type, cfg_id, cfg_name));
+}
+
+static const struct nrc_os_node_type _bench_types[] = {
+    { "udp in", bench_udp_in_alloc, &nrc_udp_in_node_api },
+    { "udp out", bench_udp_out_alloc, &nrc_udp_out_node_api },
+    { "sink", bench_sink_alloc, &_bench_sink_api }
+};
+
+static struct nrc_node_hdr* bench_node(const char *cfg_id)
+{
+    u32_t i;
+
+    for (i = 0; i < _bench_node_count; i++) {
+        if (strcmp(_bench_node[i]->cfg_id, cfg_id) == 0) {
+            return _bench_node[i];
+        }
+    }
+
+    fprintf(stderr, "no node %s\n", cfg_id);
+    exit(1);
+}
+
+// A udp in node and its sink per in case, a udp out node per out case, each on its own port
+static void bench_cfg(void)
+{
+    u32_t   len;
+    u32_t   i;
+
+    len = (u32_t)snprintf(_bench_cfg, BENCH_CFG_SIZE, "[");
+
+    for (i = 0; i < sizeof(_bench_in) / sizeof(_bench_in[0]); i++) {
+        len += (u32_t)snprintf(&_bench_cfg[len], BENCH_CFG_SIZE - len,
+            "{\"id\":\"%s\",\"type\":\"udp in\",\"port\":\"%u\",\"datatype\":\"buffer\",\"batch\":%u,"
+            "\"size\":%u,\"gro\":%s,\"wires\":[[\"sink_%s\"]]},"
+            "{\"id\":\"sink_%s\",\"type\":\"sink\",\"wires\":[]},",
+            _bench_in[i].cfg_id, _bench_port + i, _bench_in[i].batch, BENCH_PAYLOAD,
+            _bench_in[i].gro ? "true" : "false", _bench_in[i].cfg_id, _bench_in[i].cfg_id);
+    }
+    for (i = 0; i < sizeof(_bench_out) / sizeof(_bench_out[0]); i++) {
+        len += (u32_t)snprintf(&_bench_cfg[len], BENCH_CFG_SIZE - len,
+            "{\"id\":\"%s\",\"type\":\"udp out\",\"addr\":\"127.0.0.1\",\"port\":\"%u\",\"outport\":\"\","
+            "\"batch\":%u,\"wires\":[]}%s",
+            _bench_out[i].cfg_id, _bench_port + 16 + i, _bench_out[i].batch,
+            (i + 1 < sizeof(_bench_out) / sizeof(_bench_out[0])) ? "," : "");
+    }
+    snprintf(&_bench_cfg[len], BENCH_CFG_SIZE - len, "]");
+}
+
+static void bench_report(const struct bench_case *c, u64_t packets, const struct bench_time *before,
+    const struct bench_time *after, const struct nrc_udp_stats *stats_before, const struct nrc_udp_stats *stats_after)
+{
+    double  seconds = (double)(after->wall_ns - before->wall_ns) / 1e9;
+    u64_t   cpu_ns = (after->cpu_ns - before->cpu_ns) - (after->main_cpu_ns - before->main_cpu_ns);
+
+    printf("{\"bench\":\"%s\",\"schema\":%u,\"batch\":%u,\"gro\":%s,\"packets\":%llu,\"seconds\":%.6f,"
+        "\"packets_per_sec\":%.0f,\"cpu_ns_per_packet\":%.1f,\"calls\":%llu,\"dropped\":%llu}\n",
+        c->bench, BENCH_SCHEMA, c->batch, c->gro ? "true" : "false", (unsigned long long)packets, seconds,
+        (seconds > 0.0) ? (double)packets / seconds : 0.0,
+        (packets > 0) ? (double)cpu_ns / (double)packets : 0.0,
+        (unsigned long long)(stats_after->calls - stats_before->calls),
+        (unsigned long long)(stats_after->dropped - stats_before->dropped));
+    fflush(stdout);
+}
+
+static int bench_socket(u32_t port, bool_t bind_to)
+{
+    struct sockaddr_in  addr;
+    int                 size = 4 * 1024 * 1024;
+    int                 fd;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons((u16_t)port);
+
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd >= 0) {
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+
+        if ((bind_to ? bind(fd, (struct sockaddr*)&addr, sizeof(addr)) :
+            connect(fd, (struct sockaddr*)&addr, sizeof(addr))) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    if (fd < 0) {
+        fprintf(stderr, "socket on port %u: %s\n", port, strerror(errno));
+        exit(1);
+    }
+
+    return fd;
+}
+
+// A burst of BENCH_BURST datagrams, one sendmmsg or with gro one segmented send
+static void bench_send_burst(int fd, bool_t gro, u8_t *payload)
+{
+    struct mmsghdr  mmsg[BENCH_BURST];
+    struct iovec    iov[BENCH_BURST];
+    u32_t           done = 0;
+    int             sent;
+    u32_t           i;
+
+    if (gro) {
+        while (send(fd, payload, BENCH_BURST * BENCH_PAYLOAD, 0) < 0) {
+            sched_yield();
+        }
+    }
+    else {
+        memset(mmsg, 0, sizeof(mmsg));
+        for (i = 0; i < BENCH_BURST; i++) {
+            iov[i].iov_base = &payload[i * BENCH_PAYLOAD];
+            iov[i].iov_len = BENCH_PAYLOAD;
+            mmsg[i].msg_hdr.msg_iov = &iov[i];
+            mmsg[i].msg_hdr.msg_iovlen = 1;
+        }
+        while (done < BENCH_BURST) {
+            sent = sendmmsg(fd, &mmsg[done], BENCH_BURST - done, 0);
+            if (sent > 0) {
+                done += (u32_t)sent;
+            }
+            else {
+                sched_yield();
+            }
+        }
+    }
+}
+
+static void bench_udp_in(const struct bench_case *c, u32_t port, u64_t packets)
+{
+    static u8_t             payload[BENCH_BURST * BENCH_PAYLOAD];
+    char                    sink_id[NRC_MAX_CFG_NAME_LEN];
+    struct bench_sink       *sink;
+    struct nrc_node_hdr     *node = bench_node(c->cfg_id);
+    struct nrc_udp_stats    stats_before;
+    struct nrc_udp_stats    stats_after;
+    struct bench_time       before;
+    struct bench_time       after;
+    u64_t                   base;
+    u64_t                   sent = 0;
+    int                     segment = BENCH_PAYLOAD;
+    int                     fd;
+
+    snprintf(sink_id, sizeof(sink_id), "sink_%s", c->cfg_id);
+    sink = (struct bench_sink*)bench_node(sink_id);
+    fd = bench_socket(port, FALSE);
+    if (c->gro && (setsockopt(fd, SOL_UDP, UDP_SEGMENT, &segment, sizeof(segment)) != 0)) {
+        fprintf(stderr, "%s: no UDP_SEGMENT, skipped\n", c->cfg_id);
+        close(fd);
+        return;
+    }
+    memset(payload, 0x5A, sizeof(payload));
+
+    base = __atomic_load_n(&sink->packets, __ATOMIC_ACQUIRE);
+    nrc_udp_get_stats(node, &stats_before);
+    bench_time_read(&before);
+
+    while ((__atomic_load_n(&sink->packets, __ATOMIC_ACQUIRE) - base < packets) &&
+        (bench_clock_ns(CLOCK_MONOTONIC) - before.wall_ns < BENCH_TIMEOUT_NS)) {
+
+        if ((sent < packets) && (sent - (__atomic_load_n(&sink->packets, __ATOMIC_ACQUIRE) - base) <=
+            BENCH_WINDOW - BENCH_BURST)) {
+            bench_send_burst(fd, c->gro, payload);
+            sent += BENCH_BURST;
+        }
+        else {
+            sched_yield();
+        }
+    }
+
+    bench_time_read(&after);
+    nrc_udp_get_stats(node, &stats_after);
+    close(fd);
+
+    bench_report(c, __atomic_load_n(&sink->packets, __ATOMIC_ACQUIRE) - base, &before, &after,
+        &stats_before, &stats_after);
+}
+
+static struct nrc_msg_hdr* bench_out_chain(void)
+{
+    struct nrc_msg_hdr  *chain = 0;
+    struct nrc_msg_buf  *msg;
+    u32_t               i;
+
+    for (i = 0; i < BENCH_BURST; i++) {
+        msg = (struct nrc_msg_buf*)nrc_os_msg_alloc(sizeof(struct nrc_msg_buf) + BENCH_PAYLOAD);
+        if (msg == 0) {
+            fprintf(stderr, "out of messages\n");
+            exit(1);
+        }
+        msg->hdr.next = chain;
+        msg->hdr.topic = 0;
+        msg->hdr.type = NRC_MSG_TYPE_BUF;
+        msg->len = BENCH_PAYLOAD;
+        memset(msg->buf, 0x5A, BENCH_PAYLOAD);
+        chain = &msg->hdr;
+    }
+
+    return chain;
+}
+
+static void bench_udp_out(const struct bench_case *c, u32_t port, u64_t packets)
+{
+    static u8_t             buf[BENCH_BURST][BENCH_PAYLOAD];
+    struct mmsghdr          mmsg[BENCH_BURST];
+    struct iovec            iov[BENCH_BURST];
+    struct nrc_node_hdr     *node = bench_node(c->cfg_id);
+    struct nrc_udp_stats    stats_before;
+    struct nrc_udp_stats    stats_after;
+    struct bench_time       before;
+    struct bench_time       after;
+    nrc_node_id_t           id;
+    u64_t                   sent = 0;
+    u64_t                   received = 0;
+    u64_t                   dropped;
+    int                     count;
+    int                     fd;
+    u32_t                   i;
+
+    if (nrc_os_get_node_id(c->cfg_id, &id) != NRC_PORT_RES_OK) {
+        fprintf(stderr, "no node id %s\n", c->cfg_id);
+        exit(1);
+    }
+    fd = bench_socket(port, TRUE);
+
+    memset(mmsg, 0, sizeof(mmsg));
+    for (i = 0; i < BENCH_BURST; i++) {
+        iov[i].iov_base = buf[i];
+        iov[i].iov_len = BENCH_PAYLOAD;
+        mmsg[i].msg_hdr.msg_iov = &iov[i];
+        mmsg[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    nrc_udp_get_stats(node, &stats_before);
+    bench_time_read(&before);
+
+    do {
+        // Datagrams the node dropped never arrive, count them as done
+        nrc_udp_get_stats(node, &stats_after);
+        dropped = stats_after.dropped - stats_before.dropped;
+
+        if ((sent < packets) && (sent - received - dropped <= BENCH_WINDOW - BENCH_BURST)) {
+            nrc_os_send_msg_chain(id, bench_out_chain(), 0);
+            sent += BENCH_BURST;
+        }
+        count = recvmmsg(fd, mmsg, BENCH_BURST, MSG_DONTWAIT, 0);
+        if (count > 0) {
+            received += (u32_t)count;
+        }
+        else if (sent - received - dropped > BENCH_WINDOW - BENCH_BURST) {
+            sched_yield();
+        }
+    } while ((received + dropped < packets) &&
+        (bench_clock_ns(CLOCK_MONOTONIC) - before.wall_ns < BENCH_TIMEOUT_NS));
+
+    bench_time_read(&after);
+    nrc_udp_get_stats(node, &stats_after);
+    close(fd);
+
+    bench_report(c, received, &before, &after, &stats_before, &stats_after);
+}
+
+int main(int argc, char *argv[])
+{
+    u32_t   scale = 1;
+    u32_t   i;
+
+    if (argc > 1) {
+        scale = (u32_t)atoi(argv[1]);
+    }
+    if (argc > 2) {
+        _bench_port = (u32_t)atoi(argv[2]);
+    }
+    if ((scale == 0) || (_bench_port == 0) || (_bench_port > 65535 - 32)) {
+        fprintf(stderr, "usage: %s [scale] [port]\n", argv[0]);
+        return 1;
+    }
+
+    nrc_port_init();
+    nrc_os_init();
+    nrc_os_set_node_types(_bench_types, sizeof(_bench_types) / sizeof(_bench_types[0]));
+    bench_cfg();
+    if ((nrc_cfg_init((u32_t*)_bench_cfg) != NRC_PORT_RES_OK) ||
+        (nrc_os_deploy() != NRC_PORT_RES_OK) ||
+        (nrc_os_start() != NRC_PORT_RES_OK)) {
+        fprintf(stderr, "deploy failed\n");
+        return 1;
+    }
+
+    for (i = 0; i < sizeof(_bench_in) / sizeof(_bench_in[0]); i++) {
+        bench_udp_in(&_bench_in[i], _bench_port + i, (u64_t)BENCH_PACKETS * scale);
+    }
+    for (i = 0; i < sizeof(_bench_out) / sizeof(_bench_out[0]); i++) {
+        bench_udp_out(&_bench_out[i], _bench_port + 16 + i, (u64_t)BENCH_PACKETS * scale);
+    }
+
+    return 0;
+}
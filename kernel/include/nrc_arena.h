@@ -0,0 +1,106 @@
+/**
+ * Copyright 2017 Tomas Frisberg & Ola Bjorsne
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http ://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _NRC_ARENA_H_
+#define _NRC_ARENA_H_
+
+#include "nrc_types.h"
+#include "nrc_defs.h"
+#include "nrc_port.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Fixed size arena, sized once from a plan and never grown.
+ *
+ * The arena is one block of memory split into a bump area, for objects that
+ * live as long as the arena like nodes, and pools of fixed size blocks, for
+ * messages. The plan counts blocks per size class, the classes go in steps of
+ * about 1.5x from 16 bytes. An alloc takes a block of the smallest class that
+ * fits, or of a larger one if that class is used up, and a free puts it back
+ * in its pool. Both are a list operation under the pool's lock. The arena
+ * never calls the heap.
+ */
+
+#define NRC_ARENA_CLASSES       (34)    // 16 bytes to 1.5 MB
+#define NRC_ARENA_ALIGN         (16)
+
+struct nrc_arena_plan {
+    u32_t   bump_size;
+    u32_t   block_count[NRC_ARENA_CLASSES];
+};
+
+struct nrc_arena_block {
+    struct nrc_arena_block  *next;
+};
+
+struct nrc_arena_pool {
+    nrc_port_mutex_t        lock;
+    struct nrc_arena_block  *free;
+    u8_t                    *start;
+    u8_t                    *end;
+    u32_t                   block_size;
+    u32_t                   free_count;
+    u64_t                   alloc_count;
+    u64_t                   free_total;     // Frees, in nrc_port_heap_stats free_count
+    u64_t                   failed_count;
+};
+
+struct nrc_arena {
+    u8_t                    *base;
+    u32_t                   size;
+    nrc_port_mutex_t        bump_lock;
+    u8_t                    *bump;
+    u8_t                    *bump_end;
+    u8_t                    *pool_start;    // Pools follow the bump area, in class order
+    struct nrc_arena_pool   pool[NRC_ARENA_CLASSES];
+};
+
+void nrc_arena_plan_init(struct nrc_arena_plan *plan);
+
+// Room for count objects of size in the bump area, or count blocks of size in the pools
+void nrc_arena_plan_bump(struct nrc_arena_plan *plan, u32_t size, u32_t count);
+void nrc_arena_plan_blocks(struct nrc_arena_plan *plan, u32_t size, u32_t count);
+
+// Bytes of memory the plan takes. NRC_PORT_RES_ERROR if it does not fit in u32_t or a block is too big.
+s32_t nrc_arena_plan_size(const struct nrc_arena_plan *plan, u32_t *size);
+
+// Lays out the plan in memory, NRC_PORT_RES_ERROR if size is less than nrc_arena_plan_size
+s32_t nrc_arena_init(struct nrc_arena *arena, const struct nrc_arena_plan *plan, u8_t *memory, u32_t size);
+
+// Frees the locks, the memory is the caller's
+void nrc_arena_deinit(struct nrc_arena *arena);
+
+// Never freed, 0 when the bump area is used up
+void* nrc_arena_bump(struct nrc_arena *arena, u32_t size);
+
+// 0 when no pool with blocks of at least size has one free
+void* nrc_arena_alloc(struct nrc_arena *arena, u32_t size);
+void nrc_arena_free(struct nrc_arena *arena, void *buf);
+
+// TRUE if buf is from nrc_arena_alloc of the arena
+bool_t nrc_arena_owns(const struct nrc_arena *arena, const void *buf);
+
+// Counters of one pool, NRC_PORT_RES_NOT_FOUND past the last class
+s32_t nrc_arena_stats(struct nrc_arena *arena, u32_t size_class, struct nrc_port_heap_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
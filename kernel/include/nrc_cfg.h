@@ -24,7 +24,16 @@
 extern "C" {
 #endif
 
+/**
+ * The config is a Node-RED flows.json or a binary image compiled from one (nrc_cfg_image.h).
+ * A flows.json is indexed once at init, the get functions are hash lookups and strings are
+ * copied out of the config text. An image is only checked and then read in place.
+ *
+ * nrc_cfg_init:      cfg_address is an image or a zero terminated flows.json text, it must be kept until deinit
+ * nrc_cfg_init_file: maps an image or flows.json file read-only until deinit
+ */
 s32_t nrc_cfg_init(u32_t *cfg_address);
+s32_t nrc_cfg_init_file(const s8_t *path);
 s32_t nrc_cfg_deinit(void);
 
 s32_t nrc_cfg_get_node(u32_t index, s8_t *cfg_type, s8_t *cfg_id, u32_t max_str_len);
@@ -35,6 +44,19 @@ s32_t nrc_cfg_get_int(s8_t *cfg_type, s8_t *cfg_id, s8_t *cfg_param_name, s32_t
 s32_t nrc_cfg_get_str_from_array(s8_t *cfg_type, s8_t *cfg_id, s8_t *cfg_arr_name, u8_t index, s8_t *str, uint32_t max_str_len);
 s32_t nrc_cfg_get_int_from_array(s8_t *cfg_type, s8_t *cfg_id, s8_t *cfg_arr_name, u8_t index, s32_t *value);
 
+// Id of the index:th node wired to output port, from the node's wires array of arrays
+s32_t nrc_cfg_get_wire(s8_t *cfg_type, s8_t *cfg_id, u8_t port, u8_t index, s8_t *wire_id, uint32_t max_str_len);
+
+// Nodes wired to output port, NRC_PORT_RES_NOT_FOUND past the last port
+s32_t nrc_cfg_get_wire_count(s8_t *cfg_type, s8_t *cfg_id, u8_t port, u32_t *count);
+
+// Hashes of a node to tell if it changed between configs, the same for a flows.json and its image.
+// hash covers the params except the editor position x, y and the wires, wires_hash the wires.
+s32_t nrc_cfg_get_node_hash(s8_t *cfg_type, s8_t *cfg_id, u32_t *hash, u32_t *wires_hash);
+
+// Compiles the loaded flows.json into an image, free it with nrc_port_heap_free
+s32_t nrc_cfg_build_image(u8_t **image, u32_t *size);
+
 #ifdef __cplusplus
 }
 #endif
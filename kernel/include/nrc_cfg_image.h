@@ -0,0 +1,88 @@
+/**
+ * Copyright 2017 Tomas Frisberg & Ola Bjorsne
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http ://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _NRC_CFG_IMAGE_H_
+#define _NRC_CFG_IMAGE_H_
+
+#include "nrc_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Binary config image, a precompiled flows.json that nrc_cfg reads in place.
+ *
+ * All records are u32_t aligned and in the byte order of the target. Offsets are from
+ * the start of the image. The layout is:
+ *
+ *   header
+ *   node table     nodes sorted by id
+ *   order table    u32_t index in node table for each node, in flows.json order
+ *   value table    params and array elements, params of a node sorted by name
+ *   string table   decoded zero terminated strings, offset 0 is the empty string
+ *
+ * The checksum is FNV-1a over the u32_t words after the header.
+ */
+
+#define NRC_CFG_IMAGE_MAGIC     (0x4943524E)    // "NRCI"
+#define NRC_CFG_IMAGE_VERSION   (1)
+
+// Value kinds, also used by the flows.json index
+enum nrc_cfg_kind {
+    NRC_CFG_K_NULL = 0,
+    NRC_CFG_K_FALSE,
+    NRC_CFG_K_TRUE,
+    NRC_CFG_K_NUMBER,
+    NRC_CFG_K_STRING,
+    NRC_CFG_K_ARRAY,
+    NRC_CFG_K_OBJECT
+};
+
+struct nrc_cfg_image_hdr {
+    u32_t   magic;
+    u16_t   version;
+    u16_t   header_size;
+    u32_t   image_size;
+    u32_t   checksum;
+    u32_t   node_count;
+    u32_t   node_offset;
+    u32_t   order_offset;
+    u32_t   value_count;
+    u32_t   value_offset;
+    u32_t   string_size;
+    u32_t   string_offset;
+};
+
+struct nrc_cfg_image_node {
+    u32_t   id;             // String offset
+    u32_t   type;           // String offset
+    u32_t   first;          // First param in value table
+    u32_t   count;
+};
+
+struct nrc_cfg_image_value {
+    u32_t   name;           // String offset of member name, 0 for array elements
+    u32_t   data;           // String offset for strings and numbers, first child for arrays and objects
+    u32_t   count;          // String length, or number of children
+    u32_t   kind;           // enum nrc_cfg_kind
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -24,6 +24,7 @@
 #define NRC_MSG_TYPE_INT    (1)
 #define NRC_MSG_TYPE_STRING (2)
 #define NRC_MSG_TYPE_BUF    (3)
+#define NRC_MSG_TYPE_OBJ    (4)
 
 #ifdef __cplusplus
 extern "C" {
@@ -47,9 +48,20 @@ struct nrc_msg_str {
 
 struct nrc_msg_buf {
     struct nrc_msg_hdr  hdr;
+    u32_t               len;        // Bytes of buf
     u8_t                buf[NRC_EMTPY_ARRAY];
 };
 
+// Structured message, built and read with nrc_msg_obj.h
+struct nrc_msg_obj {
+    struct nrc_msg_hdr  hdr;
+    u32_t               size;       // Bytes of data in use
+    u32_t               capacity;   // Bytes of data
+    u32_t               root;       // Offset of the root table in data
+    u32_t               reserved;
+    u64_t               data[NRC_EMTPY_ARRAY];
+};
+
 #ifdef __cplusplus
 }
 #endif
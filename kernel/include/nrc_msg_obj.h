@@ -0,0 +1,148 @@
+/**
+ * Copyright 2017 Tomas Frisberg & Ola Bjorsne
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http ://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _NRC_MSG_OBJ_H_
+#define _NRC_MSG_OBJ_H_
+
+#include "nrc_types.h"
+#include "nrc_defs.h"
+#include "nrc_msg.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Structured messages, NRC_MSG_TYPE_OBJ.
+ *
+ * Fields are key/value pairs in tables, all in the one allocation of the
+ * message, so a message is sent, cloned and copied like any other. Tables
+ * are objects, with an index on the key, or arrays, indexed by position.
+ * Values are null, bool, int, float, string, blob or a nested table.
+ *
+ * Keys are interned once, typically when a node is initialized, and a
+ * lookup is then a probe on the hash kept with the key, without string compares. A node reads
+ * msg.payload.temperature with the keys of payload and temperature.
+ *
+ * Names from outside, e.g. parsed JSON, are not interned, the key table is
+ * bounded and never shrinks. The builder gives them the interned key if the
+ * name is known, otherwise the name is stored in the message and the field
+ * gets an inline key, only valid in that message. Both kinds index by the
+ * hash of the name, so a get with an interned key also finds a field named
+ * the same with an inline key, comparing names only with those on its probe.
+ *
+ * The builder fills a message allocated up front and never allocates per
+ * field. Each table is given its max number of fields when begun. Errors
+ * stick to the builder and are reported by finish.
+ */
+
+#define NRC_MSG_OBJ_NULL    (0)
+#define NRC_MSG_OBJ_BOOL    (1)
+#define NRC_MSG_OBJ_INT     (2)
+#define NRC_MSG_OBJ_FLOAT   (3)
+#define NRC_MSG_OBJ_STR     (4)
+#define NRC_MSG_OBJ_BLOB    (5)
+#define NRC_MSG_OBJ_OBJECT  (6)
+#define NRC_MSG_OBJ_ARRAY   (7)
+
+#define NRC_MSG_OBJ_DEPTH   (8)     // Max nesting of tables while building
+
+typedef u32_t nrc_msg_key_t;        // 0 is no key
+
+#define NRC_MSG_KEY_INLINE  (0x80000000U)   // Set in keys with the name stored in the message
+
+// Initialized by nrc_os_init, cleared by nrc_os_deinit
+void nrc_msg_key_init(void);
+void nrc_msg_key_deinit(void);
+
+// Interns name, the same name always gives the same key. 0 if the key table is full.
+// Names are kept in a fixed pool, interning never allocates.
+// Lookups of known keys take no lock.
+nrc_msg_key_t nrc_msg_key(const s8_t *name);
+nrc_msg_key_t nrc_msg_key_n(const s8_t *name, u32_t len);   // name need not be terminated
+const s8_t* nrc_msg_key_name(nrc_msg_key_t key);
+
+// Key of name if it is already interned, else 0. Never adds a key.
+nrc_msg_key_t nrc_msg_key_lookup_n(const s8_t *name, u32_t len);
+
+// Allocated with nrc_os_msg_alloc, capacity bytes for tables and values
+struct nrc_msg_obj* nrc_msg_obj_alloc(u32_t capacity);
+
+// Bytes of capacity a table or a string value takes, to size a message exactly
+u32_t nrc_msg_obj_table_size(u32_t field_max, bool_t object);
+u32_t nrc_msg_obj_str_size(u32_t len);
+u32_t nrc_msg_obj_key_size(u32_t len);                  // Most an inline key takes
+
+struct nrc_msg_obj_builder {
+    struct nrc_msg_obj  *msg;
+    u32_t               table[NRC_MSG_OBJ_DEPTH];       // Open tables, innermost last
+    u32_t               depth;
+    bool_t              failed;                         // Out of capacity, fields or depth
+};
+
+// Starts the root object of msg
+void nrc_msg_obj_build(struct nrc_msg_obj_builder *builder, struct nrc_msg_obj *msg, u32_t field_max);
+
+// Interned key of name if known, otherwise an inline key with name stored in msg. 0 if it does not fit.
+nrc_msg_key_t nrc_msg_obj_key(struct nrc_msg_obj_builder *builder, const s8_t *name, u32_t len);
+
+// Key is ignored in arrays, a field gets the next position
+void nrc_msg_obj_put_null(struct nrc_msg_obj_builder *builder, nrc_msg_key_t key);
+void nrc_msg_obj_put_bool(struct nrc_msg_obj_builder *builder, nrc_msg_key_t key, bool_t value);
+void nrc_msg_obj_put_int(struct nrc_msg_obj_builder *builder, nrc_msg_key_t key, s64_t value);
+void nrc_msg_obj_put_float(struct nrc_msg_obj_builder *builder, nrc_msg_key_t key, double value);
+void nrc_msg_obj_put_str(struct nrc_msg_obj_builder *builder, nrc_msg_key_t key, const s8_t *str, u32_t len);
+void nrc_msg_obj_put_blob(struct nrc_msg_obj_builder *builder, nrc_msg_key_t key, const void *blob, u32_t len);
+
+void nrc_msg_obj_begin_object(struct nrc_msg_obj_builder *builder, nrc_msg_key_t key, u32_t field_max);
+void nrc_msg_obj_begin_array(struct nrc_msg_obj_builder *builder, nrc_msg_key_t key, u32_t field_max);
+void nrc_msg_obj_end(struct nrc_msg_obj_builder *builder);
+
+// Ends the open tables. NRC_PORT_RES_ERROR if anything did not fit, the message is then incomplete.
+s32_t nrc_msg_obj_finish(struct nrc_msg_obj_builder *builder);
+
+struct nrc_msg_obj_value {
+    u32_t   type;
+    u32_t   len;            // Bytes of a string, without terminator, or a blob. Fields of a table.
+    union {
+        bool_t      b;
+        s64_t       i;
+        double      f;
+        const s8_t  *str;   // Zero terminated
+        const u8_t  *blob;
+        u32_t       table;  // For nrc_msg_obj_get and nrc_msg_obj_field
+    } v;
+};
+
+#define nrc_msg_obj_root(msg)   ((msg)->root)
+
+// Key is the position in arrays. FALSE if there is no such field.
+bool_t nrc_msg_obj_get(const struct nrc_msg_obj *msg, u32_t table, nrc_msg_key_t key, struct nrc_msg_obj_value *value);
+
+// Follows keys from the root, e.g. payload then temperature
+bool_t nrc_msg_obj_path(const struct nrc_msg_obj *msg, const nrc_msg_key_t *keys, u32_t count, struct nrc_msg_obj_value *value);
+
+// Fields in the order put, key is 0 in arrays
+bool_t nrc_msg_obj_field(const struct nrc_msg_obj *msg, u32_t table, u32_t index, nrc_msg_key_t *key, struct nrc_msg_obj_value *value);
+
+// Name of an interned key or an inline key of msg, 0 if none. len may be 0.
+const s8_t* nrc_msg_obj_key_name(const struct nrc_msg_obj *msg, nrc_msg_key_t key, u32_t *len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
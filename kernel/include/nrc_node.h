@@ -25,13 +25,10 @@
 extern "C" {
 #endif
 
-#ifdef _LONG_HANDLES_
-typedef u64_t nrc_node_id_t;
-#else
+// Dense index of a registered node, 1 for the first one registered. 0 is no node.
 typedef u32_t nrc_node_id_t;
-#endif
 
-struct nrc_node;
+struct nrc_node_hdr;
 
 typedef s32_t (*nrc_node_init_t)(struct nrc_node_hdr *self, nrc_node_id_t id);
 typedef s32_t (*nrc_node_deinit_t)(struct nrc_node_hdr *self);
@@ -39,6 +36,7 @@ typedef s32_t (*nrc_node_start_t)(struct nrc_node_hdr *self);
 typedef s32_t (*nrc_node_stop_t)(struct nrc_node_hdr *self);
 typedef s32_t (*nrc_node_recv_msg_t)(struct nrc_node_hdr *self, struct nrc_msg_hdr *msg);
 typedef s32_t (*nrc_node_recv_evt_t)(struct nrc_node_hdr *self, u32_t event_mask);
+typedef s32_t (*nrc_node_recv_msg_batch_t)(struct nrc_node_hdr *self, struct nrc_msg_hdr **msgs, u32_t count);
 
 struct nrc_node_api {
     nrc_node_init_t     init;
@@ -47,6 +45,9 @@ struct nrc_node_api {
     nrc_node_stop_t     stop;
     nrc_node_recv_msg_t recv_msg;
     nrc_node_recv_evt_t recv_evt;
+
+    // Optional, when set it replaces recv_msg and gets a run of queued messages in send order
+    nrc_node_recv_msg_batch_t recv_msg_batch;
 };
 
 struct nrc_node_hdr {
@@ -55,6 +56,15 @@ struct nrc_node_hdr {
     const s8_t          *cfg_name;
 };
 
+// Most memory one node of a type takes, declared for the static arena, see nrc_os_set_arena
+struct nrc_node_mem {
+    u32_t   node_size;      // Given to nrc_os_node_alloc
+    u32_t   msg_size;       // Largest message the node allocates, as given to nrc_os_msg_alloc
+    u32_t   msg_count;      // Messages allocated by the node alive at once, wherever they are
+    u32_t   queue_depth;    // Messages queued for the node at once, bound it with nrc_os_set_queue_limit
+    u32_t   keep_size;      // Bytes the node takes with nrc_os_node_mem_alloc
+};
+
 #ifdef __cplusplus
 }
 #endif
@@ -21,6 +21,8 @@
 #include "nrc_defs.h"
 #include "nrc_node.h"
 #include "nrc_msg.h"
+#include "nrc_timer.h"
+#include "nrc_port.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -29,21 +31,292 @@ extern "C" {
 s32_t nrc_os_init(void);
 s32_t nrc_os_deinit(void);
 
+// Number of worker threads dispatching nodes, 1 by default. Call between init and start.
+s32_t nrc_os_set_workers(u32_t count);
+
+/**
+ * nrc_os_start:  compiles the wires and starts the workers. On an error nothing
+ *                is left running and start may be called again.
+ * nrc_os_stop:   each node ends its turn and is stopped, deployed or registered.
+ *                The workers and the I/O reactor are then joined. Not alongside
+ *                a deploy.
+ * nrc_os_deinit: after stop, or instead of start. Deinits and frees the nodes,
+ *                the queued messages, the records and the arena reserved by
+ *                nrc_os_set_arena, and clears the keys. A new nrc_os_init may
+ *                follow. Trace rings are not freed, a thread may still hold its
+ *                own.
+ */
 s32_t nrc_os_start(void);
 s32_t nrc_os_stop(void);
 
+/**
+ * Static arena, no heap use once started. Set between init and the first node alloc.
+ *
+ * The sizing pass reads the flow config and, for every node of a type in types,
+ * adds what it declares: the node itself, its compiled wires, one low-water
+ * subscription, keep_size bytes it takes at init, msg_count messages of msg_size
+ * and a delivery for each of queue_depth queued messages. Nodes of other types
+ * are taken to be not deployed. The total is reserved as one arena, pages
+ * touched, and nodes, messages, deliveries and subscriptions are then taken from
+ * it. An alloc beyond the declared needs fails instead of growing.
+ *
+ * Once started, the heap is only used by what changes the flow or is asked for:
+ * - nrc_os_register_node and nrc_os_deploy, the registry is built on the heap,
+ *   as are the locks of new nodes and the parsed config of nrc_cfg_init
+ * - trace rings, one per thread on its first event, see NRC_OS_TRACE, and
+ *   nrc_trace_snapshot
+ * - nrc_cfg_build_image
+ * The kernel's nodes take their buffers at init, see nrc_os_node_mem_alloc.
+ *
+ * nrc_os_arena_size: bytes the flow config needs
+ * nrc_os_set_arena:  memory of size bytes, 0 to reserve it from the heap now. If
+ *                    it is too small nrc_os_set_arena gives NRC_PORT_RES_ERROR and
+ *                    nrc_os_start refuses to start.
+ *
+ * Timers are kept in the nodes and take nothing.
+ */
+struct nrc_os_type_mem {
+    const s8_t          *cfg_type;
+    struct nrc_node_mem mem;
+};
+
+struct nrc_port_heap_stats;
+
+s32_t nrc_os_arena_size(const struct nrc_os_type_mem *types, u32_t count, u32_t *size);
+s32_t nrc_os_set_arena(u8_t *memory, u32_t size, const struct nrc_os_type_mem *types, u32_t count);
+
+// Counters of one arena size class, NRC_PORT_RES_NOT_FOUND past the last one
+s32_t nrc_os_get_arena_stats(u32_t size_class, struct nrc_port_heap_stats *stats);
+
 struct nrc_node_hdr* nrc_os_node_alloc(u32_t size);
+
+// Memory a node keeps from init to deinit, from the arena if set, declared as its keep_size.
+// Freed in deinit, in an arena it stays taken like the node.
+void* nrc_os_node_mem_alloc(u32_t size);
+void nrc_os_node_mem_free(void *buf);
 s32_t nrc_os_register_node(struct nrc_node_hdr *node, struct nrc_node_api *api, const s8_t *cfg_id);
 
 s32_t nrc_os_get_node_id(const s8_t *cfg_id, nrc_node_id_t *id);
 
+/**
+ * Deploy of the flow config, nodes are made from node types. A type's alloc takes
+ * nrc_os_node_alloc and keeps copies of the cfg strings, like nrc_json_node_alloc.
+ * The types are kept by the caller.
+ *
+ * nrc_os_deploy compares the loaded config with what the last deploy made and only
+ * acts on the difference:
+ * - a new node is allocated, registered, init and started
+ * - a node whose params or type changed is stopped and deinit, and a new one is made
+ *   in its place. It keeps its id and its queued messages.
+ * - a removed node is stopped and deinit. It is taken out of the wires leading to it
+ *   first, then its queued messages are freed. A send still in flight to it, e.g.
+ *   lock-free or by a stale id, frees the message.
+ * - other nodes keep running with their queues and state. Their wires are compiled
+ *   again if they changed in config or lead to a node that came or went.
+ * Changes to the editor position x, y do not count, see nrc_cfg_get_node_hash.
+ *
+ * To redeploy, load the new config with nrc_cfg_deinit and nrc_cfg_init or
+ * nrc_cfg_init_file and call nrc_os_deploy again. It may be called before or after
+ * nrc_os_start, from any thread but a worker. A node is only touched between two of
+ * its turns; messages and events sent to it meanwhile wait. A node keeps its id
+ * also when it is removed and later comes back, a removed node's id gives
+ * NRC_PORT_RES_INVALID_IN_PARAM. Nodes of types not given, and nodes registered
+ * with nrc_os_register_node, are left alone apart from their wires. With a static
+ * arena a node made by a redeploy takes new room, the old one's is not reused.
+ *
+ * The result is NRC_PORT_RES_ERROR if a node could not be made or failed its
+ * init or start, the rest of the config is deployed.
+ */
+typedef struct nrc_node_hdr* (*nrc_os_node_alloc_t)(const s8_t *cfg_type, const s8_t *cfg_id, const s8_t *cfg_name);
+
+struct nrc_os_node_type {
+    const s8_t          *cfg_type;
+    nrc_os_node_alloc_t alloc;
+    struct nrc_node_api *api;
+};
+
+s32_t nrc_os_set_node_types(const struct nrc_os_node_type *types, u32_t count);
+s32_t nrc_os_deploy(void);
+
 struct nrc_msg_hdr* nrc_os_msg_alloc(u32_t size);
+
+/**
+ * Messages are reference counted. Clone adds a reference to the same message
+ * without copying, e.g. one per extra wire when fanning out. Every reference
+ * is sent or freed on its own and the memory is released with the last one.
+ * A shared message is read-only; make_writable returns msg itself if the
+ * caller holds the only reference, else a private copy (releasing msg).
+ * Both act on msg only, not on a chain linked through next, and return 0 if
+ * msg is not a kernel message or the copy gets no memory, msg is then kept.
+ */
 struct nrc_msg_hdr* nrc_os_msg_clone(struct nrc_msg_hdr *msg);
+struct nrc_msg_hdr* nrc_os_msg_make_writable(struct nrc_msg_hdr *msg);
 void nrc_os_msg_free(struct nrc_msg_hdr *msg);
 
+/**
+ * Lower prio value is higher priority. Priority orders ready nodes against
+ * each other; a node receives its messages one at a time, in send order,
+ * and never concurrently with itself even when several workers run. A node
+ * runs at the highest priority of the work it has waiting: one already
+ * queued moves up when sent a message or event of a higher priority.
+ */
 s32_t nrc_os_send_msg(nrc_node_id_t id, struct nrc_msg_hdr *msg, s8_t prio);
+
+struct nrc_os_send_entry {
+    nrc_node_id_t       id;
+    struct nrc_msg_hdr  *msg;
+    s8_t                prio;
+};
+
+/**
+ * Sends a burst with one mailbox lock per target and at most one worker wakeup.
+ * The result is the same as sending the messages one at a time in order. Either
+ * all messages are sent or, on error, none and the caller still owns them.
+ *
+ * nrc_os_send_msg_batch: entries may have different targets
+ * nrc_os_send_msg_chain: messages linked through next, all to one target. The
+ *                        links are cleared, each message is delivered on its own.
+ */
+s32_t nrc_os_send_msg_batch(const struct nrc_os_send_entry *entries, u32_t count);
+s32_t nrc_os_send_msg_chain(nrc_node_id_t id, struct nrc_msg_hdr *chain, s8_t prio);
+
+/**
+ * Sends msg to every node wired to the output port, port 0 is the first array of
+ * the node's wires in config. Wires are resolved to nodes by nrc_os_start, or by
+ * registration for a node registered later, so a send is a walk over pointers.
+ * Wires to nodes that are not registered by then are left out.
+ *
+ * The wires share msg, see nrc_os_msg_clone. As nrc_os_send_msg_batch either all
+ * wires get msg or, on error, none and the caller still owns it. A port without
+ * wires frees msg.
+ */
+s32_t nrc_os_send_port(struct nrc_node_hdr *self, u32_t port, struct nrc_msg_hdr *msg, s8_t prio);
+
+// As nrc_os_send_port for each message of a chain linked through next, the links are
+// cleared. One mailbox lock per wired node and at most one worker wakeup for all. On
+// error no message is sent and the chain is left as it was.
+s32_t nrc_os_send_port_chain(struct nrc_node_hdr *self, u32_t port, struct nrc_msg_hdr *chain, s8_t prio);
+
+/**
+ * Send without locks or allocation, for driver threads, signal handlers and
+ * interrupts. The message is pushed on an ingress queue with one atomic exchange
+ * and a worker moves it to the mailbox. Messages from one sender arrive in order.
+ *
+ * NRC_PORT_RES_BUSY if the message is already queued elsewhere, e.g. a shared
+ * message, the caller then keeps it. The mailbox policy applies when the worker
+ * delivers; a full rejecting mailbox drops the message as there is no one to tell.
+ */
+s32_t nrc_os_send_msg_lock_free(nrc_node_id_t id, struct nrc_msg_hdr *msg, s8_t prio);
+
 s32_t nrc_os_set_evt(nrc_node_id_t id, u32_t event_mask, s8_t prio);
 
+/**
+ * Mailboxes are unbounded by default. A limit bounds the messages queued for a
+ * node, the policy says what a send does when it is reached:
+ *
+ * NRC_OS_QUEUE_REJECT:      the send gives NRC_PORT_RES_BUSY and the caller keeps
+ *                           the message. A batch or chain is rejected as a whole.
+ * NRC_OS_QUEUE_DROP_OLDEST: the oldest queued message is dropped
+ * NRC_OS_QUEUE_DROP_NEWEST: the message sent is dropped, the send still succeeds
+ * NRC_OS_QUEUE_LATEST:      a message replaces the queued one with the same topic,
+ *                           in its place. Past the limit the oldest is dropped.
+ *                           Conflates also with limit 0.
+ *
+ * Once the limit has been reached, the node's subscribers get their event when
+ * the mailbox has drained to low_water, for credit based flow control.
+ * Set the limit before messages are sent to the node.
+ */
+enum nrc_os_queue_policy {
+    NRC_OS_QUEUE_REJECT = 0,
+    NRC_OS_QUEUE_DROP_OLDEST,
+    NRC_OS_QUEUE_DROP_NEWEST,
+    NRC_OS_QUEUE_LATEST
+};
+
+s32_t nrc_os_set_queue_limit(nrc_node_id_t id, u32_t limit, enum nrc_os_queue_policy policy, u32_t low_water);
+s32_t nrc_os_subscribe_low_water(nrc_node_id_t id, nrc_node_id_t subscriber, u32_t event_mask, s8_t prio);
+
+/**
+ * Kernel timers in a hierarchical timing wheel with 1 ms ticks. Start and stop
+ * are O(1) and waiting timers cost nothing, an idle kernel sleeps until the
+ * next deadline. The timer is kept by the caller, e.g. in its node struct.
+ *
+ * On expiry the node gets event_mask in recv_evt or, if given to start, msg.
+ * A one-shot timer hands msg over. A periodic timer keeps it and sends a
+ * shared reference each period, see nrc_os_msg_clone. Once stop or a new
+ * start returns, the earlier start delivers nothing more and its msg is freed.
+ * Busy workers look for expired timers every few turns, a long recv_msg
+ * delays them.
+ */
+struct nrc_os_timer {
+    struct nrc_timer_link   link;       // Kernel use
+    nrc_node_id_t           id;
+    struct nrc_msg_hdr      *msg;
+    u32_t                   event_mask;
+    u32_t                   period;     // ms, 0 for one-shot
+    s8_t                    prio;
+    s8_t                    padding[3];
+};
+
+s32_t nrc_os_timer_init(struct nrc_os_timer *timer, nrc_node_id_t id, u32_t event_mask, s8_t prio);
+s32_t nrc_os_timer_start(struct nrc_os_timer *timer, u32_t timeout, u32_t period, struct nrc_msg_hdr *msg);
+s32_t nrc_os_timer_stop(struct nrc_os_timer *timer);
+
+/**
+ * File descriptors of a node, waited for by the port's I/O reactor. When the fd
+ * becomes ready the node gets evt_in or evt_out in recv_evt, an error or hang up
+ * gives those of interest. Readiness is edge-triggered: the node reads or writes
+ * until EAGAIN and then calls again with the bits that gave it. A node that stops
+ * earlier, e.g. after a batch, sets its event itself to go on in a later turn.
+ * The io is kept by the caller, e.g. in its node struct. Remove it before the fd
+ * is closed, no event is set after remove returns.
+ */
+struct nrc_os_io {
+    nrc_port_io_t   handle;     // Kernel use
+    nrc_node_id_t   id;
+    u32_t           evt_in;
+    u32_t           evt_out;
+    s8_t            prio;
+    s8_t            padding[3];
+};
+
+s32_t nrc_os_io_init(struct nrc_os_io *io, nrc_node_id_t id, u32_t evt_in, u32_t evt_out, s8_t prio);
+s32_t nrc_os_io_add(struct nrc_os_io *io, s32_t fd, u32_t interest);
+s32_t nrc_os_io_modify(struct nrc_os_io *io, u32_t interest);
+s32_t nrc_os_io_again(struct nrc_os_io *io, u32_t ready);
+s32_t nrc_os_io_remove(struct nrc_os_io *io);
+
+/**
+ * Runtime statistics per node, built in when the kernel is compiled with
+ * NRC_OS_STATS=1, else the calls give NRC_PORT_RES_NOT_SUPPORTED.
+ *
+ * Times are in ns and measured per turn, one recv_evt or the messages a node
+ * gets in one go (up to a batch). Every turn is timed with nrc_port_ticks and
+ * converted to ns when read, at the rate the ticks have run since init. Sent
+ * counts messages sent from the node's own recv_msg/recv_evt. Values are read
+ * while the node runs, each is whole but a snapshot may be slightly behind.
+ */
+struct nrc_os_stats {
+    u64_t   recv_msg_count;
+    u64_t   sent_msg_count;
+    u64_t   recv_evt_count;
+    u64_t   msg_time;           // Total time in recv_msg/recv_msg_batch
+    u64_t   msg_time_max;       // Longest turn
+    u64_t   evt_time;           // Total time in recv_evt
+    u64_t   evt_time_max;
+    u64_t   dropped_count;      // Dropped by the queue policy
+    u64_t   rejected_count;     // Sends refused with NRC_PORT_RES_BUSY
+    u32_t   queued;             // Messages in the mailbox now
+    u32_t   queued_max;         // High-water mark of queued
+};
+
+typedef void (*nrc_os_stats_hook_t)(nrc_node_id_t id, const s8_t *cfg_id, const struct nrc_os_stats *stats);
+
+s32_t nrc_os_get_stats(nrc_node_id_t id, struct nrc_os_stats *stats);
+
+// Calls hook for every node each period_ms, from the first worker. Call between init and start.
+s32_t nrc_os_set_stats_hook(nrc_os_stats_hook_t hook, u32_t period_ms);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,73 @@
+/**
+ * Copyright 2017 Tomas Frisberg & Ola Bjorsne
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http ://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _NRC_PRIOQ_H_
+#define _NRC_PRIOQ_H_
+
+#include "nrc_types.h"
+#include "nrc_defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Priority queue with one FIFO per s8_t priority level.
+ *
+ * Lower value is higher priority. Items are linked intrusively through a
+ * struct nrc_prioq_link member, both ways so an item can be taken out from
+ * anywhere. An occupancy bitmap makes put, get and remove O(1) regardless of
+ * queue depth. Not thread safe, the caller does the locking.
+ */
+
+#define NRC_PRIOQ_LEVELS        (256)
+#define NRC_PRIOQ_BITMAP_WORDS  (NRC_PRIOQ_LEVELS / 32)
+
+struct nrc_prioq_link {
+    struct nrc_prioq_link   *next;
+    struct nrc_prioq_link   *prev;
+};
+
+struct nrc_prioq_level {
+    struct nrc_prioq_link   *head;
+    struct nrc_prioq_link   *tail;
+};
+
+struct nrc_prioq {
+    u32_t                   count;
+    u32_t                   summary;                        // Bit n set if bitmap[n] != 0
+    u32_t                   bitmap[NRC_PRIOQ_BITMAP_WORDS]; // Bit set if level is non-empty
+    struct nrc_prioq_level  level[NRC_PRIOQ_LEVELS];
+};
+
+void nrc_prioq_init(struct nrc_prioq *queue);
+
+void nrc_prioq_put(struct nrc_prioq *queue, struct nrc_prioq_link *item, s8_t prio);
+
+// Returns the first item of the highest priority level, or 0 if empty
+struct nrc_prioq_link* nrc_prioq_get(struct nrc_prioq *queue, s8_t *prio);
+
+// Returns FALSE if empty, else the priority of the item nrc_prioq_get would return
+bool_t nrc_prioq_peek_prio(struct nrc_prioq *queue, s8_t *prio);
+
+// Takes item out of the queue, prio is the one it was put with. The item must be queued.
+void nrc_prioq_remove(struct nrc_prioq *queue, struct nrc_prioq_link *item, s8_t prio);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
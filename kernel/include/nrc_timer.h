@@ -0,0 +1,80 @@
+/**
+ * Copyright 2017 Tomas Frisberg & Ola Bjorsne
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http ://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _NRC_TIMER_H_
+#define _NRC_TIMER_H_
+
+#include "nrc_types.h"
+#include "nrc_defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Hierarchical timing wheel.
+ *
+ * Each level has 64 slots, a slot of level n spans 64^n ticks. A timer goes
+ * to the lowest level that reaches its expiry and moves down a level when
+ * the wheel comes to its slot. Add and remove are O(1). Occupancy bitmaps
+ * let the wheel jump over empty ticks, so the cost of advancing depends on
+ * the timers, not on the time passed. Timers further away than the top level
+ * reaches wait there and are placed again until in range.
+ *
+ * Items are linked intrusively through a struct nrc_timer_link member. Not
+ * thread safe, the caller does the locking.
+ */
+
+#define NRC_TIMER_LEVELS        (5)     // Reaches 64^5 ticks, 12 days of ms
+#define NRC_TIMER_SLOT_BITS     (6)
+#define NRC_TIMER_SLOTS         (1U << NRC_TIMER_SLOT_BITS)
+
+#define NRC_TIMER_NEVER         (0xFFFFFFFFFFFFFFFFULL)
+
+struct nrc_timer_link {
+    struct nrc_timer_link   *next;
+    struct nrc_timer_link   *previous;
+    u64_t                   expires;    // Tick
+    u32_t                   slot;       // 0 when not in the wheel, else 1 + level * slots + index
+};
+
+struct nrc_timer_wheel {
+    u64_t                   now;                            // Next tick to process
+    u32_t                   count;
+    u64_t                   bitmap[NRC_TIMER_LEVELS];       // Bit set if slot is non-empty
+    struct nrc_timer_link   *slot[NRC_TIMER_LEVELS][NRC_TIMER_SLOTS];
+};
+
+void nrc_timer_wheel_init(struct nrc_timer_wheel *wheel, u64_t now);
+
+// A tick already processed expires on the next one. Link must not be in the wheel.
+void nrc_timer_wheel_add(struct nrc_timer_wheel *wheel, struct nrc_timer_link *link, u64_t expires);
+void nrc_timer_wheel_remove(struct nrc_timer_wheel *wheel, struct nrc_timer_link *link);
+
+// Earliest tick the wheel has work, an expiry or a slot to move down, NRC_TIMER_NEVER if empty
+u64_t nrc_timer_wheel_next(struct nrc_timer_wheel *wheel);
+
+// Processes all ticks up to and including now. Returns the expired links in
+// expiry order, linked through next, or 0.
+struct nrc_timer_link* nrc_timer_wheel_advance(struct nrc_timer_wheel *wheel, u64_t now);
+
+#define nrc_timer_link_pending(link)    ((link)->slot != 0)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
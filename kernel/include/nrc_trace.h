@@ -0,0 +1,122 @@
+/**
+ * Copyright 2017 Tomas Frisberg & Ola Bjorsne
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http ://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _NRC_TRACE_H_
+#define _NRC_TRACE_H_
+
+#include "nrc_types.h"
+#include "nrc_defs.h"
+#include "nrc_node.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Kernel tracing, built in when compiled with NRC_OS_TRACE=1.
+ *
+ * Every thread writes fixed size records into its own ring, without locks or
+ * read-modify-write atomics, overwriting the oldest. A snapshot collects all
+ * rings while they are written and can be turned into a Chrome trace with
+ * tools/nrc_trace_json.c. Without NRC_OS_TRACE the trace points compile out
+ * and the calls give NRC_PORT_RES_NOT_SUPPORTED.
+ *
+ * Only turn boundaries read the clock. On a busy worker a turn begins when
+ * the previous one ended. Sends, events and allocations made by a node while
+ * it runs carry the time its recv_msg/recv_evt started, in the order they
+ * were made.
+ */
+
+#ifndef NRC_OS_TRACE
+#define NRC_OS_TRACE    (0)
+#endif
+
+enum nrc_trace_kind {
+    NRC_TRACE_K_SEND = 0,       // node: receiver, msg, arg: prio
+    NRC_TRACE_K_TURN_BEGIN,     // node: dispatched node, worker turn starts
+    NRC_TRACE_K_TURN_END,       // node: dispatched node, arg: messages received in the turn
+    NRC_TRACE_K_RECV_MSG,       // node, msg: before recv_msg, or per message before recv_msg_batch
+    NRC_TRACE_K_RECV_EVT,       // node, arg: event mask, before recv_evt
+    NRC_TRACE_K_SET_EVT,        // node, arg: event mask
+    NRC_TRACE_K_MSG_ALLOC,      // msg, arg: size
+    NRC_TRACE_K_MSG_FREE,       // msg, last reference released
+    NRC_TRACE_K_IDLE,           // Worker goes to sleep
+    NRC_TRACE_K_COUNT
+};
+
+#define NRC_TRACE_ALL   ((1U << NRC_TRACE_K_COUNT) - 1)
+
+struct nrc_trace_rec {
+    u64_t   ticks;          // nrc_port_ticks
+    u64_t   node;           // nrc_node_id_t, 0 if none
+    u64_t   msg;            // Message address, 0 if none
+    u32_t   arg;
+    u16_t   thread;         // Ring index, one ring per thread
+    u8_t    kind;           // enum nrc_trace_kind
+    u8_t    reserved;
+};
+
+/**
+ * Snapshot image, from nrc_trace_snapshot. Records of each thread are in the
+ * order written, threads follow each other. Two (ticks, ns) points map ticks
+ * to time. Offsets are from the start of the image.
+ */
+#define NRC_TRACE_SNAPSHOT_MAGIC    (0x5443524E)    // "NRCT"
+#define NRC_TRACE_SNAPSHOT_VERSION  (1)
+
+struct nrc_trace_snapshot_hdr {
+    u32_t   magic;
+    u16_t   version;
+    u16_t   header_size;
+    u32_t   image_size;
+    u32_t   record_size;
+    u32_t   record_count;
+    u32_t   record_offset;
+    u32_t   name_count;
+    u32_t   name_offset;
+    u64_t   ticks_start;
+    u64_t   ns_start;
+    u64_t   ticks_end;
+    u64_t   ns_end;
+};
+
+struct nrc_trace_name {
+    u64_t   node;
+    s8_t    cfg_id[NRC_MAX_CFG_NAME_LEN];   // Zero padded, not terminated at full length
+};
+
+s32_t nrc_trace_init(void);
+
+// Kinds to record, a bit per enum nrc_trace_kind. All by default.
+s32_t nrc_trace_set_mask(u32_t mask);
+
+void nrc_trace_write(u32_t kind, nrc_node_id_t node, const void *msg, u32_t arg);
+void nrc_trace_name(nrc_node_id_t node, const s8_t *cfg_id);
+
+// Image is allocated with nrc_port_heap_alloc, free with nrc_port_heap_free
+s32_t nrc_trace_snapshot(u8_t **image, u32_t *size);
+
+#if NRC_OS_TRACE
+#define NRC_TRACE(kind, node, msg, arg)     nrc_trace_write((kind), (nrc_node_id_t)(node), (msg), (u32_t)(arg))
+#else
+#define NRC_TRACE(kind, node, msg, arg)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,265 @@
+/**
+ * Copyright 2017 Tomas Frisberg & Ola Bjorsne
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http ://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "nrc_arena.h"
+#include <stdint.h>
+#include <string.h>
+
+#define NRC_ARENA_ALIGN_UP(size)    (((size) + (NRC_ARENA_ALIGN - 1)) & ~(u64_t)(NRC_ARENA_ALIGN - 1))
+
+// 16, 24, 32, 48, 64, ... every block size is a multiple of 8
+static u32_t nrc_arena_class_size(u32_t size_class)
+{
+    return (((size_class & 1) != 0) ? 24U : 16U) << (size_class / 2);
+}
+
+// Smallest class with blocks of at least size, NRC_ARENA_CLASSES if none
+static u32_t nrc_arena_class(u32_t size)
+{
+    u32_t size_class = 0;
+
+    while ((size_class < NRC_ARENA_CLASSES) && (nrc_arena_class_size(size_class) < size)) {
+        size_class++;
+    }
+
+    return size_class;
+}
+
+void nrc_arena_plan_init(struct nrc_arena_plan *plan)
+{
+    memset(plan, 0, sizeof(struct nrc_arena_plan));
+}
+
+void nrc_arena_plan_bump(struct nrc_arena_plan *plan, u32_t size, u32_t count)
+{
+    u64_t bump_size = plan->bump_size + (NRC_ARENA_ALIGN_UP((u64_t)size) * count);
+
+    plan->bump_size = (bump_size > U32_MAX_VALUE) ? U32_MAX_VALUE : (u32_t)bump_size;
+}
+
+void nrc_arena_plan_blocks(struct nrc_arena_plan *plan, u32_t size, u32_t count)
+{
+    u32_t size_class = nrc_arena_class(size);
+
+    // Too big for any class, the plan no longer fits
+    if (size_class == NRC_ARENA_CLASSES) {
+        plan->bump_size = U32_MAX_VALUE;
+    }
+    else if ((u64_t)plan->block_count[size_class] + count > U32_MAX_VALUE) {
+        plan->block_count[size_class] = U32_MAX_VALUE;
+    }
+    else {
+        plan->block_count[size_class] += count;
+    }
+}
+
+s32_t nrc_arena_plan_size(const struct nrc_arena_plan *plan, u32_t *size)
+{
+    s32_t result = NRC_PORT_RES_ERROR;
+    u64_t total = NRC_ARENA_ALIGN_UP((u64_t)plan->bump_size);
+    u32_t size_class;
+
+    for (size_class = 0; size_class < NRC_ARENA_CLASSES; size_class++) {
+        total += (u64_t)plan->block_count[size_class] * nrc_arena_class_size(size_class);
+    }
+
+    // Memory handed in need not be aligned
+    total += NRC_ARENA_ALIGN;
+
+    if ((plan->bump_size != U32_MAX_VALUE) && (total <= U32_MAX_VALUE)) {
+        *size = (u32_t)total;
+        result = NRC_PORT_RES_OK;
+    }
+
+    return result;
+}
+
+s32_t nrc_arena_init(struct nrc_arena *arena, const struct nrc_arena_plan *plan, u8_t *memory, u32_t size)
+{
+    s32_t                   result = NRC_PORT_RES_INVALID_IN_PARAM;
+    struct nrc_arena_pool   *pool;
+    struct nrc_arena_block  *block;
+    u32_t                   plan_size;
+    u32_t                   size_class;
+    u32_t                   i;
+    u8_t                    *next;
+
+    memset(arena, 0, sizeof(struct nrc_arena));
+
+    if ((memory == 0) || (nrc_arena_plan_size(plan, &plan_size) != NRC_PORT_RES_OK)) {
+        return result;
+    }
+    result = NRC_PORT_RES_ERROR;
+    if (size < plan_size) {
+        return result;
+    }
+
+    // Every page is touched now, not on a first use while running
+    memset(memory, 0, size);
+
+    arena->base = memory;
+    arena->size = size;
+    arena->bump = (u8_t*)(uintptr_t)NRC_ARENA_ALIGN_UP((uintptr_t)memory);
+    arena->bump_end = arena->bump + NRC_ARENA_ALIGN_UP((u64_t)plan->bump_size);
+    arena->pool_start = arena->bump_end;
+
+    result = nrc_port_mutex_init(&arena->bump_lock);
+    next = arena->pool_start;
+
+    for (size_class = 0; (size_class < NRC_ARENA_CLASSES) && (result == NRC_PORT_RES_OK); size_class++) {
+        pool = &arena->pool[size_class];
+        pool->block_size = nrc_arena_class_size(size_class);
+        pool->start = next;
+
+        // Blocks are listed in address order, the first alloc takes the lowest
+        for (i = plan->block_count[size_class]; i > 0; i--) {
+            block = (struct nrc_arena_block*)(next + ((i - 1) * pool->block_size));
+            block->next = pool->free;
+            pool->free = block;
+        }
+        pool->free_count = plan->block_count[size_class];
+        next += (u64_t)plan->block_count[size_class] * pool->block_size;
+        pool->end = next;
+
+        if (pool->free_count != 0) {
+            result = nrc_port_mutex_init(&pool->lock);
+        }
+    }
+
+    return result;
+}
+
+void nrc_arena_deinit(struct nrc_arena *arena)
+{
+    u32_t size_class;
+
+    if (arena->bump_lock != 0) {
+        nrc_port_mutex_deinit(arena->bump_lock);
+    }
+    for (size_class = 0; size_class < NRC_ARENA_CLASSES; size_class++) {
+        if (arena->pool[size_class].lock != 0) {
+            nrc_port_mutex_deinit(arena->pool[size_class].lock);
+        }
+    }
+
+    memset(arena, 0, sizeof(struct nrc_arena));
+}
+
+void* nrc_arena_bump(struct nrc_arena *arena, u32_t size)
+{
+    void    *buf = 0;
+    u64_t   aligned = NRC_ARENA_ALIGN_UP((u64_t)size);
+
+    nrc_port_mutex_lock(arena->bump_lock, 0);
+    if (aligned <= (u64_t)(arena->bump_end - arena->bump)) {
+        buf = arena->bump;
+        arena->bump += aligned;
+    }
+    nrc_port_mutex_unlock(arena->bump_lock);
+
+    return buf;
+}
+
+void* nrc_arena_alloc(struct nrc_arena *arena, u32_t size)
+{
+    struct nrc_arena_block  *block = 0;
+    struct nrc_arena_pool   *pool;
+    u32_t                   size_class = nrc_arena_class(size);
+    u32_t                   first = size_class;
+
+    // A used up class borrows from the next larger one that has blocks
+    for (; (block == 0) && (size_class < NRC_ARENA_CLASSES); size_class++) {
+        pool = &arena->pool[size_class];
+
+        if (pool->start != pool->end) {
+            nrc_port_mutex_lock(pool->lock, 0);
+            block = pool->free;
+            if (block != 0) {
+                pool->free = block->next;
+                pool->free_count--;
+                pool->alloc_count++;
+            }
+            nrc_port_mutex_unlock(pool->lock);
+        }
+    }
+
+    if ((block == 0) && (first < NRC_ARENA_CLASSES)) {
+        pool = &arena->pool[first];
+        if (pool->start != pool->end) {
+            nrc_port_mutex_lock(pool->lock, 0);
+            pool->failed_count++;
+            nrc_port_mutex_unlock(pool->lock);
+        }
+    }
+
+    return block;
+}
+
+void nrc_arena_free(struct nrc_arena *arena, void *buf)
+{
+    struct nrc_arena_block  *block = (struct nrc_arena_block*)buf;
+    struct nrc_arena_pool   *pool;
+    u32_t                   size_class;
+
+    for (size_class = 0; size_class < NRC_ARENA_CLASSES; size_class++) {
+        pool = &arena->pool[size_class];
+
+        if (((u8_t*)buf >= pool->start) && ((u8_t*)buf < pool->end)) {
+            nrc_port_mutex_lock(pool->lock, 0);
+            block->next = pool->free;
+            pool->free = block;
+            pool->free_count++;
+            pool->free_total++;
+            nrc_port_mutex_unlock(pool->lock);
+            break;
+        }
+    }
+}
+
+bool_t nrc_arena_owns(const struct nrc_arena *arena, const void *buf)
+{
+    return (arena->base != 0) && ((const u8_t*)buf >= arena->pool_start) &&
+           ((const u8_t*)buf < arena->pool[NRC_ARENA_CLASSES - 1].end);
+}
+
+s32_t nrc_arena_stats(struct nrc_arena *arena, u32_t size_class, struct nrc_port_heap_stats *stats)
+{
+    s32_t                   result = NRC_PORT_RES_INVALID_IN_PARAM;
+    struct nrc_arena_pool   *pool;
+
+    if ((stats != 0) && (size_class < NRC_ARENA_CLASSES)) {
+        pool = &arena->pool[size_class];
+
+        memset(stats, 0, sizeof(struct nrc_port_heap_stats));
+        stats->block_size = nrc_arena_class_size(size_class);
+
+        if (pool->start != pool->end) {
+            nrc_port_mutex_lock(pool->lock, 0);
+            stats->alloc_count = pool->alloc_count;
+            stats->free_count = pool->free_total;
+            stats->failed_count = pool->failed_count;
+            stats->in_use_bytes = (u64_t)((u32_t)((pool->end - pool->start) / pool->block_size) - pool->free_count) *
+                                  pool->block_size;
+            nrc_port_mutex_unlock(pool->lock);
+        }
+        result = NRC_PORT_RES_OK;
+    }
+    else if (stats != 0) {
+        result = NRC_PORT_RES_NOT_FOUND;
+    }
+
+    return result;
+}
@@ -0,0 +1,1642 @@
+/**
+ * Copyright 2017 Tomas Frisberg & Ola Bjorsne
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http ://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "nrc_cfg.h"
+#include "nrc_cfg_image.h"
+#include "nrc_port.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NRC_CFG_MAX_DEPTH       (32)
+#define NRC_CFG_MIN_TOKENS      (256)
+#define NRC_CFG_MIN_SLOTS       (64)
+
+// Token 0 is the root value, it is never a member, element or node so 0 marks "none"
+#define NRC_CFG_NONE            (0)
+#define NRC_CFG_INVALID         (U32_MAX_VALUE)
+
+enum nrc_cfg_state {
+    NRC_CFG_S_INVALID = 0,
+    NRC_CFG_S_INITIALIZED
+};
+
+// One JSON value. Names, strings and numbers are slices of the config text.
+struct nrc_cfg_token {
+    u32_t   name_offset;    // Member name, only when the parent is an object
+    u32_t   offset;         // Value text, strings without the quotes
+    u32_t   len;
+    u32_t   child;          // First element or member
+    u32_t   next;           // Next element or member of the parent
+    u16_t   name_len;
+    u8_t    kind;
+    u8_t    escaped;        // String contains escape sequences
+};
+
+// A flow node, an object with string members id and type
+struct nrc_cfg_node {
+    u32_t   token;
+    u32_t   id;
+    u32_t   type;
+};
+
+struct nrc_cfg_slot {
+    u32_t   hash;
+    u32_t   node;           // Index in node array
+    u32_t   token;          // Node object or param token, NRC_CFG_NONE when slot is empty
+};
+
+struct nrc_cfg_table {
+    u32_t               mask;
+    struct nrc_cfg_slot *slot;
+};
+
+struct nrc_cfg_parser {
+    const s8_t              *text;
+    u32_t                   text_len;
+    u32_t                   pos;
+    struct nrc_cfg_token    *token;
+    u32_t                   count;
+    u32_t                   size;
+};
+
+struct nrc_cfg {
+    enum nrc_cfg_state      state;
+
+    const s8_t              *text;
+    u32_t                   text_len;
+    const u8_t              *mapped;    // Set when the config is a file mapped by nrc_cfg_init_file
+    u32_t                   mapped_size;
+
+    const struct nrc_cfg_image_hdr *image;  // Set when the config is a binary image, nothing is indexed
+
+    struct nrc_cfg_token    *token;
+    u32_t                   token_count;
+
+    struct nrc_cfg_node     *node;
+    u32_t                   node_count;
+
+    struct nrc_cfg_table    node_table; // By id
+    struct nrc_cfg_table    param_table;// By node and param name
+};
+
+static struct nrc_cfg _cfg;
+
+static u32_t nrc_cfg_parse_value(struct nrc_cfg_parser *parser, u32_t depth);
+
+static u32_t nrc_cfg_hash(u32_t hash, const s8_t *str, u32_t len)
+{
+    u32_t i;
+
+    // FNV-1a
+    for (i = 0; i < len; i++) {
+        hash = (hash ^ (u8_t)str[i]) * 16777619U;
+    }
+
+    return hash;
+}
+
+static u32_t nrc_cfg_param_hash(u32_t node, const s8_t *name, u32_t len)
+{
+    return nrc_cfg_hash(2166136261U ^ (node * 2654435761U), name, len);
+}
+
+static bool_t nrc_cfg_slice_equal(const s8_t *slice, u32_t len, const s8_t *str)
+{
+    return ((strncmp((const char*)slice, (const char*)str, len) == 0) && (str[len] == 0)) ? TRUE : FALSE;
+}
+
+static void nrc_cfg_skip_space(struct nrc_cfg_parser *parser)
+{
+    s8_t c;
+
+    while (parser->pos < parser->text_len) {
+        c = parser->text[parser->pos];
+        if ((c != ' ') && (c != '\t') && (c != '\n') && (c != '\r')) {
+            break;
+        }
+        parser->pos++;
+    }
+}
+
+static u32_t nrc_cfg_new_token(struct nrc_cfg_parser *parser)
+{
+    struct nrc_cfg_token    *token;
+    u32_t                   index = NRC_CFG_INVALID;
+
+    if (parser->count == parser->size) {
+        token = (struct nrc_cfg_token*)nrc_port_heap_alloc(2 * parser->size * sizeof(struct nrc_cfg_token));
+        if (token != 0) {
+            memcpy(token, parser->token, parser->count * sizeof(struct nrc_cfg_token));
+            nrc_port_heap_free(parser->token);
+            parser->token = token;
+            parser->size *= 2;
+        }
+    }
+
+    if (parser->count < parser->size) {
+        index = parser->count++;
+        memset(&parser->token[index], 0, sizeof(struct nrc_cfg_token));
+    }
+
+    return index;
+}
+
+// Scans a string starting at the opening quote, gives the slice between the quotes
+static s32_t nrc_cfg_scan_string(struct nrc_cfg_parser *parser, u32_t *offset, u32_t *len, u8_t *escaped)
+{
+    s32_t result = NRC_PORT_RES_ERROR;
+    s8_t  c;
+
+    *escaped = 0;
+    *offset = ++parser->pos;
+
+    while (parser->pos < parser->text_len) {
+        c = parser->text[parser->pos];
+        if (c == '"') {
+            *len = parser->pos - *offset;
+            parser->pos++;
+            result = NRC_PORT_RES_OK;
+            break;
+        }
+        if (c == '\\') {
+            *escaped = 1;
+            parser->pos++;
+        }
+        parser->pos++;
+    }
+
+    return result;
+}
+
+static s32_t nrc_cfg_scan_literal(struct nrc_cfg_parser *parser, const s8_t *literal, u32_t len)
+{
+    s32_t result = NRC_PORT_RES_ERROR;
+
+    if ((parser->text_len - parser->pos >= len) &&
+        (memcmp(&parser->text[parser->pos], literal, len) == 0)) {
+        parser->pos += len;
+        result = NRC_PORT_RES_OK;
+    }
+
+    return result;
+}
+
+static s32_t nrc_cfg_scan_number(struct nrc_cfg_parser *parser)
+{
+    s32_t result = NRC_PORT_RES_ERROR;
+    u32_t start = parser->pos;
+    s8_t  c;
+
+    while (parser->pos < parser->text_len) {
+        c = parser->text[parser->pos];
+        if (((c < '0') || (c > '9')) && (c != '-') && (c != '+') && (c != '.') && (c != 'e') && (c != 'E')) {
+            break;
+        }
+        parser->pos++;
+    }
+    if (parser->pos > start) {
+        result = NRC_PORT_RES_OK;
+    }
+
+    return result;
+}
+
+// Parses the members of an object or the elements of an array, the parser is at the opening bracket
+static s32_t nrc_cfg_parse_children(struct nrc_cfg_parser *parser, u32_t index, u32_t depth)
+{
+    s32_t   result = NRC_PORT_RES_OK;
+    bool_t  object = (parser->token[index].kind == NRC_CFG_K_OBJECT) ? TRUE : FALSE;
+    s8_t    close = (object == TRUE) ? '}' : ']';
+    u32_t   last = NRC_CFG_NONE;
+    u32_t   child;
+    u32_t   name_offset = 0;
+    u32_t   name_len = 0;
+    u8_t    escaped;
+
+    parser->pos++;
+    nrc_cfg_skip_space(parser);
+
+    if ((parser->pos < parser->text_len) && (parser->text[parser->pos] == close)) {
+        parser->pos++;
+        return result;
+    }
+
+    while (result == NRC_PORT_RES_OK) {
+        if (object == TRUE) {
+            nrc_cfg_skip_space(parser);
+            result = NRC_PORT_RES_ERROR;
+            if ((parser->pos < parser->text_len) && (parser->text[parser->pos] == '"') &&
+                (nrc_cfg_scan_string(parser, &name_offset, &name_len, &escaped) == NRC_PORT_RES_OK) &&
+                (name_len <= 0xFFFF)) {
+                nrc_cfg_skip_space(parser);
+                if ((parser->pos < parser->text_len) && (parser->text[parser->pos] == ':')) {
+                    parser->pos++;
+                    result = NRC_PORT_RES_OK;
+                }
+            }
+            if (result != NRC_PORT_RES_OK) {
+                break;
+            }
+        }
+
+        child = nrc_cfg_parse_value(parser, depth + 1);
+        if (child == NRC_CFG_INVALID) {
+            result = NRC_PORT_RES_ERROR;
+            break;
+        }
+
+        // Tokens may have moved when the array grew, only indexes are kept
+        parser->token[child].name_offset = name_offset;
+        parser->token[child].name_len = (u16_t)name_len;
+        if (last == NRC_CFG_NONE) {
+            parser->token[index].child = child;
+        }
+        else {
+            parser->token[last].next = child;
+        }
+        last = child;
+
+        nrc_cfg_skip_space(parser);
+        if (parser->pos >= parser->text_len) {
+            result = NRC_PORT_RES_ERROR;
+        }
+        else if (parser->text[parser->pos] == ',') {
+            parser->pos++;
+        }
+        else if (parser->text[parser->pos] == close) {
+            parser->pos++;
+            break;
+        }
+        else {
+            result = NRC_PORT_RES_ERROR;
+        }
+    }
+
+    return result;
+}
+
+static u32_t nrc_cfg_parse_value(struct nrc_cfg_parser *parser, u32_t depth)
+{
+    s32_t   result = NRC_PORT_RES_ERROR;
+    u32_t   index;
+    u32_t   offset;
+    u32_t   len;
+    u8_t    escaped;
+    s8_t    c;
+
+    nrc_cfg_skip_space(parser);
+
+    if ((depth > NRC_CFG_MAX_DEPTH) || (parser->pos >= parser->text_len)) {
+        return NRC_CFG_INVALID;
+    }
+
+    index = nrc_cfg_new_token(parser);
+    if (index == NRC_CFG_INVALID) {
+        return NRC_CFG_INVALID;
+    }
+
+    c = parser->text[parser->pos];
+    offset = parser->pos;
+
+    switch (c) {
+    case '{':
+        parser->token[index].kind = NRC_CFG_K_OBJECT;
+        result = nrc_cfg_parse_children(parser, index, depth);
+        break;
+    case '[':
+        parser->token[index].kind = NRC_CFG_K_ARRAY;
+        result = nrc_cfg_parse_children(parser, index, depth);
+        break;
+    case '"':
+        result = nrc_cfg_scan_string(parser, &offset, &len, &escaped);
+        parser->token[index].kind = NRC_CFG_K_STRING;
+        parser->token[index].escaped = escaped;
+        break;
+    case 't':
+        result = nrc_cfg_scan_literal(parser, "true", 4);
+        parser->token[index].kind = NRC_CFG_K_TRUE;
+        break;
+    case 'f':
+        result = nrc_cfg_scan_literal(parser, "false", 5);
+        parser->token[index].kind = NRC_CFG_K_FALSE;
+        break;
+    case 'n':
+        result = nrc_cfg_scan_literal(parser, "null", 4);
+        parser->token[index].kind = NRC_CFG_K_NULL;
+        break;
+    default:
+        result = nrc_cfg_scan_number(parser);
+        parser->token[index].kind = NRC_CFG_K_NUMBER;
+        break;
+    }
+
+    if (result != NRC_PORT_RES_OK) {
+        return NRC_CFG_INVALID;
+    }
+
+    if ((c != '"') && (c != '{') && (c != '[')) {
+        len = parser->pos - offset;
+    }
+    else if (c != '"') {
+        len = 0;
+    }
+    parser->token[index].offset = offset;
+    parser->token[index].len = len;
+
+    return index;
+}
+
+// Member of an object token, NRC_CFG_NONE if not found
+static u32_t nrc_cfg_find_member(const struct nrc_cfg_token *token, u32_t object, const s8_t *name)
+{
+    u32_t member;
+
+    for (member = token[object].child; member != NRC_CFG_NONE; member = token[member].next) {
+        if (nrc_cfg_slice_equal(&_cfg.text[token[member].name_offset], token[member].name_len, name) == TRUE) {
+            break;
+        }
+    }
+
+    return member;
+}
+
+static s32_t nrc_cfg_table_alloc(struct nrc_cfg_table *table, u32_t count)
+{
+    s32_t result = NRC_PORT_RES_ERROR;
+    u32_t slots = NRC_CFG_MIN_SLOTS;
+
+    // At most half full
+    while (slots < 2 * count) {
+        slots *= 2;
+    }
+
+    table->slot = (struct nrc_cfg_slot*)nrc_port_heap_alloc(slots * sizeof(struct nrc_cfg_slot));
+    if (table->slot != 0) {
+        memset(table->slot, 0, slots * sizeof(struct nrc_cfg_slot));
+        table->mask = slots - 1;
+        result = NRC_PORT_RES_OK;
+    }
+
+    return result;
+}
+
+static void nrc_cfg_table_insert(struct nrc_cfg_table *table, u32_t hash, u32_t node, u32_t token)
+{
+    u32_t index = hash & table->mask;
+
+    while (table->slot[index].token != NRC_CFG_NONE) {
+        index = (index + 1) & table->mask;
+    }
+
+    table->slot[index].hash = hash;
+    table->slot[index].node = node;
+    table->slot[index].token = token;
+}
+
+// Indexes the flow nodes and their params, the first node with an id wins
+static s32_t nrc_cfg_build_index(u32_t flows)
+{
+    s32_t                   result = NRC_PORT_RES_ERROR;
+    struct nrc_cfg_token    *token = _cfg.token;
+    u32_t                   param_count = 0;
+    u32_t                   element_count = 0;
+    u32_t                   element;
+    u32_t                   member;
+    u32_t                   id;
+    u32_t                   type;
+    u32_t                   i;
+
+    for (element = token[flows].child; element != NRC_CFG_NONE; element = token[element].next) {
+        element_count++;
+    }
+
+    _cfg.node = (struct nrc_cfg_node*)nrc_port_heap_alloc((element_count + 1) * sizeof(struct nrc_cfg_node));
+    if (_cfg.node == 0) {
+        return result;
+    }
+
+    for (element = token[flows].child; element != NRC_CFG_NONE; element = token[element].next) {
+        if (token[element].kind == NRC_CFG_K_OBJECT) {
+            id = nrc_cfg_find_member(token, element, "id");
+            type = nrc_cfg_find_member(token, element, "type");
+
+            if ((id != NRC_CFG_NONE) && (token[id].kind == NRC_CFG_K_STRING) &&
+                (type != NRC_CFG_NONE) && (token[type].kind == NRC_CFG_K_STRING)) {
+                _cfg.node[_cfg.node_count].token = element;
+                _cfg.node[_cfg.node_count].id = id;
+                _cfg.node[_cfg.node_count].type = type;
+                _cfg.node_count++;
+
+                for (member = token[element].child; member != NRC_CFG_NONE; member = token[member].next) {
+                    param_count++;
+                }
+            }
+        }
+    }
+
+    if ((nrc_cfg_table_alloc(&_cfg.node_table, _cfg.node_count) == NRC_PORT_RES_OK) &&
+        (nrc_cfg_table_alloc(&_cfg.param_table, param_count) == NRC_PORT_RES_OK)) {
+
+        for (i = 0; i < _cfg.node_count; i++) {
+            id = _cfg.node[i].id;
+            nrc_cfg_table_insert(&_cfg.node_table,
+                nrc_cfg_hash(2166136261U, &_cfg.text[token[id].offset], token[id].len), i, _cfg.node[i].token);
+
+            for (member = token[_cfg.node[i].token].child; member != NRC_CFG_NONE; member = token[member].next) {
+                nrc_cfg_table_insert(&_cfg.param_table,
+                    nrc_cfg_param_hash(i, &_cfg.text[token[member].name_offset], token[member].name_len), i, member);
+            }
+        }
+        result = NRC_PORT_RES_OK;
+    }
+
+    return result;
+}
+
+static s32_t nrc_cfg_load(const s8_t *text, u32_t text_len)
+{
+    s32_t                   result = NRC_PORT_RES_ERROR;
+    struct nrc_cfg_parser   parser;
+    u32_t                   root;
+    u32_t                   flows;
+
+    memset(&parser, 0, sizeof(struct nrc_cfg_parser));
+    parser.text = text;
+    parser.text_len = text_len;
+    parser.size = NRC_CFG_MIN_TOKENS;
+    parser.token = (struct nrc_cfg_token*)nrc_port_heap_alloc(parser.size * sizeof(struct nrc_cfg_token));
+
+    _cfg.text = text;
+    _cfg.text_len = text_len;
+
+    if (parser.token != 0) {
+        root = nrc_cfg_parse_value(&parser, 0);
+
+        _cfg.token = parser.token;
+        _cfg.token_count = parser.count;
+
+        if (root != NRC_CFG_INVALID) {
+            // A flows file is an array of nodes, the flows api wraps it in an object
+            flows = root;
+            if (parser.token[root].kind == NRC_CFG_K_OBJECT) {
+                flows = nrc_cfg_find_member(parser.token, root, "flows");
+                if (flows == NRC_CFG_NONE) {
+                    flows = NRC_CFG_INVALID;
+                }
+            }
+            if ((flows != NRC_CFG_INVALID) && (parser.token[flows].kind == NRC_CFG_K_ARRAY)) {
+                result = nrc_cfg_build_index(flows);
+            }
+        }
+    }
+
+    if (result == NRC_PORT_RES_OK) {
+        _cfg.state = NRC_CFG_S_INITIALIZED;
+    }
+    else {
+        nrc_cfg_deinit();
+    }
+
+    return result;
+}
+
+static u32_t nrc_cfg_checksum(const u32_t *word, u32_t count)
+{
+    u32_t hash = 2166136261U;
+    u32_t i;
+
+    // FNV-1a a word at a time, the image may be large
+    for (i = 0; i < count; i++) {
+        hash = (hash ^ word[i]) * 16777619U;
+    }
+
+    return hash;
+}
+
+// Checks an image in place, max_size is U32_MAX_VALUE when the size is only known from the header
+static s32_t nrc_cfg_load_image(const u8_t *data, u32_t max_size)
+{
+    s32_t                           result = NRC_PORT_RES_ERROR;
+    const struct nrc_cfg_image_hdr  *hdr = (const struct nrc_cfg_image_hdr*)data;
+    u64_t                           end;
+
+    if ((hdr->version == NRC_CFG_IMAGE_VERSION) &&
+        (hdr->header_size == sizeof(struct nrc_cfg_image_hdr)) &&
+        (hdr->image_size <= max_size) &&
+        ((hdr->image_size % sizeof(u32_t)) == 0)) {
+
+        end = (u64_t)hdr->string_offset + hdr->string_size;
+
+        if ((hdr->node_offset + ((u64_t)hdr->node_count * sizeof(struct nrc_cfg_image_node)) <= hdr->order_offset) &&
+            (hdr->order_offset + ((u64_t)hdr->node_count * sizeof(u32_t)) <= hdr->value_offset) &&
+            (hdr->value_offset + ((u64_t)hdr->value_count * sizeof(struct nrc_cfg_image_value)) <= hdr->string_offset) &&
+            (hdr->node_offset >= hdr->header_size) &&
+            (hdr->string_size > 0) && (end <= hdr->image_size) &&
+            (data[end - 1] == 0) &&
+            (nrc_cfg_checksum((const u32_t*)(data + hdr->header_size),
+                (hdr->image_size - hdr->header_size) / sizeof(u32_t)) == hdr->checksum)) {
+
+            _cfg.image = hdr;
+            _cfg.node_count = hdr->node_count;
+            _cfg.state = NRC_CFG_S_INITIALIZED;
+            result = NRC_PORT_RES_OK;
+        }
+    }
+
+    if (result != NRC_PORT_RES_OK) {
+        nrc_cfg_deinit();
+    }
+
+    return result;
+}
+
+s32_t nrc_cfg_init(u32_t *cfg_address)
+{
+    s32_t result = NRC_PORT_RES_INVALID_IN_PARAM;
+
+    if (cfg_address != 0) {
+        nrc_cfg_deinit();
+
+        if (*cfg_address == NRC_CFG_IMAGE_MAGIC) {
+            result = nrc_cfg_load_image((const u8_t*)cfg_address, U32_MAX_VALUE);
+        }
+        else {
+            result = nrc_cfg_load((const s8_t*)cfg_address, (u32_t)strlen((const char*)cfg_address));
+        }
+    }
+
+    return result;
+}
+
+s32_t nrc_cfg_init_file(const s8_t *path)
+{
+    s32_t       result;
+    const u8_t  *data;
+    u32_t       size;
+
+    nrc_cfg_deinit();
+
+    result = nrc_port_file_map(path, &data, &size);
+
+    if (result == NRC_PORT_RES_OK) {
+        _cfg.mapped = data;
+        _cfg.mapped_size = size;
+
+        if ((size >= sizeof(struct nrc_cfg_image_hdr)) && (*(const u32_t*)data == NRC_CFG_IMAGE_MAGIC)) {
+            result = nrc_cfg_load_image(data, size);
+        }
+        else {
+            result = nrc_cfg_load((const s8_t*)data, size);
+        }
+    }
+
+    return result;
+}
+
+s32_t nrc_cfg_deinit(void)
+{
+    if (_cfg.token != 0) {
+        nrc_port_heap_free(_cfg.token);
+    }
+    if (_cfg.node != 0) {
+        nrc_port_heap_free(_cfg.node);
+    }
+    if (_cfg.node_table.slot != 0) {
+        nrc_port_heap_free(_cfg.node_table.slot);
+    }
+    if (_cfg.param_table.slot != 0) {
+        nrc_port_heap_free(_cfg.param_table.slot);
+    }
+    if (_cfg.mapped != 0) {
+        nrc_port_file_unmap(_cfg.mapped, _cfg.mapped_size);
+    }
+
+    memset(&_cfg, 0, sizeof(struct nrc_cfg));
+
+    return NRC_PORT_RES_OK;
+}
+
+// Index of the node with the id and, when given, type. NRC_CFG_INVALID if not found.
+static u32_t nrc_cfg_find_node(const s8_t *cfg_type, const s8_t *cfg_id)
+{
+    struct nrc_cfg_token    *token = _cfg.token;
+    struct nrc_cfg_slot     *slot;
+    u32_t                   node = NRC_CFG_INVALID;
+    u32_t                   hash;
+    u32_t                   index;
+    u32_t                   id;
+    u32_t                   type;
+
+    if ((_cfg.state == NRC_CFG_S_INITIALIZED) && (cfg_id != 0)) {
+        hash = nrc_cfg_hash(2166136261U, cfg_id, (u32_t)strlen((const char*)cfg_id));
+
+        for (index = hash & _cfg.node_table.mask; ; index = (index + 1) & _cfg.node_table.mask) {
+            slot = &_cfg.node_table.slot[index];
+            if (slot->token == NRC_CFG_NONE) {
+                break;
+            }
+            id = _cfg.node[slot->node].id;
+            if ((slot->hash == hash) &&
+                (nrc_cfg_slice_equal(&_cfg.text[token[id].offset], token[id].len, cfg_id) == TRUE)) {
+                node = slot->node;
+                break;
+            }
+        }
+
+        if ((node != NRC_CFG_INVALID) && (cfg_type != 0)) {
+            type = _cfg.node[node].type;
+            if (nrc_cfg_slice_equal(&_cfg.text[token[type].offset], token[type].len, cfg_type) == FALSE) {
+                node = NRC_CFG_INVALID;
+            }
+        }
+    }
+
+    return node;
+}
+
+// Param token of a node, NRC_CFG_NONE if not found
+static u32_t nrc_cfg_find_param(const s8_t *cfg_type, const s8_t *cfg_id, const s8_t *cfg_param_name)
+{
+    struct nrc_cfg_token    *token = _cfg.token;
+    struct nrc_cfg_slot     *slot;
+    u32_t                   param = NRC_CFG_NONE;
+    u32_t                   node;
+    u32_t                   hash;
+    u32_t                   index;
+
+    node = nrc_cfg_find_node(cfg_type, cfg_id);
+
+    if ((node != NRC_CFG_INVALID) && (cfg_param_name != 0)) {
+        hash = nrc_cfg_param_hash(node, cfg_param_name, (u32_t)strlen((const char*)cfg_param_name));
+
+        for (index = hash & _cfg.param_table.mask; ; index = (index + 1) & _cfg.param_table.mask) {
+            slot = &_cfg.param_table.slot[index];
+            if (slot->token == NRC_CFG_NONE) {
+                break;
+            }
+            if ((slot->hash == hash) && (slot->node == node) &&
+                (nrc_cfg_slice_equal(&_cfg.text[token[slot->token].name_offset],
+                    token[slot->token].name_len, cfg_param_name) == TRUE)) {
+                param = slot->token;
+                break;
+            }
+        }
+    }
+
+    return param;
+}
+
+static u32_t nrc_cfg_find_element(u32_t array, u8_t index)
+{
+    u32_t element = NRC_CFG_NONE;
+    u32_t i;
+
+    if ((array != NRC_CFG_NONE) && (_cfg.token[array].kind == NRC_CFG_K_ARRAY)) {
+        element = _cfg.token[array].child;
+        for (i = 0; (i < index) && (element != NRC_CFG_NONE); i++) {
+            element = _cfg.token[element].next;
+        }
+    }
+
+    return element;
+}
+
+static const s8_t* nrc_cfg_image_str(u32_t offset)
+{
+    return (const s8_t*)_cfg.image + _cfg.image->string_offset + offset;
+}
+
+static const struct nrc_cfg_image_node* nrc_cfg_image_node(u32_t index)
+{
+    return (const struct nrc_cfg_image_node*)((const u8_t*)_cfg.image + _cfg.image->node_offset) + index;
+}
+
+static const struct nrc_cfg_image_value* nrc_cfg_image_value(u32_t index)
+{
+    return (const struct nrc_cfg_image_value*)((const u8_t*)_cfg.image + _cfg.image->value_offset) + index;
+}
+
+// Binary search of the sorted node table, the first of equal ids wins like in flows.json
+static const struct nrc_cfg_image_node* nrc_cfg_image_find_node(const s8_t *cfg_type, const s8_t *cfg_id)
+{
+    const struct nrc_cfg_image_node     *node = 0;
+    u32_t                               low = 0;
+    u32_t                               high;
+    u32_t                               mid;
+
+    if ((_cfg.state != NRC_CFG_S_INITIALIZED) || (cfg_id == 0)) {
+        return node;
+    }
+
+    high = _cfg.image->node_count;
+    while (low < high) {
+        mid = low + ((high - low) / 2);
+        if (strcmp((const char*)nrc_cfg_image_str(nrc_cfg_image_node(mid)->id), (const char*)cfg_id) < 0) {
+            low = mid + 1;
+        }
+        else {
+            high = mid;
+        }
+    }
+
+    if ((low < _cfg.image->node_count) &&
+        (strcmp((const char*)nrc_cfg_image_str(nrc_cfg_image_node(low)->id), (const char*)cfg_id) == 0)) {
+        node = nrc_cfg_image_node(low);
+
+        if ((cfg_type != 0) && (strcmp((const char*)nrc_cfg_image_str(node->type), (const char*)cfg_type) != 0)) {
+            node = 0;
+        }
+    }
+
+    return node;
+}
+
+// Binary search of the node's sorted params, the first of equal names wins
+static const struct nrc_cfg_image_value* nrc_cfg_image_find_param(const s8_t *cfg_type, const s8_t *cfg_id, const s8_t *cfg_param_name)
+{
+    const struct nrc_cfg_image_value    *param = 0;
+    const struct nrc_cfg_image_node     *node = 0;
+    u32_t                               low;
+    u32_t                               high;
+    u32_t                               mid;
+
+    if (cfg_param_name != 0) {
+        node = nrc_cfg_image_find_node(cfg_type, cfg_id);
+    }
+
+    if (node != 0) {
+        low = node->first;
+        high = node->first + node->count;
+        while (low < high) {
+            mid = low + ((high - low) / 2);
+            if (strcmp((const char*)nrc_cfg_image_str(nrc_cfg_image_value(mid)->name), (const char*)cfg_param_name) < 0) {
+                low = mid + 1;
+            }
+            else {
+                high = mid;
+            }
+        }
+
+        if ((low < node->first + node->count) &&
+            (strcmp((const char*)nrc_cfg_image_str(nrc_cfg_image_value(low)->name), (const char*)cfg_param_name) == 0)) {
+            param = nrc_cfg_image_value(low);
+        }
+    }
+
+    return param;
+}
+
+static const struct nrc_cfg_image_value* nrc_cfg_image_find_element(const struct nrc_cfg_image_value *array, u8_t index)
+{
+    const struct nrc_cfg_image_value *element = 0;
+
+    if ((array != 0) && (array->kind == NRC_CFG_K_ARRAY) && (index < array->count)) {
+        element = nrc_cfg_image_value(array->data + index);
+    }
+
+    return element;
+}
+
+static u32_t nrc_cfg_hex(s8_t c)
+{
+    u32_t value = U32_MAX_VALUE;
+
+    if ((c >= '0') && (c <= '9')) {
+        value = (u32_t)(c - '0');
+    }
+    else if ((c >= 'a') && (c <= 'f')) {
+        value = (u32_t)(c - 'a' + 10);
+    }
+    else if ((c >= 'A') && (c <= 'F')) {
+        value = (u32_t)(c - 'A' + 10);
+    }
+
+    return value;
+}
+
+// Copies a string slice out of the config text, escape sequences are decoded to UTF-8
+static s32_t nrc_cfg_decode(const s8_t *src, u32_t len, bool_t escaped, s8_t *str, u32_t max_str_len, u32_t *str_len)
+{
+    s32_t       result = NRC_PORT_RES_INVALID_IN_PARAM;
+    u32_t       i;
+    u32_t       n = 0;
+    u32_t       code;
+    u32_t       digit;
+    u32_t       j;
+    s8_t        c;
+
+    if ((str == 0) || (max_str_len == 0)) {
+        return result;
+    }
+
+    if (escaped == FALSE) {
+        if (len < max_str_len) {
+            memcpy(str, src, len);
+            n = len;
+            result = NRC_PORT_RES_OK;
+        }
+    }
+    else {
+        result = NRC_PORT_RES_OK;
+
+        for (i = 0; (i < len) && (result == NRC_PORT_RES_OK); i++) {
+            c = src[i];
+            code = (u8_t)c;
+
+            if ((c == '\\') && (i + 1 < len)) {
+                c = src[++i];
+                switch (c) {
+                case 'b': code = '\b'; break;
+                case 'f': code = '\f'; break;
+                case 'n': code = '\n'; break;
+                case 'r': code = '\r'; break;
+                case 't': code = '\t'; break;
+                case 'u':
+                    code = 0;
+                    for (j = 0; (j < 4) && (result == NRC_PORT_RES_OK); j++) {
+                        digit = (i + 1 < len) ? nrc_cfg_hex(src[++i]) : U32_MAX_VALUE;
+                        if (digit == U32_MAX_VALUE) {
+                            result = NRC_PORT_RES_ERROR;
+                        }
+                        code = (code << 4) | digit;
+                    }
+                    break;
+                default: code = (u8_t)c; break;
+                }
+            }
+
+            if (result != NRC_PORT_RES_OK) {
+                break;
+            }
+
+            // Surrogate pairs are not combined, each half is encoded on its own
+            if (code < 0x80) {
+                if (n + 1 >= max_str_len) {
+                    result = NRC_PORT_RES_INVALID_IN_PARAM;
+                    break;
+                }
+                str[n++] = (s8_t)code;
+            }
+            else if ((code < 0x800) && (c == 'u')) {
+                if (n + 2 >= max_str_len) {
+                    result = NRC_PORT_RES_INVALID_IN_PARAM;
+                    break;
+                }
+                str[n++] = (s8_t)(0xC0 | (code >> 6));
+                str[n++] = (s8_t)(0x80 | (code & 0x3F));
+            }
+            else if (c == 'u') {
+                if (n + 3 >= max_str_len) {
+                    result = NRC_PORT_RES_INVALID_IN_PARAM;
+                    break;
+                }
+                str[n++] = (s8_t)(0xE0 | (code >> 12));
+                str[n++] = (s8_t)(0x80 | ((code >> 6) & 0x3F));
+                str[n++] = (s8_t)(0x80 | (code & 0x3F));
+            }
+            else {
+                // Raw UTF-8 byte in the text
+                if (n + 1 >= max_str_len) {
+                    result = NRC_PORT_RES_INVALID_IN_PARAM;
+                    break;
+                }
+                str[n++] = (s8_t)code;
+            }
+        }
+    }
+
+    if (result != NRC_PORT_RES_OK) {
+        n = 0;
+    }
+    str[n] = 0;
+
+    if (str_len != 0) {
+        *str_len = n;
+    }
+
+    return result;
+}
+
+static s32_t nrc_cfg_copy_str(u32_t token, s8_t *str, u32_t max_str_len)
+{
+    s32_t result = NRC_PORT_RES_NOT_FOUND;
+
+    if ((token != NRC_CFG_NONE) && (_cfg.token[token].kind == NRC_CFG_K_STRING)) {
+        result = nrc_cfg_decode(&_cfg.text[_cfg.token[token].offset], _cfg.token[token].len,
+            (_cfg.token[token].escaped != 0) ? TRUE : FALSE, str, max_str_len, 0);
+    }
+
+    return result;
+}
+
+static s32_t nrc_cfg_image_copy_str(u32_t offset, u32_t len, s8_t *str, u32_t max_str_len)
+{
+    s32_t result = NRC_PORT_RES_INVALID_IN_PARAM;
+
+    if ((str != 0) && (len < max_str_len)) {
+        memcpy(str, nrc_cfg_image_str(offset), len + 1);
+        result = NRC_PORT_RES_OK;
+    }
+    else if ((str != 0) && (max_str_len > 0)) {
+        str[0] = 0;
+    }
+
+    return result;
+}
+
+// Integer value of a number, a string holding a number (Node-RED stores many numbers as strings) or a boolean
+static s32_t nrc_cfg_parse_int(u32_t kind, const s8_t *src, u32_t len, s32_t *value)
+{
+    s32_t   result = NRC_PORT_RES_ERROR;
+    u32_t   i = 0;
+    s64_t   v = 0;
+    bool_t  negative = FALSE;
+
+    if (value == 0) {
+        return NRC_PORT_RES_INVALID_IN_PARAM;
+    }
+
+    switch (kind) {
+    case NRC_CFG_K_TRUE:
+        *value = 1;
+        result = NRC_PORT_RES_OK;
+        break;
+    case NRC_CFG_K_FALSE:
+        *value = 0;
+        result = NRC_PORT_RES_OK;
+        break;
+    case NRC_CFG_K_NUMBER:
+    case NRC_CFG_K_STRING:
+        if ((len > 0) && ((src[0] == '-') || (src[0] == '+'))) {
+            negative = (src[0] == '-') ? TRUE : FALSE;
+            i++;
+        }
+        if (i < len) {
+            result = NRC_PORT_RES_OK;
+        }
+        for (; (i < len) && (result == NRC_PORT_RES_OK); i++) {
+            if ((src[i] < '0') || (src[i] > '9')) {
+                result = NRC_PORT_RES_ERROR;
+            }
+            else {
+                v = (v * 10) + (src[i] - '0');
+                if (v > ((s64_t)S32_MAX_VALUE + 1)) {
+                    result = NRC_PORT_RES_ERROR;
+                }
+            }
+        }
+        if (negative == TRUE) {
+            v = -v;
+        }
+        if ((result == NRC_PORT_RES_OK) && (v <= S32_MAX_VALUE)) {
+            *value = (s32_t)v;
+        }
+        else {
+            result = NRC_PORT_RES_ERROR;
+        }
+        break;
+    default:
+        break;
+    }
+
+    return result;
+}
+
+static s32_t nrc_cfg_copy_int(u32_t token, s32_t *value)
+{
+    s32_t result = NRC_PORT_RES_NOT_FOUND;
+
+    if (token != NRC_CFG_NONE) {
+        result = nrc_cfg_parse_int(_cfg.token[token].kind,
+            &_cfg.text[_cfg.token[token].offset], _cfg.token[token].len, value);
+    }
+
+    return result;
+}
+
+static s32_t nrc_cfg_image_copy_int(const struct nrc_cfg_image_value *param, s32_t *value)
+{
+    s32_t result = NRC_PORT_RES_NOT_FOUND;
+
+    if (param != 0) {
+        result = nrc_cfg_parse_int(param->kind, nrc_cfg_image_str(param->data), param->count, value);
+    }
+
+    return result;
+}
+
+s32_t nrc_cfg_get_node(u32_t index, s8_t *cfg_type, s8_t *cfg_id, u32_t max_str_len)
+{
+    s32_t                           result = NRC_PORT_RES_NOT_FOUND;
+    const struct nrc_cfg_image_node *node;
+    const u32_t                     *order;
+
+    if ((_cfg.state == NRC_CFG_S_INITIALIZED) && (index < _cfg.node_count)) {
+        if (_cfg.image != 0) {
+            order = (const u32_t*)((const u8_t*)_cfg.image + _cfg.image->order_offset);
+            node = nrc_cfg_image_node(order[index]);
+
+            result = nrc_cfg_image_copy_str(node->type, (u32_t)strlen((const char*)nrc_cfg_image_str(node->type)),
+                cfg_type, max_str_len);
+
+            if (result == NRC_PORT_RES_OK) {
+                result = nrc_cfg_image_copy_str(node->id, (u32_t)strlen((const char*)nrc_cfg_image_str(node->id)),
+                    cfg_id, max_str_len);
+            }
+        }
+        else {
+            result = nrc_cfg_copy_str(_cfg.node[index].type, cfg_type, max_str_len);
+
+            if (result == NRC_PORT_RES_OK) {
+                result = nrc_cfg_copy_str(_cfg.node[index].id, cfg_id, max_str_len);
+            }
+        }
+    }
+
+    return result;
+}
+
+s32_t nrc_cfg_get_str(s8_t *cfg_type, s8_t *cfg_id, s8_t *cfg_param_name, s8_t *str, uint32_t max_str_len)
+{
+    s32_t                               result = NRC_PORT_RES_NOT_FOUND;
+    const struct nrc_cfg_image_value    *param;
+
+    if (_cfg.image != 0) {
+        param = nrc_cfg_image_find_param(cfg_type, cfg_id, cfg_param_name);
+        if ((param != 0) && (param->kind == NRC_CFG_K_STRING)) {
+            result = nrc_cfg_image_copy_str(param->data, param->count, str, max_str_len);
+        }
+    }
+    else {
+        result = nrc_cfg_copy_str(nrc_cfg_find_param(cfg_type, cfg_id, cfg_param_name), str, max_str_len);
+    }
+
+    return result;
+}
+
+s32_t nrc_cfg_get_int(s8_t *cfg_type, s8_t *cfg_id, s8_t *cfg_param_name, s32_t *value)
+{
+    s32_t result;
+
+    if (_cfg.image != 0) {
+        result = nrc_cfg_image_copy_int(nrc_cfg_image_find_param(cfg_type, cfg_id, cfg_param_name), value);
+    }
+    else {
+        result = nrc_cfg_copy_int(nrc_cfg_find_param(cfg_type, cfg_id, cfg_param_name), value);
+    }
+
+    return result;
+}
+
+s32_t nrc_cfg_get_str_from_array(s8_t *cfg_type, s8_t *cfg_id, s8_t *cfg_arr_name, u8_t index, s8_t *str, uint32_t max_str_len)
+{
+    s32_t                               result = NRC_PORT_RES_NOT_FOUND;
+    const struct nrc_cfg_image_value    *element;
+
+    if (_cfg.image != 0) {
+        element = nrc_cfg_image_find_element(nrc_cfg_image_find_param(cfg_type, cfg_id, cfg_arr_name), index);
+        if ((element != 0) && (element->kind == NRC_CFG_K_STRING)) {
+            result = nrc_cfg_image_copy_str(element->data, element->count, str, max_str_len);
+        }
+    }
+    else {
+        result = nrc_cfg_copy_str(nrc_cfg_find_element(nrc_cfg_find_param(cfg_type, cfg_id, cfg_arr_name), index),
+            str, max_str_len);
+    }
+
+    return result;
+}
+
+s32_t nrc_cfg_get_int_from_array(s8_t *cfg_type, s8_t *cfg_id, s8_t *cfg_arr_name, u8_t index, s32_t *value)
+{
+    s32_t result;
+
+    if (_cfg.image != 0) {
+        result = nrc_cfg_image_copy_int(
+            nrc_cfg_image_find_element(nrc_cfg_image_find_param(cfg_type, cfg_id, cfg_arr_name), index), value);
+    }
+    else {
+        result = nrc_cfg_copy_int(nrc_cfg_find_element(nrc_cfg_find_param(cfg_type, cfg_id, cfg_arr_name), index),
+            value);
+    }
+
+    return result;
+}
+
+s32_t nrc_cfg_get_wire(s8_t *cfg_type, s8_t *cfg_id, u8_t port, u8_t index, s8_t *wire_id, uint32_t max_str_len)
+{
+    s32_t                               result = NRC_PORT_RES_NOT_FOUND;
+    const struct nrc_cfg_image_value    *element;
+
+    if (_cfg.image != 0) {
+        element = nrc_cfg_image_find_element(
+            nrc_cfg_image_find_element(nrc_cfg_image_find_param(cfg_type, cfg_id, "wires"), port), index);
+        if ((element != 0) && (element->kind == NRC_CFG_K_STRING)) {
+            result = nrc_cfg_image_copy_str(element->data, element->count, wire_id, max_str_len);
+        }
+    }
+    else {
+        result = nrc_cfg_copy_str(
+            nrc_cfg_find_element(nrc_cfg_find_element(nrc_cfg_find_param(cfg_type, cfg_id, "wires"), port), index),
+            wire_id, max_str_len);
+    }
+
+    return result;
+}
+
+s32_t nrc_cfg_get_wire_count(s8_t *cfg_type, s8_t *cfg_id, u8_t port, u32_t *count)
+{
+    s32_t                               result = NRC_PORT_RES_NOT_FOUND;
+    const struct nrc_cfg_image_value    *array;
+    u32_t                               token;
+
+    if (_cfg.image != 0) {
+        array = nrc_cfg_image_find_element(nrc_cfg_image_find_param(cfg_type, cfg_id, "wires"), port);
+        if ((array != 0) && (array->kind == NRC_CFG_K_ARRAY)) {
+            *count = array->count;
+            result = NRC_PORT_RES_OK;
+        }
+    }
+    else {
+        token = nrc_cfg_find_element(nrc_cfg_find_param(cfg_type, cfg_id, "wires"), port);
+        if ((token != NRC_CFG_NONE) && (_cfg.token[token].kind == NRC_CFG_K_ARRAY)) {
+            *count = 0;
+            for (token = _cfg.token[token].child; token != NRC_CFG_NONE; token = _cfg.token[token].next) {
+                (*count)++;
+            }
+            result = NRC_PORT_RES_OK;
+        }
+    }
+
+    return result;
+}
+
+/**
+ * Node hash. Strings are hashed decoded and members of objects in any order, so a node
+ * hashes the same from a flows.json and from its image.
+ */
+
+#define NRC_CFG_HASH_SEED       (2166136261U)
+#define NRC_CFG_HASH_CHUNK      (256)   // Escaped source decoded at once to hash it
+
+static u32_t nrc_cfg_hash_u32(u32_t hash, u32_t value)
+{
+    return nrc_cfg_hash(hash, (const s8_t*)&value, sizeof(value));
+}
+
+// Editor position and wires do not change what a node does
+static bool_t nrc_cfg_hash_skipped(const s8_t *name, u32_t len)
+{
+    return (nrc_cfg_slice_equal(name, len, "x") || nrc_cfg_slice_equal(name, len, "y") ||
+            nrc_cfg_slice_equal(name, len, "wires")) ? TRUE : FALSE;
+}
+
+// Hash of a string slice of the config text, decoded like nrc_cfg_copy_str. Escaped
+// text is decoded in pieces that end between escapes, FNV-1a goes on byte by byte.
+static u32_t nrc_cfg_hash_text(u32_t hash, const s8_t *src, u32_t len, bool_t escaped)
+{
+    s8_t    str[NRC_CFG_HASH_CHUNK + 1];
+    u32_t   str_len;
+    u32_t   start = hash;
+    u32_t   pos = 0;
+    u32_t   end;
+
+    if (escaped == FALSE) {
+        hash = nrc_cfg_hash(hash, src, len);
+    }
+    else {
+        // Decoded text is never longer than its escaped source
+        while (pos < len) {
+            for (end = pos; (end < len) && ((end - pos) <= (NRC_CFG_HASH_CHUNK - 6)); ) {
+                if (src[end] != '\\') {
+                    end++;
+                }
+                else {
+                    end += ((end + 1 < len) && (src[end + 1] == 'u')) ? 6 : 2;
+                }
+            }
+            if (end > len) {
+                end = len;
+            }
+
+            // Text that does not decode counts as empty, as nrc_cfg_decode gives it
+            if (nrc_cfg_decode(src + pos, end - pos, TRUE, str, sizeof(str), &str_len) != NRC_PORT_RES_OK) {
+                hash = start;
+                break;
+            }
+            hash = nrc_cfg_hash(hash, str, str_len);
+            pos = end;
+        }
+    }
+
+    return hash;
+}
+
+// Member names carry no escaped flag, most have nothing to decode
+static u32_t nrc_cfg_hash_name(const s8_t *name, u32_t len)
+{
+    return nrc_cfg_hash_text(NRC_CFG_HASH_SEED, name, len, (memchr(name, '\\', len) != 0) ? TRUE : FALSE);
+}
+
+static u32_t nrc_cfg_hash_token(u32_t token, bool_t node)
+{
+    struct nrc_cfg_token    *t = &_cfg.token[token];
+    u32_t                   hash = nrc_cfg_hash_u32(NRC_CFG_HASH_SEED, t->kind);
+    u32_t                   members = 0;
+    u32_t                   child;
+
+    switch (t->kind) {
+    case NRC_CFG_K_STRING:
+    case NRC_CFG_K_NUMBER:
+        hash = nrc_cfg_hash_text(hash, &_cfg.text[t->offset], t->len, (t->escaped != 0) ? TRUE : FALSE);
+        break;
+    case NRC_CFG_K_ARRAY:
+        for (child = t->child; child != NRC_CFG_NONE; child = _cfg.token[child].next) {
+            hash = nrc_cfg_hash_u32(hash, nrc_cfg_hash_token(child, FALSE));
+        }
+        break;
+    case NRC_CFG_K_OBJECT:
+        for (child = t->child; child != NRC_CFG_NONE; child = _cfg.token[child].next) {
+            if ((node == FALSE) || !nrc_cfg_hash_skipped(&_cfg.text[_cfg.token[child].name_offset], _cfg.token[child].name_len)) {
+                members += nrc_cfg_hash_u32(
+                    nrc_cfg_hash_name(&_cfg.text[_cfg.token[child].name_offset], _cfg.token[child].name_len),
+                    nrc_cfg_hash_token(child, FALSE));
+            }
+        }
+        hash = nrc_cfg_hash_u32(hash, members);
+        break;
+    default:
+        break;
+    }
+
+    return hash;
+}
+
+static u32_t nrc_cfg_hash_image_value(const struct nrc_cfg_image_value *value);
+
+static u32_t nrc_cfg_hash_image_member(const struct nrc_cfg_image_value *member)
+{
+    const s8_t *name = nrc_cfg_image_str(member->name);
+
+    return nrc_cfg_hash_u32(nrc_cfg_hash(NRC_CFG_HASH_SEED, name, (u32_t)strlen((const char*)name)),
+                            nrc_cfg_hash_image_value(member));
+}
+
+static u32_t nrc_cfg_hash_image_value(const struct nrc_cfg_image_value *value)
+{
+    u32_t hash = nrc_cfg_hash_u32(NRC_CFG_HASH_SEED, value->kind);
+    u32_t members = 0;
+    u32_t i;
+
+    switch (value->kind) {
+    case NRC_CFG_K_STRING:
+    case NRC_CFG_K_NUMBER:
+        hash = nrc_cfg_hash(hash, nrc_cfg_image_str(value->data), value->count);
+        break;
+    case NRC_CFG_K_ARRAY:
+        for (i = 0; i < value->count; i++) {
+            hash = nrc_cfg_hash_u32(hash, nrc_cfg_hash_image_value(nrc_cfg_image_value(value->data + i)));
+        }
+        break;
+    case NRC_CFG_K_OBJECT:
+        for (i = 0; i < value->count; i++) {
+            members += nrc_cfg_hash_image_member(nrc_cfg_image_value(value->data + i));
+        }
+        hash = nrc_cfg_hash_u32(hash, members);
+        break;
+    default:
+        break;
+    }
+
+    return hash;
+}
+
+s32_t nrc_cfg_get_node_hash(s8_t *cfg_type, s8_t *cfg_id, u32_t *hash, u32_t *wires_hash)
+{
+    s32_t                               result = NRC_PORT_RES_NOT_FOUND;
+    const struct nrc_cfg_image_node     *image_node;
+    const struct nrc_cfg_image_value    *param;
+    u32_t                               members = 0;
+    u32_t                               node;
+    u32_t                               token;
+    u32_t                               i;
+
+    if ((hash == 0) || (wires_hash == 0)) {
+        return NRC_PORT_RES_INVALID_IN_PARAM;
+    }
+
+    *wires_hash = NRC_CFG_HASH_SEED;
+
+    if (_cfg.image != 0) {
+        image_node = nrc_cfg_image_find_node(cfg_type, cfg_id);
+
+        if (image_node != 0) {
+            for (i = 0; i < image_node->count; i++) {
+                param = nrc_cfg_image_value(image_node->first + i);
+
+                if (!nrc_cfg_hash_skipped(nrc_cfg_image_str(param->name), (u32_t)strlen((const char*)nrc_cfg_image_str(param->name)))) {
+                    members += nrc_cfg_hash_image_member(param);
+                }
+            }
+            param = nrc_cfg_image_find_param(cfg_type, cfg_id, "wires");
+            if (param != 0) {
+                *wires_hash = nrc_cfg_hash_image_value(param);
+            }
+            *hash = nrc_cfg_hash_u32(nrc_cfg_hash_u32(NRC_CFG_HASH_SEED, NRC_CFG_K_OBJECT), members);
+            result = NRC_PORT_RES_OK;
+        }
+    }
+    else {
+        node = nrc_cfg_find_node(cfg_type, cfg_id);
+
+        if (node != NRC_CFG_INVALID) {
+            *hash = nrc_cfg_hash_token(_cfg.node[node].token, TRUE);
+
+            token = nrc_cfg_find_param(cfg_type, cfg_id, "wires");
+            if (token != NRC_CFG_NONE) {
+                *wires_hash = nrc_cfg_hash_token(token, FALSE);
+            }
+            result = NRC_PORT_RES_OK;
+        }
+    }
+
+    return result;
+}
+
+/**
+ * Image builder, compiles the loaded flows.json. Runs offline so it allocates freely.
+ */
+
+struct nrc_cfg_intern_slot {
+    u32_t   hash;
+    u32_t   offset;
+    u32_t   used;
+};
+
+struct nrc_cfg_builder {
+    struct nrc_cfg_image_node   *node;
+    struct nrc_cfg_image_value  *value;
+    u32_t                       value_count;
+    s8_t                        *string;
+    u32_t                       string_size;
+    struct nrc_cfg_intern_slot  *intern;
+    u32_t                       intern_mask;
+};
+
+struct nrc_cfg_sort_key {
+    const s8_t  *id;
+    u32_t       index;
+};
+
+// Adds a string to the string table once, gives its offset
+static s32_t nrc_cfg_intern(struct nrc_cfg_builder *builder, const s8_t *src, u32_t len, bool_t escaped, u32_t *offset)
+{
+    s32_t   result;
+    s8_t    *str = &builder->string[builder->string_size];
+    u32_t   str_len;
+    u32_t   hash;
+    u32_t   index;
+
+    // Decode at the end of the table, it is only kept if the string is new. Decoded is never longer.
+    result = nrc_cfg_decode(src, len, escaped, str, len + 1, &str_len);
+
+    if (result == NRC_PORT_RES_OK) {
+        hash = nrc_cfg_hash(2166136261U, str, str_len);
+
+        for (index = hash & builder->intern_mask; ; index = (index + 1) & builder->intern_mask) {
+            if (builder->intern[index].used == 0) {
+                builder->intern[index].hash = hash;
+                builder->intern[index].offset = builder->string_size;
+                builder->intern[index].used = 1;
+                builder->string_size += str_len + 1;
+                break;
+            }
+            if ((builder->intern[index].hash == hash) &&
+                (strcmp((const char*)&builder->string[builder->intern[index].offset], (const char*)str) == 0)) {
+                break;
+            }
+        }
+        *offset = builder->intern[index].offset;
+    }
+
+    return result;
+}
+
+// Emits the children of an array or object token as a contiguous range, object members sorted by name
+static s32_t nrc_cfg_build_values(struct nrc_cfg_builder *builder, u32_t parent, u32_t *first, u32_t *count)
+{
+    s32_t                       result = NRC_PORT_RES_OK;
+    struct nrc_cfg_token        *token = _cfg.token;
+    struct nrc_cfg_image_value  *value;
+    struct nrc_cfg_image_value  moved;
+    u32_t                       child;
+    u32_t                       n = 0;
+    u32_t                       i;
+    u32_t                       j;
+
+    for (child = token[parent].child; child != NRC_CFG_NONE; child = token[child].next) {
+        n++;
+    }
+
+    *first = builder->value_count;
+    *count = n;
+    builder->value_count += n;
+
+    for (child = token[parent].child, i = 0; (child != NRC_CFG_NONE) && (result == NRC_PORT_RES_OK); child = token[child].next, i++) {
+        value = &builder->value[*first + i];
+        value->kind = token[child].kind;
+        value->name = 0;
+        value->data = 0;
+        value->count = 0;
+
+        if (token[parent].kind == NRC_CFG_K_OBJECT) {
+            result = nrc_cfg_intern(builder, &_cfg.text[token[child].name_offset], token[child].name_len, TRUE, &value->name);
+        }
+
+        if (result == NRC_PORT_RES_OK) {
+            switch (token[child].kind) {
+            case NRC_CFG_K_STRING:
+            case NRC_CFG_K_NUMBER:
+                result = nrc_cfg_intern(builder, &_cfg.text[token[child].offset], token[child].len,
+                    (token[child].escaped != 0) ? TRUE : FALSE, &value->data);
+                value->count = (u32_t)strlen((const char*)&builder->string[value->data]);
+                break;
+            case NRC_CFG_K_ARRAY:
+            case NRC_CFG_K_OBJECT:
+                result = nrc_cfg_build_values(builder, child, &value->data, &value->count);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    // Insertion sort, stable so the first of equal names is found first
+    if ((result == NRC_PORT_RES_OK) && (token[parent].kind == NRC_CFG_K_OBJECT)) {
+        value = &builder->value[*first];
+        for (i = 1; i < n; i++) {
+            moved = value[i];
+            for (j = i; (j > 0) &&
+                (strcmp((const char*)&builder->string[value[j - 1].name], (const char*)&builder->string[moved.name]) > 0); j--) {
+                value[j] = value[j - 1];
+            }
+            value[j] = moved;
+        }
+    }
+
+    return result;
+}
+
+static int nrc_cfg_sort_key_cmp(const void *a, const void *b)
+{
+    const struct nrc_cfg_sort_key   *key_a = (const struct nrc_cfg_sort_key*)a;
+    const struct nrc_cfg_sort_key   *key_b = (const struct nrc_cfg_sort_key*)b;
+    int                             cmp = strcmp((const char*)key_a->id, (const char*)key_b->id);
+
+    if (cmp == 0) {
+        cmp = (key_a->index < key_b->index) ? -1 : 1;
+    }
+
+    return cmp;
+}
+
+s32_t nrc_cfg_build_image(u8_t **image, u32_t *size)
+{
+    s32_t                       result = NRC_PORT_RES_INVALID_IN_PARAM;
+    struct nrc_cfg_builder      builder;
+    struct nrc_cfg_sort_key     *key = 0;
+    struct nrc_cfg_image_hdr    *hdr;
+    struct nrc_cfg_image_node   *node;
+    u32_t                       *order;
+    u32_t                       slots = NRC_CFG_MIN_SLOTS;
+    u32_t                       string_max;
+    u64_t                       image_size;
+    u32_t                       i;
+
+    if ((image == 0) || (size == 0)) {
+        return result;
+    }
+    if ((_cfg.state != NRC_CFG_S_INITIALIZED) || (_cfg.image != 0)) {
+        return NRC_PORT_RES_NOT_SUPPORTED;
+    }
+
+    *image = 0;
+    *size = 0;
+    memset(&builder, 0, sizeof(struct nrc_cfg_builder));
+
+    // Strings decode to at most their slice length. A repeated string is decoded once more before it is
+    // found, ids and types are the only slices interned twice.
+    string_max = (2 * _cfg.text_len) + (2 * _cfg.token_count) + sizeof(u32_t);
+    while (slots < 4 * _cfg.token_count) {
+        slots *= 2;
+    }
+
+    builder.node = (struct nrc_cfg_image_node*)nrc_port_heap_alloc((_cfg.node_count + 1) * sizeof(struct nrc_cfg_image_node));
+    builder.value = (struct nrc_cfg_image_value*)nrc_port_heap_alloc(_cfg.token_count * sizeof(struct nrc_cfg_image_value));
+    builder.string = (s8_t*)nrc_port_heap_alloc(string_max);
+    builder.intern = (struct nrc_cfg_intern_slot*)nrc_port_heap_alloc(slots * sizeof(struct nrc_cfg_intern_slot));
+    builder.intern_mask = slots - 1;
+    key = (struct nrc_cfg_sort_key*)nrc_port_heap_alloc((_cfg.node_count + 1) * sizeof(struct nrc_cfg_sort_key));
+
+    result = NRC_PORT_RES_ERROR;
+
+    if ((builder.node != 0) && (builder.value != 0) && (builder.string != 0) && (builder.intern != 0) && (key != 0)) {
+        memset(builder.intern, 0, slots * sizeof(struct nrc_cfg_intern_slot));
+        result = nrc_cfg_intern(&builder, (const s8_t*)"", 0, FALSE, &i);
+
+        for (i = 0; (i < _cfg.node_count) && (result == NRC_PORT_RES_OK); i++) {
+            node = &builder.node[i];
+            result = nrc_cfg_intern(&builder, &_cfg.text[_cfg.token[_cfg.node[i].id].offset], _cfg.token[_cfg.node[i].id].len,
+                (_cfg.token[_cfg.node[i].id].escaped != 0) ? TRUE : FALSE, &node->id);
+            if (result == NRC_PORT_RES_OK) {
+                result = nrc_cfg_intern(&builder, &_cfg.text[_cfg.token[_cfg.node[i].type].offset], _cfg.token[_cfg.node[i].type].len,
+                    (_cfg.token[_cfg.node[i].type].escaped != 0) ? TRUE : FALSE, &node->type);
+            }
+            if (result == NRC_PORT_RES_OK) {
+                result = nrc_cfg_build_values(&builder, _cfg.node[i].token, &node->first, &node->count);
+            }
+        }
+    }
+
+    if (result == NRC_PORT_RES_OK) {
+        for (i = 0; i < _cfg.node_count; i++) {
+            key[i].id = &builder.string[builder.node[i].id];
+            key[i].index = i;
+        }
+        qsort(key, _cfg.node_count, sizeof(struct nrc_cfg_sort_key), nrc_cfg_sort_key_cmp);
+
+        image_size = sizeof(struct nrc_cfg_image_hdr) +
+            ((u64_t)_cfg.node_count * (sizeof(struct nrc_cfg_image_node) + sizeof(u32_t))) +
+            ((u64_t)builder.value_count * sizeof(struct nrc_cfg_image_value)) +
+            ((builder.string_size + sizeof(u32_t) - 1) & ~(sizeof(u32_t) - 1));
+
+        result = NRC_PORT_RES_ERROR;
+        if (image_size <= U32_MAX_VALUE) {
+            *image = nrc_port_heap_alloc((u32_t)image_size);
+        }
+
+        if (*image != 0) {
+            memset(*image, 0, (size_t)image_size);
+
+            hdr = (struct nrc_cfg_image_hdr*)*image;
+            hdr->magic = NRC_CFG_IMAGE_MAGIC;
+            hdr->version = NRC_CFG_IMAGE_VERSION;
+            hdr->header_size = sizeof(struct nrc_cfg_image_hdr);
+            hdr->image_size = (u32_t)image_size;
+            hdr->node_count = _cfg.node_count;
+            hdr->node_offset = sizeof(struct nrc_cfg_image_hdr);
+            hdr->order_offset = hdr->node_offset + (_cfg.node_count * sizeof(struct nrc_cfg_image_node));
+            hdr->value_count = builder.value_count;
+            hdr->value_offset = hdr->order_offset + (_cfg.node_count * sizeof(u32_t));
+            hdr->string_size = builder.string_size;
+            hdr->string_offset = hdr->value_offset + (builder.value_count * sizeof(struct nrc_cfg_image_value));
+
+            node = (struct nrc_cfg_image_node*)(*image + hdr->node_offset);
+            order = (u32_t*)(*image + hdr->order_offset);
+            for (i = 0; i < _cfg.node_count; i++) {
+                node[i] = builder.node[key[i].index];
+                order[key[i].index] = i;
+            }
+            memcpy(*image + hdr->value_offset, builder.value, builder.value_count * sizeof(struct nrc_cfg_image_value));
+            memcpy(*image + hdr->string_offset, builder.string, builder.string_size);
+
+            hdr->checksum = nrc_cfg_checksum((const u32_t*)(*image + hdr->header_size),
+                (hdr->image_size - hdr->header_size) / sizeof(u32_t));
+
+            *size = hdr->image_size;
+            result = NRC_PORT_RES_OK;
+        }
+    }
+
+    if (builder.node != 0) {
+        nrc_port_heap_free(builder.node);
+    }
+    if (builder.value != 0) {
+        nrc_port_heap_free(builder.value);
+    }
+    if (builder.string != 0) {
+        nrc_port_heap_free(builder.string);
+    }
+    if (builder.intern != 0) {
+        nrc_port_heap_free(builder.intern);
+    }
+    if (key != 0) {
+        nrc_port_heap_free(key);
+    }
+
+    return result;
+}
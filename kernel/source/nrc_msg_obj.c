@@ -0,0 +1,670 @@
+/**
+ * Copyright 2017 Tomas Frisberg & Ola Bjorsne
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http ://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "nrc_msg_obj.h"
+#include "nrc_os.h"
+#include "nrc_port.h"
+#include <stddef.h>
+#include <string.h>
+
+#ifndef NRC_MSG_KEY_MAX
+#define NRC_MSG_KEY_MAX         (1024)  // Interned keys, power of two
+#endif
+
+#ifndef NRC_MSG_KEY_NAME_SIZE
+#define NRC_MSG_KEY_NAME_SIZE   (NRC_MSG_KEY_MAX * 16)     // Bytes for all key names, with terminators
+#endif
+
+#define NRC_MSG_KEY_SLOTS       (NRC_MSG_KEY_MAX * 2)
+
+#define NRC_MSG_OBJ_ALIGN(size) (((size) + 7U) & ~7U)
+#define NRC_MSG_OBJ_NO_ROOM     (U32_MAX_VALUE)
+#define NRC_MSG_OBJ_FIELD_MAX   (0xFFFE)    // Index entries are u16_t
+
+#define NRC_MSG_OBJ_DATA(msg)   ((u8_t*)(msg)->data)
+
+// An inline key is the offset / 8 of its name: the length, the hash, then the terminated name
+#define NRC_MSG_OBJ_KEY_OFFSET(key)     (((key) & ~NRC_MSG_KEY_INLINE) * 8U)
+#define NRC_MSG_OBJ_KEY_LEN(msg, key)   (*(const u32_t*)(NRC_MSG_OBJ_DATA(msg) + NRC_MSG_OBJ_KEY_OFFSET(key)))
+#define NRC_MSG_OBJ_KEY_HASH(msg, key)  (*(const u32_t*)(NRC_MSG_OBJ_DATA(msg) + NRC_MSG_OBJ_KEY_OFFSET(key) + sizeof(u32_t)))
+#define NRC_MSG_OBJ_KEY_NAME(msg, key)  ((const s8_t*)(NRC_MSG_OBJ_DATA(msg) + NRC_MSG_OBJ_KEY_OFFSET(key) + (2 * sizeof(u32_t))))
+
+// Tables and values are at 8 byte aligned offsets in data
+struct nrc_msg_obj_field {
+    nrc_msg_key_t   key;        // Position in arrays
+    u8_t            type;
+    u8_t            padding[3];
+    union {
+        s64_t       i;
+        double      f;
+        struct {
+            u32_t   offset;     // Of the string, blob or table
+            u32_t   len;
+        } ref;
+    } value;
+};
+
+// Followed by field_max fields and, in objects, the index
+struct nrc_msg_obj_table {
+    u32_t   count;
+    u32_t   field_max;
+    u32_t   mask;               // Index slots - 1, 0 in arrays
+    u32_t   reserved;
+};
+
+// Open addressing on the name hash of the key, a slot holds field number + 1, 0 if free
+#define NRC_MSG_OBJ_INDEX(table) \
+    ((u16_t*)((struct nrc_msg_obj_field*)((table) + 1) + (table)->field_max))
+
+// Slots go from 0 to a key once and never back, so lookups probe them without the lock
+struct nrc_msg_keys {
+    nrc_port_mutex_t    lock;
+    volatile u32_t      count;
+    const s8_t          *name[NRC_MSG_KEY_MAX + 1];     // By key
+    u32_t               len[NRC_MSG_KEY_MAX + 1];
+    u32_t               hash[NRC_MSG_KEY_MAX + 1];
+    volatile u32_t      slot[NRC_MSG_KEY_SLOTS];        // Key, 0 if free
+    u32_t               name_used;
+    s8_t                name_pool[NRC_MSG_KEY_NAME_SIZE];   // Names are copied here, never to the heap
+};
+
+static struct nrc_msg_keys _keys;
+
+static u32_t nrc_msg_key_hash(const s8_t *name, u32_t len)
+{
+    u32_t hash = 2166136261U;
+    u32_t i;
+
+    // FNV-1a
+    for (i = 0; i < len; i++) {
+        hash = (hash ^ (u8_t)name[i]) * 16777619U;
+    }
+
+    return hash;
+}
+
+static u32_t nrc_msg_obj_key_slot(u32_t hash, u32_t mask)
+{
+    return (hash * 2654435761U) & mask;
+}
+
+// Key of name, or 0 and the free slot that ends its probe
+static nrc_msg_key_t nrc_msg_key_find(const s8_t *name, u32_t len, u32_t hash, u32_t *index)
+{
+    nrc_msg_key_t   key = 0;
+    nrc_msg_key_t   other;
+    u32_t           slot = hash & (NRC_MSG_KEY_SLOTS - 1);
+
+    while ((other = nrc_port_atomic_load_acquire(&_keys.slot[slot])) != 0) {
+        if ((_keys.hash[other] == hash) && (_keys.len[other] == len) && (memcmp(_keys.name[other], name, len) == 0)) {
+            key = other;
+            break;
+        }
+        slot = (slot + 1) & (NRC_MSG_KEY_SLOTS - 1);
+    }
+    *index = slot;
+
+    return key;
+}
+
+void nrc_msg_key_init(void)
+{
+    s32_t result;
+
+    memset(&_keys, 0, sizeof(struct nrc_msg_keys));
+
+    result = nrc_port_mutex_init(&_keys.lock);
+    (void)result;
+}
+
+void nrc_msg_key_deinit(void)
+{
+    nrc_port_mutex_deinit(_keys.lock);
+    memset(&_keys, 0, sizeof(struct nrc_msg_keys));
+}
+
+nrc_msg_key_t nrc_msg_key(const s8_t *name)
+{
+    return (name != 0) ? nrc_msg_key_n(name, (u32_t)strlen(name)) : 0;
+}
+
+nrc_msg_key_t nrc_msg_key_n(const s8_t *name, u32_t len)
+{
+    nrc_msg_key_t   key = 0;
+    s8_t            *copy;
+    u32_t           hash;
+    u32_t           index;
+
+    if (name != 0) {
+        hash = nrc_msg_key_hash(name, len);
+        key = nrc_msg_key_find(name, len, hash, &index);
+
+        if (key == 0) {
+            nrc_port_mutex_lock(_keys.lock, 0);
+
+            // Another thread may have added it meanwhile
+            key = nrc_msg_key_find(name, len, hash, &index);
+
+            if ((key == 0) && (_keys.count < NRC_MSG_KEY_MAX) && (len < NRC_MSG_KEY_NAME_SIZE - _keys.name_used)) {
+                copy = &_keys.name_pool[_keys.name_used];
+                _keys.name_used += len + 1;
+                memcpy(copy, name, len);
+                copy[len] = 0;
+
+                key = _keys.count + 1;
+                _keys.name[key] = copy;
+                _keys.len[key] = len;
+                _keys.hash[key] = hash;
+                nrc_port_atomic_store(&_keys.count, key);
+                nrc_port_atomic_store_release(&_keys.slot[index], key);
+            }
+
+            nrc_port_mutex_unlock(_keys.lock);
+        }
+    }
+
+    return key;
+}
+
+nrc_msg_key_t nrc_msg_key_lookup_n(const s8_t *name, u32_t len)
+{
+    nrc_msg_key_t   key = 0;
+    u32_t           index;
+
+    if (name != 0) {
+        key = nrc_msg_key_find(name, len, nrc_msg_key_hash(name, len), &index);
+    }
+
+    return key;
+}
+
+const s8_t* nrc_msg_key_name(nrc_msg_key_t key)
+{
+    const s8_t *name = 0;
+
+    if ((key != 0) && (key <= nrc_port_atomic_load(&_keys.count))) {
+        name = _keys.name[key];
+    }
+
+    return name;
+}
+
+struct nrc_msg_obj* nrc_msg_obj_alloc(u32_t capacity)
+{
+    struct nrc_msg_obj *msg;
+
+    capacity = NRC_MSG_OBJ_ALIGN(capacity);
+    msg = (struct nrc_msg_obj*)nrc_os_msg_alloc((u32_t)offsetof(struct nrc_msg_obj, data) + capacity);
+
+    if (msg != 0) {
+        msg->hdr.type = NRC_MSG_TYPE_OBJ;
+        msg->size = 0;
+        msg->capacity = capacity;
+        msg->root = 0;
+        msg->reserved = 0;
+    }
+
+    return msg;
+}
+
+// Index slots of an object, at most half full
+static u32_t nrc_msg_obj_index_slots(u32_t field_max)
+{
+    u32_t slots = 2;
+
+    while (slots < (field_max * 2)) {
+        slots *= 2;
+    }
+
+    return slots;
+}
+
+u32_t nrc_msg_obj_table_size(u32_t field_max, bool_t object)
+{
+    u32_t slots = object ? nrc_msg_obj_index_slots(field_max) : 0;
+
+    return NRC_MSG_OBJ_ALIGN(sizeof(struct nrc_msg_obj_table) + (field_max * sizeof(struct nrc_msg_obj_field)) +
+                             (slots * sizeof(u16_t)));
+}
+
+u32_t nrc_msg_obj_str_size(u32_t len)
+{
+    return NRC_MSG_OBJ_ALIGN(len + 1);
+}
+
+u32_t nrc_msg_obj_key_size(u32_t len)
+{
+    return NRC_MSG_OBJ_ALIGN((2 * sizeof(u32_t)) + len + 1);
+}
+
+// Hash of the key's name, an interned and an inline key of the same name index to the same slot
+static u32_t nrc_msg_obj_key_hash(const struct nrc_msg_obj *msg, nrc_msg_key_t key)
+{
+    u32_t hash = 0;
+
+    if ((key & NRC_MSG_KEY_INLINE) != 0) {
+        if (NRC_MSG_OBJ_KEY_OFFSET(key) < msg->size) {
+            hash = NRC_MSG_OBJ_KEY_HASH(msg, key);
+        }
+    }
+    else if (key <= NRC_MSG_KEY_MAX) {
+        hash = _keys.hash[key];
+    }
+
+    return hash;
+}
+
+// TRUE if the keys name the same field. Interned keys only by id, an inline key by its name.
+static bool_t nrc_msg_obj_key_same(const struct nrc_msg_obj *msg, nrc_msg_key_t a, nrc_msg_key_t b, u32_t b_hash)
+{
+    const s8_t  *a_name;
+    const s8_t  *b_name;
+    u32_t       a_len;
+    u32_t       b_len;
+    bool_t      same = (a == b);
+
+    if ((same == FALSE) && (((a | b) & NRC_MSG_KEY_INLINE) != 0) && (nrc_msg_obj_key_hash(msg, a) == b_hash)) {
+        a_name = nrc_msg_obj_key_name(msg, a, &a_len);
+        b_name = nrc_msg_obj_key_name(msg, b, &b_len);
+
+        same = (a_name != 0) && (b_name != 0) && (a_len == b_len) && (memcmp(a_name, b_name, a_len) == 0);
+    }
+
+    return same;
+}
+
+// Offset of size bytes taken from the end of data, NRC_MSG_OBJ_NO_ROOM if they do not fit
+static u32_t nrc_msg_obj_reserve(struct nrc_msg_obj_builder *builder, u32_t size)
+{
+    struct nrc_msg_obj  *msg = builder->msg;
+    u32_t               offset = NRC_MSG_OBJ_NO_ROOM;
+
+    size = NRC_MSG_OBJ_ALIGN(size);
+
+    if ((builder->failed == FALSE) && (size <= (msg->capacity - msg->size))) {
+        offset = msg->size;
+        msg->size += size;
+    }
+    else {
+        builder->failed = TRUE;
+    }
+
+    return offset;
+}
+
+static struct nrc_msg_obj_table* nrc_msg_obj_table_at(const struct nrc_msg_obj *msg, u32_t offset)
+{
+    return (struct nrc_msg_obj_table*)(NRC_MSG_OBJ_DATA(msg) + offset);
+}
+
+// Next field of the innermost open table, or 0 if it is full
+static struct nrc_msg_obj_field* nrc_msg_obj_add(struct nrc_msg_obj_builder *builder, nrc_msg_key_t key, u8_t type)
+{
+    struct nrc_msg_obj_table    *table;
+    struct nrc_msg_obj_field    *field = 0;
+    u32_t                       top;
+
+    if ((builder->failed == FALSE) && (builder->depth != 0)) {
+        top = builder->depth - 1;
+        table = nrc_msg_obj_table_at(builder->msg, builder->table[top]);
+
+        if ((table->count < table->field_max) && ((key != 0) || (table->mask == 0))) {
+            field = (struct nrc_msg_obj_field*)(table + 1) + table->count;
+            field->key = (table->mask == 0) ? table->count : key;
+            field->type = type;
+            memset(field->padding, 0, sizeof(field->padding));
+            field->value.i = 0;
+            table->count++;
+        }
+    }
+
+    if (field == 0) {
+        builder->failed = TRUE;
+    }
+
+    return field;
+}
+
+static void nrc_msg_obj_begin(struct nrc_msg_obj_builder *builder, nrc_msg_key_t key, u32_t field_max, u8_t type)
+{
+    struct nrc_msg_obj_table    *table;
+    struct nrc_msg_obj_field    *field = 0;
+    u32_t                       slots = 0;
+    u32_t                       size;
+    u32_t                       offset;
+
+    if ((builder->depth == NRC_MSG_OBJ_DEPTH) || (field_max > NRC_MSG_OBJ_FIELD_MAX)) {
+        builder->failed = TRUE;
+        return;
+    }
+
+    if (type == NRC_MSG_OBJ_OBJECT) {
+        slots = nrc_msg_obj_index_slots(field_max);
+    }
+
+    size = sizeof(struct nrc_msg_obj_table) + (field_max * sizeof(struct nrc_msg_obj_field)) + (slots * sizeof(u16_t));
+
+    if (builder->depth != 0) {
+        field = nrc_msg_obj_add(builder, key, type);
+    }
+    offset = nrc_msg_obj_reserve(builder, size);
+
+    if (builder->failed == FALSE) {
+        table = nrc_msg_obj_table_at(builder->msg, offset);
+        table->count = 0;
+        table->field_max = field_max;
+        table->mask = (slots != 0) ? (slots - 1) : 0;
+        table->reserved = 0;
+
+        if (field != 0) {
+            field->value.ref.offset = offset;
+        }
+        else {
+            builder->msg->root = offset;
+        }
+
+        builder->table[builder->depth] = offset;
+        builder->depth++;
+    }
+}
+
+void nrc_msg_obj_build(struct nrc_msg_obj_builder *builder, struct nrc_msg_obj *msg, u32_t field_max)
+{
+    memset(builder, 0, sizeof(struct nrc_msg_obj_builder));
+    builder->msg = msg;
+
+    msg->size = 0;
+    nrc_msg_obj_begin(builder, 0, field_max, NRC_MSG_OBJ_OBJECT);
+}
+
+nrc_msg_key_t nrc_msg_obj_key(struct nrc_msg_obj_builder *builder, const s8_t *name, u32_t len)
+{
+    nrc_msg_key_t   key = nrc_msg_key_lookup_n(name, len);
+    u8_t            *data;
+    u32_t           offset;
+
+    if ((key == 0) && (name != 0) && (len < (U32_MAX_VALUE - 16))) {
+        offset = nrc_msg_obj_reserve(builder, nrc_msg_obj_key_size(len));
+
+        if (offset != NRC_MSG_OBJ_NO_ROOM) {
+            data = NRC_MSG_OBJ_DATA(builder->msg) + offset;
+            *(u32_t*)data = len;
+            *(u32_t*)(data + sizeof(u32_t)) = nrc_msg_key_hash(name, len);
+            memcpy(data + (2 * sizeof(u32_t)), name, len);
+            data[(2 * sizeof(u32_t)) + len] = 0;
+
+            key = NRC_MSG_KEY_INLINE | (offset / 8U);
+        }
+    }
+
+    return key;
+}
+
+void nrc_msg_obj_put_null(struct nrc_msg_obj_builder *builder, nrc_msg_key_t key)
+{
+    nrc_msg_obj_add(builder, key, NRC_MSG_OBJ_NULL);
+}
+
+void nrc_msg_obj_put_bool(struct nrc_msg_obj_builder *builder, nrc_msg_key_t key, bool_t value)
+{
+    struct nrc_msg_obj_field *field = nrc_msg_obj_add(builder, key, NRC_MSG_OBJ_BOOL);
+
+    if (field != 0) {
+        field->value.i = (value != FALSE) ? 1 : 0;
+    }
+}
+
+void nrc_msg_obj_put_int(struct nrc_msg_obj_builder *builder, nrc_msg_key_t key, s64_t value)
+{
+    struct nrc_msg_obj_field *field = nrc_msg_obj_add(builder, key, NRC_MSG_OBJ_INT);
+
+    if (field != 0) {
+        field->value.i = value;
+    }
+}
+
+void nrc_msg_obj_put_float(struct nrc_msg_obj_builder *builder, nrc_msg_key_t key, double value)
+{
+    struct nrc_msg_obj_field *field = nrc_msg_obj_add(builder, key, NRC_MSG_OBJ_FLOAT);
+
+    if (field != 0) {
+        field->value.f = value;
+    }
+}
+
+static void nrc_msg_obj_put_bytes(struct nrc_msg_obj_builder *builder, nrc_msg_key_t key, u8_t type,
+                                  const void *bytes, u32_t len, u32_t terminator)
+{
+    struct nrc_msg_obj_field    *field = nrc_msg_obj_add(builder, key, type);
+    u8_t                        *data;
+    u32_t                       offset;
+
+    if ((field != 0) && (len < (U32_MAX_VALUE - 8))) {
+        offset = nrc_msg_obj_reserve(builder, len + terminator);
+
+        if (offset != NRC_MSG_OBJ_NO_ROOM) {
+            data = NRC_MSG_OBJ_DATA(builder->msg) + offset;
+            memcpy(data, bytes, len);
+            if (terminator != 0) {
+                data[len] = 0;
+            }
+
+            field->value.ref.offset = offset;
+            field->value.ref.len = len;
+        }
+    }
+    else {
+        builder->failed = TRUE;
+    }
+}
+
+void nrc_msg_obj_put_str(struct nrc_msg_obj_builder *builder, nrc_msg_key_t key, const s8_t *str, u32_t len)
+{
+    nrc_msg_obj_put_bytes(builder, key, NRC_MSG_OBJ_STR, str, len, 1);
+}
+
+void nrc_msg_obj_put_blob(struct nrc_msg_obj_builder *builder, nrc_msg_key_t key, const void *blob, u32_t len)
+{
+    nrc_msg_obj_put_bytes(builder, key, NRC_MSG_OBJ_BLOB, blob, len, 0);
+}
+
+void nrc_msg_obj_begin_object(struct nrc_msg_obj_builder *builder, nrc_msg_key_t key, u32_t field_max)
+{
+    nrc_msg_obj_begin(builder, key, field_max, NRC_MSG_OBJ_OBJECT);
+}
+
+void nrc_msg_obj_begin_array(struct nrc_msg_obj_builder *builder, nrc_msg_key_t key, u32_t field_max)
+{
+    nrc_msg_obj_begin(builder, key, field_max, NRC_MSG_OBJ_ARRAY);
+}
+
+void nrc_msg_obj_end(struct nrc_msg_obj_builder *builder)
+{
+    struct nrc_msg_obj_table    *table;
+    struct nrc_msg_obj_field    *field;
+    u16_t                       *index;
+    u32_t                       hash;
+    u32_t                       slot;
+    u32_t                       top;
+    u32_t                       i;
+
+    if (builder->depth == 0) {
+        builder->failed = TRUE;
+        return;
+    }
+
+    top = builder->depth - 1;
+    table = nrc_msg_obj_table_at(builder->msg, builder->table[top]);
+
+    // Objects get their index now that the fields are known, a later duplicate key wins
+    if ((builder->failed == FALSE) && (table->mask != 0)) {
+        field = (struct nrc_msg_obj_field*)(table + 1);
+        index = NRC_MSG_OBJ_INDEX(table);
+        memset(index, 0, (table->mask + 1) * sizeof(u16_t));
+
+        for (i = 0; i < table->count; i++) {
+            hash = nrc_msg_obj_key_hash(builder->msg, field[i].key);
+            slot = nrc_msg_obj_key_slot(hash, table->mask);
+
+            while ((index[slot] != 0) && !nrc_msg_obj_key_same(builder->msg, field[index[slot] - 1].key, field[i].key, hash)) {
+                slot = (slot + 1) & table->mask;
+            }
+            index[slot] = (u16_t)(i + 1);
+        }
+    }
+
+    builder->depth--;
+}
+
+s32_t nrc_msg_obj_finish(struct nrc_msg_obj_builder *builder)
+{
+    while (builder->depth != 0) {
+        nrc_msg_obj_end(builder);
+    }
+
+    return builder->failed ? NRC_PORT_RES_ERROR : NRC_PORT_RES_OK;
+}
+
+static void nrc_msg_obj_value_of(const struct nrc_msg_obj *msg, const struct nrc_msg_obj_field *field,
+                                 struct nrc_msg_obj_value *value)
+{
+    value->type = field->type;
+    value->len = 0;
+
+    switch (field->type) {
+    case NRC_MSG_OBJ_BOOL:
+        value->v.b = (field->value.i != 0) ? TRUE : FALSE;
+        break;
+    case NRC_MSG_OBJ_INT:
+        value->v.i = field->value.i;
+        break;
+    case NRC_MSG_OBJ_FLOAT:
+        value->v.f = field->value.f;
+        break;
+    case NRC_MSG_OBJ_STR:
+        value->v.str = (const s8_t*)(NRC_MSG_OBJ_DATA(msg) + field->value.ref.offset);
+        value->len = field->value.ref.len;
+        break;
+    case NRC_MSG_OBJ_BLOB:
+        value->v.blob = NRC_MSG_OBJ_DATA(msg) + field->value.ref.offset;
+        value->len = field->value.ref.len;
+        break;
+    case NRC_MSG_OBJ_OBJECT:
+    case NRC_MSG_OBJ_ARRAY:
+        value->v.table = field->value.ref.offset;
+        value->len = nrc_msg_obj_table_at(msg, field->value.ref.offset)->count;
+        break;
+    default:
+        value->v.i = 0;
+        break;
+    }
+}
+
+bool_t nrc_msg_obj_get(const struct nrc_msg_obj *msg, u32_t table, nrc_msg_key_t key, struct nrc_msg_obj_value *value)
+{
+    const struct nrc_msg_obj_table  *t = nrc_msg_obj_table_at(msg, table);
+    const struct nrc_msg_obj_field  *field = (const struct nrc_msg_obj_field*)(t + 1);
+    const struct nrc_msg_obj_field  *found = 0;
+    const u16_t                     *index;
+    u32_t                           hash;
+    u32_t                           slot;
+
+    if (t->mask == 0) {
+        if (key < t->count) {
+            found = &field[key];
+        }
+    }
+    else if (key != 0) {
+        index = NRC_MSG_OBJ_INDEX(t);
+        hash = nrc_msg_obj_key_hash(msg, key);
+        slot = nrc_msg_obj_key_slot(hash, t->mask);
+
+        // The name may not have been interned when the message was built, its inline key is in the same probe
+        while (index[slot] != 0) {
+            if (nrc_msg_obj_key_same(msg, field[index[slot] - 1].key, key, hash)) {
+                found = &field[index[slot] - 1];
+                break;
+            }
+            slot = (slot + 1) & t->mask;
+        }
+    }
+
+    if (found != 0) {
+        nrc_msg_obj_value_of(msg, found, value);
+    }
+
+    return (found != 0);
+}
+
+bool_t nrc_msg_obj_path(const struct nrc_msg_obj *msg, const nrc_msg_key_t *keys, u32_t count, struct nrc_msg_obj_value *value)
+{
+    u32_t   table = msg->root;
+    bool_t  found = TRUE;
+    u32_t   i;
+
+    for (i = 0; (i < count) && found; i++) {
+        found = nrc_msg_obj_get(msg, table, keys[i], value);
+
+        if (found && (i + 1 < count)) {
+            found = (value->type == NRC_MSG_OBJ_OBJECT) || (value->type == NRC_MSG_OBJ_ARRAY);
+            table = value->v.table;
+        }
+    }
+
+    return found && (count != 0);
+}
+
+bool_t nrc_msg_obj_field(const struct nrc_msg_obj *msg, u32_t table, u32_t index, nrc_msg_key_t *key, struct nrc_msg_obj_value *value)
+{
+    const struct nrc_msg_obj_table  *t = nrc_msg_obj_table_at(msg, table);
+    const struct nrc_msg_obj_field  *field = (const struct nrc_msg_obj_field*)(t + 1);
+    bool_t                          found = FALSE;
+
+    if (index < t->count) {
+        if (key != 0) {
+            *key = (t->mask == 0) ? 0 : field[index].key;
+        }
+        nrc_msg_obj_value_of(msg, &field[index], value);
+        found = TRUE;
+    }
+
+    return found;
+}
+
+const s8_t* nrc_msg_obj_key_name(const struct nrc_msg_obj *msg, nrc_msg_key_t key, u32_t *len)
+{
+    const s8_t  *name = 0;
+    u32_t       name_len = 0;
+
+    if ((key & NRC_MSG_KEY_INLINE) != 0) {
+        if (NRC_MSG_OBJ_KEY_OFFSET(key) < msg->size) {
+            name = NRC_MSG_OBJ_KEY_NAME(msg, key);
+            name_len = NRC_MSG_OBJ_KEY_LEN(msg, key);
+        }
+    }
+    else {
+        name = nrc_msg_key_name(key);
+        if (name != 0) {
+            name_len = _keys.len[key];
+        }
+    }
+
+    if (len != 0) {
+        *len = name_len;
+    }
+
+    return name;
+}
@@ -15,25 +15,91 @@
  */
 
 #include "nrc_os.h"
+#include "nrc_cfg.h"
+#include "nrc_arena.h"
 #include "nrc_port.h"
+#include "nrc_prioq.h"
+#include "nrc_msg_obj.h"
+#include "nrc_trace.h"
 #include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 
 #define NRC_OS_STACK_SIZE   (4096)
+
+#ifndef NRC_OS_BATCH_SIZE
+#define NRC_OS_BATCH_SIZE   (32)    // Max messages a node gets per turn before other nodes run
+#endif
+
+#ifndef NRC_OS_MAX_WORKERS
+#define NRC_OS_MAX_WORKERS  (16)    // Max 32, one bit each in the idle mask
+#endif
+
 #define NRC_OS_NODE_TYPE    (0xA5A5)
 #define NRC_OS_MSG_TYPE     (0x5A5A)
 
+#define NRC_OS_INJECT_WORDS (NRC_PRIOQ_LEVELS / 32)
+#define NRC_OS_LEVEL(prio)  ((u32_t)((s32_t)(prio) + 128))
+#define NRC_OS_LEVEL_EMPTY  (U32_MAX_VALUE)
+#define NRC_OS_PRIO(level)  ((s8_t)((s32_t)(level) - 128))
+
+#define NRC_OS_REGISTRY_MIN_SLOTS   (64)
+
+#ifndef NRC_OS_MAX_NODES
+#define NRC_OS_MAX_NODES    (65536) // Registered nodes, ids are 1 up to this
+#endif
+
+#define NRC_OS_CACHE_LINE       (64)
+#define NRC_OS_CACHE_LINES(size)    (((size) + NRC_OS_CACHE_LINE - 1) / NRC_OS_CACHE_LINE)
+#define NRC_OS_NODE_CHUNK       (64)    // Records allocated together, they never move
+#define NRC_OS_NODE_CHUNKS      ((NRC_OS_MAX_NODES + NRC_OS_NODE_CHUNK - 1) / NRC_OS_NODE_CHUNK)
+
+#define NRC_OS_MAX_WIRES    (256)   // Output ports of a node and wires of a port, indexed by u8_t in config
+
+#ifndef NRC_OS_BATCH_TARGETS
+#define NRC_OS_BATCH_TARGETS    (16)    // Targets a batch send collects before it appends to mailboxes
+#endif
+
+#ifndef NRC_OS_INGRESS_BATCH
+#define NRC_OS_INGRESS_BATCH    (256)   // Deliveries a worker takes from the ingress queue per look
+#endif
+
+#ifndef NRC_OS_STATS
+#define NRC_OS_STATS            (0)     // Per-node runtime statistics, see nrc_os_get_stats
+#endif
+
+#ifndef NRC_OS_TIMER_TURNS
+#define NRC_OS_TIMER_TURNS      (16)    // Turns between a busy worker's looks at the timers
+#endif
+
+// Node scheduling state, a node is in at most one run queue and run by one worker at a time.
+// PAUSE is set on top by a deploy, the node is then parked when its turn ends and not
+// scheduled again until resumed. A parked node's sched is NRC_OS_NODE_PAUSE alone.
+#define NRC_OS_NODE_IDLE        (0)
+#define NRC_OS_NODE_SCHEDULED   (1)
+#define NRC_OS_NODE_PAUSE       (2)
+
 enum nrc_os_state {
     NRC_OS_S_INVALID = 0,
     NRC_OS_S_INITIALIZED,
-    NRC_OS_S_STARTED
+    NRC_OS_S_STARTED,
+    NRC_OS_S_STOPPED        // Only nrc_os_deinit is left
 };
 
-struct nrc_os_msg_hdr {
-    struct nrc_os_msg_hdr   *next;
+// One delivery of a message, the entry in a node mailbox
+struct nrc_os_msg_ref {
+    struct nrc_prioq_link   link;   // Must be first
+    struct nrc_os_msg_hdr   *msg;
     nrc_node_id_t           to_node_id;
     s8_t                    prio;
     s8_t                    padding[3];
+};
+
+struct nrc_os_msg_hdr {
+    struct nrc_os_msg_ref   ref;        // Used by the first delivery, more are allocated while it is queued
+    volatile u32_t          ref_busy;   // Set while ref is in a mailbox
+    volatile u32_t          ref_count;  // Owners of the message, payload is read-only when above 1
     u32_t                   total_size;
     u32_t                   type;
 };
@@ -42,274 +108,3283 @@ struct nrc_os_msg_tail {
     u32_t dead_beef;
 };
 
+#if NRC_OS_STATS
+// Each field has one writer at a time, no locked instructions on the dispatch path
+struct nrc_os_node_counters {
+    // Written by the worker running the node, nodes never run concurrently with themselves.
+    // Read whole without a lock, see nrc_os_stats_add. Times are in nrc_port_ticks.
+    volatile u64_t  recv_msg_count;
+    volatile u64_t  sent_msg_count;
+    volatile u64_t  recv_evt_count;
+    volatile u64_t  msg_time;
+    volatile u64_t  msg_time_max;
+    volatile u64_t  evt_time;
+    volatile u64_t  evt_time_max;
+
+    // Written under mq_lock
+    u64_t   dropped_count;
+    u64_t   rejected_count;
+    u32_t   queued_max;
+};
+#endif
+
+// Node told when a mailbox has drained to its low-water mark
+struct nrc_os_low_water_sub {
+    struct nrc_os_low_water_sub *next;
+    nrc_node_id_t               id;
+    u32_t                       event_mask;
+    s8_t                        prio;
+};
+
+// Output ports compiled from the node's wires at start, node[first[port]] up to node[first[port + 1]]
+struct nrc_os_wires {
+    struct nrc_os_node_hdr  **node;
+    u32_t                   port_count;
+    u32_t                   first[NRC_EMTPY_ARRAY];
+};
+
+// Dispatch state of a registered node, in a record of its own cache lines. What
+// every send and turn touches is first, on a 64-bit target that is the first line.
 struct nrc_os_node_hdr {
-    struct nrc_os_node_hdr  *next;
-    struct nrc_os_node_hdr  *previous;
+    volatile u32_t          sched;
+    volatile u32_t          event;
+    nrc_node_id_t           id;
+    s8_t                    prio;
+    s8_t                    evt_prio;           // Priority of the event that made event non-zero
+    u8_t                    mq_policy;          // enum nrc_os_queue_policy
+    u8_t                    mq_full;            // Limit reached, subscribers wait for low-water
+    struct nrc_node_api     *api;
+    struct nrc_node_hdr     *node_hdr;          // The node's own struct, given to the api
+
+    // Mailbox, messages are delivered in the order they were sent
+    nrc_port_mutex_t        mq_lock;
+    struct nrc_os_msg_ref   *mq_head;
+    struct nrc_os_msg_ref   *mq_tail;
+    u32_t                   mq_count;
+    u32_t                   mq_limit;           // 0 for no limit
+    u32_t                   mq_reserved;        // Room taken by sends to a rejecting node
+    u32_t                   mq_low_water;
+    struct nrc_os_low_water_sub *volatile mq_subs;
+
+    struct nrc_prioq_link   run_link;           // Link in a worker run queue
+    volatile u32_t          run_worker;         // Index + 1 of the worker whose run queue holds the node, 0 if none
+    volatile s8_t           run_prio;           // Priority queued at, written under that worker's lock
+    volatile u32_t          boost;              // Level + 1 of work of higher priority that came meanwhile, 0 if none
+    struct nrc_os_node_hdr  *inject_next;       // Link in an inject stack
+    struct nrc_os_wires     *wires;             // 0 until start, or if the node has no wires
+    struct nrc_os_node_cold *cold;
+
+#if NRC_OS_STATS
+    struct nrc_os_node_counters stats;
+#endif
+};
+
+// A record rounded up to whole cache lines, so no two nodes share one
+union nrc_os_node_slot {
+    struct nrc_os_node_hdr  node;
+    u8_t                    lines[NRC_OS_CACHE_LINES(sizeof(struct nrc_os_node_hdr)) * NRC_OS_CACHE_LINE];
+};
 
-    struct nrc_node_api *api;
-    const s8_t          *cfg_id;
+// Kernel data of a node id that dispatch never reads, kept as long as the id
+struct nrc_os_node_cold {
+    s8_t                    cfg_id[NRC_MAX_CFG_NAME_LEN];
+    u32_t                   cfg_hash;
+    u32_t                   wires_hash;     // From config at the last deploy
+    u32_t                   wires_missing;  // Wires left out, to nodes not registered
+    bool_t                  wires_changed;
+
+    // Set for nodes made by nrc_os_deploy
+    const struct nrc_os_node_type   *type;
+    u32_t                   params_hash;
+    u32_t                   deploy_gen;     // Last deploy that found the node in config
+    bool_t                  held;           // Paused until the deploy has started it
+    bool_t                  removing;       // Left out of wires, removed once none lead to it
+    struct nrc_os_node_hdr  *deploy_next;   // Nodes the deploy inits and starts
+};
 
-    u32_t               event;
-    s8_t                prio;
-    s8_t                padding[3];
+// In front of the node's own struct
+struct nrc_os_node_tag {
+    struct nrc_os_node_hdr  *hot;           // 0 until registered
+    u32_t                   type;
+    u32_t                   padding;
+};
 
-    u32_t               type;
+// Deliveries for one target collected by a batch send
+struct nrc_os_batch_run {
+    struct nrc_os_node_hdr  *node;
+    struct nrc_os_msg_ref   *head;
+    struct nrc_os_msg_ref   *tail;
+    u32_t                   count;
 };
 
-struct nrc_os {
-    enum nrc_os_state           state;
+struct nrc_os_registry_slot {
+    u32_t                           hash;
+    struct nrc_os_node_hdr *volatile node;  // 0 if the slot is free, set after hash
+};
+
+// Open addressing index on cfg_id, power of two slots, at most half full. Built a
+// quarter full so registrations insert in place until it is replaced by one twice
+// the size.
+struct nrc_os_registry {
+    struct nrc_os_registry      *retired;   // The table this one replaced, freed by nrc_os_deinit
+    u32_t                       mask;
+    u32_t                       count;
+    struct nrc_os_registry_slot slot[NRC_EMTPY_ARRAY];
+};
 
+struct nrc_os_worker {
     nrc_port_thread_t           thread;
     nrc_port_sema_t             sema;
+    nrc_port_mutex_t            lock;
+    struct nrc_prioq            run_queue;  // Ready nodes, protected by lock
+    volatile u32_t              best_level; // Level of the first node in run_queue, read without lock
+    u32_t                       index;
+    u32_t                       timer_turns;
+#if NRC_OS_STATS
+    u64_t                       now;        // Last time read by the worker, in ns
+#endif
+};
 
-    struct nrc_os_node_hdr      *node_list;
-    struct nrc_os_msg_hdr       *msg_list;
+struct nrc_os {
+    enum nrc_os_state           state;
+
+    u32_t                       worker_count;
+    volatile u32_t              worker_started;
+    volatile u32_t              worker_stop;    // Set to make the workers return
+    volatile u32_t              idle_mask;  // Bit set while a worker sleeps
+    struct nrc_os_worker        worker[NRC_OS_MAX_WORKERS];
+
+    // Records of the registered nodes by id, id 1 is the first record of the first
+    // chunk. A chunk is allocated with its first node and ids are never reused.
+    union nrc_os_node_slot      *node_chunk[NRC_OS_NODE_CHUNKS];
+    u8_t                        *node_chunk_mem[NRC_OS_NODE_CHUNKS];    // As allocated, before aligning
+    volatile u32_t              node_count;
+
+    // Lookups read the registry without locks. A slot is only ever filled, so a
+    // registration inserts in place while there is room. Once frozen by nrc_os_start
+    // a replaced table is kept until nrc_os_deinit, a reader may still be in it.
+    struct nrc_os_registry      *volatile registry;
+    bool_t                      registry_frozen;
+
+    // Deploy from config, see nrc_os_deploy. A worker parking a paused node signals deploy_sema.
+    const struct nrc_os_node_type   *node_types;
+    u32_t                       node_type_count;
+    u32_t                       deploy_gen;
+    nrc_port_sema_t             deploy_sema;
+
+    // Static arena, see nrc_os_set_arena. Set before the first node, never changed.
+    struct nrc_arena            arena;
+    bool_t                      arena_set;
+    bool_t                      arena_failed;   // Too small, nrc_os_start refuses
+    u8_t                        *arena_memory;  // Reserved from the heap, freed by nrc_os_deinit
+
+    // Nodes made ready outside a worker, e.g. by nrc_os_set_evt from a driver thread.
+    // One lock-free stack per priority level, taken whole by the first worker to look.
+    struct nrc_os_node_hdr      *volatile inject[NRC_PRIOQ_LEVELS];
+    volatile u32_t              inject_bitmap[NRC_OS_INJECT_WORDS];
+    volatile u32_t              inject_pending;
+
+    // Messages sent with nrc_os_send_msg_lock_free, linked through the embedded ref.
+    // Producers push with one exchange on ingress_head, one worker at a time takes
+    // from ingress_tail. The stub keeps the queue from ever being empty of links.
+    struct nrc_os_msg_ref       *volatile ingress_head;
+    struct nrc_os_msg_ref       *ingress_tail;
+    struct nrc_os_msg_ref       ingress_stub;
+    volatile u32_t              ingress_pending;
+    volatile u32_t              ingress_busy;   // Set while a worker takes from the queue
+
+    // Timers, any worker advances the wheel. timer_due is the next tick the wheel
+    // has work, NRC_TIMER_NEVER if none, written under timer_lock.
+    nrc_port_mutex_t            timer_lock;
+    struct nrc_timer_wheel      timer_wheel;
+    u64_t                       timer_due;
+    volatile u32_t              timer_sleeper;  // Index + 1 of the idle worker that sleeps until timer_due
+
+#if NRC_OS_STATS
+    // Periodic dump, only touched by the first worker once started
+    nrc_os_stats_hook_t         stats_hook;
+    u64_t                       stats_period;
+    u64_t                       stats_due;
+
+    // Ticks and ns at init, to scale ticks to ns over all the time since
+    u64_t                       stats_ticks;
+    u64_t                       stats_ns;
+#endif
 };
 
 static struct nrc_os _os;
 
-static void nrc_os_thread_fcn(void)
+static NRC_PORT_THREAD_LOCAL struct nrc_os_worker *_os_current_worker;
+
+#if NRC_OS_STATS
+// Node in recv_msg/recv_evt on this thread, its sends are counted
+static NRC_PORT_THREAD_LOCAL struct nrc_os_node_hdr *_os_current_node;
+#endif
+
+static void nrc_os_take_ingress(void);
+static struct nrc_os_msg_ref* nrc_os_ingress_pop(void);
+static void nrc_os_msg_ref_put(struct nrc_os_msg_ref *ref);
+static void nrc_os_msg_ref_drop_list(struct nrc_os_msg_ref *ref);
+static void nrc_os_msg_release(struct nrc_os_msg_hdr *header);
+static void nrc_os_node_free(struct nrc_node_hdr *node_hdr);
+static void nrc_os_node_pause(struct nrc_os_node_hdr *node);
+
+// Bytes a message of size takes with the kernel's header and tail
+static u32_t nrc_os_msg_total_size(u32_t size)
 {
-    //printf("Enter NRC OS Thread\n");
+    if ((size % 4) != 0) {
+        size += 4 - (size % 4);
+    }
 
-    //printf("Exit NRC OS Thread\n");
+    return sizeof(struct nrc_os_msg_hdr) + size + sizeof(struct nrc_os_msg_tail);
 }
 
-s32_t nrc_os_init(void)
+// Messages and deliveries, freed while running
+static void* nrc_os_mem_alloc(u32_t size)
 {
-    s32_t result = 0;
-
-    assert(sizeof(struct nrc_os_msg_hdr) % 4 == 0);
-    assert(sizeof(struct nrc_os_msg_tail) % 4 == 0);
+    return _os.arena_set ? nrc_arena_alloc(&_os.arena, size) : nrc_port_heap_fast_alloc(size);
+}
 
-    memset(&_os, 0, sizeof(struct nrc_os));
+static void nrc_os_mem_free(void *buf)
+{
+    if (_os.arena_set && nrc_arena_owns(&_os.arena, buf)) {
+        nrc_arena_free(&_os.arena, buf);
+    }
+    else {
+        nrc_port_heap_fast_free(buf);
+    }
+}
 
-    result = nrc_port_sema_init(0, &_os.sema);
-    assert(result == NRC_PORT_RES_OK);
+// Nodes and what belongs to them, kept as long as the kernel
+static void* nrc_os_mem_keep(u32_t size)
+{
+    return _os.arena_set ? nrc_arena_bump(&_os.arena, size) : nrc_port_heap_alloc(size);
+}
 
-    result = nrc_port_thread_init(
-        NRC_PORT_THREAD_PRIO_NORMAL,
-        NRC_OS_STACK_SIZE,
-        nrc_os_thread_fcn,
-        &(_os.thread));
-    assert(result == NRC_PORT_RES_OK);
+// Record of an id, also of a node removed by a deploy. 0 if the id was never given.
+static struct nrc_os_node_hdr* nrc_os_node_record(nrc_node_id_t id)
+{
+    struct nrc_os_node_hdr *node = 0;
 
-    _os.state = NRC_OS_S_INITIALIZED;
+    // Id 0 wraps around and is out of range too
+    if ((u32_t)(id - 1) < nrc_port_atomic_load_acquire(&_os.node_count)) {
+        node = &_os.node_chunk[(id - 1) / NRC_OS_NODE_CHUNK][(id - 1) % NRC_OS_NODE_CHUNK].node;
+    }
 
-    return result;
+    return node;
 }
 
-s32_t nrc_os_deinit(void)
+// Record of a registered node, 0 if id is not one
+static struct nrc_os_node_hdr* nrc_os_node(nrc_node_id_t id)
 {
-    s32_t result = NRC_PORT_RES_OK;
+    struct nrc_os_node_hdr *node = nrc_os_node_record(id);
 
-    assert(_os.state == NRC_OS_S_INITIALIZED);
+    // A removed node keeps its record without an api
+    if ((node != 0) && (nrc_port_atomic_load_ptr((void *volatile *)&node->api) == 0)) {
+        node = 0;
+    }
 
-    //TODO: Dealloc all nodes, messages, events, etc..
-    
-    return result;
+    return node;
 }
 
-s32_t nrc_os_start(void)
+// Record of the node whose own struct is node_hdr, 0 if it is not registered
+static struct nrc_os_node_hdr* nrc_os_node_of(const struct nrc_node_hdr *node_hdr)
 {
-    s32_t result;
+    const struct nrc_os_node_tag *tag = (const struct nrc_os_node_tag*)node_hdr - 1;
 
-    assert(_os.state == NRC_OS_S_INITIALIZED);
+    return (tag->type == NRC_OS_NODE_TYPE) ? tag->hot : 0;
+}
 
-    result = nrc_port_thread_start(_os.thread);
-    assert(result == NRC_PORT_RES_OK);
+static void nrc_os_worker_update_best(struct nrc_os_worker *worker)
+{
+    s8_t prio;
+    u32_t level = NRC_OS_LEVEL_EMPTY;
 
-    _os.state = NRC_OS_S_STARTED;
-    
-    return result;
+    if (nrc_prioq_peek_prio(&worker->run_queue, &prio)) {
+        level = NRC_OS_LEVEL(prio);
+    }
+    nrc_port_atomic_store(&worker->best_level, level);
 }
 
-s32_t nrc_os_stop(void)
+// Wakes one sleeping worker, if any
+static void nrc_os_wake_idle(void)
 {
-    s32_t result = NRC_PORT_RES_OK;
+    u32_t idle = nrc_port_atomic_load(&_os.idle_mask);
 
-    assert(_os.state == NRC_OS_S_STARTED);
+    while (idle != 0) {
+        u32_t bit = idle & (~idle + 1);
 
-    //TODO:
-    
-    return result;
+        if ((nrc_port_atomic_and(&_os.idle_mask, ~bit) & bit) != 0) {
+            u32_t index = 0;
+
+            while ((bit >>= 1) != 0) {
+                index++;
+            }
+            nrc_port_sema_signal(_os.worker[index].sema);
+            break;
+        }
+        idle = nrc_port_atomic_load(&_os.idle_mask);
+    }
 }
 
-struct nrc_node_hdr* nrc_os_node_alloc(u32_t size)
+static void nrc_os_wake_worker(u32_t index)
 {
-    u32_t total_size = sizeof(struct nrc_os_node_hdr) + size;
+    u32_t bit = 1U << index;
 
-    struct nrc_os_node_hdr  *os_node_hdr = (struct nrc_os_node_hdr*)nrc_port_heap_alloc(total_size);
-    struct nrc_node_hdr     *node_hdr = 0;
+    if ((nrc_port_atomic_and(&_os.idle_mask, ~bit) & bit) != 0) {
+        nrc_port_sema_signal(_os.worker[index].sema);
+    }
+}
 
-    if (os_node_hdr != 0) {
-        node_hdr = (struct nrc_node_hdr*)(os_node_hdr + 1);
+static void nrc_os_inject(struct nrc_os_node_hdr *node, s8_t prio)
+{
+    u32_t                   level = NRC_OS_LEVEL(prio);
+    struct nrc_os_node_hdr  *head;
 
-        memset(os_node_hdr, 0, sizeof(struct nrc_os_node_hdr));
-        memset(node_hdr, 0, sizeof(struct nrc_node_hdr));
+    node->run_prio = prio;
 
-        os_node_hdr->prio = S8_MAX_VALUE;
-        os_node_hdr->type = NRC_OS_NODE_TYPE;
+    do {
+        head = (struct nrc_os_node_hdr*)nrc_port_atomic_load_ptr((void *volatile *)&_os.inject[level]);
+        node->inject_next = head;
+    } while (!nrc_port_atomic_cas_ptr((void *volatile *)&_os.inject[level], head, node));
+
+    nrc_port_atomic_or(&_os.inject_bitmap[level / 32], 1U << (level % 32));
+    nrc_port_atomic_store(&_os.inject_pending, 1);
+}
+
+// Priority to queue the node at, raised by work of a higher priority that came while it was
+// queued or running, see nrc_os_node_promote
+static s8_t nrc_os_node_boosted(struct nrc_os_node_hdr *node, s8_t prio)
+{
+    u32_t boost;
+
+    if (nrc_port_atomic_load(&node->boost) != 0) {
+        boost = nrc_port_atomic_xchg(&node->boost, 0);
+
+        if ((boost != 0) && (boost - 1 < NRC_OS_LEVEL(prio))) {
+            prio = NRC_OS_PRIO(boost - 1);
+        }
     }
 
-    return node_hdr;
+    return prio;
 }
 
-s32_t nrc_os_register_node(struct nrc_node_hdr *node_hdr, struct nrc_node_api *api, const s8_t *cfg_id)
+// Worker lock held. The worker is set before the boost is read, see nrc_os_node_promote.
+static void nrc_os_run_queue_link(struct nrc_os_worker *worker, struct nrc_os_node_hdr *node, s8_t prio)
 {
-    s32_t result = NRC_PORT_RES_INVALID_IN_PARAM;
+    nrc_port_atomic_store(&node->run_worker, worker->index + 1);
+    prio = nrc_os_node_boosted(node, prio);
+    node->run_prio = prio;
+    nrc_prioq_put(&worker->run_queue, &node->run_link, prio);
+}
 
-    if ((node_hdr != 0) && (api != 0) && (cfg_id != 0) &&
-        (api->init != 0) && (api->deinit != 0) && (api->start != 0) && (api->stop != 0) &&
-        (api->recv_msg != 0) && (api->recv_evt != 0)) {
+// Gives TRUE if the queue already had work, then it is worth waking a thief
+static bool_t nrc_os_run_queue_add(struct nrc_os_worker *worker, struct nrc_os_node_hdr *node, s8_t prio)
+{
+    bool_t was_empty;
+
+    nrc_port_mutex_lock(worker->lock, 0);
+    was_empty = (worker->run_queue.count == 0);
+    nrc_os_run_queue_link(worker, node, prio);
+    nrc_os_worker_update_best(worker);
+    nrc_port_mutex_unlock(worker->lock);
 
-        struct nrc_os_node_hdr *os_node_hdr = (struct nrc_os_node_hdr*)node_hdr - 1;
+    // The worker itself picks up the first node
+    return !was_empty;
+}
 
-        if (os_node_hdr->type != NRC_OS_NODE_TYPE) {
-            os_node_hdr->api = api;
-            os_node_hdr->cfg_id = cfg_id;
-            os_node_hdr->prio = S8_MAX_VALUE;
-            os_node_hdr->event = 0;
+static void nrc_os_run_queue_put(struct nrc_os_worker *worker, struct nrc_os_node_hdr *node, s8_t prio)
+{
+    if (nrc_os_run_queue_add(worker, node, prio)) {
+        nrc_os_wake_idle();
+    }
+}
 
-            if (_os.node_list == 0) {
-                _os.node_list = os_node_hdr;
-                os_node_hdr->previous = 0;
-            }
-            else {
-                struct nrc_os_node_hdr *node = _os.node_list;
+// The node is already queued or running and got work of prio. Work of a higher priority is
+// recorded as a boost, then the node is moved up if it waits in a run queue. Otherwise the
+// boost is taken when the node is next queued, by a worker or from an inject stack. One left
+// after the node went idle raises a later turn at most. Gives TRUE if the node was moved.
+static bool_t nrc_os_node_promote(struct nrc_os_node_hdr *node, s8_t prio, bool_t lock_free)
+{
+    struct nrc_os_worker    *worker;
+    u32_t                   level = NRC_OS_LEVEL(prio);
+    u32_t                   boost;
+    u32_t                   index;
+    s8_t                    queued;
+    bool_t                  moved = FALSE;
+
+    if (prio >= node->run_prio) {
+        return FALSE;
+    }
 
-                while (node->next != 0) {
-                    node = node->next;
-                }
+    boost = nrc_port_atomic_load(&node->boost);
+    while (((boost == 0) || (level < boost - 1)) && !nrc_port_atomic_cas(&node->boost, boost, level + 1)) {
+        boost = nrc_port_atomic_load(&node->boost);
+    }
+
+    // Read after the boost is set, so a worker queueing the node meanwhile either takes it or is seen
+    index = nrc_port_atomic_load(&node->run_worker);
+
+    if ((index != 0) && (lock_free == FALSE)) {
+        worker = &_os.worker[index - 1];
 
-                node->next = os_node_hdr;
-                os_node_hdr->previous = node;
+        nrc_port_mutex_lock(worker->lock, 0);
+        if (nrc_port_atomic_load(&node->run_worker) == index) {
+            queued = node->run_prio;
+            prio = nrc_os_node_boosted(node, queued);
+
+            // Queued at run_prio while run_worker names this worker
+            if (prio < queued) {
+                nrc_prioq_remove(&worker->run_queue, &node->run_link, queued);
+                node->run_prio = prio;
+                nrc_prioq_put(&worker->run_queue, &node->run_link, prio);
+                nrc_os_worker_update_best(worker);
+                moved = TRUE;
             }
+        }
+        nrc_port_mutex_unlock(worker->lock);
+    }
 
-            result = NRC_PORT_RES_OK;
+    return moved;
+}
+
+// Called after work was added to the node. Queues the node unless it is already queued or running,
+// then work of a higher priority than it was queued with promotes it.
+// Gives TRUE if a sleeping worker should be woken, so a batch can wake once.
+static bool_t nrc_os_node_ready(struct nrc_os_node_hdr *node, s8_t prio, bool_t lock_free)
+{
+    bool_t wake = FALSE;
+
+    if (nrc_port_atomic_cas(&node->sched, NRC_OS_NODE_IDLE, NRC_OS_NODE_SCHEDULED)) {
+        struct nrc_os_worker *worker = _os_current_worker;
+
+        if ((worker != 0) && (lock_free == FALSE)) {
+            wake = nrc_os_run_queue_add(worker, node, prio);
+        }
+        else {
+            nrc_os_inject(node, prio);
+            wake = TRUE;
         }
     }
+    else {
+        wake = nrc_os_node_promote(node, prio, lock_free);
+    }
 
-    return result;
+    return wake;
 }
 
-s32_t nrc_os_get_node_id(const s8_t *cfg_id, nrc_node_id_t *id)
+static void nrc_os_node_wake(struct nrc_os_node_hdr *node, s8_t prio, bool_t lock_free)
 {
-    s32_t result = NRC_PORT_RES_INVALID_IN_PARAM;
+    if (nrc_os_node_ready(node, prio, lock_free)) {
+        nrc_os_wake_idle();
+    }
+}
 
-    if ((cfg_id != 0) && (id != 0)) {
+// Moves all injected nodes to the worker's run queue
+static void nrc_os_take_injected(struct nrc_os_worker *worker)
+{
+    struct nrc_os_node_hdr  *node;
+    struct nrc_os_node_hdr  *chain;
+    struct nrc_os_node_hdr  *next;
+    u32_t                   word;
+    u32_t                   bits;
+    u32_t                   bit;
+    u32_t                   level;
 
-        *id = 0;
-        result = NRC_PORT_RES_NOT_FOUND;
+    nrc_port_mutex_lock(worker->lock, 0);
 
-        bool_t                  found = FALSE;
-        struct nrc_os_node_hdr  *node = _os.node_list;
+    for (word = 0; word < NRC_OS_INJECT_WORDS; word++) {
+        bits = nrc_port_atomic_load(&_os.inject_bitmap[word]);
 
-        while ((found == FALSE) && (node != 0)) {
-            if (strncmp(cfg_id, node->cfg_id, NRC_MAX_CFG_NAME_LEN) == 0) {
-                found = TRUE;
-                *id = (nrc_node_id_t)node;
-                result = NRC_PORT_RES_OK;
+        for (bit = 0; bits != 0; bit++, bits >>= 1) {
+            if ((bits & 1) == 0) {
+                continue;
+            }
+
+            // Clear before taking the stack, a concurrent push sets the bit again
+            level = (word * 32) + bit;
+            nrc_port_atomic_and(&_os.inject_bitmap[word], ~(1U << bit));
+            node = (struct nrc_os_node_hdr*)nrc_port_atomic_xchg_ptr((void *volatile *)&_os.inject[level], 0);
+
+            // Stack is LIFO, reverse it to keep the order of arrival
+            chain = 0;
+            while (node != 0) {
+                next = node->inject_next;
+                node->inject_next = chain;
+                chain = node;
+                node = next;
+            }
+            while (chain != 0) {
+                node = chain;
+                chain = node->inject_next;
+                nrc_os_run_queue_link(worker, node, NRC_OS_PRIO(level));
             }
-            node = node->next;
         }
     }
-     
-    return result;
+
+    nrc_os_worker_update_best(worker);
+    nrc_port_mutex_unlock(worker->lock);
 }
 
-struct nrc_msg_hdr* nrc_os_msg_alloc(u32_t size)
+static struct nrc_os_node_hdr* nrc_os_run_queue_get(struct nrc_os_worker *worker)
 {
-    if ((size % 4) != 0) {
-        size += 4 - (size % 4);
+    struct nrc_prioq_link   *link;
+    struct nrc_os_node_hdr  *node = 0;
+
+    nrc_port_mutex_lock(worker->lock, 0);
+    link = nrc_prioq_get(&worker->run_queue, 0);
+    if (link != 0) {
+        node = (struct nrc_os_node_hdr*)((u8_t*)link - offsetof(struct nrc_os_node_hdr, run_link));
+        nrc_port_atomic_store_release(&node->run_worker, 0);
+        nrc_os_worker_update_best(worker);
     }
+    nrc_port_mutex_unlock(worker->lock);
 
-    u32_t total_size = sizeof(struct nrc_os_msg_hdr) + size + sizeof(struct nrc_os_msg_tail);
+    return node;
+}
 
-    struct nrc_os_msg_hdr *header = (struct nrc_os_msg_hdr*)nrc_port_heap_fast_alloc(total_size);
-    struct nrc_msg_hdr    *msg = 0;
+// Next node to run. Steals when another worker holds higher priority work than the local queue.
+static struct nrc_os_node_hdr* nrc_os_next_node(struct nrc_os_worker *worker)
+{
+    struct nrc_os_node_hdr  *node = 0;
+    struct nrc_os_worker    *victim = 0;
+    u32_t                   best;
+    u32_t                   level;
+    u32_t                   i;
+
+    if (nrc_port_atomic_load(&_os.ingress_pending) != 0) {
+        nrc_os_take_ingress();
+    }
+    if ((nrc_port_atomic_load(&_os.inject_pending) != 0) && (nrc_port_atomic_xchg(&_os.inject_pending, 0) != 0)) {
+        nrc_os_take_injected(worker);
+    }
 
-    if (header != 0) {
-        msg = (struct nrc_msg_hdr*)(header + 1);
+    best = nrc_port_atomic_load(&worker->best_level);
 
-        struct nrc_os_msg_tail *tail = (struct nrc_os_msg_tail*)((uint8_t*)msg + size);
+    for (i = 1; i < _os.worker_count; i++) {
+        struct nrc_os_worker *other = &_os.worker[(worker->index + i) % _os.worker_count];
 
-        memset(&header, 0, sizeof(header));
-        memset(&msg, 0, sizeof(struct nrc_msg_hdr));
+        level = nrc_port_atomic_load(&other->best_level);
+        if (level < best) {
+            best = level;
+            victim = other;
+        }
+    }
 
-        header->total_size = total_size;
-        header->type = NRC_OS_MSG_TYPE;
-        tail->dead_beef = 0xDEADBEEF;
+    if (victim != 0) {
+        node = nrc_os_run_queue_get(victim);
     }
-    
-    return msg;
+    if (node == 0) {
+        node = nrc_os_run_queue_get(worker);
+    }
+
+    return node;
 }
 
-struct nrc_msg_hdr* nrc_os_msg_clone(struct nrc_msg_hdr *msg)
+static bool_t nrc_os_work_available(void)
 {
-    //TODO: Check valid message
+    bool_t  available = (nrc_port_atomic_load(&_os.inject_pending) != 0) || (nrc_port_atomic_load(&_os.ingress_pending) != 0);
+    u32_t   i;
+
+    for (i = 0; (available == FALSE) && (i < _os.worker_count); i++) {
+        available = (nrc_port_atomic_load(&_os.worker[i].best_level) != NRC_OS_LEVEL_EMPTY);
+    }
+
+    return available;
+}
 
-    struct nrc_os_msg_hdr *header = (struct nrc_os_msg_hdr*)msg - 1;
-    struct nrc_os_msg_hdr *new_header = (struct nrc_os_msg_hdr*)nrc_port_heap_fast_alloc(header->total_size);
+static void nrc_os_low_water_notify(struct nrc_os_node_hdr *node)
+{
+    struct nrc_os_low_water_sub *sub;
 
-    memcpy(new_header, header, header->total_size);
+    sub = (struct nrc_os_low_water_sub*)nrc_port_atomic_load_ptr((void *volatile *)&node->mq_subs);
+    for (; sub != 0; sub = sub->next) {
+        nrc_os_set_evt(sub->id, sub->event_mask, sub->prio);
+    }
+}
 
-    return (struct nrc_msg_hdr*)(new_header + 1);
+#if NRC_OS_STATS
+// Counters have one writer, a plain add that is stored whole
+static void nrc_os_stats_add(volatile u64_t *counter, u64_t value)
+{
+    nrc_port_atomic_store64(counter, nrc_port_atomic_load64(counter) + value);
 }
 
-void nrc_os_msg_free(struct nrc_msg_hdr *msg)
+static void nrc_os_stats_max(volatile u64_t *counter, u64_t value)
 {
-    struct nrc_os_msg_hdr   *os_msg_header;
+    if (value > nrc_port_atomic_load64(counter)) {
+        nrc_port_atomic_store64(counter, value);
+    }
+}
+#endif
 
-    while (msg != 0) {
-        os_msg_header = (struct nrc_os_msg_hdr*)msg - 1;
+static void nrc_os_run_node(struct nrc_os_worker *worker, struct nrc_os_node_hdr *node)
+{
+    struct nrc_node_hdr     *node_hdr = node->node_hdr;
+    struct nrc_msg_hdr      *msgs[NRC_OS_BATCH_SIZE];
+    u32_t                   msg_count = 0;
+    struct nrc_os_msg_ref   *batch;
+    struct nrc_os_msg_ref   *last;
+    struct nrc_os_msg_ref   *ref;
+    struct nrc_os_msg_hdr   *os_msg_hdr;
+    u32_t                   event;
+    u32_t                   count;
+    s8_t                    prio;
+    bool_t                  drained;
+    bool_t                  parked = FALSE;
+#if NRC_OS_STATS
+    u64_t                   start;
+    u64_t                   time;
+
+    // Every turn is timed in ticks, converted to ns when read
+    _os_current_node = node;
+#endif
+
+    // Queued before a deploy paused it, see nrc_os_node_pause
+    if (((nrc_port_atomic_load(&node->sched) & NRC_OS_NODE_PAUSE) != 0) &&
+        nrc_port_atomic_cas(&node->sched, NRC_OS_NODE_SCHEDULED | NRC_OS_NODE_PAUSE, NRC_OS_NODE_PAUSE)) {
+#if NRC_OS_STATS
+        _os_current_node = 0;
+#endif
+        nrc_port_sema_signal(_os.deploy_sema);
+        return;
+    }
 
-        //TODO: Check valid message
+    NRC_TRACE(NRC_TRACE_K_TURN_BEGIN, node->id, 0, 0);
+
+    event = nrc_port_atomic_xchg(&node->event, 0);
+    if (event != 0) {
+#if NRC_OS_STATS
+        start = nrc_port_ticks();
+#endif
+        NRC_TRACE(NRC_TRACE_K_RECV_EVT, node->id, 0, event);
+        node->api->recv_evt(node_hdr, event);
+#if NRC_OS_STATS
+        time = nrc_port_ticks() - start;
+        nrc_os_stats_add(&node->stats.recv_evt_count, 1);
+        nrc_os_stats_add(&node->stats.evt_time, time);
+        nrc_os_stats_max(&node->stats.evt_time_max, time);
+#endif
+    }
 
-        msg = msg->next;
+    // Take up to a batch of messages from the mailbox
+    nrc_port_mutex_lock(node->mq_lock, 0);
+    batch = node->mq_head;
+    last = batch;
+    for (count = 1; (last != 0) && (count < NRC_OS_BATCH_SIZE); count++) {
+        last = (struct nrc_os_msg_ref*)last->link.next;
+    }
+    if (last != 0) {
+        node->mq_head = (struct nrc_os_msg_ref*)last->link.next;
+        last->link.next = 0;
+    }
+    else {
+        node->mq_head = 0;
+    }
+    if (node->mq_head == 0) {
+        node->mq_tail = 0;
+    }
+    // The loop stops on the last message taken, or after the end of the mailbox
+    if (last == 0) {
+        count--;
+    }
+    node->mq_count -= count;
+
+    drained = (node->mq_full != 0) && (node->mq_count <= node->mq_low_water);
+    if (drained) {
+        node->mq_full = 0;
+    }
+    nrc_port_mutex_unlock(node->mq_lock);
+
+    // Producers held back by the limit get going while this batch runs
+    if (drained) {
+        nrc_os_low_water_notify(node);
+    }
+
+#if NRC_OS_STATS
+    start = nrc_port_ticks();
+#endif
+
+    while (batch != 0) {
+        ref = batch;
+        batch = (struct nrc_os_msg_ref*)ref->link.next;
+        os_msg_hdr = ref->msg;
+
+        // Release the delivery before the node gets the message, it may send it on
+        if (ref == &os_msg_hdr->ref) {
+            ref->link.next = 0;
+            nrc_port_atomic_store(&os_msg_hdr->ref_busy, FALSE);
+        }
+        else {
+            nrc_os_mem_free(ref);
+        }
+
+        NRC_TRACE(NRC_TRACE_K_RECV_MSG, node->id, os_msg_hdr + 1, 0);
+
+        if (node->api->recv_msg_batch != 0) {
+            msgs[msg_count++] = (struct nrc_msg_hdr*)(os_msg_hdr + 1);
+        }
+        else {
+            node->api->recv_msg(node_hdr, (struct nrc_msg_hdr*)(os_msg_hdr + 1));
+        }
+    }
+
+    if (msg_count != 0) {
+        node->api->recv_msg_batch(node_hdr, msgs, msg_count);
+    }
+
+#if NRC_OS_STATS
+    if (count != 0) {
+        time = nrc_port_ticks() - start;
+        nrc_os_stats_add(&node->stats.recv_msg_count, count);
+        nrc_os_stats_add(&node->stats.msg_time, time);
+        nrc_os_stats_max(&node->stats.msg_time_max, time);
+    }
+    _os_current_node = 0;
+#endif
+
+    NRC_TRACE(NRC_TRACE_K_TURN_END, node->id, 0, count);
+
+    // Go idle unless more work arrived. Senders append under mq_lock and then try
+    // to wake the node, so either they see it idle or we see their message here.
+    // A node paused by a deploy is parked instead, with its messages.
+    nrc_port_mutex_lock(node->mq_lock, 0);
+    ref = node->mq_head;
+    if (ref != 0) {
+        prio = ref->prio;
+
+        if (((nrc_port_atomic_load(&node->sched) & NRC_OS_NODE_PAUSE) != 0) &&
+            nrc_port_atomic_cas(&node->sched, NRC_OS_NODE_SCHEDULED | NRC_OS_NODE_PAUSE, NRC_OS_NODE_PAUSE)) {
+            ref = 0;
+            parked = TRUE;
+        }
+    }
+    else {
+        parked = ((nrc_port_atomic_and(&node->sched, ~(u32_t)NRC_OS_NODE_SCHEDULED) & NRC_OS_NODE_PAUSE) != 0);
+    }
+    nrc_port_mutex_unlock(node->mq_lock);
 
-        nrc_port_heap_fast_free(os_msg_header);
+    if (ref != 0) {
+        nrc_os_run_queue_put(worker, node, prio);
+    }
+    else if (parked) {
+        nrc_port_sema_signal(_os.deploy_sema);
+    }
+    else if ((nrc_port_atomic_load(&node->event) != 0) &&
+             nrc_port_atomic_cas(&node->sched, NRC_OS_NODE_IDLE, NRC_OS_NODE_SCHEDULED)) {
+        nrc_os_run_queue_put(worker, node, node->evt_prio);
     }
 }
 
+#if NRC_OS_STATS
+// Scaled by the rate of ticks against ns since init, so the estimate improves as time goes
+static u64_t nrc_os_stats_ns(u64_t ticks)
+{
+    u64_t ticks_since = nrc_port_ticks() - _os.stats_ticks;
+    u64_t ns_since = nrc_port_time_ns() - _os.stats_ns;
+
+    return (ticks_since != 0) ? (u64_t)((double)ticks * ((double)ns_since / (double)ticks_since)) : ticks;
+}
 
-s32_t nrc_os_send_msg(nrc_node_id_t id, struct nrc_msg_hdr *msg, s8_t prio)
+static void nrc_os_stats_read(struct nrc_os_node_hdr *node, struct nrc_os_stats *stats)
 {
-    s32_t result = NRC_PORT_RES_INVALID_IN_PARAM;
+    stats->recv_msg_count = nrc_port_atomic_load64(&node->stats.recv_msg_count);
+    stats->sent_msg_count = nrc_port_atomic_load64(&node->stats.sent_msg_count);
+    stats->recv_evt_count = nrc_port_atomic_load64(&node->stats.recv_evt_count);
+    stats->msg_time = nrc_os_stats_ns(nrc_port_atomic_load64(&node->stats.msg_time));
+    stats->msg_time_max = nrc_os_stats_ns(nrc_port_atomic_load64(&node->stats.msg_time_max));
+    stats->evt_time = nrc_os_stats_ns(nrc_port_atomic_load64(&node->stats.evt_time));
+    stats->evt_time_max = nrc_os_stats_ns(nrc_port_atomic_load64(&node->stats.evt_time_max));
+
+    nrc_port_mutex_lock(node->mq_lock, 0);
+    stats->dropped_count = node->stats.dropped_count;
+    stats->rejected_count = node->stats.rejected_count;
+    stats->queued = node->mq_count;
+    stats->queued_max = node->stats.queued_max;
+    nrc_port_mutex_unlock(node->mq_lock);
+}
 
-    if ((id != 0) && (msg != 0)) {
+static void nrc_os_stats_dump(struct nrc_os_worker *worker)
+{
+    struct nrc_os_node_hdr  *node;
+    struct nrc_os_stats     stats;
+    nrc_node_id_t           id;
+
+    // Ids are never reused, a node registered meanwhile is in the next dump
+    for (id = 1; (node = nrc_os_node_record(id)) != 0; id++) {
+        if (node->api != 0) {
+            nrc_os_stats_read(node, &stats);
+            _os.stats_hook(id, node->cold->cfg_id, &stats);
+        }
+    }
 
-        struct nrc_os_node_hdr  *os_node_hdr = (struct nrc_os_node_hdr*)id - 1;
-        struct nrc_os_msg_hdr   *os_msg_hdr = (struct nrc_os_msg_hdr*)msg - 1;
+    _os.stats_due += _os.stats_period;
+    if (_os.stats_due <= worker->now) {
+        // Fell behind, e.g. a long turn, skip the missed periods
+        _os.stats_due = worker->now + _os.stats_period;
+    }
+}
 
-        if ((os_node_hdr->type == NRC_OS_NODE_TYPE) && (os_msg_hdr->type == NRC_OS_MSG_TYPE)) {
+// Sleep of an idle worker, in ms with 0 for no limit. The first worker wakes for the next dump.
+static u32_t nrc_os_stats_timeout(struct nrc_os_worker *worker)
+{
+    u32_t   timeout = 0;
+    u64_t   now;
+
+    if ((_os.stats_hook != 0) && (worker->index == 0)) {
+        now = nrc_port_time_ns();
+        timeout = 1;
+        if (_os.stats_due > now) {
+            timeout += (u32_t)((_os.stats_due - now) / 1000000ULL);
+        }
+    }
 
-            os_msg_hdr->prio = prio;
+    return timeout;
+}
+#else
+#define nrc_os_stats_timeout(worker)    (0)
+#endif
 
-            if ((_os.msg_list == 0) || (os_msg_hdr->prio < _os.msg_list->prio)) {
-                os_msg_hdr->next = _os.msg_list;
-                _os.msg_list = os_msg_hdr;
-            }
-            else {
-                struct nrc_os_msg_hdr *msg = _os.msg_list;
+// Timer ticks are ms
+static u64_t nrc_os_timer_now(void)
+{
+    return nrc_port_time_ns() / 1000000ULL;
+}
 
-                while ((msg->next != 0) && (os_msg_hdr->prio >= msg->next->prio)) {
-                    msg = msg->next;
-                }
-                os_msg_hdr->next = msg->next;
-                msg->next = os_msg_hdr;
-            }
+// Called under timer_lock, so a timer stopped or started again gets nothing from before
+static void nrc_os_timer_expire(struct nrc_os_timer *timer, u64_t now)
+{
+    struct nrc_msg_hdr  *msg = timer->msg;
+    u64_t               expires;
+
+    if (timer->period != 0) {
+        // Keeps the phase, periods missed while late are skipped
+        expires = timer->link.expires + timer->period;
+        if (expires <= now) {
+            expires += (((now - expires) / timer->period) + 1) * timer->period;
+        }
+        nrc_timer_wheel_add(&_os.timer_wheel, &timer->link, expires);
 
-            result = NRC_PORT_RES_OK;
+        if (msg != 0) {
+            msg = nrc_os_msg_clone(msg);
         }
     }
+    else {
+        timer->msg = 0;
+    }
 
-    return result;
+    if (msg != 0) {
+        if (nrc_os_send_msg(timer->id, msg, timer->prio) != NRC_PORT_RES_OK) {
+            nrc_os_msg_free(msg);
+        }
+    }
+    else {
+        nrc_os_set_evt(timer->id, timer->event_mask, timer->prio);
+    }
 }
 
-s32_t nrc_os_set_evt(nrc_node_id_t id, u32_t event_mask, enum nrc_os_prio prio)
+// Delivers expired timers. Gives TRUE if any were, then there may be nodes to run.
+static bool_t nrc_os_timer_poll(void)
 {
-    s32_t result = NRC_PORT_RES_NOT_SUPPORTED;
-    
-    return result;
-}
\ No newline at end of file
+    struct nrc_timer_link   *link;
+    struct nrc_timer_link   *next;
+    bool_t                  expired = FALSE;
+    u64_t                   now;
+
+    // Read without lock, a stale value only makes this look once too early or too late
+    if (_os.timer_due != NRC_TIMER_NEVER) {
+        now = nrc_os_timer_now();
+
+        if (now >= _os.timer_due) {
+            nrc_port_mutex_lock(_os.timer_lock, 0);
+
+            link = nrc_timer_wheel_advance(&_os.timer_wheel, now);
+            expired = (link != 0);
+
+            while (link != 0) {
+                next = link->next;
+                nrc_os_timer_expire((struct nrc_os_timer*)link, now);
+                link = next;
+            }
+            _os.timer_due = nrc_timer_wheel_next(&_os.timer_wheel);
+
+            nrc_port_mutex_unlock(_os.timer_lock);
+        }
+    }
+
+    return expired;
+}
+
+// Sleep of an idle worker until the next timer, in ms with 0 for no limit. The first
+// idle worker takes the deadline, the others sleep until woken.
+static u32_t nrc_os_timer_timeout(struct nrc_os_worker *worker)
+{
+    u32_t   timeout = 0;
+    u64_t   due;
+    u64_t   now;
+
+    if (nrc_port_atomic_cas(&_os.timer_sleeper, 0, worker->index + 1)) {
+        // A start moving the deadline up after this sees the worker idle and wakes it
+        nrc_port_mutex_lock(_os.timer_lock, 0);
+        due = _os.timer_due;
+        nrc_port_mutex_unlock(_os.timer_lock);
+
+        if (due != NRC_TIMER_NEVER) {
+            now = nrc_os_timer_now();
+            timeout = 1;
+            if (due > now) {
+                timeout = ((due - now) < U32_MAX_VALUE) ? (u32_t)(due - now) : U32_MAX_VALUE;
+            }
+        }
+    }
+
+    return timeout;
+}
+
+// Gives up the deadline after a sleep. Woken for work the worker may be busy past it,
+// another idle worker takes it over.
+static void nrc_os_timer_wakeup(struct nrc_os_worker *worker, s32_t sleep_result)
+{
+    if (nrc_port_atomic_load(&_os.timer_sleeper) == worker->index + 1) {
+        nrc_port_atomic_store(&_os.timer_sleeper, 0);
+
+        if ((sleep_result != NRC_PORT_RES_TIMEOUT) && (_os.timer_due != NRC_TIMER_NEVER)) {
+            nrc_os_wake_idle();
+        }
+    }
+}
+
+static u32_t nrc_os_idle_timeout(struct nrc_os_worker *worker)
+{
+    u32_t timeout = nrc_os_timer_timeout(worker);
+    u32_t stats_timeout = nrc_os_stats_timeout(worker);
+
+    if ((stats_timeout != 0) && ((timeout == 0) || (stats_timeout < timeout))) {
+        timeout = stats_timeout;
+    }
+
+    return timeout;
+}
+
+static void nrc_os_thread_fcn(void)
+{
+    struct nrc_os_worker    *worker;
+    struct nrc_os_node_hdr  *node;
+    s32_t                   sleep_result;
+    u32_t                   bit;
+
+    worker = &_os.worker[nrc_port_atomic_add(&_os.worker_started, 1)];
+    assert(worker < &_os.worker[_os.worker_count]);
+
+    _os_current_worker = worker;
+    bit = 1U << worker->index;
+
+    while (nrc_port_atomic_load(&_os.worker_stop) == 0) {
+        node = nrc_os_next_node(worker);
+
+        if (node != 0) {
+            nrc_os_run_node(worker, node);
+
+            if (--worker->timer_turns == 0) {
+                worker->timer_turns = NRC_OS_TIMER_TURNS;
+                nrc_os_timer_poll();
+            }
+        }
+        else if (nrc_os_timer_poll() == FALSE) {
+            // Announce idle before the last look, producers add work and then check the mask
+            nrc_port_atomic_or(&_os.idle_mask, bit);
+            sleep_result = NRC_PORT_RES_OK;
+
+            if (nrc_os_work_available() == FALSE) {
+                NRC_TRACE(NRC_TRACE_K_IDLE, 0, 0, 0);
+                sleep_result = nrc_port_sema_wait(worker->sema, nrc_os_idle_timeout(worker));
+            }
+            nrc_port_atomic_and(&_os.idle_mask, ~bit);
+            nrc_os_timer_wakeup(worker, sleep_result);
+        }
+
+#if NRC_OS_STATS
+        // A busy worker looks at the clock as often as at the timers
+        if ((_os.stats_hook != 0) && (worker->index == 0) &&
+            ((node == 0) || (worker->timer_turns == NRC_OS_TIMER_TURNS))) {
+            worker->now = nrc_port_time_ns();
+            if (worker->now >= _os.stats_due) {
+                nrc_os_stats_dump(worker);
+            }
+        }
+#endif
+    }
+}
+
+static u32_t nrc_os_hash(const s8_t *str)
+{
+    u32_t hash = 2166136261U;
+    u32_t i;
+
+    // FNV-1a, limited like the strncmp in the lookup
+    for (i = 0; (i < NRC_MAX_CFG_NAME_LEN) && (str[i] != 0); i++) {
+        hash = (hash ^ (u8_t)str[i]) * 16777619U;
+    }
+
+    return hash;
+}
+
+static void nrc_os_registry_insert(struct nrc_os_registry *registry, struct nrc_os_node_hdr *node)
+{
+    u32_t index = node->cold->cfg_hash & registry->mask;
+
+    while (registry->slot[index].node != 0) {
+        index = (index + 1) & registry->mask;
+    }
+
+    // A lookup that finds the node also finds its hash
+    registry->slot[index].hash = node->cold->cfg_hash;
+    nrc_port_atomic_store_ptr_release((void *volatile *)&registry->slot[index].node, node);
+    registry->count++;
+}
+
+// Builds an index of all registered nodes, in registration order so the first registered id wins
+static struct nrc_os_registry* nrc_os_registry_build(void)
+{
+    struct nrc_os_registry  *registry;
+    struct nrc_os_node_hdr  *node;
+    nrc_node_id_t           id;
+    u32_t                   slots = NRC_OS_REGISTRY_MIN_SLOTS;
+    u32_t                   size;
+
+    while (slots < (_os.node_count * 4)) {
+        slots *= 2;
+    }
+
+    size = sizeof(struct nrc_os_registry) + (slots - NRC_EMTPY_ARRAY) * sizeof(struct nrc_os_registry_slot);
+    registry = (struct nrc_os_registry*)nrc_port_heap_alloc(size);
+
+    if (registry != 0) {
+        memset(registry, 0, size);
+        registry->mask = slots - 1;
+
+        for (id = 1; (node = nrc_os_node_record(id)) != 0; id++) {
+            nrc_os_registry_insert(registry, node);
+        }
+    }
+
+    return registry;
+}
+
+// Publishes an index of all records. Called with the registration lock once started.
+static s32_t nrc_os_registry_rebuild(void)
+{
+    struct nrc_os_registry  *registry = _os.registry;
+    struct nrc_os_registry  *new_registry = nrc_os_registry_build();
+    s32_t                   result = NRC_PORT_RES_ERROR;
+
+    if (new_registry != 0) {
+        // Before start no lookup runs alongside, the old table can go at once
+        if (_os.registry_frozen) {
+            new_registry->retired = registry;
+        }
+        else if (registry != 0) {
+            new_registry->retired = registry->retired;
+            nrc_port_heap_free(registry);
+        }
+        nrc_port_atomic_xchg_ptr((void *volatile *)&_os.registry, new_registry);
+        result = NRC_PORT_RES_OK;
+    }
+
+    return result;
+}
+
+// In place while the table is at most half full, a full one is replaced by one twice the size
+static s32_t nrc_os_registry_add(struct nrc_os_node_hdr *node)
+{
+    struct nrc_os_registry  *registry = _os.registry;
+    s32_t                   result = NRC_PORT_RES_OK;
+
+    if ((registry != 0) && ((registry->count + 1) * 2 <= registry->mask + 1)) {
+        nrc_os_registry_insert(registry, node);
+    }
+    else {
+        result = nrc_os_registry_rebuild();
+    }
+
+    return result;
+}
+
+// First record registered with cfg_id, also of a removed node. 0 if none.
+static struct nrc_os_node_hdr* nrc_os_registry_find(const s8_t *cfg_id, bool_t removed)
+{
+    struct nrc_os_registry  *registry = (struct nrc_os_registry*)nrc_port_atomic_load_ptr((void *volatile *)&_os.registry);
+    struct nrc_os_node_hdr  *node = 0;
+    u32_t                   hash;
+    u32_t                   index;
+
+    if (registry != 0) {
+        hash = nrc_os_hash(cfg_id);
+        index = hash & registry->mask;
+
+        for (; (node = (struct nrc_os_node_hdr*)nrc_port_atomic_load_ptr((void *volatile *)&registry->slot[index].node)) != 0;
+             index = (index + 1) & registry->mask) {
+
+            if ((registry->slot[index].hash == hash) &&
+                (strncmp(cfg_id, node->cold->cfg_id, NRC_MAX_CFG_NAME_LEN) == 0) &&
+                (removed || (nrc_port_atomic_load_ptr((void *volatile *)&node->api) != 0))) {
+                break;
+            }
+        }
+    }
+
+    return node;
+}
+
+s32_t nrc_os_init(void)
+{
+    s32_t result = NRC_PORT_RES_OK;
+    u32_t i;
+
+    assert(sizeof(struct nrc_os_msg_hdr) % 4 == 0);
+    assert(sizeof(struct nrc_os_msg_tail) % 4 == 0);
+    assert(NRC_OS_MAX_WORKERS <= 32);
+
+    memset(&_os, 0, sizeof(struct nrc_os));
+
+    _os.worker_count = 1;
+    _os.ingress_head = &_os.ingress_stub;
+    _os.ingress_tail = &_os.ingress_stub;
+
+#if NRC_OS_TRACE
+    nrc_trace_init();
+#endif
+
+    nrc_msg_key_init();
+
+#if NRC_OS_STATS
+    _os.stats_ticks = nrc_port_ticks();
+    _os.stats_ns = nrc_port_time_ns();
+#endif
+
+    for (i = 0; (i < NRC_OS_MAX_WORKERS) && (result == NRC_PORT_RES_OK); i++) {
+        struct nrc_os_worker *worker = &_os.worker[i];
+
+        worker->index = i;
+        worker->best_level = NRC_OS_LEVEL_EMPTY;
+        worker->timer_turns = NRC_OS_TIMER_TURNS;
+        nrc_prioq_init(&worker->run_queue);
+
+        result = nrc_port_sema_init(0, &worker->sema);
+        if (result == NRC_PORT_RES_OK) {
+            result = nrc_port_mutex_init(&worker->lock);
+        }
+    }
+
+    nrc_timer_wheel_init(&_os.timer_wheel, nrc_os_timer_now());
+    _os.timer_due = NRC_TIMER_NEVER;
+    if (result == NRC_PORT_RES_OK) {
+        result = nrc_port_mutex_init(&_os.timer_lock);
+    }
+    if (result == NRC_PORT_RES_OK) {
+        result = nrc_port_sema_init(0, &_os.deploy_sema);
+    }
+    assert(result == NRC_PORT_RES_OK);
+
+    _os.state = NRC_OS_S_INITIALIZED;
+
+    return result;
+}
+
+// Drops the queued messages and frees what the record holds, its node is gone. In an arena
+// only the lock, the rest goes with the arena.
+static void nrc_os_record_free(struct nrc_os_node_hdr *node)
+{
+    struct nrc_os_low_water_sub *sub;
+
+    nrc_os_msg_ref_drop_list(node->mq_head);
+    node->mq_head = 0;
+    node->mq_tail = 0;
+    node->mq_count = 0;
+
+    if (!_os.arena_set) {
+        if (node->wires != 0) {
+            nrc_port_heap_free(node->wires);
+        }
+        while ((sub = node->mq_subs) != 0) {
+            node->mq_subs = sub->next;
+            nrc_port_heap_free(sub);
+        }
+        nrc_port_heap_free(node->cold);
+    }
+    node->wires = 0;
+    node->mq_subs = 0;
+    node->cold = 0;
+
+    nrc_port_mutex_deinit(node->mq_lock);
+    node->mq_lock = 0;
+}
+
+s32_t nrc_os_deinit(void)
+{
+    s32_t                   result = NRC_PORT_RES_OK;
+    struct nrc_os_registry  *registry = _os.registry;
+    struct nrc_os_registry  *retired;
+    struct nrc_os_node_hdr  *node;
+    struct nrc_os_msg_ref   *ref;
+    struct nrc_os_msg_hdr   *os_msg_hdr;
+    nrc_node_id_t           id;
+    u32_t                   chunk;
+    u32_t                   i;
+
+    assert((_os.state == NRC_OS_S_INITIALIZED) || (_os.state == NRC_OS_S_STOPPED));
+
+    // Nodes first, they may free or send messages. Deployed but never started by
+    // nrc_os_start, they run and are stopped here.
+    for (id = 1; (node = nrc_os_node_record(id)) != 0; id++) {
+        if ((node->api != 0) && (node->node_hdr != 0)) {
+            if (_os.state == NRC_OS_S_INITIALIZED) {
+                node->api->stop(node->node_hdr);
+            }
+            node->api->deinit(node->node_hdr);
+        }
+        if (node->node_hdr != 0) {
+            ((struct nrc_os_node_tag*)node->node_hdr - 1)->hot = 0;
+            nrc_os_node_free(node->node_hdr);
+            node->node_hdr = 0;
+        }
+        node->api = 0;
+    }
+
+    // Lock-free sends no worker took
+    while ((ref = nrc_os_ingress_pop()) != 0) {
+        os_msg_hdr = ref->msg;
+        nrc_os_msg_ref_put(ref);
+        nrc_os_msg_release(os_msg_hdr);
+    }
+
+    // Records, also one a failed registration took back
+    for (chunk = 0; (chunk < NRC_OS_NODE_CHUNKS) && (_os.node_chunk[chunk] != 0); chunk++) {
+        for (i = 0; i < NRC_OS_NODE_CHUNK; i++) {
+            node = &_os.node_chunk[chunk][i].node;
+
+            if (node->cold != 0) {
+                nrc_os_record_free(node);
+            }
+        }
+        if (!_os.arena_set) {
+            nrc_port_heap_free(_os.node_chunk_mem[chunk]);
+        }
+        _os.node_chunk[chunk] = 0;
+    }
+    _os.node_count = 0;
+
+    _os.registry = 0;
+    while (registry != 0) {
+        retired = registry->retired;
+        nrc_port_heap_free(registry);
+        registry = retired;
+    }
+
+    for (i = 0; i < NRC_OS_MAX_WORKERS; i++) {
+        nrc_port_sema_deinit(_os.worker[i].sema);
+        nrc_port_mutex_deinit(_os.worker[i].lock);
+    }
+    nrc_port_mutex_deinit(_os.timer_lock);
+    nrc_port_sema_deinit(_os.deploy_sema);
+
+    if (_os.arena_set) {
+        nrc_arena_deinit(&_os.arena);
+        _os.arena_set = FALSE;
+    }
+    if (_os.arena_memory != 0) {
+        nrc_port_heap_free(_os.arena_memory);
+        _os.arena_memory = 0;
+    }
+
+    nrc_msg_key_deinit();
+
+    _os.state = NRC_OS_S_INVALID;
+
+    return result;
+}
+
+s32_t nrc_os_set_workers(u32_t count)
+{
+    s32_t result = NRC_PORT_RES_INVALID_IN_PARAM;
+
+    assert(_os.state == NRC_OS_S_INITIALIZED);
+
+    if ((count >= 1) && (count <= NRC_OS_MAX_WORKERS)) {
+        _os.worker_count = count;
+        result = NRC_PORT_RES_OK;
+    }
+
+    return result;
+}
+
+// Ports and wires of a node in config, 0 wires if it has none
+static void nrc_os_wires_count(const s8_t *cfg_id, u32_t *port_count, u32_t *total)
+{
+    u32_t count;
+
+    *port_count = 0;
+    *total = 0;
+
+    while ((*port_count < NRC_OS_MAX_WIRES) &&
+           (nrc_cfg_get_wire_count(0, (s8_t*)cfg_id, (u8_t)*port_count, &count) == NRC_PORT_RES_OK)) {
+        *total += count;
+        (*port_count)++;
+    }
+}
+
+// Bytes before the node pointers of a wires table
+static u32_t nrc_os_wires_hdr_size(u32_t port_count)
+{
+    u32_t size = offsetof(struct nrc_os_wires, first) + ((port_count + 1) * sizeof(u32_t));
+
+    return (size + sizeof(void*) - 1) & ~(u32_t)(sizeof(void*) - 1);
+}
+
+// Bytes of a chunk of node records, with room to align it to a cache line
+static u32_t nrc_os_node_chunk_size(void)
+{
+    return (NRC_OS_NODE_CHUNK * sizeof(union nrc_os_node_slot)) + NRC_OS_CACHE_LINE;
+}
+
+// Sizing pass, what the deployed nodes of the flow config declare
+static void nrc_os_arena_plan(const struct nrc_os_type_mem *types, u32_t count, struct nrc_arena_plan *plan)
+{
+    const struct nrc_node_mem   *mem;
+    s8_t                        cfg_type[NRC_MAX_CFG_NAME_LEN];
+    s8_t                        cfg_id[NRC_MAX_CFG_NAME_LEN];
+    u32_t                       port_count;
+    u32_t                       total;
+    u32_t                       nodes = 0;
+    u32_t                       index;
+    u32_t                       i;
+
+    nrc_arena_plan_init(plan);
+
+    for (index = 0; nrc_cfg_get_node(index, cfg_type, cfg_id, NRC_MAX_CFG_NAME_LEN) == NRC_PORT_RES_OK; index++) {
+        for (i = 0; (i < count) && (strcmp((const char*)types[i].cfg_type, (const char*)cfg_type) != 0); i++) {
+        }
+        if (i == count) {
+            continue;
+        }
+        mem = &types[i].mem;
+
+        nrc_arena_plan_bump(plan, sizeof(struct nrc_os_node_tag) + mem->node_size, 1);
+        nrc_arena_plan_bump(plan, sizeof(struct nrc_os_node_cold), 1);
+        nrc_arena_plan_bump(plan, sizeof(struct nrc_os_low_water_sub), 1);
+        nodes++;
+
+        nrc_os_wires_count(cfg_id, &port_count, &total);
+        if (total != 0) {
+            nrc_arena_plan_bump(plan, nrc_os_wires_hdr_size(port_count) + (total * sizeof(struct nrc_os_node_hdr*)), 1);
+        }
+
+        if (mem->keep_size != 0) {
+            nrc_arena_plan_bump(plan, mem->keep_size, 1);
+        }
+        nrc_arena_plan_blocks(plan, nrc_os_msg_total_size(mem->msg_size), mem->msg_count);
+        nrc_arena_plan_blocks(plan, sizeof(struct nrc_os_msg_ref), mem->queue_depth);
+    }
+
+    nrc_arena_plan_bump(plan, nrc_os_node_chunk_size(), (nodes + NRC_OS_NODE_CHUNK - 1) / NRC_OS_NODE_CHUNK);
+}
+
+// Resolves the node's wires from config to node pointers, wires to nodes not registered or being
+// removed are left out.
+// The node must not be running unless it has no wires yet, see nrc_os_node_pause.
+static s32_t nrc_os_wires_compile(struct nrc_os_node_hdr *node)
+{
+    s32_t               result = NRC_PORT_RES_OK;
+    struct nrc_os_wires *wires = 0;
+    s8_t                wire_id[NRC_MAX_CFG_NAME_LEN];
+    nrc_node_id_t       id;
+    u32_t               port_count;
+    u32_t               total;
+    u32_t               count;
+    u32_t               size = 0;
+    u32_t               missing = 0;
+    u32_t               port;
+    u32_t               i;
+
+    nrc_os_wires_count(node->cold->cfg_id, &port_count, &total);
+
+    if (total != 0) {
+        size = nrc_os_wires_hdr_size(port_count);
+
+        wires = (struct nrc_os_wires*)nrc_os_mem_keep(size + (total * sizeof(struct nrc_os_node_hdr*)));
+        result = NRC_PORT_RES_ERROR;
+    }
+
+    if (wires != 0) {
+        result = NRC_PORT_RES_OK;
+        wires->node = (struct nrc_os_node_hdr**)((u8_t*)wires + size);
+        wires->port_count = port_count;
+        total = 0;
+
+        for (port = 0; port < port_count; port++) {
+            wires->first[port] = total;
+            count = 0;
+            nrc_cfg_get_wire_count(0, (s8_t*)node->cold->cfg_id, (u8_t)port, &count);
+
+            for (i = 0; (i < count) && (i < NRC_OS_MAX_WIRES); i++) {
+                if ((nrc_cfg_get_wire(0, (s8_t*)node->cold->cfg_id, (u8_t)port, (u8_t)i, wire_id, NRC_MAX_CFG_NAME_LEN) == NRC_PORT_RES_OK) &&
+                    (nrc_os_get_node_id(wire_id, &id) == NRC_PORT_RES_OK) && !nrc_os_node_record(id)->cold->removing) {
+                    wires->node[total++] = nrc_os_node(id);
+                }
+                else {
+                    missing++;
+                }
+            }
+        }
+        wires->first[port_count] = total;
+    }
+
+    if (result == NRC_PORT_RES_OK) {
+        if ((node->wires != 0) && !_os.arena_set) {
+            nrc_port_heap_free(node->wires);
+        }
+        node->wires = wires;
+        node->cold->wires_missing = missing;
+    }
+
+    return result;
+}
+
+s32_t nrc_os_arena_size(const struct nrc_os_type_mem *types, u32_t count, u32_t *size)
+{
+    s32_t                   result = NRC_PORT_RES_INVALID_IN_PARAM;
+    struct nrc_arena_plan   plan;
+
+    if (((types != 0) || (count == 0)) && (size != 0)) {
+        nrc_os_arena_plan(types, count, &plan);
+        result = nrc_arena_plan_size(&plan, size);
+    }
+
+    return result;
+}
+
+s32_t nrc_os_set_arena(u8_t *memory, u32_t size, const struct nrc_os_type_mem *types, u32_t count)
+{
+    s32_t                   result = NRC_PORT_RES_INVALID_IN_PARAM;
+    struct nrc_arena_plan   plan;
+    u32_t                   plan_size;
+
+    assert(_os.state == NRC_OS_S_INITIALIZED);
+    assert((_os.node_count == 0) && !_os.arena_set);
+
+    if ((types != 0) || (count == 0)) {
+        nrc_os_arena_plan(types, count, &plan);
+        result = nrc_arena_plan_size(&plan, &plan_size);
+
+        if ((result == NRC_PORT_RES_OK) && (memory == 0)) {
+            memory = nrc_port_heap_alloc(plan_size);
+            size = plan_size;
+            _os.arena_memory = memory;
+        }
+
+        result = NRC_PORT_RES_ERROR;
+        if (memory != 0) {
+            result = nrc_arena_init(&_os.arena, &plan, memory, size);
+        }
+
+        _os.arena_set = (result == NRC_PORT_RES_OK);
+        _os.arena_failed = !_os.arena_set;
+
+        if ((_os.arena_failed) && (_os.arena_memory != 0)) {
+            nrc_arena_deinit(&_os.arena);
+            nrc_port_heap_free(_os.arena_memory);
+            _os.arena_memory = 0;
+        }
+    }
+
+    return result;
+}
+
+s32_t nrc_os_get_arena_stats(u32_t size_class, struct nrc_port_heap_stats *stats)
+{
+    s32_t result = NRC_PORT_RES_NOT_SUPPORTED;
+
+    if (_os.arena_set) {
+        result = nrc_arena_stats(&_os.arena, size_class, stats);
+    }
+
+    return result;
+}
+
+// Makes the first count workers return and waits for them, they may be started again
+static void nrc_os_workers_join(u32_t count)
+{
+    u32_t i;
+
+    nrc_port_atomic_store(&_os.worker_stop, 1);
+
+    for (i = 0; i < count; i++) {
+        nrc_port_sema_signal(_os.worker[i].sema);
+        nrc_port_thread_join(_os.worker[i].thread);
+        _os.worker[i].thread = 0;
+    }
+
+    nrc_port_atomic_store(&_os.worker_started, 0);
+    nrc_port_atomic_store(&_os.worker_stop, 0);
+}
+
+s32_t nrc_os_start(void)
+{
+    s32_t                   result = NRC_PORT_RES_OK;
+    struct nrc_os_node_hdr  *node;
+    nrc_node_id_t           id;
+    u32_t                   started = 0;
+
+    assert(_os.state == NRC_OS_S_INITIALIZED);
+
+    if (_os.arena_failed) {
+        return NRC_PORT_RES_ERROR;
+    }
+
+    // Lookups may run on workers from now on, replaced registries are kept
+    _os.registry_frozen = TRUE;
+    _os.state = NRC_OS_S_STARTED;
+
+    for (id = 1; ((node = nrc_os_node_record(id)) != 0) && (result == NRC_PORT_RES_OK); id++) {
+        if (node->api != 0) {
+            result = nrc_os_wires_compile(node);
+        }
+    }
+
+    while ((started < _os.worker_count) && (result == NRC_PORT_RES_OK)) {
+        result = nrc_port_thread_init(
+            NRC_PORT_THREAD_PRIO_NORMAL,
+            NRC_OS_STACK_SIZE,
+            nrc_os_thread_fcn,
+            &(_os.worker[started].thread));
+
+        if (result == NRC_PORT_RES_OK) {
+            result = nrc_port_thread_start(_os.worker[started].thread);
+        }
+        if (result == NRC_PORT_RES_OK) {
+            started++;
+        }
+    }
+
+    // Not started, the workers that were are joined and start may be called again
+    if (result != NRC_PORT_RES_OK) {
+        nrc_os_workers_join(started);
+        _os.state = NRC_OS_S_INITIALIZED;
+        _os.registry_frozen = FALSE;
+    }
+
+    return result;
+}
+
+s32_t nrc_os_stop(void)
+{
+    s32_t                   result = NRC_PORT_RES_OK;
+    struct nrc_os_node_hdr  *node;
+    nrc_node_id_t           id;
+
+    assert(_os.state == NRC_OS_S_STARTED);
+
+    // Each node ends its turn and gets no more, stop then runs alone like in a deploy
+    for (id = 1; (node = nrc_os_node_record(id)) != 0; id++) {
+        if (node->api != 0) {
+            nrc_os_node_pause(node);
+            node->api->stop(node->node_hdr);
+        }
+    }
+
+    // Nothing is left to run, also the reactor has no node to call
+    nrc_os_workers_join(_os.worker_count);
+    nrc_port_io_stop();
+
+    _os.state = NRC_OS_S_STOPPED;
+
+    return result;
+}
+
+struct nrc_node_hdr* nrc_os_node_alloc(u32_t size)
+{
+    u32_t total_size = sizeof(struct nrc_os_node_tag) + size;
+
+    struct nrc_os_node_tag  *tag = (struct nrc_os_node_tag*)nrc_os_mem_keep(total_size);
+    struct nrc_node_hdr     *node_hdr = 0;
+
+    if (tag != 0) {
+        node_hdr = (struct nrc_node_hdr*)(tag + 1);
+
+        memset(tag, 0, sizeof(struct nrc_os_node_tag));
+        memset(node_hdr, 0, sizeof(struct nrc_node_hdr));
+
+        tag->type = NRC_OS_NODE_TYPE;
+    }
+
+    return node_hdr;
+}
+
+// Node memory goes back to the heap, in an arena it is kept
+static void nrc_os_node_free(struct nrc_node_hdr *node_hdr)
+{
+    if (!_os.arena_set) {
+        nrc_port_heap_free((struct nrc_os_node_tag*)node_hdr - 1);
+    }
+}
+
+void* nrc_os_node_mem_alloc(u32_t size)
+{
+    void *buf = 0;
+
+    if (size != 0) {
+        buf = nrc_os_mem_keep(size);
+    }
+
+    return buf;
+}
+
+// Heap memory goes back, in an arena it is kept like the node
+void nrc_os_node_mem_free(void *buf)
+{
+    if ((buf != 0) && !_os.arena_set) {
+        nrc_port_heap_free(buf);
+    }
+}
+
+// Record for the next id, in a new chunk if the last one is full. Called with the registration lock.
+static struct nrc_os_node_hdr* nrc_os_node_take(void)
+{
+    struct nrc_os_node_hdr  *node = 0;
+    struct nrc_os_node_cold *cold;
+    u32_t                   index = _os.node_count;
+    u8_t                    *chunk;
+
+    if ((index < NRC_OS_MAX_NODES) && (_os.node_chunk[index / NRC_OS_NODE_CHUNK] == 0)) {
+        chunk = (u8_t*)nrc_os_mem_keep(nrc_os_node_chunk_size());
+
+        // Records never move, the chunk is not freed while the kernel runs
+        if (chunk != 0) {
+            _os.node_chunk_mem[index / NRC_OS_NODE_CHUNK] = chunk;
+            chunk += (NRC_OS_CACHE_LINE - ((uintptr_t)chunk % NRC_OS_CACHE_LINE)) % NRC_OS_CACHE_LINE;
+            memset(chunk, 0, NRC_OS_NODE_CHUNK * sizeof(union nrc_os_node_slot));
+            _os.node_chunk[index / NRC_OS_NODE_CHUNK] = (union nrc_os_node_slot*)chunk;
+        }
+    }
+
+    if ((index < NRC_OS_MAX_NODES) && (_os.node_chunk[index / NRC_OS_NODE_CHUNK] != 0)) {
+        node = &_os.node_chunk[index / NRC_OS_NODE_CHUNK][index % NRC_OS_NODE_CHUNK].node;
+
+        // Taken back after a failed registration keeps its cold part and lock
+        if (node->cold == 0) {
+            cold = (struct nrc_os_node_cold*)nrc_os_mem_keep(sizeof(struct nrc_os_node_cold));
+
+            if ((cold == 0) || (nrc_port_mutex_init(&node->mq_lock) != NRC_PORT_RES_OK)) {
+                node = 0;
+            }
+            else {
+                node->cold = cold;
+            }
+        }
+    }
+
+    return node;
+}
+
+// Gives the node an id. A deploy adds it paused and publishes the registry itself.
+static struct nrc_os_node_hdr* nrc_os_node_add(struct nrc_node_hdr *node_hdr, struct nrc_node_api *api, const s8_t *cfg_id,
+                                               bool_t deploy)
+{
+    struct nrc_os_node_tag  *tag = (struct nrc_os_node_tag*)node_hdr - 1;
+    struct nrc_os_node_hdr  *os_node_hdr = 0;
+    struct nrc_os_node_cold *cold;
+    bool_t                  started = (_os.state == NRC_OS_S_STARTED);
+    s32_t                   result = NRC_PORT_RES_OK;
+
+    if ((tag->type != NRC_OS_NODE_TYPE) || (tag->hot != 0)) {
+        return os_node_hdr;
+    }
+
+    if (started) {
+        nrc_port_irq_disable();
+    }
+
+    os_node_hdr = nrc_os_node_take();
+
+    if (os_node_hdr != 0) {
+        cold = os_node_hdr->cold;
+        memset(cold, 0, sizeof(struct nrc_os_node_cold));
+        memcpy(cold->cfg_id, cfg_id, strnlen(cfg_id, NRC_MAX_CFG_NAME_LEN - 1));
+        cold->cfg_hash = nrc_os_hash(cold->cfg_id);
+
+        os_node_hdr->id = _os.node_count + 1;
+        os_node_hdr->api = api;
+        os_node_hdr->node_hdr = node_hdr;
+        os_node_hdr->prio = S8_MAX_VALUE;
+        os_node_hdr->event = 0;
+        os_node_hdr->run_worker = 0;
+        os_node_hdr->boost = 0;
+        os_node_hdr->sched = deploy ? NRC_OS_NODE_PAUSE : NRC_OS_NODE_IDLE;
+        tag->hot = os_node_hdr;
+
+        // The record is complete before its id is valid
+        nrc_port_atomic_store_release(&_os.node_count, os_node_hdr->id);
+
+        if (!deploy) {
+            result = nrc_os_registry_add(os_node_hdr);
+        }
+
+#if NRC_OS_TRACE
+        if (result == NRC_PORT_RES_OK) {
+            nrc_trace_name(os_node_hdr->id, cold->cfg_id);
+        }
+#endif
+
+        // Not found by a lookup yet, the id is taken back
+        if (result != NRC_PORT_RES_OK) {
+            nrc_port_atomic_store_release(&_os.node_count, os_node_hdr->id - 1);
+            os_node_hdr->api = 0;
+            os_node_hdr->node_hdr = 0;
+            tag->hot = 0;
+            os_node_hdr = 0;
+        }
+    }
+
+    if (started) {
+        nrc_port_irq_enable();
+    }
+
+    return os_node_hdr;
+}
+
+s32_t nrc_os_register_node(struct nrc_node_hdr *node_hdr, struct nrc_node_api *api, const s8_t *cfg_id)
+{
+    s32_t                   result = NRC_PORT_RES_INVALID_IN_PARAM;
+    struct nrc_os_node_hdr  *os_node_hdr;
+
+    if ((node_hdr != 0) && (api != 0) && (cfg_id != 0) &&
+        (api->init != 0) && (api->deinit != 0) && (api->start != 0) && (api->stop != 0) &&
+        (api->recv_msg != 0) && (api->recv_evt != 0)) {
+
+        os_node_hdr = nrc_os_node_add(node_hdr, api, cfg_id, FALSE);
+        result = (os_node_hdr != 0) ? NRC_PORT_RES_OK : NRC_PORT_RES_ERROR;
+
+        if ((result == NRC_PORT_RES_OK) && (_os.state == NRC_OS_S_STARTED)) {
+            result = nrc_os_wires_compile(os_node_hdr);
+        }
+    }
+
+    return result;
+}
+
+s32_t nrc_os_get_node_id(const s8_t *cfg_id, nrc_node_id_t *id)
+{
+    s32_t                   result = NRC_PORT_RES_INVALID_IN_PARAM;
+    struct nrc_os_node_hdr  *node;
+
+    if ((cfg_id != 0) && (id != 0)) {
+        *id = 0;
+        result = NRC_PORT_RES_NOT_FOUND;
+
+        node = nrc_os_registry_find(cfg_id, FALSE);
+        if (node != 0) {
+            *id = node->id;
+            result = NRC_PORT_RES_OK;
+        }
+    }
+
+    return result;
+}
+
+struct nrc_msg_hdr* nrc_os_msg_alloc(u32_t size)
+{
+    u32_t total_size = nrc_os_msg_total_size(size);
+
+    if ((size % 4) != 0) {
+        size += 4 - (size % 4);
+    }
+
+    struct nrc_os_msg_hdr *header = (struct nrc_os_msg_hdr*)nrc_os_mem_alloc(total_size);
+    struct nrc_msg_hdr    *msg = 0;
+
+    if (header != 0) {
+        msg = (struct nrc_msg_hdr*)(header + 1);
+
+        struct nrc_os_msg_tail *tail = (struct nrc_os_msg_tail*)((uint8_t*)msg + size);
+
+        memset(header, 0, sizeof(struct nrc_os_msg_hdr));
+        memset(msg, 0, sizeof(struct nrc_msg_hdr));
+
+        header->ref.msg = header;
+        header->ref_count = 1;
+        header->total_size = total_size;
+        header->type = NRC_OS_MSG_TYPE;
+        tail->dead_beef = 0xDEADBEEF;
+
+        NRC_TRACE(NRC_TRACE_K_MSG_ALLOC, 0, msg, total_size);
+    }
+    
+    return msg;
+}
+
+// Drops one reference, memory is released with the last one
+static void nrc_os_msg_release(struct nrc_os_msg_hdr *header)
+{
+    if (nrc_port_atomic_add(&header->ref_count, (u32_t)-1) == 1) {
+        NRC_TRACE(NRC_TRACE_K_MSG_FREE, 0, header + 1, 0);
+        nrc_os_mem_free(header);
+    }
+}
+
+struct nrc_msg_hdr* nrc_os_msg_clone(struct nrc_msg_hdr *msg)
+{
+    struct nrc_os_msg_hdr *header;
+
+    if (msg == 0) {
+        return 0;
+    }
+    header = (struct nrc_os_msg_hdr*)msg - 1;
+    if (header->type != NRC_OS_MSG_TYPE) {
+        return 0;
+    }
+
+    // No copy, the caller gets one more reference to the same read-only message
+    nrc_port_atomic_add(&header->ref_count, 1);
+
+    return msg;
+}
+
+struct nrc_msg_hdr* nrc_os_msg_make_writable(struct nrc_msg_hdr *msg)
+{
+    struct nrc_os_msg_hdr *header;
+    struct nrc_os_msg_hdr *new_header;
+    struct nrc_msg_hdr    *new_msg = msg;
+
+    if (msg == 0) {
+        return 0;
+    }
+    header = (struct nrc_os_msg_hdr*)msg - 1;
+    if (header->type != NRC_OS_MSG_TYPE) {
+        return 0;
+    }
+
+    if (nrc_port_atomic_load(&header->ref_count) > 1) {
+        new_header = (struct nrc_os_msg_hdr*)nrc_os_mem_alloc(header->total_size);
+        new_msg = 0;
+
+        if (new_header != 0) {
+            memset(new_header, 0, sizeof(struct nrc_os_msg_hdr));
+            memcpy(new_header + 1, header + 1, header->total_size - sizeof(struct nrc_os_msg_hdr));
+
+            new_header->ref.msg = new_header;
+            new_header->ref_count = 1;
+            new_header->total_size = header->total_size;
+            new_header->type = NRC_OS_MSG_TYPE;
+
+            new_msg = (struct nrc_msg_hdr*)(new_header + 1);
+
+            NRC_TRACE(NRC_TRACE_K_MSG_ALLOC, 0, new_msg, new_header->total_size);
+
+            nrc_os_msg_release(header);
+        }
+    }
+
+    return new_msg;
+}
+
+void nrc_os_msg_free(struct nrc_msg_hdr *msg)
+{
+    struct nrc_os_msg_hdr   *os_msg_header;
+
+    while (msg != 0) {
+        os_msg_header = (struct nrc_os_msg_hdr*)msg - 1;
+        assert(os_msg_header->type == NRC_OS_MSG_TYPE);
+
+        msg = msg->next;
+
+        nrc_os_msg_release(os_msg_header);
+    }
+}
+
+
+#if NRC_OS_STATS
+static void nrc_os_stats_sent(u32_t count)
+{
+    struct nrc_os_node_hdr *node = _os_current_node;
+
+    if (node != 0) {
+        nrc_os_stats_add(&node->stats.sent_msg_count, count);
+    }
+}
+#endif
+
+// Takes a delivery for the message, the embedded one unless it is already in a mailbox
+static struct nrc_os_msg_ref* nrc_os_msg_ref_get(struct nrc_os_msg_hdr *os_msg_hdr, nrc_node_id_t id, s8_t prio)
+{
+    struct nrc_os_msg_ref *ref = &os_msg_hdr->ref;
+
+    // A shared message can be in several mailboxes at once
+    if (!nrc_port_atomic_cas(&os_msg_hdr->ref_busy, FALSE, TRUE)) {
+        ref = (struct nrc_os_msg_ref*)nrc_os_mem_alloc(sizeof(struct nrc_os_msg_ref));
+    }
+
+    if (ref != 0) {
+        ref->msg = os_msg_hdr;
+        ref->to_node_id = id;
+        ref->prio = prio;
+        ref->link.next = 0;
+    }
+
+    return ref;
+}
+
+static void nrc_os_msg_ref_put(struct nrc_os_msg_ref *ref)
+{
+    if (ref == &ref->msg->ref) {
+        ref->link.next = 0;
+        nrc_port_atomic_store(&ref->msg->ref_busy, FALSE);
+    }
+    else {
+        nrc_os_mem_free(ref);
+    }
+}
+
+// Gives back deliveries that were never queued, when a batch fails
+static void nrc_os_msg_ref_put_list(struct nrc_os_msg_ref *ref)
+{
+    struct nrc_os_msg_ref *next;
+
+    while (ref != 0) {
+        next = (struct nrc_os_msg_ref*)ref->link.next;
+        nrc_os_msg_ref_put(ref);
+        ref = next;
+    }
+}
+
+// Deliveries dropped by a queue policy, each held a reference to its message
+static void nrc_os_msg_ref_drop_list(struct nrc_os_msg_ref *ref)
+{
+    struct nrc_os_msg_ref *next;
+    struct nrc_os_msg_hdr *os_msg_hdr;
+
+    while (ref != 0) {
+        next = (struct nrc_os_msg_ref*)ref->link.next;
+        os_msg_hdr = ref->msg;
+        nrc_os_msg_ref_put(ref);
+        nrc_os_msg_release(os_msg_hdr);
+        ref = next;
+    }
+}
+
+static void nrc_os_mailbox_append(struct nrc_os_node_hdr *node, struct nrc_os_msg_ref *head, struct nrc_os_msg_ref *tail, u32_t count)
+{
+    if (node->mq_tail == 0) {
+        node->mq_head = head;
+    }
+    else {
+        node->mq_tail->link.next = &head->link;
+    }
+    node->mq_tail = tail;
+    node->mq_count += count;
+}
+
+static bool_t nrc_os_same_topic(struct nrc_os_msg_ref *a, struct nrc_os_msg_ref *b)
+{
+    const s8_t *topic_a = ((struct nrc_msg_hdr*)(a->msg + 1))->topic;
+    const s8_t *topic_b = ((struct nrc_msg_hdr*)(b->msg + 1))->topic;
+
+    return (topic_a == topic_b) || ((topic_a != 0) && (topic_b != 0) && (strcmp(topic_a, topic_b) == 0));
+}
+
+// Replaces the queued delivery with the same topic as ref, gives the replaced one or 0
+static struct nrc_os_msg_ref* nrc_os_mailbox_replace(struct nrc_os_node_hdr *node, struct nrc_os_msg_ref *ref)
+{
+    struct nrc_os_msg_ref *prev = 0;
+    struct nrc_os_msg_ref *old = node->mq_head;
+
+    if (((struct nrc_msg_hdr*)(ref->msg + 1))->topic == 0) {
+        return 0;
+    }
+
+    while ((old != 0) && !nrc_os_same_topic(old, ref)) {
+        prev = old;
+        old = (struct nrc_os_msg_ref*)old->link.next;
+    }
+
+    if (old != 0) {
+        ref->link.next = old->link.next;
+        if (prev == 0) {
+            node->mq_head = ref;
+        }
+        else {
+            prev->link.next = &ref->link;
+        }
+        if (node->mq_tail == old) {
+            node->mq_tail = ref;
+        }
+        old->link.next = 0;
+    }
+
+    return old;
+}
+
+// Queues count deliveries under the node's limit, called with mq_lock held. Dropped
+// deliveries are added to dropped, to be released after the lock.
+static void nrc_os_mailbox_put_bounded(struct nrc_os_node_hdr *node, struct nrc_os_msg_ref *head, struct nrc_os_msg_ref *tail,
+                                       u32_t count, bool_t reserved, struct nrc_os_msg_ref **dropped)
+{
+    struct nrc_os_msg_ref   *ref;
+    struct nrc_os_msg_ref   *next;
+    struct nrc_os_msg_ref   *old;
+    u32_t                   drops = 0;
+
+    switch (node->mq_policy) {
+    case NRC_OS_QUEUE_REJECT:
+        // The sender made room with nrc_os_mailbox_reserve
+        if (reserved) {
+            node->mq_reserved -= count;
+        }
+        nrc_os_mailbox_append(node, head, tail, count);
+        break;
+
+    default:
+        for (ref = head; ref != 0; ref = next) {
+            next = (struct nrc_os_msg_ref*)ref->link.next;
+            ref->link.next = 0;
+            old = 0;
+
+            if (node->mq_policy == NRC_OS_QUEUE_LATEST) {
+                old = nrc_os_mailbox_replace(node, ref);
+            }
+            if (old != 0) {
+                ref = old;
+            }
+            else if ((node->mq_policy == NRC_OS_QUEUE_DROP_NEWEST) && (node->mq_limit != 0) &&
+                     (node->mq_count >= node->mq_limit)) {
+                // ref itself is dropped
+            }
+            else {
+                nrc_os_mailbox_append(node, ref, ref, 1);
+                ref = 0;
+
+                if ((node->mq_limit != 0) && (node->mq_count > node->mq_limit)) {
+                    ref = node->mq_head;
+                    node->mq_head = (struct nrc_os_msg_ref*)ref->link.next;
+                    node->mq_count--;
+                    ref->link.next = 0;
+                }
+            }
+
+            if (ref != 0) {
+                ref->link.next = (*dropped != 0) ? &(*dropped)->link : 0;
+                *dropped = ref;
+                drops++;
+            }
+        }
+#if NRC_OS_STATS
+        node->stats.dropped_count += drops;
+#endif
+        break;
+    }
+
+    if ((node->mq_limit != 0) && ((drops != 0) || (node->mq_count >= node->mq_limit))) {
+        node->mq_full = 1;
+    }
+}
+
+// Appends a list of count deliveries under one lock, reserved if room was taken with
+// nrc_os_mailbox_reserve. Deliveries to a removed node are dropped. Gives TRUE if a
+// sleeping worker should be woken.
+static bool_t nrc_os_mailbox_put(struct nrc_os_node_hdr *node, struct nrc_os_msg_ref *head, struct nrc_os_msg_ref *tail,
+                                 u32_t count, bool_t reserved)
+{
+    struct nrc_os_msg_ref   *dropped = 0;
+    s8_t                    prio = head->prio;
+    bool_t                  gone;
+
+    nrc_port_mutex_lock(node->mq_lock, 0);
+    // Removed by a deploy since the sender looked it up, see nrc_os_node_remove
+    gone = (nrc_port_atomic_load_ptr((void *volatile *)&node->api) == 0);
+    if (gone) {
+        if (reserved) {
+            node->mq_reserved -= count;
+        }
+        dropped = head;
+    }
+    else if ((node->mq_limit == 0) && (node->mq_policy != NRC_OS_QUEUE_LATEST)) {
+        nrc_os_mailbox_append(node, head, tail, count);
+    }
+    else {
+        nrc_os_mailbox_put_bounded(node, head, tail, count, reserved, &dropped);
+    }
+#if NRC_OS_STATS
+    if (node->mq_count > node->stats.queued_max) {
+        node->stats.queued_max = node->mq_count;
+    }
+#endif
+    nrc_port_mutex_unlock(node->mq_lock);
+
+    if (dropped != 0) {
+        nrc_os_msg_ref_drop_list(dropped);
+    }
+
+    // Only queues the node if it was idle, a burst costs one wakeup
+    return gone ? FALSE : nrc_os_node_ready(node, prio, FALSE);
+}
+
+static bool_t nrc_os_mailbox_rejects(struct nrc_os_node_hdr *node)
+{
+    return (node->mq_limit != 0) && (node->mq_policy == NRC_OS_QUEUE_REJECT);
+}
+
+// Takes room in a rejecting mailbox before anything is sent, so a send is whole or refused
+static s32_t nrc_os_mailbox_reserve(struct nrc_os_node_hdr *node, u32_t count)
+{
+    s32_t result = NRC_PORT_RES_OK;
+
+    nrc_port_mutex_lock(node->mq_lock, 0);
+    if ((node->mq_count + node->mq_reserved + count) > node->mq_limit) {
+        result = NRC_PORT_RES_BUSY;
+        node->mq_full = 1;
+#if NRC_OS_STATS
+        node->stats.rejected_count += count;
+#endif
+    }
+    else {
+        node->mq_reserved += count;
+    }
+    nrc_port_mutex_unlock(node->mq_lock);
+
+    return result;
+}
+
+static void nrc_os_mailbox_unreserve(struct nrc_os_node_hdr *node, u32_t count)
+{
+    nrc_port_mutex_lock(node->mq_lock, 0);
+    node->mq_reserved -= count;
+    nrc_port_mutex_unlock(node->mq_lock);
+}
+
+s32_t nrc_os_send_msg(nrc_node_id_t id, struct nrc_msg_hdr *msg, s8_t prio)
+{
+    s32_t result = NRC_PORT_RES_INVALID_IN_PARAM;
+
+    if ((id != 0) && (msg != 0)) {
+
+        struct nrc_os_node_hdr  *os_node_hdr = nrc_os_node(id);
+        struct nrc_os_msg_hdr   *os_msg_hdr = (struct nrc_os_msg_hdr*)msg - 1;
+
+        if ((os_node_hdr != 0) && (os_msg_hdr->type == NRC_OS_MSG_TYPE)) {
+
+            struct nrc_os_msg_ref   *ref = nrc_os_msg_ref_get(os_msg_hdr, id, prio);
+            bool_t                  reserved = nrc_os_mailbox_rejects(os_node_hdr);
+
+            result = NRC_PORT_RES_ERROR;
+
+            if (ref != 0) {
+                result = reserved ? nrc_os_mailbox_reserve(os_node_hdr, 1) : NRC_PORT_RES_OK;
+            }
+
+            if (result == NRC_PORT_RES_OK) {
+                NRC_TRACE(NRC_TRACE_K_SEND, id, msg, (u8_t)prio);
+
+                if (nrc_os_mailbox_put(os_node_hdr, ref, ref, 1, reserved)) {
+                    nrc_os_wake_idle();
+                }
+#if NRC_OS_STATS
+                nrc_os_stats_sent(1);
+#endif
+            }
+            else if (ref != 0) {
+                nrc_os_msg_ref_put(ref);
+            }
+        }
+    }
+
+    return result;
+}
+
+// Appends the collected runs, one mailbox lock per target. Gives TRUE if a sleeping worker should be woken.
+static bool_t nrc_os_batch_flush(struct nrc_os_batch_run *run, u32_t *run_count)
+{
+    bool_t  wake = FALSE;
+    u32_t   j;
+
+    for (j = 0; j < *run_count; j++) {
+        wake |= nrc_os_mailbox_put(run[j].node, run[j].head, run[j].tail, run[j].count,
+                                   nrc_os_mailbox_rejects(run[j].node));
+    }
+    *run_count = 0;
+
+    return wake;
+}
+
+// Adds the delivery to the run of its target, keeping send order. Flushes when all runs are taken.
+static bool_t nrc_os_batch_add(struct nrc_os_batch_run *run, u32_t *run_count, struct nrc_os_msg_ref *ref)
+{
+    struct nrc_os_node_hdr  *os_node_hdr = nrc_os_node_record(ref->to_node_id);
+    bool_t                  wake = FALSE;
+    u32_t                   j;
+
+    ref->link.next = 0;
+
+    for (j = 0; (j < *run_count) && (run[j].node != os_node_hdr); j++) {
+    }
+
+    if (j == NRC_OS_BATCH_TARGETS) {
+        wake = nrc_os_batch_flush(run, run_count);
+        j = 0;
+    }
+
+    if (j == *run_count) {
+        run[j].node = os_node_hdr;
+        run[j].head = ref;
+        run[j].count = 0;
+        (*run_count)++;
+    }
+    else {
+        run[j].tail->link.next = &ref->link;
+    }
+    run[j].tail = ref;
+    run[j].count++;
+
+    return wake;
+}
+
+s32_t nrc_os_send_msg_batch(const struct nrc_os_send_entry *entries, u32_t count)
+{
+    s32_t                   result = NRC_PORT_RES_INVALID_IN_PARAM;
+    struct nrc_os_batch_run run[NRC_OS_BATCH_TARGETS];
+    u32_t                   run_count = 0;
+    struct nrc_os_msg_ref   *list = 0;
+    struct nrc_os_msg_ref   *list_tail = 0;
+    struct nrc_os_msg_ref   *ref;
+    struct nrc_os_node_hdr  *os_node_hdr;
+    struct nrc_os_msg_hdr   *os_msg_hdr;
+    bool_t                  wake = FALSE;
+    u32_t                   i;
+    u32_t                   j;
+
+    if ((entries == 0) && (count != 0)) {
+        return result;
+    }
+
+    // Take all deliveries first so a failure leaves nothing half sent
+    result = NRC_PORT_RES_OK;
+    for (i = 0; (i < count) && (result == NRC_PORT_RES_OK); i++) {
+        result = NRC_PORT_RES_INVALID_IN_PARAM;
+
+        if ((entries[i].id != 0) && (entries[i].msg != 0)) {
+            os_node_hdr = nrc_os_node(entries[i].id);
+            os_msg_hdr = (struct nrc_os_msg_hdr*)entries[i].msg - 1;
+
+            if ((os_node_hdr != 0) && (os_msg_hdr->type == NRC_OS_MSG_TYPE)) {
+                ref = nrc_os_msg_ref_get(os_msg_hdr, entries[i].id, entries[i].prio);
+                result = NRC_PORT_RES_ERROR;
+
+                if (ref != 0) {
+                    if (list_tail == 0) {
+                        list = ref;
+                    }
+                    else {
+                        list_tail->link.next = &ref->link;
+                    }
+                    list_tail = ref;
+                    result = NRC_PORT_RES_OK;
+                }
+            }
+        }
+    }
+
+    // Room in rejecting mailboxes, given back if one is full. The record, a deploy may remove the node meanwhile.
+    for (i = 0; (i < count) && (result == NRC_PORT_RES_OK); i++) {
+        os_node_hdr = nrc_os_node_record(entries[i].id);
+
+        if (nrc_os_mailbox_rejects(os_node_hdr)) {
+            result = nrc_os_mailbox_reserve(os_node_hdr, 1);
+        }
+    }
+    if (result == NRC_PORT_RES_BUSY) {
+        for (j = 0; j + 1 < i; j++) {
+            os_node_hdr = nrc_os_node_record(entries[j].id);
+
+            if (nrc_os_mailbox_rejects(os_node_hdr)) {
+                nrc_os_mailbox_unreserve(os_node_hdr, 1);
+            }
+        }
+    }
+
+    if (result != NRC_PORT_RES_OK) {
+        nrc_os_msg_ref_put_list(list);
+        return result;
+    }
+
+    // Group by target keeping send order, one mailbox append per target
+    while (list != 0) {
+        ref = list;
+        list = (struct nrc_os_msg_ref*)ref->link.next;
+
+        NRC_TRACE(NRC_TRACE_K_SEND, ref->to_node_id, ref->msg + 1, (u8_t)ref->prio);
+
+        wake |= nrc_os_batch_add(run, &run_count, ref);
+    }
+    wake |= nrc_os_batch_flush(run, &run_count);
+
+    if (wake) {
+        nrc_os_wake_idle();
+    }
+#if NRC_OS_STATS
+    nrc_os_stats_sent(count);
+#endif
+
+    return result;
+}
+
+s32_t nrc_os_send_msg_chain(nrc_node_id_t id, struct nrc_msg_hdr *chain, s8_t prio)
+{
+    s32_t                   result = NRC_PORT_RES_INVALID_IN_PARAM;
+    struct nrc_os_node_hdr  *os_node_hdr;
+    struct nrc_os_msg_hdr   *os_msg_hdr;
+    struct nrc_os_msg_ref   *head = 0;
+    struct nrc_os_msg_ref   *tail = 0;
+    struct nrc_os_msg_ref   *ref;
+    struct nrc_msg_hdr      *msg;
+    u32_t                   count = 0;
+    bool_t                  reserved;
+
+    if ((id == 0) || (chain == 0)) {
+        return result;
+    }
+
+    os_node_hdr = nrc_os_node(id);
+    if (os_node_hdr == 0) {
+        return result;
+    }
+
+    result = NRC_PORT_RES_OK;
+    for (msg = chain; (msg != 0) && (result == NRC_PORT_RES_OK); msg = msg->next) {
+        os_msg_hdr = (struct nrc_os_msg_hdr*)msg - 1;
+        result = NRC_PORT_RES_INVALID_IN_PARAM;
+
+        if (os_msg_hdr->type == NRC_OS_MSG_TYPE) {
+            ref = nrc_os_msg_ref_get(os_msg_hdr, id, prio);
+            result = NRC_PORT_RES_ERROR;
+
+            if (ref != 0) {
+                if (tail == 0) {
+                    head = ref;
+                }
+                else {
+                    tail->link.next = &ref->link;
+                }
+                tail = ref;
+                count++;
+                result = NRC_PORT_RES_OK;
+            }
+        }
+    }
+
+    reserved = nrc_os_mailbox_rejects(os_node_hdr);
+    if ((result == NRC_PORT_RES_OK) && reserved) {
+        result = nrc_os_mailbox_reserve(os_node_hdr, count);
+    }
+
+    if (result != NRC_PORT_RES_OK) {
+        nrc_os_msg_ref_put_list(head);
+        return result;
+    }
+
+    // Receivers own each message alone, unlink the chain before it is visible
+    while (chain != 0) {
+        msg = chain;
+        chain = msg->next;
+        msg->next = 0;
+
+        NRC_TRACE(NRC_TRACE_K_SEND, id, msg, (u8_t)prio);
+    }
+
+    if (nrc_os_mailbox_put(os_node_hdr, head, tail, count, reserved)) {
+        nrc_os_wake_idle();
+    }
+#if NRC_OS_STATS
+    nrc_os_stats_sent(count);
+#endif
+
+    return result;
+}
+
+// Sends msg_count messages of chain, linked through next, to every wire. All deliveries
+// and room in rejecting mailboxes are taken first so a failure leaves nothing half sent
+// and the caller still owns the messages. A port without wires frees them.
+static s32_t nrc_os_send_wires(struct nrc_os_node_hdr **wire, u32_t count, struct nrc_msg_hdr *chain, u32_t msg_count,
+                               s8_t prio)
+{
+    s32_t                   result = NRC_PORT_RES_OK;
+    struct nrc_os_batch_run run[NRC_OS_BATCH_TARGETS];
+    u32_t                   run_count = 0;
+    struct nrc_os_msg_ref   *list = 0;
+    struct nrc_os_msg_ref   *list_tail = 0;
+    struct nrc_os_msg_ref   *ref;
+    struct nrc_msg_hdr      *msg;
+    bool_t                  wake = FALSE;
+    u32_t                   i;
+    u32_t                   j;
+    u32_t                   k;
+
+    msg = chain;
+    for (k = 0; (k < msg_count) && (result == NRC_PORT_RES_OK); k++) {
+        for (i = 0; (i < count) && (result == NRC_PORT_RES_OK); i++) {
+            ref = nrc_os_msg_ref_get((struct nrc_os_msg_hdr*)msg - 1, wire[i]->id, prio);
+            result = NRC_PORT_RES_ERROR;
+
+            if (ref != 0) {
+                if (list_tail == 0) {
+                    list = ref;
+                }
+                else {
+                    list_tail->link.next = &ref->link;
+                }
+                list_tail = ref;
+                result = NRC_PORT_RES_OK;
+            }
+        }
+        msg = msg->next;
+    }
+
+    for (i = 0; (i < count) && (result == NRC_PORT_RES_OK); i++) {
+        if (nrc_os_mailbox_rejects(wire[i])) {
+            result = nrc_os_mailbox_reserve(wire[i], msg_count);
+        }
+    }
+    if (result == NRC_PORT_RES_BUSY) {
+        for (j = 0; j + 1 < i; j++) {
+            if (nrc_os_mailbox_rejects(wire[j])) {
+                nrc_os_mailbox_unreserve(wire[j], msg_count);
+            }
+        }
+    }
+
+    if (result != NRC_PORT_RES_OK) {
+        nrc_os_msg_ref_put_list(list);
+        return result;
+    }
+
+    // Receivers own each message alone, unlink it before it is visible. Shared by all
+    // wires, one reference each.
+    for (k = 0; k < msg_count; k++) {
+        msg = chain;
+        chain = msg->next;
+        msg->next = 0;
+
+        if (count == 0) {
+            nrc_os_msg_release((struct nrc_os_msg_hdr*)msg - 1);
+        }
+        else {
+            nrc_port_atomic_add(&((struct nrc_os_msg_hdr*)msg - 1)->ref_count, count - 1);
+        }
+    }
+
+    while (list != 0) {
+        ref = list;
+        list = (struct nrc_os_msg_ref*)ref->link.next;
+
+        NRC_TRACE(NRC_TRACE_K_SEND, ref->to_node_id, ref->msg + 1, (u8_t)prio);
+
+        wake |= nrc_os_batch_add(run, &run_count, ref);
+    }
+    wake |= nrc_os_batch_flush(run, &run_count);
+
+    if (wake) {
+        nrc_os_wake_idle();
+    }
+#if NRC_OS_STATS
+    nrc_os_stats_sent(count * msg_count);
+#endif
+
+    return result;
+}
+
+// Wires of the output port, none if the port has none
+static struct nrc_os_node_hdr** nrc_os_port_wires(struct nrc_os_node_hdr *os_node_hdr, u32_t port, u32_t *count)
+{
+    struct nrc_os_wires     *wires = os_node_hdr->wires;
+    struct nrc_os_node_hdr  **wire = 0;
+
+    *count = 0;
+    if ((wires != 0) && (port < wires->port_count)) {
+        wire = &wires->node[wires->first[port]];
+        *count = wires->first[port + 1] - wires->first[port];
+    }
+
+    return wire;
+}
+
+s32_t nrc_os_send_port(struct nrc_node_hdr *self, u32_t port, struct nrc_msg_hdr *msg, s8_t prio)
+{
+    s32_t                   result = NRC_PORT_RES_INVALID_IN_PARAM;
+    struct nrc_os_node_hdr  *os_node_hdr;
+    struct nrc_os_node_hdr  **wire;
+    u32_t                   count;
+
+    if ((self == 0) || (msg == 0)) {
+        return result;
+    }
+
+    os_node_hdr = nrc_os_node_of(self);
+    if ((os_node_hdr == 0) || (((struct nrc_os_msg_hdr*)msg - 1)->type != NRC_OS_MSG_TYPE)) {
+        return result;
+    }
+
+    wire = nrc_os_port_wires(os_node_hdr, port, &count);
+    result = nrc_os_send_wires(wire, count, msg, 1, prio);
+
+    return result;
+}
+
+s32_t nrc_os_send_port_chain(struct nrc_node_hdr *self, u32_t port, struct nrc_msg_hdr *chain, s8_t prio)
+{
+    s32_t                   result = NRC_PORT_RES_INVALID_IN_PARAM;
+    struct nrc_os_node_hdr  *os_node_hdr;
+    struct nrc_msg_hdr      *msg;
+    struct nrc_os_node_hdr  **wire;
+    u32_t                   msg_count = 0;
+    u32_t                   count;
+
+    if ((self == 0) || (chain == 0)) {
+        return result;
+    }
+
+    os_node_hdr = nrc_os_node_of(self);
+    if (os_node_hdr == 0) {
+        return result;
+    }
+    for (msg = chain; msg != 0; msg = msg->next) {
+        if (((struct nrc_os_msg_hdr*)msg - 1)->type != NRC_OS_MSG_TYPE) {
+            return result;
+        }
+        msg_count++;
+    }
+
+    wire = nrc_os_port_wires(os_node_hdr, port, &count);
+    result = nrc_os_send_wires(wire, count, chain, msg_count, prio);
+
+    return result;
+}
+
+// Links ref last in the ingress queue. Until the link from the previous one is
+// stored, the worker stops there and takes the rest at a later look.
+static void nrc_os_ingress_push(struct nrc_os_msg_ref *ref)
+{
+    struct nrc_os_msg_ref *prev;
+
+    ref->link.next = 0;
+    prev = (struct nrc_os_msg_ref*)nrc_port_atomic_xchg_ptr((void *volatile *)&_os.ingress_head, ref);
+    nrc_port_atomic_store_ptr_release((void *volatile *)&prev->link.next, &ref->link);
+}
+
+// First delivery of the ingress queue, 0 if it is empty or a push is half done
+static struct nrc_os_msg_ref* nrc_os_ingress_pop(void)
+{
+    struct nrc_os_msg_ref   *tail = _os.ingress_tail;
+    struct nrc_os_msg_ref   *next;
+    struct nrc_os_msg_ref   *ref = 0;
+
+    next = (struct nrc_os_msg_ref*)nrc_port_atomic_load_ptr((void *volatile *)&tail->link.next);
+
+    if (tail == &_os.ingress_stub) {
+        if (next != 0) {
+            _os.ingress_tail = next;
+            tail = next;
+            next = (struct nrc_os_msg_ref*)nrc_port_atomic_load_ptr((void *volatile *)&tail->link.next);
+        }
+        else {
+            tail = 0;
+        }
+    }
+
+    if (next != 0) {
+        _os.ingress_tail = next;
+        ref = tail;
+    }
+    else if ((tail != 0) && (tail == nrc_port_atomic_load_ptr((void *volatile *)&_os.ingress_head))) {
+        // Last one, the stub goes behind it so the queue keeps a link to take it by
+        nrc_os_ingress_push(&_os.ingress_stub);
+        next = (struct nrc_os_msg_ref*)nrc_port_atomic_load_ptr((void *volatile *)&tail->link.next);
+        if (next != 0) {
+            _os.ingress_tail = next;
+            ref = tail;
+        }
+    }
+
+    return ref;
+}
+
+// Moves sends from the ingress queue to the mailboxes, readying the nodes on the worker
+static void nrc_os_take_ingress(void)
+{
+    struct nrc_os_batch_run run[NRC_OS_BATCH_TARGETS];
+    u32_t                   run_count = 0;
+    struct nrc_os_msg_ref   *ref = 0;
+    struct nrc_os_node_hdr  *os_node_hdr;
+    struct nrc_os_msg_hdr   *os_msg_hdr;
+    bool_t                  wake = FALSE;
+    u32_t                   count = 0;
+
+    // One worker takes at a time, the others find the queue busy and move on
+    if (!nrc_port_atomic_cas(&_os.ingress_busy, FALSE, TRUE)) {
+        return;
+    }
+
+    // A push left half done is not lost, its sender sets pending again when done
+    nrc_port_atomic_xchg(&_os.ingress_pending, 0);
+
+    while ((count < NRC_OS_INGRESS_BATCH) && ((ref = nrc_os_ingress_pop()) != 0)) {
+        // The record, the node may have been removed since the send
+        os_node_hdr = nrc_os_node_record(ref->to_node_id);
+        count++;
+
+        // The sender is gone, a full rejecting mailbox drops the message
+        if (nrc_os_mailbox_rejects(os_node_hdr) && (nrc_os_mailbox_reserve(os_node_hdr, 1) != NRC_PORT_RES_OK)) {
+            os_msg_hdr = ref->msg;
+            nrc_os_msg_ref_put(ref);
+            nrc_os_msg_release(os_msg_hdr);
+        }
+        else {
+            NRC_TRACE(NRC_TRACE_K_SEND, ref->to_node_id, ref->msg + 1, (u8_t)ref->prio);
+
+            wake |= nrc_os_batch_add(run, &run_count, ref);
+        }
+    }
+    wake |= nrc_os_batch_flush(run, &run_count);
+
+    if (ref != 0) {
+        nrc_port_atomic_store(&_os.ingress_pending, 1);
+    }
+    nrc_port_atomic_store(&_os.ingress_busy, FALSE);
+
+    if (wake) {
+        nrc_os_wake_idle();
+    }
+}
+
+s32_t nrc_os_send_msg_lock_free(nrc_node_id_t id, struct nrc_msg_hdr *msg, s8_t prio)
+{
+    s32_t result = NRC_PORT_RES_INVALID_IN_PARAM;
+
+    if ((id != 0) && (msg != 0)) {
+
+        struct nrc_os_node_hdr  *os_node_hdr = nrc_os_node(id);
+        struct nrc_os_msg_hdr   *os_msg_hdr = (struct nrc_os_msg_hdr*)msg - 1;
+
+        if ((os_node_hdr != 0) && (os_msg_hdr->type == NRC_OS_MSG_TYPE)) {
+            result = NRC_PORT_RES_BUSY;
+
+            // Only the embedded delivery, another would have to be allocated
+            if (nrc_port_atomic_cas(&os_msg_hdr->ref_busy, FALSE, TRUE)) {
+                struct nrc_os_msg_ref *ref = &os_msg_hdr->ref;
+
+                ref->msg = os_msg_hdr;
+                ref->to_node_id = id;
+                ref->prio = prio;
+
+                nrc_os_ingress_push(ref);
+                nrc_port_atomic_store(&_os.ingress_pending, 1);
+                nrc_os_wake_idle();
+
+                result = NRC_PORT_RES_OK;
+            }
+        }
+    }
+
+    return result;
+}
+
+s32_t nrc_os_set_evt(nrc_node_id_t id, u32_t event_mask, s8_t prio)
+{
+    s32_t result = NRC_PORT_RES_INVALID_IN_PARAM;
+
+    if ((id != 0) && (event_mask != 0)) {
+
+        struct nrc_os_node_hdr *os_node_hdr = nrc_os_node(id);
+
+        if (os_node_hdr != 0) {
+
+            NRC_TRACE(NRC_TRACE_K_SET_EVT, id, 0, event_mask);
+
+            // Only the 0 to non-zero transition makes the node ready, later
+            // events are merged and delivered in the same recv_evt call
+            if (nrc_port_atomic_or(&os_node_hdr->event, event_mask) == 0) {
+                os_node_hdr->evt_prio = prio;
+                nrc_os_node_wake(os_node_hdr, prio, TRUE);
+            }
+
+            result = NRC_PORT_RES_OK;
+        }
+    }
+
+    return result;
+}
+
+s32_t nrc_os_get_stats(nrc_node_id_t id, struct nrc_os_stats *stats)
+{
+    s32_t result = NRC_PORT_RES_INVALID_IN_PARAM;
+
+    if ((id != 0) && (stats != 0)) {
+
+        struct nrc_os_node_hdr *os_node_hdr = nrc_os_node(id);
+
+        if (os_node_hdr != 0) {
+#if NRC_OS_STATS
+            nrc_os_stats_read(os_node_hdr, stats);
+            result = NRC_PORT_RES_OK;
+#else
+            result = NRC_PORT_RES_NOT_SUPPORTED;
+#endif
+        }
+    }
+
+    return result;
+}
+
+s32_t nrc_os_set_stats_hook(nrc_os_stats_hook_t hook, u32_t period_ms)
+{
+    s32_t result = NRC_PORT_RES_NOT_SUPPORTED;
+
+    assert(_os.state == NRC_OS_S_INITIALIZED);
+
+#if NRC_OS_STATS
+    result = NRC_PORT_RES_INVALID_IN_PARAM;
+
+    if ((hook == 0) || (period_ms != 0)) {
+        _os.stats_period = (u64_t)period_ms * 1000000ULL;
+        _os.stats_due = nrc_port_time_ns() + _os.stats_period;
+        _os.stats_hook = hook;
+        result = NRC_PORT_RES_OK;
+    }
+#endif
+
+    return result;
+}
+
+s32_t nrc_os_set_queue_limit(nrc_node_id_t id, u32_t limit, enum nrc_os_queue_policy policy, u32_t low_water)
+{
+    s32_t result = NRC_PORT_RES_INVALID_IN_PARAM;
+
+    if ((id != 0) && (policy <= NRC_OS_QUEUE_LATEST) && ((limit == 0) || (low_water < limit))) {
+
+        struct nrc_os_node_hdr *os_node_hdr = nrc_os_node(id);
+
+        if (os_node_hdr != 0) {
+            nrc_port_mutex_lock(os_node_hdr->mq_lock, 0);
+            os_node_hdr->mq_limit = limit;
+            os_node_hdr->mq_policy = (u8_t)policy;
+            os_node_hdr->mq_low_water = low_water;
+            nrc_port_mutex_unlock(os_node_hdr->mq_lock);
+
+            result = NRC_PORT_RES_OK;
+        }
+    }
+
+    return result;
+}
+
+s32_t nrc_os_subscribe_low_water(nrc_node_id_t id, nrc_node_id_t subscriber, u32_t event_mask, s8_t prio)
+{
+    s32_t result = NRC_PORT_RES_INVALID_IN_PARAM;
+
+    if ((id != 0) && (subscriber != 0) && (event_mask != 0)) {
+
+        struct nrc_os_node_hdr      *os_node_hdr = nrc_os_node(id);
+        struct nrc_os_low_water_sub *sub;
+
+        if ((os_node_hdr != 0) && (nrc_os_node(subscriber) != 0)) {
+            sub = (struct nrc_os_low_water_sub*)nrc_os_mem_keep(sizeof(struct nrc_os_low_water_sub));
+            result = NRC_PORT_RES_ERROR;
+
+            if (sub != 0) {
+                sub->id = subscriber;
+                sub->event_mask = event_mask;
+                sub->prio = prio;
+
+                // Subscriptions live as long as the node, the dispatcher reads the list without lock
+                do {
+                    sub->next = (struct nrc_os_low_water_sub*)nrc_port_atomic_load_ptr((void *volatile *)&os_node_hdr->mq_subs);
+                } while (!nrc_port_atomic_cas_ptr((void *volatile *)&os_node_hdr->mq_subs, sub->next, sub));
+
+                result = NRC_PORT_RES_OK;
+            }
+        }
+    }
+
+    return result;
+}
+
+s32_t nrc_os_timer_init(struct nrc_os_timer *timer, nrc_node_id_t id, u32_t event_mask, s8_t prio)
+{
+    s32_t result = NRC_PORT_RES_INVALID_IN_PARAM;
+
+    if ((timer != 0) && (id != 0)) {
+        memset(timer, 0, sizeof(struct nrc_os_timer));
+        timer->id = id;
+        timer->event_mask = event_mask;
+        timer->prio = prio;
+
+        result = NRC_PORT_RES_OK;
+    }
+
+    return result;
+}
+
+s32_t nrc_os_timer_start(struct nrc_os_timer *timer, u32_t timeout, u32_t period, struct nrc_msg_hdr *msg)
+{
+    s32_t               result = NRC_PORT_RES_INVALID_IN_PARAM;
+    struct nrc_msg_hdr  *old_msg = 0;
+    u64_t               now;
+    u64_t               due;
+    u32_t               sleeper;
+    bool_t              wake;
+
+    if ((timer != 0) && (timer->id != 0)) {
+        now = nrc_os_timer_now();
+
+        nrc_port_mutex_lock(_os.timer_lock, 0);
+
+        nrc_timer_wheel_remove(&_os.timer_wheel, &timer->link);
+        if (timer->msg != msg) {
+            old_msg = timer->msg;
+        }
+        timer->msg = msg;
+        timer->period = period;
+
+        // An empty wheel has not been advanced since its last timer, catch up first
+        if (_os.timer_wheel.count == 0) {
+            _os.timer_wheel.now = now;
+        }
+        nrc_timer_wheel_add(&_os.timer_wheel, &timer->link, now + timeout);
+
+        due = nrc_timer_wheel_next(&_os.timer_wheel);
+        wake = (due < _os.timer_due);
+        _os.timer_due = due;
+
+        nrc_port_mutex_unlock(_os.timer_lock);
+
+        if (old_msg != 0) {
+            nrc_os_msg_free(old_msg);
+        }
+
+        // The worker that took the deadline may be asleep until a later one
+        if (wake) {
+            sleeper = nrc_port_atomic_load(&_os.timer_sleeper);
+            if (sleeper != 0) {
+                nrc_os_wake_worker(sleeper - 1);
+            }
+            else {
+                nrc_os_wake_idle();
+            }
+        }
+
+        result = NRC_PORT_RES_OK;
+    }
+
+    return result;
+}
+
+s32_t nrc_os_timer_stop(struct nrc_os_timer *timer)
+{
+    s32_t               result = NRC_PORT_RES_INVALID_IN_PARAM;
+    struct nrc_msg_hdr  *msg;
+
+    if ((timer != 0) && (timer->id != 0)) {
+        nrc_port_mutex_lock(_os.timer_lock, 0);
+
+        nrc_timer_wheel_remove(&_os.timer_wheel, &timer->link);
+        msg = timer->msg;
+        timer->msg = 0;
+        _os.timer_due = nrc_timer_wheel_next(&_os.timer_wheel);
+
+        nrc_port_mutex_unlock(_os.timer_lock);
+
+        if (msg != 0) {
+            nrc_os_msg_free(msg);
+        }
+
+        result = NRC_PORT_RES_OK;
+    }
+
+    return result;
+}
+
+s32_t nrc_os_io_init(struct nrc_os_io *io, nrc_node_id_t id, u32_t evt_in, u32_t evt_out, s8_t prio)
+{
+    s32_t result = NRC_PORT_RES_INVALID_IN_PARAM;
+
+    if ((io != 0) && (id != 0)) {
+        memset(io, 0, sizeof(struct nrc_os_io));
+        io->id = id;
+        io->evt_in = evt_in;
+        io->evt_out = evt_out;
+        io->prio = prio;
+
+        result = NRC_PORT_RES_OK;
+    }
+
+    return result;
+}
+
+// Reactor thread, the node's event is set like from a driver
+static void nrc_os_io_ready(void *context, u32_t ready)
+{
+    struct nrc_os_io    *io = (struct nrc_os_io*)context;
+    u32_t               event_mask = 0;
+
+    if ((ready & NRC_PORT_IO_IN) != 0) {
+        event_mask |= io->evt_in;
+    }
+    if ((ready & NRC_PORT_IO_OUT) != 0) {
+        event_mask |= io->evt_out;
+    }
+
+    if (event_mask != 0) {
+        nrc_os_set_evt(io->id, event_mask, io->prio);
+    }
+}
+
+s32_t nrc_os_io_add(struct nrc_os_io *io, s32_t fd, u32_t interest)
+{
+    s32_t result = NRC_PORT_RES_INVALID_IN_PARAM;
+
+    if ((io != 0) && (io->id != 0) && (io->handle == 0)) {
+        result = nrc_port_io_add(fd, interest, nrc_os_io_ready, io, &io->handle);
+    }
+
+    return result;
+}
+
+s32_t nrc_os_io_modify(struct nrc_os_io *io, u32_t interest)
+{
+    s32_t result = NRC_PORT_RES_INVALID_IN_PARAM;
+
+    if ((io != 0) && (io->handle != 0)) {
+        result = nrc_port_io_modify(io->handle, interest);
+    }
+
+    return result;
+}
+
+s32_t nrc_os_io_again(struct nrc_os_io *io, u32_t ready)
+{
+    s32_t result = NRC_PORT_RES_INVALID_IN_PARAM;
+
+    if ((io != 0) && (io->handle != 0)) {
+        result = nrc_port_io_again(io->handle, ready);
+    }
+
+    return result;
+}
+
+s32_t nrc_os_io_remove(struct nrc_os_io *io)
+{
+    s32_t result = NRC_PORT_RES_INVALID_IN_PARAM;
+
+    if ((io != 0) && (io->handle != 0)) {
+        result = nrc_port_io_remove(io->handle);
+        io->handle = 0;
+    }
+
+    return result;
+}
+
+s32_t nrc_os_set_node_types(const struct nrc_os_node_type *types, u32_t count)
+{
+    s32_t result = NRC_PORT_RES_INVALID_IN_PARAM;
+
+    if ((types != 0) || (count == 0)) {
+        _os.node_types = types;
+        _os.node_type_count = count;
+        result = NRC_PORT_RES_OK;
+    }
+
+    return result;
+}
+
+static const struct nrc_os_node_type* nrc_os_node_type_find(const s8_t *cfg_type)
+{
+    const struct nrc_os_node_type   *type = 0;
+    u32_t                           i;
+
+    for (i = 0; (i < _os.node_type_count) && (type == 0); i++) {
+        if (strcmp((const char*)_os.node_types[i].cfg_type, (const char*)cfg_type) == 0) {
+            type = &_os.node_types[i];
+        }
+    }
+
+    return type;
+}
+
+// Waits for the node to end its turn, it then gets nothing until resumed. Messages
+// and events sent meanwhile wait. Before start there is no turn to wait for, a
+// node queued then is parked when a worker first takes it.
+static void nrc_os_node_pause(struct nrc_os_node_hdr *node)
+{
+    nrc_port_atomic_or(&node->sched, NRC_OS_NODE_PAUSE);
+
+    while ((_os.state == NRC_OS_S_STARTED) && (nrc_port_atomic_load(&node->sched) != NRC_OS_NODE_PAUSE)) {
+        nrc_port_sema_wait(_os.deploy_sema, 1);
+    }
+}
+
+static void nrc_os_node_resume(struct nrc_os_node_hdr *node)
+{
+    struct nrc_os_msg_ref   *ref;
+    s8_t                    prio = 0;
+
+    // A node still queued from before the pause just runs, a parked one is woken for its work
+    if (nrc_port_atomic_and(&node->sched, ~(u32_t)NRC_OS_NODE_PAUSE) == NRC_OS_NODE_PAUSE) {
+        nrc_port_mutex_lock(node->mq_lock, 0);
+        ref = node->mq_head;
+        if (ref != 0) {
+            prio = ref->prio;
+        }
+        nrc_port_mutex_unlock(node->mq_lock);
+
+        if (ref != 0) {
+            nrc_os_node_wake(node, prio, TRUE);
+        }
+        else if (nrc_port_atomic_load(&node->event) != 0) {
+            nrc_os_node_wake(node, node->evt_prio, TRUE);
+        }
+    }
+}
+
+// Takes the paused node's struct away, its record stays for the id
+static void nrc_os_node_unbind(struct nrc_os_node_hdr *node)
+{
+    struct nrc_node_hdr *node_hdr = node->node_hdr;
+
+    node->api->stop(node_hdr);
+    node->api->deinit(node_hdr);
+
+    ((struct nrc_os_node_tag*)node_hdr - 1)->hot = 0;
+    node->node_hdr = 0;
+    nrc_os_node_free(node_hdr);
+}
+
+// Node removed from config, lookups and sends no longer find it and its queue is freed
+static void nrc_os_node_remove(struct nrc_os_node_hdr *node)
+{
+    struct nrc_os_msg_ref *dropped;
+
+    nrc_port_atomic_store_ptr_release((void *volatile *)&node->api, 0);
+
+    nrc_port_mutex_lock(node->mq_lock, 0);
+    dropped = node->mq_head;
+    node->mq_head = 0;
+    node->mq_tail = 0;
+    node->mq_count = 0;
+    nrc_port_mutex_unlock(node->mq_lock);
+
+    nrc_os_msg_ref_drop_list(dropped);
+    nrc_port_atomic_store(&node->event, 0);
+    node->cold->type = 0;
+}
+
+// TRUE if a wire of the node leads to a node being removed
+static bool_t nrc_os_wires_removed(struct nrc_os_node_hdr *node)
+{
+    struct nrc_os_wires *wires = node->wires;
+    bool_t              removed = FALSE;
+    u32_t               i;
+
+    if (wires != 0) {
+        for (i = 0; (i < wires->first[wires->port_count]) && (removed == FALSE); i++) {
+            removed = wires->node[i]->cold->removing;
+        }
+    }
+
+    return removed;
+}
+
+// New or changed node of the config, gets a new struct and is held until it is started
+static struct nrc_os_node_hdr* nrc_os_deploy_node(struct nrc_os_node_hdr *node, const struct nrc_os_node_type *type,
+                                                  s8_t *cfg_type, s8_t *cfg_id)
+{
+    struct nrc_node_hdr *node_hdr;
+    s8_t                cfg_name[NRC_MAX_CFG_NAME_LEN];
+
+    if (nrc_cfg_get_str(cfg_type, cfg_id, "name", cfg_name, NRC_MAX_CFG_NAME_LEN) != NRC_PORT_RES_OK) {
+        cfg_name[0] = 0;
+    }
+
+    node_hdr = type->alloc(cfg_type, cfg_id, cfg_name);
+
+    if ((node_hdr != 0) && (node == 0)) {
+        node = nrc_os_node_add(node_hdr, type->api, cfg_id, TRUE);
+
+        if (node == 0) {
+            nrc_os_node_free(node_hdr);
+        }
+    }
+    else if (node_hdr != 0) {
+        ((struct nrc_os_node_tag*)node_hdr - 1)->hot = node;
+        node->node_hdr = node_hdr;
+        nrc_port_atomic_store_ptr_release((void *volatile *)&node->api, type->api);
+    }
+    else if ((node != 0) && (node->api != 0)) {
+        // Changed but no memory for the new one, it goes once no wire leads to it
+        node->cold->removing = TRUE;
+        node = 0;
+    }
+    else {
+        node = 0;
+    }
+
+    if (node != 0) {
+        node->cold->type = type;
+        node->cold->held = TRUE;
+        node->cold->wires_changed = TRUE;
+    }
+
+    return node;
+}
+
+s32_t nrc_os_deploy(void)
+{
+    s32_t                           result = NRC_PORT_RES_OK;
+    const struct nrc_os_node_type   *type;
+    struct nrc_os_node_hdr          *node;
+    struct nrc_os_node_hdr          *first = 0;
+    struct nrc_os_node_hdr          *last = 0;
+    s8_t                            cfg_type[NRC_MAX_CFG_NAME_LEN];
+    s8_t                            cfg_id[NRC_MAX_CFG_NAME_LEN];
+    u32_t                           params_hash;
+    u32_t                           wires_hash;
+    u32_t                           count = nrc_port_atomic_load(&_os.node_count);
+    u32_t                           index;
+    nrc_node_id_t                   id;
+    bool_t                          registered = FALSE;
+    bool_t                          added = FALSE;     // Nodes that wires left out may lead to now
+    bool_t                          removed = FALSE;
+    bool_t                          started = (_os.state == NRC_OS_S_STARTED);
+
+    assert(_os.state != NRC_OS_S_INVALID);
+    assert(_os_current_worker == 0);
+
+    _os.deploy_gen++;
+
+    // New and changed nodes, a changed one is stopped and gets a new struct in its record
+    for (index = 0; nrc_cfg_get_node(index, cfg_type, cfg_id, NRC_MAX_CFG_NAME_LEN) == NRC_PORT_RES_OK; index++) {
+        if (nrc_cfg_get_node_hash(cfg_type, cfg_id, &params_hash, &wires_hash) != NRC_PORT_RES_OK) {
+            continue;
+        }
+        node = nrc_os_registry_find(cfg_id, TRUE);
+        type = nrc_os_node_type_find(cfg_type);
+
+        if ((node != 0) && (node->cold->wires_hash != wires_hash)) {
+            node->cold->wires_hash = wires_hash;
+            node->cold->wires_changed = TRUE;
+        }
+
+        // Registered by the application, of a type not deployed, or an id seen twice
+        if (((node != 0) && (node->api != 0) && (node->cold->type == 0)) || (type == 0) ||
+            ((node != 0) && (node->cold->deploy_gen == _os.deploy_gen))) {
+            continue;
+        }
+
+        if ((node == 0) || (node->api == 0) || (node->cold->type != type) || (node->cold->params_hash != params_hash)) {
+            if ((node != 0) && (node->api != 0)) {
+                nrc_os_node_pause(node);
+                nrc_os_node_unbind(node);
+            }
+            registered |= (node == 0);
+            added |= ((node == 0) || (node->api == 0));
+
+            node = nrc_os_deploy_node(node, type, cfg_type, cfg_id);
+            if (node == 0) {
+                result = NRC_PORT_RES_ERROR;
+                continue;
+            }
+
+            node->cold->params_hash = params_hash;
+            node->cold->wires_hash = wires_hash;
+            node->cold->deploy_next = 0;
+            if (last == 0) {
+                first = node;
+            }
+            else {
+                last->cold->deploy_next = node;
+            }
+            last = node;
+        }
+        node->cold->deploy_gen = _os.deploy_gen;
+    }
+
+    // One new registry for all nodes added, lookups in init find them all
+    if (registered) {
+        if (started) {
+            nrc_port_irq_disable();
+        }
+        if (nrc_os_registry_rebuild() != NRC_PORT_RES_OK) {
+            result = NRC_PORT_RES_ERROR;
+        }
+        if (started) {
+            nrc_port_irq_enable();
+        }
+    }
+
+    // Removed nodes, deployed before but not found in config now. They stay paused in their
+    // records until no wire leads to them, a running node may still send on its old wires.
+    for (id = 1; id <= count; id++) {
+        node = nrc_os_node_record(id);
+
+        if ((node->api != 0) && (node->cold->type != 0) && (node->cold->deploy_gen != _os.deploy_gen) &&
+            !node->cold->removing) {
+            nrc_os_node_pause(node);
+            nrc_os_node_unbind(node);
+            node->cold->removing = TRUE;
+        }
+        removed |= node->cold->removing;
+    }
+
+    // Wires, between two turns of the node. Before start nrc_os_start compiles them all.
+    for (id = 1; (node = nrc_os_node_record(id)) != 0; id++) {
+        if ((node->api != 0) && !node->cold->removing && started &&
+            (node->cold->wires_changed || (added && (node->cold->wires_missing != 0)) ||
+             (removed && nrc_os_wires_removed(node)))) {
+
+            if (!node->cold->held) {
+                nrc_os_node_pause(node);
+            }
+            if (nrc_os_wires_compile(node) != NRC_PORT_RES_OK) {
+                result = NRC_PORT_RES_ERROR;
+            }
+            if (!node->cold->held) {
+                nrc_os_node_resume(node);
+            }
+        }
+        node->cold->wires_changed = FALSE;
+    }
+
+    // Nothing leads to the removed nodes any more, only stale ids and lock-free sends in flight.
+    // Those find the record without an api and drop the message, see nrc_os_mailbox_put.
+    for (id = 1; removed && (id <= count); id++) {
+        node = nrc_os_node_record(id);
+
+        if (node->cold->removing) {
+            nrc_os_node_remove(node);
+            node->cold->removing = FALSE;
+        }
+    }
+
+    // New nodes are started once all of them can be looked up
+    for (node = first; node != 0; node = node->cold->deploy_next) {
+        if (node->api->init(node->node_hdr, node->id) != NRC_PORT_RES_OK) {
+            result = NRC_PORT_RES_ERROR;
+        }
+    }
+    for (node = first; node != 0; node = node->cold->deploy_next) {
+        if (node->api->start(node->node_hdr) != NRC_PORT_RES_OK) {
+            result = NRC_PORT_RES_ERROR;
+        }
+    }
+    for (node = first; node != 0; node = node->cold->deploy_next) {
+        node->cold->held = FALSE;
+        nrc_os_node_resume(node);
+    }
+
+    return result;
+}
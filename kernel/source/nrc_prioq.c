@@ -0,0 +1,158 @@
+/**
+ * Copyright 2017 Tomas Frisberg & Ola Bjorsne
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http ://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "nrc_prioq.h"
+#include <assert.h>
+#include <string.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Level 0 holds the highest priority (-128)
+#define NRC_PRIOQ_LEVEL(prio)   ((u32_t)((s32_t)(prio) + 128))
+#define NRC_PRIOQ_PRIO(level)   ((s8_t)((s32_t)(level) - 128))
+
+// Index of the least significant set bit, value must be non-zero
+static u32_t nrc_prioq_ffs(u32_t value)
+{
+#if defined(__GNUC__)
+    return (u32_t)__builtin_ctz(value);
+#elif defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, value);
+    return (u32_t)index;
+#else
+    u32_t index = 0;
+    while ((value & 1) == 0) {
+        value >>= 1;
+        index++;
+    }
+    return index;
+#endif
+}
+
+static u32_t nrc_prioq_first_level(struct nrc_prioq *queue)
+{
+    u32_t word = nrc_prioq_ffs(queue->summary);
+
+    return (word * 32) + nrc_prioq_ffs(queue->bitmap[word]);
+}
+
+void nrc_prioq_init(struct nrc_prioq *queue)
+{
+    assert(queue != 0);
+
+    memset(queue, 0, sizeof(struct nrc_prioq));
+}
+
+void nrc_prioq_put(struct nrc_prioq *queue, struct nrc_prioq_link *item, s8_t prio)
+{
+    u32_t                   index = NRC_PRIOQ_LEVEL(prio);
+    struct nrc_prioq_level  *level = &(queue->level[index]);
+
+    item->next = 0;
+    item->prev = level->tail;
+
+    if (level->head == 0) {
+        level->head = item;
+        queue->bitmap[index / 32] |= (1U << (index % 32));
+        queue->summary |= (1U << (index / 32));
+    }
+    else {
+        level->tail->next = item;
+    }
+    level->tail = item;
+
+    queue->count++;
+}
+
+struct nrc_prioq_link* nrc_prioq_get(struct nrc_prioq *queue, s8_t *prio)
+{
+    struct nrc_prioq_link *item = 0;
+
+    if (queue->summary != 0) {
+        u32_t                   index = nrc_prioq_first_level(queue);
+        struct nrc_prioq_level  *level = &(queue->level[index]);
+
+        item = level->head;
+        level->head = item->next;
+
+        if (level->head == 0) {
+            level->tail = 0;
+            queue->bitmap[index / 32] &= ~(1U << (index % 32));
+            if (queue->bitmap[index / 32] == 0) {
+                queue->summary &= ~(1U << (index / 32));
+            }
+        }
+        else {
+            level->head->prev = 0;
+        }
+
+        item->next = 0;
+        queue->count--;
+
+        if (prio != 0) {
+            *prio = NRC_PRIOQ_PRIO(index);
+        }
+    }
+
+    return item;
+}
+
+bool_t nrc_prioq_peek_prio(struct nrc_prioq *queue, s8_t *prio)
+{
+    bool_t found = FALSE;
+
+    if (queue->summary != 0) {
+        *prio = NRC_PRIOQ_PRIO(nrc_prioq_first_level(queue));
+        found = TRUE;
+    }
+
+    return found;
+}
+
+void nrc_prioq_remove(struct nrc_prioq *queue, struct nrc_prioq_link *item, s8_t prio)
+{
+    u32_t                   index = NRC_PRIOQ_LEVEL(prio);
+    struct nrc_prioq_level  *level = &(queue->level[index]);
+
+    assert((item->prev != 0) || (level->head == item));
+
+    if (item->prev != 0) {
+        item->prev->next = item->next;
+    }
+    else {
+        level->head = item->next;
+    }
+    if (item->next != 0) {
+        item->next->prev = item->prev;
+    }
+    else {
+        level->tail = item->prev;
+    }
+
+    if (level->head == 0) {
+        queue->bitmap[index / 32] &= ~(1U << (index % 32));
+        if (queue->bitmap[index / 32] == 0) {
+            queue->summary &= ~(1U << (index / 32));
+        }
+    }
+
+    item->next = 0;
+    item->prev = 0;
+    queue->count--;
+}
@@ -0,0 +1,243 @@
+/**
+ * Copyright 2017 Tomas Frisberg & Ola Bjorsne
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http ://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "nrc_timer.h"
+#include <assert.h>
+#include <string.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#define NRC_TIMER_SLOT_MASK     (NRC_TIMER_SLOTS - 1)
+#define NRC_TIMER_SHIFT(level)  ((level) * NRC_TIMER_SLOT_BITS)
+#define NRC_TIMER_RANGE         (1ULL << NRC_TIMER_SHIFT(NRC_TIMER_LEVELS))
+
+// Index of the least significant set bit, value must be non-zero
+static u32_t nrc_timer_ffs(u32_t value)
+{
+#if defined(__GNUC__)
+    return (u32_t)__builtin_ctz(value);
+#elif defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, value);
+    return (u32_t)index;
+#else
+    u32_t index = 0;
+    while ((value & 1) == 0) {
+        value >>= 1;
+        index++;
+    }
+    return index;
+#endif
+}
+
+// Distance from index to the first set slot at or after it, wrapping around. Bits must be non-zero.
+static u32_t nrc_timer_first_from(u64_t bits, u32_t index)
+{
+    if (index != 0) {
+        bits = (bits >> index) | (bits << (NRC_TIMER_SLOTS - index));
+    }
+
+    return ((u32_t)bits != 0) ? nrc_timer_ffs((u32_t)bits) : (32 + nrc_timer_ffs((u32_t)(bits >> 32)));
+}
+
+// Slots keep their timers in the order added, the head's previous is the tail
+static void nrc_timer_slot_append(struct nrc_timer_wheel *wheel, struct nrc_timer_link *link, u32_t level, u32_t index)
+{
+    struct nrc_timer_link **head = &(wheel->slot[level][index]);
+
+    link->next = 0;
+    if (*head == 0) {
+        link->previous = link;
+        *head = link;
+        wheel->bitmap[level] |= (1ULL << index);
+    }
+    else {
+        link->previous = (*head)->previous;
+        (*head)->previous->next = link;
+        (*head)->previous = link;
+    }
+    link->slot = 1 + (level * NRC_TIMER_SLOTS) + index;
+}
+
+// Takes all timers of a slot, linked through next
+static struct nrc_timer_link* nrc_timer_slot_take(struct nrc_timer_wheel *wheel, u32_t level, u32_t index)
+{
+    struct nrc_timer_link *list = wheel->slot[level][index];
+
+    wheel->slot[level][index] = 0;
+    wheel->bitmap[level] &= ~(1ULL << index);
+
+    return list;
+}
+
+static void nrc_timer_place(struct nrc_timer_wheel *wheel, struct nrc_timer_link *link)
+{
+    u64_t place = link->expires;
+    u64_t delta;
+    u32_t level = 0;
+
+    if (place < wheel->now) {
+        place = wheel->now;
+    }
+    delta = place - wheel->now;
+    if (delta >= NRC_TIMER_RANGE) {
+        // Waits in the top level and is placed again when its slot comes up
+        delta = NRC_TIMER_RANGE - 1;
+        place = wheel->now + delta;
+    }
+
+    while ((delta >> NRC_TIMER_SHIFT(level + 1)) != 0) {
+        level++;
+    }
+
+    nrc_timer_slot_append(wheel, link, level, (u32_t)(place >> NRC_TIMER_SHIFT(level)) & NRC_TIMER_SLOT_MASK);
+}
+
+void nrc_timer_wheel_init(struct nrc_timer_wheel *wheel, u64_t now)
+{
+    assert(wheel != 0);
+
+    memset(wheel, 0, sizeof(struct nrc_timer_wheel));
+    wheel->now = now;
+}
+
+void nrc_timer_wheel_add(struct nrc_timer_wheel *wheel, struct nrc_timer_link *link, u64_t expires)
+{
+    assert(link->slot == 0);
+
+    link->expires = expires;
+    nrc_timer_place(wheel, link);
+
+    wheel->count++;
+}
+
+void nrc_timer_wheel_remove(struct nrc_timer_wheel *wheel, struct nrc_timer_link *link)
+{
+    u32_t                   level;
+    u32_t                   index;
+    struct nrc_timer_link   **head;
+
+    if (link->slot != 0) {
+        level = (link->slot - 1) / NRC_TIMER_SLOTS;
+        index = (link->slot - 1) % NRC_TIMER_SLOTS;
+        head = &(wheel->slot[level][index]);
+
+        if (link == *head) {
+            *head = link->next;
+            if (*head != 0) {
+                (*head)->previous = link->previous;
+            }
+            else {
+                wheel->bitmap[level] &= ~(1ULL << index);
+            }
+        }
+        else {
+            link->previous->next = link->next;
+            if (link->next != 0) {
+                link->next->previous = link->previous;
+            }
+            else {
+                (*head)->previous = link->previous;
+            }
+        }
+
+        link->next = 0;
+        link->previous = 0;
+        link->slot = 0;
+        wheel->count--;
+    }
+}
+
+u64_t nrc_timer_wheel_next(struct nrc_timer_wheel *wheel)
+{
+    u64_t next = NRC_TIMER_NEVER;
+    u64_t unit;
+    u64_t base;
+    u64_t tick;
+    u32_t level;
+
+    for (level = 0; level < NRC_TIMER_LEVELS; level++) {
+        if (wheel->bitmap[level] == 0) {
+            continue;
+        }
+
+        // Slots of a level come up on ticks that are a multiple of its slot span
+        unit = 1ULL << NRC_TIMER_SHIFT(level);
+        base = (wheel->now + unit - 1) & ~(unit - 1);
+        tick = base + ((u64_t)nrc_timer_first_from(wheel->bitmap[level],
+                       (u32_t)(base >> NRC_TIMER_SHIFT(level)) & NRC_TIMER_SLOT_MASK) << NRC_TIMER_SHIFT(level));
+
+        if (tick < next) {
+            next = tick;
+        }
+    }
+
+    return next;
+}
+
+struct nrc_timer_link* nrc_timer_wheel_advance(struct nrc_timer_wheel *wheel, u64_t now)
+{
+    struct nrc_timer_link   *expired = 0;
+    struct nrc_timer_link   *expired_tail = 0;
+    struct nrc_timer_link   *list;
+    struct nrc_timer_link   *link;
+    u64_t                   tick;
+    u32_t                   level;
+
+    while (wheel->count != 0) {
+        tick = nrc_timer_wheel_next(wheel);
+        if (tick > now) {
+            break;
+        }
+        wheel->now = tick;
+
+        // Move the timers of the slots that came up one level down, lowest level first
+        for (level = 1; (level < NRC_TIMER_LEVELS) && ((tick & ((1ULL << NRC_TIMER_SHIFT(level)) - 1)) == 0); level++) {
+            list = nrc_timer_slot_take(wheel, level, (u32_t)(tick >> NRC_TIMER_SHIFT(level)) & NRC_TIMER_SLOT_MASK);
+
+            while (list != 0) {
+                link = list;
+                list = link->next;
+                nrc_timer_place(wheel, link);
+            }
+        }
+
+        list = nrc_timer_slot_take(wheel, 0, (u32_t)tick & NRC_TIMER_SLOT_MASK);
+        if (list != 0) {
+            for (link = list; link != 0; link = link->next) {
+                link->slot = 0;
+                wheel->count--;
+            }
+            if (expired == 0) {
+                expired = list;
+            }
+            else {
+                expired_tail->next = list;
+            }
+            expired_tail = list->previous;
+        }
+
+        wheel->now = tick + 1;
+    }
+
+    if (wheel->now <= now) {
+        wheel->now = now + 1;
+    }
+
+    return expired;
+}
@@ -0,0 +1,309 @@
+/**
+ * Copyright 2017 Tomas Frisberg & Ola Bjorsne
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http ://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "nrc_trace.h"
+#include "nrc_port.h"
+#include <stdint.h>
+#include <string.h>
+
+#if NRC_OS_TRACE
+
+#ifndef NRC_TRACE_RING_SIZE
+#define NRC_TRACE_RING_SIZE     (4096)  // Records per thread, power of two
+#endif
+
+#define NRC_TRACE_RING_MASK     (NRC_TRACE_RING_SIZE - 1)
+
+// A writer publishes head after each record but may already be changing the
+// slot after it, the snapshot leaves this many of the oldest records out
+#define NRC_TRACE_RING_MARGIN   (2)
+
+// A clock read costs more than the rest of a record, so only turn boundaries
+// read it. A turn that follows another on a busy worker begins when that one
+// ended, the first recv of a turn when the turn began, and what a node does
+// inside a recv call gets the time the call started.
+#define NRC_TRACE_RECV          ((1U << NRC_TRACE_K_RECV_MSG) | (1U << NRC_TRACE_K_RECV_EVT))
+
+enum nrc_trace_turn {
+    NRC_TRACE_T_NONE = 0,       // Outside turns, every record reads the clock
+    NRC_TRACE_T_ENDED,          // Right after TURN_END
+    NRC_TRACE_T_BEGUN,          // After TURN_BEGIN, before the first recv
+    NRC_TRACE_T_IN_RECV
+};
+
+struct nrc_trace_ring {
+    struct nrc_trace_ring   *next;
+    volatile u32_t          head;       // Records written, only the owning thread writes
+    u16_t                   index;
+    u16_t                   turn;       // enum nrc_trace_turn
+    u64_t                   ticks;      // Last clock read
+    struct nrc_trace_rec    rec[NRC_TRACE_RING_SIZE];
+};
+
+struct nrc_trace {
+    volatile u32_t          mask;
+    volatile u32_t          ring_count;
+    struct nrc_trace_ring   *volatile ring_list;
+
+    u64_t                   ticks_start;
+    u64_t                   ns_start;
+
+    // Node names, registration is rare and appends under lock
+    nrc_port_mutex_t        name_lock;
+    struct nrc_trace_name   *name;
+    u32_t                   name_count;
+    u32_t                   name_size;
+};
+
+static struct nrc_trace _trace;
+
+static NRC_PORT_THREAD_LOCAL struct nrc_trace_ring *_trace_ring;
+
+// First record of a thread, the ring lives as long as the process
+static struct nrc_trace_ring* nrc_trace_ring_new(void)
+{
+    struct nrc_trace_ring *ring = (struct nrc_trace_ring*)nrc_port_heap_alloc(sizeof(struct nrc_trace_ring));
+
+    if (ring != 0) {
+        memset(ring, 0, sizeof(struct nrc_trace_ring));
+        ring->index = (u16_t)nrc_port_atomic_add(&_trace.ring_count, 1);
+
+        do {
+            ring->next = (struct nrc_trace_ring*)nrc_port_atomic_load_ptr((void *volatile *)&_trace.ring_list);
+        } while (!nrc_port_atomic_cas_ptr((void *volatile *)&_trace.ring_list, ring->next, ring));
+
+        _trace_ring = ring;
+    }
+
+    return ring;
+}
+
+s32_t nrc_trace_init(void)
+{
+    s32_t result;
+
+    memset(&_trace, 0, sizeof(struct nrc_trace));
+
+    _trace.mask = NRC_TRACE_ALL;
+    _trace.ticks_start = nrc_port_ticks();
+    _trace.ns_start = nrc_port_time_ns();
+
+    result = nrc_port_mutex_init(&_trace.name_lock);
+
+    return result;
+}
+
+s32_t nrc_trace_set_mask(u32_t mask)
+{
+    nrc_port_atomic_store(&_trace.mask, mask & NRC_TRACE_ALL);
+
+    return NRC_PORT_RES_OK;
+}
+
+void nrc_trace_write(u32_t kind, nrc_node_id_t node, const void *msg, u32_t arg)
+{
+    struct nrc_trace_ring   *ring;
+    struct nrc_trace_rec    *rec;
+    u32_t                   head;
+
+    if ((_trace.mask & (1U << kind)) != 0) {
+        ring = _trace_ring;
+        if (ring == 0) {
+            ring = nrc_trace_ring_new();
+        }
+
+        if (ring != 0) {
+            head = ring->head;
+            rec = &ring->rec[head & NRC_TRACE_RING_MASK];
+
+            if (kind == NRC_TRACE_K_TURN_BEGIN) {
+                if (ring->turn != NRC_TRACE_T_ENDED) {
+                    ring->ticks = nrc_port_ticks();
+                }
+                ring->turn = NRC_TRACE_T_BEGUN;
+            }
+            else if (kind == NRC_TRACE_K_TURN_END) {
+                ring->ticks = nrc_port_ticks();
+                ring->turn = NRC_TRACE_T_ENDED;
+            }
+            else if (((1U << kind) & NRC_TRACE_RECV) != 0) {
+                if (ring->turn != NRC_TRACE_T_BEGUN) {
+                    ring->ticks = nrc_port_ticks();
+                }
+                ring->turn = NRC_TRACE_T_IN_RECV;
+            }
+            else if ((ring->turn == NRC_TRACE_T_NONE) || (ring->turn == NRC_TRACE_T_ENDED)) {
+                ring->ticks = nrc_port_ticks();
+                ring->turn = NRC_TRACE_T_NONE;
+            }
+
+            rec->ticks = ring->ticks;
+            rec->node = (u64_t)node;
+            rec->msg = (u64_t)(uintptr_t)msg;
+            rec->arg = arg;
+            rec->thread = ring->index;
+            rec->kind = (u8_t)kind;
+
+            nrc_port_atomic_store_release(&ring->head, head + 1);
+        }
+    }
+}
+
+void nrc_trace_name(nrc_node_id_t node, const s8_t *cfg_id)
+{
+    struct nrc_trace_name *name;
+
+    nrc_port_mutex_lock(_trace.name_lock, 0);
+
+    if (_trace.name_count == _trace.name_size) {
+        u32_t new_size = (_trace.name_size == 0) ? 64 : (_trace.name_size * 2);
+
+        name = (struct nrc_trace_name*)nrc_port_heap_alloc(new_size * sizeof(struct nrc_trace_name));
+        if (name != 0) {
+            if (_trace.name != 0) {
+                memcpy(name, _trace.name, _trace.name_count * sizeof(struct nrc_trace_name));
+                nrc_port_heap_free(_trace.name);
+            }
+            _trace.name = name;
+            _trace.name_size = new_size;
+        }
+    }
+
+    // A node without a name shows up by id
+    if (_trace.name_count < _trace.name_size) {
+        name = &_trace.name[_trace.name_count++];
+        name->node = (u64_t)node;
+        memset(name->cfg_id, 0, NRC_MAX_CFG_NAME_LEN);
+        memcpy(name->cfg_id, cfg_id, strnlen(cfg_id, NRC_MAX_CFG_NAME_LEN));
+    }
+
+    nrc_port_mutex_unlock(_trace.name_lock);
+}
+
+s32_t nrc_trace_snapshot(u8_t **image, u32_t *size)
+{
+    s32_t                           result = NRC_PORT_RES_INVALID_IN_PARAM;
+    struct nrc_trace_snapshot_hdr   *hdr;
+    struct nrc_trace_rec            *rec;
+    struct nrc_trace_ring           *ring;
+    u32_t                           ring_count;
+    u32_t                           record_max;
+    u32_t                           record_count = 0;
+    u32_t                           name_size;
+    u32_t                           image_size;
+    u32_t                           base;
+    u32_t                           lost;
+    u32_t                           head;
+    u32_t                           i;
+
+    if ((image == 0) || (size == 0)) {
+        return result;
+    }
+
+    *image = 0;
+    *size = 0;
+    result = NRC_PORT_RES_ERROR;
+
+    nrc_port_mutex_lock(_trace.name_lock, 0);
+
+    // Rings added after this are left out
+    ring_count = nrc_port_atomic_load(&_trace.ring_count);
+    record_max = ring_count * NRC_TRACE_RING_SIZE;
+    name_size = _trace.name_count * sizeof(struct nrc_trace_name);
+    image_size = sizeof(struct nrc_trace_snapshot_hdr) + (record_max * sizeof(struct nrc_trace_rec)) + name_size;
+
+    hdr = (struct nrc_trace_snapshot_hdr*)nrc_port_heap_alloc(image_size);
+
+    if (hdr != 0) {
+        memset(hdr, 0, sizeof(struct nrc_trace_snapshot_hdr));
+        rec = (struct nrc_trace_rec*)(hdr + 1);
+
+        ring = (struct nrc_trace_ring*)nrc_port_atomic_load_ptr((void *volatile *)&_trace.ring_list);
+        for (; ring != 0; ring = ring->next) {
+            if (ring->index >= ring_count) {
+                continue;
+            }
+
+            // Copy the whole ring oldest first, slots never written have no ticks
+            base = record_count;
+            head = nrc_port_atomic_load_acquire(&ring->head);
+            for (i = 0; i < NRC_TRACE_RING_SIZE; i++) {
+                rec[base + i] = ring->rec[(head + i) & NRC_TRACE_RING_MASK];
+            }
+
+            // Drop the oldest records the writer may have overwritten meanwhile
+            lost = (nrc_port_atomic_load(&ring->head) - head) + NRC_TRACE_RING_MARGIN;
+            for (i = (lost < NRC_TRACE_RING_SIZE) ? lost : NRC_TRACE_RING_SIZE; i < NRC_TRACE_RING_SIZE; i++) {
+                if (rec[base + i].ticks != 0) {
+                    rec[record_count++] = rec[base + i];
+                }
+            }
+        }
+
+        hdr->magic = NRC_TRACE_SNAPSHOT_MAGIC;
+        hdr->version = NRC_TRACE_SNAPSHOT_VERSION;
+        hdr->header_size = sizeof(struct nrc_trace_snapshot_hdr);
+        hdr->record_size = sizeof(struct nrc_trace_rec);
+        hdr->record_count = record_count;
+        hdr->record_offset = sizeof(struct nrc_trace_snapshot_hdr);
+        hdr->name_count = _trace.name_count;
+        hdr->name_offset = hdr->record_offset + (record_count * sizeof(struct nrc_trace_rec));
+        hdr->image_size = hdr->name_offset + name_size;
+        hdr->ticks_start = _trace.ticks_start;
+        hdr->ns_start = _trace.ns_start;
+        hdr->ticks_end = nrc_port_ticks();
+        hdr->ns_end = nrc_port_time_ns();
+
+        if (name_size != 0) {
+            memcpy((u8_t*)hdr + hdr->name_offset, _trace.name, name_size);
+        }
+
+        *image = (u8_t*)hdr;
+        *size = hdr->image_size;
+        result = NRC_PORT_RES_OK;
+    }
+
+    nrc_port_mutex_unlock(_trace.name_lock);
+
+    return result;
+}
+
+#else
+
+s32_t nrc_trace_init(void)
+{
+    return NRC_PORT_RES_NOT_SUPPORTED;
+}
+
+s32_t nrc_trace_set_mask(u32_t mask)
+{
+    return NRC_PORT_RES_NOT_SUPPORTED;
+}
+
+void nrc_trace_write(u32_t kind, nrc_node_id_t node, const void *msg, u32_t arg)
+{
+}
+
+void nrc_trace_name(nrc_node_id_t node, const s8_t *cfg_id)
+{
+}
+
+s32_t nrc_trace_snapshot(u8_t **image, u32_t *size)
+{
+    return NRC_PORT_RES_NOT_SUPPORTED;
+}
+
+#endif
@@ -0,0 +1,108 @@
+/**
+ * Copyright 2017 Tomas Frisberg & Ola Bjorsne
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http ://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _NRC_JSON_H_
+#define _NRC_JSON_H_
+
+#include "nrc_types.h"
+#include "nrc_defs.h"
+#include "nrc_msg.h"
+#include "nrc_msg_obj.h"
+#include "nrc_node.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * JSON node, converts between JSON text and structured messages.
+ *
+ * A string or buffer message is parsed into an object message with the value
+ * at the configured property, payload by default. An object message is turned
+ * into a string message from the value at the property, or from the whole
+ * message if it has no such field. The topic is kept, other message types
+ * pass unchanged and text that does not parse is dropped.
+ *
+ * Parsing is done in two stages. Stage one finds the structural characters,
+ * the quotes and the start of each number or literal with SIMD compares over
+ * 64 byte blocks, AVX2 or SSE4.2 as the CPU supports, else a scalar loop.
+ * Stage two walks only those positions, first to count the fields of each
+ * table and size the message, then to build it in that allocation.
+ *
+ * Keys already interned, e.g. by nodes when initialized, are used as such.
+ * Other key names are stored in the message, see nrc_msg_obj_key, so input
+ * with new keys, like device ids, does not fill the global key table.
+ */
+
+#define NRC_JSON_SCAN_SCALAR    (0)
+#define NRC_JSON_SCAN_SSE42     (1)
+#define NRC_JSON_SCAN_AVX2      (2)
+
+#define NRC_JSON_DEPTH          (NRC_MSG_OBJ_DEPTH - 1)     // Max nesting, the root takes one level
+
+// Buffers are kept between calls, sizes in bytes. One per thread. They grow to the
+// largest input, or with nrc_json_parser_init_buf are given once and never grow.
+struct nrc_json_parser {
+    u32_t   scan;           // NRC_JSON_SCAN_*
+    bool_t  fixed;          // Buffers given, input that does not fit fails
+    u32_t   *index;         // Positions found by stage one
+    u32_t   index_size;
+    u32_t   *count;         // Fields per table, in the order opened
+    u32_t   count_size;
+    s8_t    *text;          // Unescaped strings, number copies and stringify output
+    u32_t   text_size;
+};
+
+// Bytes of the buffers for text, and stringify output, of up to max_len bytes
+#define NRC_JSON_PARSER_SIZE(max_len)   ((2 * ((max_len) + 1) * (u32_t)sizeof(u32_t)) + (max_len) + 1)
+
+// Largest text the node parses or writes, a UDP datagram. Text that is longer is
+// dropped and counted as an error. Declare NRC_JSON_NODE_KEEP_SIZE as keep_size
+// of the json type with a static arena, see nrc_os_set_arena.
+#ifndef NRC_JSON_NODE_MAX_LEN
+#define NRC_JSON_NODE_MAX_LEN   (65535)
+#endif
+#define NRC_JSON_NODE_KEEP_SIZE NRC_JSON_PARSER_SIZE(NRC_JSON_NODE_MAX_LEN)
+
+// Best stage one the CPU supports
+u32_t nrc_json_scan_best(void);
+
+// Scan is NRC_JSON_SCAN_*, one the CPU does not support falls back to the best
+void nrc_json_parser_init(struct nrc_json_parser *parser, u32_t scan);
+
+// Parser on buf of NRC_JSON_PARSER_SIZE(max_len) bytes, kept by the caller
+void nrc_json_parser_init_buf(struct nrc_json_parser *parser, u32_t scan, void *buf, u32_t max_len);
+void nrc_json_parser_deinit(struct nrc_json_parser *parser);
+
+// New message with the value of text at key of the root. NRC_PORT_RES_ERROR if text is not JSON.
+s32_t nrc_json_parse(struct nrc_json_parser *parser, const s8_t *text, u32_t len, nrc_msg_key_t key,
+                     struct nrc_msg_obj **msg);
+
+// New string message with the JSON of value, read from msg. Blobs are written like a Node.js Buffer.
+s32_t nrc_json_stringify(struct nrc_json_parser *parser, const struct nrc_msg_obj *msg,
+                         const struct nrc_msg_obj_value *value, struct nrc_msg_str **str);
+
+// Node for the config node cfg_id, registered with nrc_os_register_node and nrc_json_node_api
+// or made by nrc_os_deploy from a node type { "json", nrc_json_node_alloc, &nrc_json_node_api }
+struct nrc_node_hdr* nrc_json_node_alloc(const s8_t *cfg_type, const s8_t *cfg_id, const s8_t *cfg_name);
+
+extern struct nrc_node_api nrc_json_node_api;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
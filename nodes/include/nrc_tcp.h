@@ -0,0 +1,73 @@
+/**
+ * Copyright 2017 Tomas Frisberg & Ola Bjorsne
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http ://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _NRC_TCP_H_
+#define _NRC_TCP_H_
+
+#include "nrc_types.h"
+#include "nrc_defs.h"
+#include "nrc_node.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * TCP input node, the Node-RED tcp in as a server in stream mode. Linux only.
+ *
+ * The node listens on port and sends a message per read to its first output, a
+ * buffer message or with datatype utf8 a string. Every connection is on the I/O
+ * reactor, the reactor puts a readable one on the node's ready list. In its turn
+ * the node reads each ready connection straight into a message allocated ahead,
+ * up to size bytes, and sends the reads of the turn as one chain, see
+ * nrc_os_send_port_chain. A message takes size bytes whatever was read.
+ * Out of messages, or of fds to accept with, the node backs off and tries
+ * again on a timer instead of running again at once.
+ *
+ * Config, besides the Node-RED fields port and datatype: size in bytes and
+ * connections, the most open at once. Client mode, single and the topic are
+ * not supported.
+ *
+ * The connections are taken at init, one more is refused. With a static arena
+ * declare NRC_TCP_KEEP_SIZE of the most connections of a node as keep_size.
+ */
+
+#define NRC_TCP_DEFAULT_SIZE        (4096)
+#define NRC_TCP_DEFAULT_CONNECTIONS (256)
+#define NRC_TCP_MAX_CONNECTIONS     (65536)
+#define NRC_TCP_CONN_SIZE           (64)    // Bytes a connection takes at most
+
+#define NRC_TCP_KEEP_SIZE(connections)  ((connections) * NRC_TCP_CONN_SIZE)
+
+struct nrc_tcp_stats {
+    u64_t   reads;          // Messages sent
+    u64_t   bytes;
+    u64_t   accepted;
+    u64_t   refused;        // Over the connection limit or not on the reactor
+};
+
+struct nrc_node_hdr* nrc_tcp_in_node_alloc(const s8_t *cfg_type, const s8_t *cfg_id, const s8_t *cfg_name);
+
+extern struct nrc_node_api nrc_tcp_in_node_api;
+
+// The counters may lag while the node runs
+s32_t nrc_tcp_get_stats(struct nrc_node_hdr *node, struct nrc_tcp_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,75 @@
+/**
+ * Copyright 2017 Tomas Frisberg & Ola Bjorsne
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http ://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _NRC_UDP_H_
+#define _NRC_UDP_H_
+
+#include "nrc_types.h"
+#include "nrc_defs.h"
+#include "nrc_node.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * UDP nodes, the Node-RED udp in and udp out. Linux only.
+ *
+ * udp in sends a message per datagram received on port to its first output, a
+ * buffer message or with datatype utf8 a string. The socket is on the I/O reactor
+ * and when it is readable the node takes up to batch datagrams per recvmmsg call
+ * straight into messages allocated ahead, size bytes each, and sends them as one
+ * chain, see nrc_os_send_port_chain. A longer datagram, or a chain the wires cannot
+ * take, is dropped. Source address and multicast are not supported.
+ *
+ * With gro the kernel coalesces datagrams of a flow into buffers of up to 64 KB,
+ * fewer passes through the stack for a sender that uses GSO. The node then copies
+ * each datagram out into a message of its own size. The buffers are taken at init,
+ * declare NRC_UDP_GRO_KEEP_SIZE as keep_size of udp in with a static arena.
+ *
+ * udp out sends each buffer or string message as a datagram to addr:port, from
+ * outport if given. The messages the node gets in one turn go with one sendmmsg.
+ * A message that cannot be sent at once is dropped, like a datagram would be.
+ *
+ * Config, besides the Node-RED fields port, datatype, addr, outport and ipv udp6:
+ * batch 1 to NRC_UDP_BATCH_MAX, size in bytes and gro true.
+ */
+
+#define NRC_UDP_BATCH_MAX       (64)    // Datagrams per recvmmsg or sendmmsg call
+#define NRC_UDP_DEFAULT_SIZE    (2048)
+#define NRC_UDP_GRO_KEEP_SIZE   (8 * 65536)     // Coalesced buffers of a gro udp in node
+
+// Counters, read with nrc_udp_get_stats
+struct nrc_udp_stats {
+    u64_t   packets;    // Datagrams received or sent
+    u64_t   calls;      // recvmmsg or sendmmsg calls that moved at least one
+    u64_t   dropped;    // Too long, no memory or not sent
+};
+
+struct nrc_node_hdr* nrc_udp_in_node_alloc(const s8_t *cfg_type, const s8_t *cfg_id, const s8_t *cfg_name);
+struct nrc_node_hdr* nrc_udp_out_node_alloc(const s8_t *cfg_type, const s8_t *cfg_id, const s8_t *cfg_name);
+
+extern struct nrc_node_api nrc_udp_in_node_api;
+extern struct nrc_node_api nrc_udp_out_node_api;
+
+// Of a udp in or udp out node, the counters may lag while it runs
+s32_t nrc_udp_get_stats(struct nrc_node_hdr *node, struct nrc_udp_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,1287 @@
+/**
+ * Copyright 2017 Tomas Frisberg & Ola Bjorsne
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http ://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "nrc_json.h"
+#include "nrc_os.h"
+#include "nrc_cfg.h"
+#include "nrc_port.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define NRC_JSON_SIMD               (1)
+#define NRC_JSON_TARGET(isa)        __attribute__((target(isa)))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#include <immintrin.h>
+#define NRC_JSON_SIMD               (1)
+#define NRC_JSON_TARGET(isa)
+#else
+#define NRC_JSON_SIMD               (0)
+#endif
+
+#define NRC_JSON_BLOCK              (64)
+#define NRC_JSON_PRIO               (0)
+#define NRC_JSON_DEFAULT_PROPERTY   "payload"
+#define NRC_JSON_EXACT_MAX          (1ULL << 53)    // Integers exact in a double
+#define NRC_JSON_FIXED_MAX          (9)             // Decimals tried before %g
+
+// Characters of one block, a bit per byte
+struct nrc_json_block {
+    u64_t   quote;
+    u64_t   backslash;
+    u64_t   op;         // { } [ ] : ,
+    u64_t   space;
+};
+
+static const double _json_pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+typedef void (*nrc_json_classify_t)(const u8_t *in, struct nrc_json_block *block);
+
+enum nrc_json_state {
+    NRC_JSON_S_VALUE = 0,
+    NRC_JSON_S_VALUE_OR_CLOSE,      // After [
+    NRC_JSON_S_KEY,
+    NRC_JSON_S_KEY_OR_CLOSE,        // After {
+    NRC_JSON_S_COLON,
+    NRC_JSON_S_NEXT,                // After a value in a table, comma or close
+    NRC_JSON_S_END
+};
+
+struct nrc_json_writer {
+    struct nrc_json_parser  *parser;
+    u32_t                   pos;
+    bool_t                  failed;
+};
+
+struct nrc_json_node {
+    struct nrc_node_hdr     hdr;
+    nrc_node_id_t           id;
+    s8_t                    cfg_type[NRC_MAX_CFG_NAME_LEN];
+    s8_t                    cfg_id[NRC_MAX_CFG_NAME_LEN];
+    s8_t                    cfg_name[NRC_MAX_CFG_NAME_LEN];
+    nrc_msg_key_t           property;
+    u32_t                   error_count;    // Messages dropped, not JSON, too long or out of memory
+    struct nrc_json_parser  parser;
+    void                    *buf;           // The parser's, taken at init
+};
+
+// Index of the least significant set bit, value must be non-zero
+static u32_t nrc_json_ctz(u64_t value)
+{
+#if defined(__GNUC__)
+    return (u32_t)__builtin_ctzll(value);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanForward64(&index, value);
+    return (u32_t)index;
+#else
+    u32_t index = 0;
+    while ((value & 1) == 0) {
+        value >>= 1;
+        index++;
+    }
+    return index;
+#endif
+}
+
+// Grows a buffer to at least need bytes, keeping its first keep bytes. Given buffers do not grow.
+static bool_t nrc_json_grow(struct nrc_json_parser *parser, void **buf, u32_t *size, u32_t need, u32_t keep)
+{
+    bool_t  ok = TRUE;
+    u8_t    *grown;
+    u32_t   new_size;
+
+    if ((need > *size) && parser->fixed) {
+        ok = FALSE;
+    }
+    else if (need > *size) {
+        new_size = (*size < 256) ? 256 : *size;
+        while ((new_size < need) && (new_size < 0x80000000U)) {
+            new_size *= 2;
+        }
+        if (new_size < need) {
+            new_size = need;
+        }
+
+        grown = nrc_port_heap_alloc(new_size);
+        if (grown != 0) {
+            if (*buf != 0) {
+                memcpy(grown, *buf, keep);
+                nrc_port_heap_free(*buf);
+            }
+            *buf = grown;
+            *size = new_size;
+        }
+        else {
+            ok = FALSE;
+        }
+    }
+
+    return ok;
+}
+
+/**
+ * Stage one, classification of 64 byte blocks.
+ */
+
+static void nrc_json_classify_scalar(const u8_t *in, struct nrc_json_block *block)
+{
+    u64_t bit;
+    u32_t i;
+
+    memset(block, 0, sizeof(struct nrc_json_block));
+
+    for (i = 0; i < NRC_JSON_BLOCK; i++) {
+        bit = 1ULL << i;
+
+        switch (in[i]) {
+        case '"':
+            block->quote |= bit;
+            break;
+        case '\\':
+            block->backslash |= bit;
+            break;
+        case '{':
+        case '}':
+        case '[':
+        case ']':
+        case ':':
+        case ',':
+            block->op |= bit;
+            break;
+        case ' ':
+        case '\t':
+        case '\n':
+        case '\r':
+            block->space |= bit;
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+#if NRC_JSON_SIMD
+
+// A shuffle on the low nibble gives the one whitespace or operator character
+// with that nibble, a byte is in the class if it equals what it looks up.
+// Operators are compared with 0x20 set, which makes [ and ] into { and }.
+// A few control characters outside strings show up as operators, stage two
+// rejects them like any character that is not JSON.
+
+NRC_JSON_TARGET("sse4.2")
+static void nrc_json_classify_sse42(const u8_t *in, struct nrc_json_block *block)
+{
+    const __m128i   space_table = _mm_setr_epi8(' ', 100, 100, 100, 17, 100, 113, 2, 100, '\t', '\n', 112, 100, '\r', 100, 100);
+    const __m128i   op_table = _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 0, 0, ':', '{', ',', '}', 0, 0);
+    const __m128i   quote = _mm_set1_epi8('"');
+    const __m128i   backslash = _mm_set1_epi8('\\');
+    const __m128i   lower = _mm_set1_epi8(0x20);
+    __m128i         chunk;
+    u32_t           shift;
+
+    memset(block, 0, sizeof(struct nrc_json_block));
+
+    for (shift = 0; shift < NRC_JSON_BLOCK; shift += 16) {
+        chunk = _mm_loadu_si128((const __m128i*)(in + shift));
+
+        block->quote |= (u64_t)(u32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, quote)) << shift;
+        block->backslash |= (u64_t)(u32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, backslash)) << shift;
+        block->space |= (u64_t)(u32_t)_mm_movemask_epi8(
+            _mm_cmpeq_epi8(chunk, _mm_shuffle_epi8(space_table, chunk))) << shift;
+        block->op |= (u64_t)(u32_t)_mm_movemask_epi8(
+            _mm_cmpeq_epi8(_mm_or_si128(chunk, lower), _mm_shuffle_epi8(op_table, chunk))) << shift;
+    }
+}
+
+NRC_JSON_TARGET("avx2")
+static void nrc_json_classify_avx2(const u8_t *in, struct nrc_json_block *block)
+{
+    const __m256i   space_table = _mm256_setr_epi8(
+        ' ', 100, 100, 100, 17, 100, 113, 2, 100, '\t', '\n', 112, 100, '\r', 100, 100,
+        ' ', 100, 100, 100, 17, 100, 113, 2, 100, '\t', '\n', 112, 100, '\r', 100, 100);
+    const __m256i   op_table = _mm256_setr_epi8(
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, ':', '{', ',', '}', 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, ':', '{', ',', '}', 0, 0);
+    const __m256i   quote = _mm256_set1_epi8('"');
+    const __m256i   backslash = _mm256_set1_epi8('\\');
+    const __m256i   lower = _mm256_set1_epi8(0x20);
+    __m256i         chunk;
+    u32_t           shift;
+
+    memset(block, 0, sizeof(struct nrc_json_block));
+
+    for (shift = 0; shift < NRC_JSON_BLOCK; shift += 32) {
+        chunk = _mm256_loadu_si256((const __m256i*)(in + shift));
+
+        block->quote |= (u64_t)(u32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, quote)) << shift;
+        block->backslash |= (u64_t)(u32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, backslash)) << shift;
+        block->space |= (u64_t)(u32_t)_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(chunk, _mm256_shuffle_epi8(space_table, chunk))) << shift;
+        block->op |= (u64_t)(u32_t)_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(_mm256_or_si256(chunk, lower), _mm256_shuffle_epi8(op_table, chunk))) << shift;
+    }
+}
+
+#endif
+
+u32_t nrc_json_scan_best(void)
+{
+    u32_t scan = NRC_JSON_SCAN_SCALAR;
+
+#if NRC_JSON_SIMD && defined(__GNUC__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        scan = NRC_JSON_SCAN_AVX2;
+    }
+    else if (__builtin_cpu_supports("sse4.2")) {
+        scan = NRC_JSON_SCAN_SSE42;
+    }
+#elif NRC_JSON_SIMD
+    int info[4];
+
+    __cpuid(info, 1);
+    if ((info[2] & (1 << 20)) != 0) {
+        scan = NRC_JSON_SCAN_SSE42;
+    }
+
+    // AVX2 also needs the OS to save the ymm registers
+    if (((info[2] & (1 << 27)) != 0) && ((info[2] & (1 << 28)) != 0) && ((_xgetbv(0) & 6) == 6)) {
+        __cpuidex(info, 7, 0);
+        if ((info[1] & (1 << 5)) != 0) {
+            scan = NRC_JSON_SCAN_AVX2;
+        }
+    }
+#endif
+
+    return scan;
+}
+
+static nrc_json_classify_t nrc_json_classify(u32_t scan)
+{
+    nrc_json_classify_t classify = nrc_json_classify_scalar;
+
+#if NRC_JSON_SIMD
+    if (scan == NRC_JSON_SCAN_AVX2) {
+        classify = nrc_json_classify_avx2;
+    }
+    else if (scan == NRC_JSON_SCAN_SSE42) {
+        classify = nrc_json_classify_sse42;
+    }
+#endif
+
+    return classify;
+}
+
+/**
+ * Stage one, from character classes to positions.
+ */
+
+// Characters escaped by an odd run of backslashes before them, prev_escaped
+// carries a run that ends at the last byte into the next block
+static u64_t nrc_json_escaped(u64_t backslash, u64_t *prev_escaped)
+{
+    const u64_t even = 0x5555555555555555ULL;
+    u64_t       escaped;
+    u64_t       follows;
+    u64_t       odd_starts;
+    u64_t       sequences;
+
+    if (backslash == 0) {
+        escaped = *prev_escaped;
+        *prev_escaped = 0;
+    }
+    else {
+        // A backslash that is itself escaped does not start a run
+        backslash &= ~*prev_escaped;
+        follows = (backslash << 1) | *prev_escaped;
+
+        // Adding the starts of runs on odd bits carries through each run, the
+        // sum then has the bits of runs that started on even bits flipped
+        odd_starts = backslash & ~even & ~follows;
+        sequences = odd_starts + backslash;
+        *prev_escaped = (sequences < odd_starts) ? 1 : 0;
+
+        escaped = (even ^ (sequences << 1)) & follows;
+    }
+
+    return escaped;
+}
+
+// Bit set from each opening quote up to, not including, its closing quote
+static u64_t nrc_json_prefix_xor(u64_t bits)
+{
+    bits ^= bits << 1;
+    bits ^= bits << 2;
+    bits ^= bits << 4;
+    bits ^= bits << 8;
+    bits ^= bits << 16;
+    bits ^= bits << 32;
+
+    return bits;
+}
+
+// Positions of operators, quotes and the first byte of each number or
+// literal, to parser->index. FALSE if a string is not closed.
+static bool_t nrc_json_scan(struct nrc_json_parser *parser, const u8_t *text, u32_t len, u32_t *count)
+{
+    nrc_json_classify_t     classify = nrc_json_classify(parser->scan);
+    struct nrc_json_block   block;
+    u8_t                    tail[NRC_JSON_BLOCK];
+    const u8_t              *in;
+    u64_t                   prev_escaped = 0;
+    u64_t                   prev_in_string = 0;
+    u64_t                   prev_separator = 1;     // The text begins as if after whitespace
+    u64_t                   quote;
+    u64_t                   in_string;
+    u64_t                   separator;
+    u64_t                   structural;
+    u32_t                   *index = parser->index;
+    u32_t                   n = 0;
+    u32_t                   base;
+
+    for (base = 0; base < len; base += NRC_JSON_BLOCK) {
+        in = text + base;
+        if (len - base < NRC_JSON_BLOCK) {
+            // Whitespace pads the last block and adds no positions
+            memset(tail, ' ', NRC_JSON_BLOCK);
+            memcpy(tail, in, len - base);
+            in = tail;
+        }
+
+        classify(in, &block);
+
+        quote = block.quote & ~nrc_json_escaped(block.backslash, &prev_escaped);
+        in_string = nrc_json_prefix_xor(quote) ^ prev_in_string;
+        prev_in_string = (u64_t)((s64_t)in_string >> 63);
+
+        // Numbers and literals start after a separator, outside strings
+        separator = block.space | block.op | quote;
+        structural = (block.op & ~in_string) | quote;
+        structural |= ~separator & ~in_string & ((separator << 1) | prev_separator);
+        prev_separator = separator >> 63;
+
+        while (structural != 0) {
+            index[n++] = base + nrc_json_ctz(structural);
+            structural &= structural - 1;
+        }
+    }
+
+    *count = n;
+
+    return (prev_in_string == 0);
+}
+
+/**
+ * Stage two.
+ */
+
+static bool_t nrc_json_is_delimiter(s8_t c)
+{
+    bool_t delimiter;
+
+    switch (c) {
+    case ' ':
+    case '\t':
+    case '\n':
+    case '\r':
+    case ',':
+    case ':':
+    case '[':
+    case ']':
+    case '{':
+    case '}':
+    case '"':
+        delimiter = TRUE;
+        break;
+    default:
+        delimiter = FALSE;
+        break;
+    }
+
+    return delimiter;
+}
+
+// Fields of each table and the capacity of the message. Counts are right
+// for valid JSON, what is not valid is left for the build to reject.
+static bool_t nrc_json_count(struct nrc_json_parser *parser, const s8_t *text, u32_t n, u32_t *capacity)
+{
+    const u32_t *index = parser->index;
+    u32_t       stack[NRC_JSON_DEPTH];
+    u32_t       depth = 0;
+    u32_t       tables = 0;
+    u64_t       size = nrc_msg_obj_table_size(1, TRUE);
+    bool_t      ok = TRUE;
+    u32_t       table;
+    u32_t       i;
+    s8_t        c;
+
+    for (i = 0; (i < n) && ok; i++) {
+        c = text[index[i]];
+
+        switch (c) {
+        case '{':
+        case '[':
+            if (depth < NRC_JSON_DEPTH) {
+                // The close is the open + 2, a table is empty if it follows right away
+                table = tables++;
+                parser->count[table] = ((i + 1 < n) && (text[index[i + 1]] == c + 2)) ? 0 : 1;
+                stack[depth++] = table;
+            }
+            else {
+                ok = FALSE;
+            }
+            break;
+        case ',':
+            if (depth != 0) {
+                parser->count[stack[depth - 1]]++;
+            }
+            break;
+        case '}':
+        case ']':
+            if (depth != 0) {
+                depth--;
+                size += nrc_msg_obj_table_size(parser->count[stack[depth]], (c == '}'));
+            }
+            break;
+        case '"':
+            // Keys take room unless interned, counted as if none is. Escapes only make a string shorter.
+            if (i + 1 < n) {
+                if ((i + 2 == n) || (text[index[i + 2]] != ':')) {
+                    size += nrc_msg_obj_str_size(index[i + 1] - index[i] - 1);
+                }
+                else {
+                    size += nrc_msg_obj_key_size(index[i + 1] - index[i] - 1);
+                }
+            }
+            i++;
+            break;
+        default:
+            break;
+        }
+    }
+
+    *capacity = (u32_t)size;
+
+    return ok && (size <= (U32_MAX_VALUE / 2));
+}
+
+static u32_t nrc_json_hex(const s8_t *text)
+{
+    u32_t   value = 0;
+    u32_t   i;
+    s8_t    c;
+
+    for (i = 0; i < 4; i++) {
+        c = text[i];
+        if ((c >= '0') && (c <= '9')) {
+            value = (value << 4) | (u32_t)(c - '0');
+        }
+        else if ((c >= 'a') && (c <= 'f')) {
+            value = (value << 4) | (u32_t)(c - 'a' + 10);
+        }
+        else if ((c >= 'A') && (c <= 'F')) {
+            value = (value << 4) | (u32_t)(c - 'A' + 10);
+        }
+        else {
+            value = U32_MAX_VALUE;
+            break;
+        }
+    }
+
+    return value;
+}
+
+// Unescapes the len bytes of a string to parser->text. Length of the result, U32_MAX_VALUE if invalid.
+static u32_t nrc_json_unescape(struct nrc_json_parser *parser, const s8_t *str, u32_t len)
+{
+    s8_t    *out;
+    u32_t   n = 0;
+    u32_t   i = 0;
+    u32_t   code;
+    u32_t   low;
+
+    if (!nrc_json_grow(parser, (void**)&parser->text, &parser->text_size, len + 1, 0)) {
+        return U32_MAX_VALUE;
+    }
+    out = parser->text;
+
+    while (i < len) {
+        if (str[i] != '\\') {
+            out[n++] = str[i++];
+            continue;
+        }
+
+        // Stage one saw to it that an escape does not end the string
+        i++;
+        switch (str[i++]) {
+        case '"':  out[n++] = '"'; break;
+        case '\\': out[n++] = '\\'; break;
+        case '/':  out[n++] = '/'; break;
+        case 'b':  out[n++] = '\b'; break;
+        case 'f':  out[n++] = '\f'; break;
+        case 'n':  out[n++] = '\n'; break;
+        case 'r':  out[n++] = '\r'; break;
+        case 't':  out[n++] = '\t'; break;
+        case 'u':
+            code = (i + 4 <= len) ? nrc_json_hex(&str[i]) : U32_MAX_VALUE;
+            i += 4;
+
+            // A high surrogate must be followed by an escaped low one
+            if ((code >= 0xD800) && (code < 0xDC00)) {
+                low = ((i + 6 <= len) && (str[i] == '\\') && (str[i + 1] == 'u')) ? nrc_json_hex(&str[i + 2]) : U32_MAX_VALUE;
+                if ((low >= 0xDC00) && (low < 0xE000)) {
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                    i += 6;
+                }
+                else {
+                    code = U32_MAX_VALUE;
+                }
+            }
+            else if ((code >= 0xDC00) && (code < 0xE000)) {
+                code = U32_MAX_VALUE;
+            }
+
+            if (code == U32_MAX_VALUE) {
+                return U32_MAX_VALUE;
+            }
+
+            // UTF-8, never longer than the escape
+            if (code < 0x80) {
+                out[n++] = (s8_t)code;
+            }
+            else if (code < 0x800) {
+                out[n++] = (s8_t)(0xC0 | (code >> 6));
+                out[n++] = (s8_t)(0x80 | (code & 0x3F));
+            }
+            else if (code < 0x10000) {
+                out[n++] = (s8_t)(0xE0 | (code >> 12));
+                out[n++] = (s8_t)(0x80 | ((code >> 6) & 0x3F));
+                out[n++] = (s8_t)(0x80 | (code & 0x3F));
+            }
+            else {
+                out[n++] = (s8_t)(0xF0 | (code >> 18));
+                out[n++] = (s8_t)(0x80 | ((code >> 12) & 0x3F));
+                out[n++] = (s8_t)(0x80 | ((code >> 6) & 0x3F));
+                out[n++] = (s8_t)(0x80 | (code & 0x3F));
+            }
+            break;
+        default:
+            return U32_MAX_VALUE;
+        }
+    }
+
+    return n;
+}
+
+// String between the quotes at index[i] and index[i + 1], unescaped if it has to be
+static bool_t nrc_json_string(struct nrc_json_parser *parser, const s8_t *text, u32_t i, const s8_t **str, u32_t *len)
+{
+    const s8_t  *begin = text + parser->index[i] + 1;
+    u32_t       raw_len = parser->index[i + 1] - parser->index[i] - 1;
+    bool_t      ok = TRUE;
+
+    *str = begin;
+    *len = raw_len;
+
+    if (memchr(begin, '\\', raw_len) != 0) {
+        *len = nrc_json_unescape(parser, begin, raw_len);
+        *str = parser->text;
+        ok = (*len != U32_MAX_VALUE);
+    }
+
+    return ok;
+}
+
+// Number or literal from pos, put to the open table
+static bool_t nrc_json_scalar(struct nrc_json_parser *parser, struct nrc_msg_obj_builder *builder, nrc_msg_key_t key,
+                              const s8_t *text, u32_t pos, u32_t len)
+{
+    const s8_t  *p = text + pos;
+    const s8_t  *end = text + len;
+    const s8_t  *digits;
+    u64_t       mantissa = 0;
+    u32_t       mantissa_digits = 0;
+    s32_t       exponent = 0;
+    s32_t       exponent_value = 0;
+    bool_t      exponent_negative = FALSE;
+    bool_t      negative = FALSE;
+    bool_t      integral = TRUE;
+    bool_t      ok = TRUE;
+    double      value;
+    u32_t       token;
+
+    if ((end - p >= 4) && (memcmp(p, "true", 4) == 0)) {
+        nrc_msg_obj_put_bool(builder, key, TRUE);
+        p += 4;
+    }
+    else if ((end - p >= 5) && (memcmp(p, "false", 5) == 0)) {
+        nrc_msg_obj_put_bool(builder, key, FALSE);
+        p += 5;
+    }
+    else if ((end - p >= 4) && (memcmp(p, "null", 4) == 0)) {
+        nrc_msg_obj_put_null(builder, key);
+        p += 4;
+    }
+    else {
+        if (*p == '-') {
+            negative = TRUE;
+            p++;
+        }
+
+        // The digits of the integer and the fraction make the mantissa while
+        // they fit in 19, the fraction moves the exponent
+        digits = p;
+        if ((p < end) && (*p == '0')) {
+            p++;
+        }
+        else {
+            while ((p < end) && (*p >= '0') && (*p <= '9')) {
+                if (mantissa_digits < 19) {
+                    mantissa = (mantissa * 10) + (u64_t)(*p - '0');
+                }
+                mantissa_digits++;
+                p++;
+            }
+        }
+        ok = (p != digits);
+
+        if (ok && (p < end) && (*p == '.')) {
+            integral = FALSE;
+            digits = ++p;
+            while ((p < end) && (*p >= '0') && (*p <= '9')) {
+                if (mantissa_digits < 19) {
+                    mantissa = (mantissa * 10) + (u64_t)(*p - '0');
+                    exponent--;
+                }
+                if ((mantissa != 0) || (*p != '0')) {
+                    mantissa_digits++;
+                }
+                p++;
+            }
+            ok = (p != digits);
+        }
+
+        if (ok && (p < end) && ((*p == 'e') || (*p == 'E'))) {
+            integral = FALSE;
+            p++;
+            if ((p < end) && ((*p == '+') || (*p == '-'))) {
+                exponent_negative = (*p == '-');
+                p++;
+            }
+            digits = p;
+            while ((p < end) && (*p >= '0') && (*p <= '9')) {
+                if (exponent_value < 10000) {
+                    exponent_value = (exponent_value * 10) + (*p - '0');
+                }
+                p++;
+            }
+            exponent += exponent_negative ? -exponent_value : exponent_value;
+            ok = (p != digits);
+        }
+
+        if (ok && integral && (mantissa_digits <= 19) && (mantissa <= (u64_t)0x7FFFFFFFFFFFFFFFULL)) {
+            nrc_msg_obj_put_int(builder, key, negative ? -(s64_t)mantissa : (s64_t)mantissa);
+        }
+        else if (ok && integral && negative && (mantissa_digits == 19) && (mantissa == 0x8000000000000000ULL)) {
+            nrc_msg_obj_put_int(builder, key, (s64_t)(-0x7FFFFFFFFFFFFFFFLL - 1));
+        }
+        else if (ok && (mantissa_digits <= 19) && (mantissa <= NRC_JSON_EXACT_MAX) &&
+                 (exponent >= -22) && (exponent <= 22)) {
+            // Mantissa and power of ten are exact doubles, one rounding gives the nearest
+            value = (exponent < 0) ? ((double)mantissa / _json_pow10[-exponent]) : ((double)mantissa * _json_pow10[exponent]);
+            nrc_msg_obj_put_float(builder, key, negative ? -value : value);
+        }
+        else if (ok) {
+            // strtod needs a terminated copy, the text may go on with more digits
+            token = (u32_t)(p - (text + pos));
+            ok = nrc_json_grow(parser, (void**)&parser->text, &parser->text_size, token + 1, 0);
+            if (ok) {
+                memcpy(parser->text, text + pos, token);
+                parser->text[token] = 0;
+                nrc_msg_obj_put_float(builder, key, strtod(parser->text, 0));
+            }
+        }
+    }
+
+    return ok && ((p == end) || nrc_json_is_delimiter(*p));
+}
+
+// Builds the message from the positions of stage one and the counts
+static bool_t nrc_json_build(struct nrc_json_parser *parser, const s8_t *text, u32_t len, u32_t n,
+                             nrc_msg_key_t key, struct nrc_msg_obj_builder *builder)
+{
+    const u32_t         *index = parser->index;
+    enum nrc_json_state state = NRC_JSON_S_VALUE;
+    u8_t                open[NRC_JSON_DEPTH];   // { or [ of the open tables
+    u32_t               depth = 0;
+    u32_t               table = 0;
+    bool_t              ok = TRUE;
+    const s8_t          *str;
+    u32_t               str_len;
+    u32_t               i;
+    s8_t                c;
+
+    for (i = 0; (i < n) && ok; i++) {
+        c = text[index[i]];
+
+        switch (state) {
+        case NRC_JSON_S_VALUE:
+        case NRC_JSON_S_VALUE_OR_CLOSE:
+            if ((c == ']') && (state == NRC_JSON_S_VALUE_OR_CLOSE)) {
+                nrc_msg_obj_end(builder);
+                depth--;
+                state = (depth != 0) ? NRC_JSON_S_NEXT : NRC_JSON_S_END;
+                break;
+            }
+
+            if ((c == '{') || (c == '[')) {
+                // Counting stopped at the depth limit, so did opening
+                if (c == '{') {
+                    nrc_msg_obj_begin_object(builder, key, parser->count[table++]);
+                    state = NRC_JSON_S_KEY_OR_CLOSE;
+                }
+                else {
+                    nrc_msg_obj_begin_array(builder, key, parser->count[table++]);
+                    state = NRC_JSON_S_VALUE_OR_CLOSE;
+                }
+                open[depth++] = (u8_t)c;
+                break;
+            }
+
+            if (c == '"') {
+                ok = (i + 1 < n) && nrc_json_string(parser, text, i, &str, &str_len);
+                if (ok) {
+                    nrc_msg_obj_put_str(builder, key, str, str_len);
+                }
+                i++;
+            }
+            else {
+                ok = !nrc_json_is_delimiter(c) && nrc_json_scalar(parser, builder, key, text, index[i], len);
+            }
+            state = (depth != 0) ? NRC_JSON_S_NEXT : NRC_JSON_S_END;
+            break;
+
+        case NRC_JSON_S_KEY:
+        case NRC_JSON_S_KEY_OR_CLOSE:
+            if ((c == '}') && (state == NRC_JSON_S_KEY_OR_CLOSE)) {
+                nrc_msg_obj_end(builder);
+                depth--;
+                state = (depth != 0) ? NRC_JSON_S_NEXT : NRC_JSON_S_END;
+            }
+            else if (c == '"') {
+                ok = (i + 1 < n) && nrc_json_string(parser, text, i, &str, &str_len);
+                if (ok) {
+                    // Names are not interned here, input could fill the key table
+                    key = nrc_msg_obj_key(builder, str, str_len);
+                    ok = (key != 0);
+                }
+                i++;
+                state = NRC_JSON_S_COLON;
+            }
+            else {
+                ok = FALSE;
+            }
+            break;
+
+        case NRC_JSON_S_COLON:
+            ok = (c == ':');
+            state = NRC_JSON_S_VALUE;
+            break;
+
+        case NRC_JSON_S_NEXT:
+            if (c == ',') {
+                state = (open[depth - 1] == '{') ? NRC_JSON_S_KEY : NRC_JSON_S_VALUE;
+                key = 0;
+            }
+            else if (c == open[depth - 1] + 2) {
+                nrc_msg_obj_end(builder);
+                depth--;
+                state = (depth != 0) ? NRC_JSON_S_NEXT : NRC_JSON_S_END;
+            }
+            else {
+                ok = FALSE;
+            }
+            break;
+
+        default:
+            ok = FALSE;
+            break;
+        }
+    }
+
+    return ok && (state == NRC_JSON_S_END);
+}
+
+void nrc_json_parser_init(struct nrc_json_parser *parser, u32_t scan)
+{
+    u32_t best = nrc_json_scan_best();
+
+    memset(parser, 0, sizeof(struct nrc_json_parser));
+    parser->scan = (scan <= best) ? scan : best;
+}
+
+void nrc_json_parser_init_buf(struct nrc_json_parser *parser, u32_t scan, void *buf, u32_t max_len)
+{
+    nrc_json_parser_init(parser, scan);
+
+    parser->fixed = TRUE;
+    parser->index_size = (max_len + 1) * sizeof(u32_t);
+    parser->index = (u32_t*)buf;
+    parser->count_size = parser->index_size;
+    parser->count = (u32_t*)((u8_t*)buf + parser->index_size);
+    parser->text_size = max_len + 1;
+    parser->text = (s8_t*)((u8_t*)buf + (2 * parser->index_size));
+}
+
+void nrc_json_parser_deinit(struct nrc_json_parser *parser)
+{
+    // Given buffers are the caller's
+    if ((parser->fixed == FALSE) && (parser->index != 0)) {
+        nrc_port_heap_free(parser->index);
+    }
+    if ((parser->fixed == FALSE) && (parser->count != 0)) {
+        nrc_port_heap_free(parser->count);
+    }
+    if ((parser->fixed == FALSE) && (parser->text != 0)) {
+        nrc_port_heap_free(parser->text);
+    }
+
+    memset(parser, 0, sizeof(struct nrc_json_parser));
+}
+
+s32_t nrc_json_parse(struct nrc_json_parser *parser, const s8_t *text, u32_t len, nrc_msg_key_t key,
+                     struct nrc_msg_obj **msg)
+{
+    s32_t                       result = NRC_PORT_RES_INVALID_IN_PARAM;
+    struct nrc_msg_obj_builder  builder;
+    struct nrc_msg_obj          *obj = 0;
+    u32_t                       capacity = 0;
+    u32_t                       n = 0;
+
+    if ((parser == 0) || (text == 0) || (key == 0) || (msg == 0) || (len >= (U32_MAX_VALUE / 8))) {
+        return result;
+    }
+
+    *msg = 0;
+    result = NRC_PORT_RES_ERROR;
+
+    // Each byte is at most one position and opens at most one table
+    if (nrc_json_grow(parser, (void**)&parser->index, &parser->index_size, (len + 1) * sizeof(u32_t), 0) &&
+        nrc_json_grow(parser, (void**)&parser->count, &parser->count_size, (len + 1) * sizeof(u32_t), 0) &&
+        nrc_json_scan(parser, (const u8_t*)text, len, &n) &&
+        nrc_json_count(parser, text, n, &capacity)) {
+
+        obj = nrc_msg_obj_alloc(capacity);
+    }
+
+    if (obj != 0) {
+        nrc_msg_obj_build(&builder, obj, 1);
+
+        if (nrc_json_build(parser, text, len, n, key, &builder) && (nrc_msg_obj_finish(&builder) == NRC_PORT_RES_OK)) {
+            *msg = obj;
+            result = NRC_PORT_RES_OK;
+        }
+        else {
+            nrc_os_msg_free(&obj->hdr);
+        }
+    }
+
+    return result;
+}
+
+/**
+ * Stringify.
+ */
+
+static void nrc_json_write(struct nrc_json_writer *writer, const void *bytes, u32_t len)
+{
+    struct nrc_json_parser *parser = writer->parser;
+
+    if ((writer->failed == FALSE) && (len != 0)) {
+        if (nrc_json_grow(parser, (void**)&parser->text, &parser->text_size, writer->pos + len, writer->pos)) {
+            memcpy(parser->text + writer->pos, bytes, len);
+            writer->pos += len;
+        }
+        else {
+            writer->failed = TRUE;
+        }
+    }
+}
+
+static void nrc_json_write_str(struct nrc_json_writer *writer, const s8_t *str, u32_t len)
+{
+    static const s8_t   hex[] = "0123456789abcdef";
+    s8_t                escape[6];
+    u32_t               escape_len;
+    u32_t               start = 0;
+    u32_t               i;
+    u8_t                c;
+
+    nrc_json_write(writer, "\"", 1);
+
+    for (i = 0; i < len; i++) {
+        c = (u8_t)str[i];
+        if ((c != '"') && (c != '\\') && (c >= 0x20)) {
+            continue;
+        }
+
+        nrc_json_write(writer, str + start, i - start);
+        start = i + 1;
+
+        escape[0] = '\\';
+        escape_len = 2;
+        switch (c) {
+        case '"':  escape[1] = '"'; break;
+        case '\\': escape[1] = '\\'; break;
+        case '\b': escape[1] = 'b'; break;
+        case '\f': escape[1] = 'f'; break;
+        case '\n': escape[1] = 'n'; break;
+        case '\r': escape[1] = 'r'; break;
+        case '\t': escape[1] = 't'; break;
+        default:
+            memcpy(&escape[1], "u00", 3);
+            escape[4] = hex[c >> 4];
+            escape[5] = hex[c & 0xF];
+            escape_len = 6;
+            break;
+        }
+        nrc_json_write(writer, escape, escape_len);
+    }
+
+    nrc_json_write(writer, str + start, len - start);
+    nrc_json_write(writer, "\"", 1);
+}
+
+static void nrc_json_write_int(struct nrc_json_writer *writer, s64_t value)
+{
+    s8_t    buf[24];
+    u32_t   pos = sizeof(buf);
+    u64_t   magnitude = (value < 0) ? (0 - (u64_t)value) : (u64_t)value;
+
+    do {
+        buf[--pos] = (s8_t)('0' + (magnitude % 10));
+        magnitude /= 10;
+    } while (magnitude != 0);
+
+    if (value < 0) {
+        buf[--pos] = '-';
+    }
+
+    nrc_json_write(writer, buf + pos, sizeof(buf) - pos);
+}
+
+// Fewest decimals up to NRC_JSON_FIXED_MAX that read back the same, else the
+// shorter of 15 or 17 digits that does. JSON has no NaN or infinity.
+static void nrc_json_write_float(struct nrc_json_writer *writer, double value)
+{
+    s8_t    buf[32];
+    s32_t   len = 0;
+    u32_t   pos = sizeof(buf);
+    u32_t   decimals;
+    double  scaled;
+    u64_t   fixed;
+
+    if (!isfinite(value)) {
+        nrc_json_write(writer, "null", 4);
+        return;
+    }
+
+    // A fixed point candidate is exact, as is the division back when it fits 53 bits
+    for (decimals = 0; decimals <= NRC_JSON_FIXED_MAX; decimals++) {
+        scaled = fabs(value) * _json_pow10[decimals];
+        if (scaled >= (double)NRC_JSON_EXACT_MAX) {
+            break;
+        }
+
+        fixed = (u64_t)(scaled + 0.5);
+        if ((double)fixed / _json_pow10[decimals] == fabs(value)) {
+            do {
+                buf[--pos] = (s8_t)('0' + (fixed % 10));
+                fixed /= 10;
+                if (sizeof(buf) - pos == decimals) {
+                    buf[--pos] = '.';
+                    if (fixed == 0) {
+                        buf[--pos] = '0';
+                    }
+                }
+            } while ((fixed != 0) || (sizeof(buf) - pos < decimals));
+
+            if ((value < 0) && ((sizeof(buf) - pos != 1) || (buf[pos] != '0'))) {
+                buf[--pos] = '-';
+            }
+            nrc_json_write(writer, buf + pos, sizeof(buf) - pos);
+            return;
+        }
+    }
+
+    len = snprintf(buf, sizeof(buf), "%.15g", value);
+    if (strtod(buf, 0) != value) {
+        len = snprintf(buf, sizeof(buf), "%.17g", value);
+    }
+    nrc_json_write(writer, buf, (u32_t)len);
+}
+
+static void nrc_json_write_value(struct nrc_json_writer *writer, const struct nrc_msg_obj *msg,
+                                 const struct nrc_msg_obj_value *value)
+{
+    struct nrc_msg_obj_value    field;
+    nrc_msg_key_t               key;
+    const s8_t                  *name;
+    u32_t                       name_len;
+    u32_t                       i;
+
+    switch (value->type) {
+    case NRC_MSG_OBJ_BOOL:
+        if (value->v.b) {
+            nrc_json_write(writer, "true", 4);
+        }
+        else {
+            nrc_json_write(writer, "false", 5);
+        }
+        break;
+    case NRC_MSG_OBJ_INT:
+        nrc_json_write_int(writer, value->v.i);
+        break;
+    case NRC_MSG_OBJ_FLOAT:
+        nrc_json_write_float(writer, value->v.f);
+        break;
+    case NRC_MSG_OBJ_STR:
+        nrc_json_write_str(writer, value->v.str, value->len);
+        break;
+    case NRC_MSG_OBJ_BLOB:
+        nrc_json_write(writer, "{\"type\":\"Buffer\",\"data\":[", 25);
+        for (i = 0; i < value->len; i++) {
+            if (i != 0) {
+                nrc_json_write(writer, ",", 1);
+            }
+            nrc_json_write_int(writer, value->v.blob[i]);
+        }
+        nrc_json_write(writer, "]}", 2);
+        break;
+    case NRC_MSG_OBJ_OBJECT:
+    case NRC_MSG_OBJ_ARRAY:
+        nrc_json_write(writer, (value->type == NRC_MSG_OBJ_OBJECT) ? "{" : "[", 1);
+        for (i = 0; nrc_msg_obj_field(msg, value->v.table, i, &key, &field); i++) {
+            if (i != 0) {
+                nrc_json_write(writer, ",", 1);
+            }
+            if (value->type == NRC_MSG_OBJ_OBJECT) {
+                name = nrc_msg_obj_key_name(msg, key, &name_len);
+                if (name != 0) {
+                    nrc_json_write_str(writer, name, name_len);
+                }
+                else {
+                    nrc_json_write(writer, "\"\"", 2);
+                }
+                nrc_json_write(writer, ":", 1);
+            }
+            nrc_json_write_value(writer, msg, &field);
+        }
+        nrc_json_write(writer, (value->type == NRC_MSG_OBJ_OBJECT) ? "}" : "]", 1);
+        break;
+    default:
+        nrc_json_write(writer, "null", 4);
+        break;
+    }
+}
+
+s32_t nrc_json_stringify(struct nrc_json_parser *parser, const struct nrc_msg_obj *msg,
+                         const struct nrc_msg_obj_value *value, struct nrc_msg_str **str)
+{
+    s32_t                   result = NRC_PORT_RES_INVALID_IN_PARAM;
+    struct nrc_json_writer  writer;
+    struct nrc_msg_str      *out = 0;
+
+    if ((parser == 0) || (msg == 0) || (value == 0) || (str == 0)) {
+        return result;
+    }
+
+    *str = 0;
+    result = NRC_PORT_RES_ERROR;
+
+    writer.parser = parser;
+    writer.pos = 0;
+    writer.failed = FALSE;
+    nrc_json_write_value(&writer, msg, value);
+
+    if (writer.failed == FALSE) {
+        out = (struct nrc_msg_str*)nrc_os_msg_alloc((u32_t)offsetof(struct nrc_msg_str, str) + writer.pos + 1);
+    }
+
+    if (out != 0) {
+        out->hdr.type = NRC_MSG_TYPE_STRING;
+        memcpy(out->str, parser->text, writer.pos);
+        out->str[writer.pos] = 0;
+
+        *str = out;
+        result = NRC_PORT_RES_OK;
+    }
+
+    return result;
+}
+
+/**
+ * Node.
+ */
+
+static s32_t nrc_json_node_init(struct nrc_node_hdr *self, nrc_node_id_t id)
+{
+    struct nrc_json_node    *node = (struct nrc_json_node*)self;
+    s8_t                    property[NRC_MAX_CFG_NAME_LEN];
+    s32_t                   result = NRC_PORT_RES_OK;
+
+    node->id = id;
+    node->error_count = 0;
+
+    // Sized once, nothing is allocated for a message but the message
+    node->buf = nrc_os_node_mem_alloc(NRC_JSON_NODE_KEEP_SIZE);
+    if (node->buf != 0) {
+        nrc_json_parser_init_buf(&node->parser, nrc_json_scan_best(), node->buf, NRC_JSON_NODE_MAX_LEN);
+    }
+    else {
+        nrc_json_parser_init(&node->parser, nrc_json_scan_best());
+        result = NRC_PORT_RES_ERROR;
+    }
+
+    if ((nrc_cfg_get_str(node->cfg_type, node->cfg_id, "property", property, NRC_MAX_CFG_NAME_LEN) != NRC_PORT_RES_OK) ||
+        (property[0] == 0)) {
+        strcpy(property, NRC_JSON_DEFAULT_PROPERTY);
+    }
+    node->property = nrc_msg_key(property);
+
+    if (node->property == 0) {
+        result = NRC_PORT_RES_ERROR;
+    }
+
+    return result;
+}
+
+static s32_t nrc_json_node_deinit(struct nrc_node_hdr *self)
+{
+    struct nrc_json_node *node = (struct nrc_json_node*)self;
+
+    nrc_json_parser_deinit(&node->parser);
+    nrc_os_node_mem_free(node->buf);
+    node->buf = 0;
+
+    return NRC_PORT_RES_OK;
+}
+
+static s32_t nrc_json_node_start(struct nrc_node_hdr *self)
+{
+    return NRC_PORT_RES_OK;
+}
+
+static s32_t nrc_json_node_stop(struct nrc_node_hdr *self)
+{
+    return NRC_PORT_RES_OK;
+}
+
+static s32_t nrc_json_node_recv_msg(struct nrc_node_hdr *self, struct nrc_msg_hdr *msg)
+{
+    struct nrc_json_node        *node = (struct nrc_json_node*)self;
+    struct nrc_msg_obj          *obj = 0;
+    struct nrc_msg_str          *str = 0;
+    struct nrc_msg_obj_value    value;
+    struct nrc_msg_hdr          *out = msg;
+    s32_t                       result = NRC_PORT_RES_OK;
+
+    switch (msg->type) {
+    case NRC_MSG_TYPE_STRING:
+        result = nrc_json_parse(&node->parser, ((struct nrc_msg_str*)msg)->str,
+                                (u32_t)strlen(((struct nrc_msg_str*)msg)->str), node->property, &obj);
+        out = (struct nrc_msg_hdr*)obj;
+        break;
+    case NRC_MSG_TYPE_BUF:
+        result = nrc_json_parse(&node->parser, (const s8_t*)((struct nrc_msg_buf*)msg)->buf,
+                                ((struct nrc_msg_buf*)msg)->len, node->property, &obj);
+        out = (struct nrc_msg_hdr*)obj;
+        break;
+    case NRC_MSG_TYPE_OBJ:
+        obj = (struct nrc_msg_obj*)msg;
+        if (!nrc_msg_obj_get(obj, nrc_msg_obj_root(obj), node->property, &value)) {
+            value.type = NRC_MSG_OBJ_OBJECT;
+            value.v.table = nrc_msg_obj_root(obj);
+        }
+        result = nrc_json_stringify(&node->parser, obj, &value, &str);
+        out = (struct nrc_msg_hdr*)str;
+        break;
+    default:
+        break;
+    }
+
+    if (result == NRC_PORT_RES_OK) {
+        if (out != msg) {
+            out->topic = msg->topic;
+            nrc_os_msg_free(msg);
+        }
+        if (nrc_os_send_port(self, 0, out, NRC_JSON_PRIO) != NRC_PORT_RES_OK) {
+            node->error_count++;
+            nrc_os_msg_free(out);
+        }
+    }
+    else {
+        node->error_count++;
+        nrc_os_msg_free(msg);
+    }
+
+    return NRC_PORT_RES_OK;
+}
+
+static s32_t nrc_json_node_recv_evt(struct nrc_node_hdr *self, u32_t event_mask)
+{
+    return NRC_PORT_RES_OK;
+}
+
+struct nrc_node_api nrc_json_node_api = {
+    nrc_json_node_init,
+    nrc_json_node_deinit,
+    nrc_json_node_start,
+    nrc_json_node_stop,
+    nrc_json_node_recv_msg,
+    nrc_json_node_recv_evt,
+    0
+};
+
+struct nrc_node_hdr* nrc_json_node_alloc(const s8_t *cfg_type, const s8_t *cfg_id, const s8_t *cfg_name)
+{
+    struct nrc_json_node *node = (struct nrc_json_node*)nrc_os_node_alloc(sizeof(struct nrc_json_node));
+
+    if (node != 0) {
+        memset((u8_t*)node + sizeof(struct nrc_node_hdr), 0, sizeof(struct nrc_json_node) - sizeof(struct nrc_node_hdr));
+
+        strncpy(node->cfg_type, cfg_type, NRC_MAX_CFG_NAME_LEN - 1);
+        strncpy(node->cfg_id, cfg_id, NRC_MAX_CFG_NAME_LEN - 1);
+        if (cfg_name != 0) {
+            strncpy(node->cfg_name, cfg_name, NRC_MAX_CFG_NAME_LEN - 1);
+        }
+
+        node->hdr.cfg_type = node->cfg_type;
+        node->hdr.cfg_id = node->cfg_id;
+        node->hdr.cfg_name = node->cfg_name;
+    }
+
+    return (struct nrc_node_hdr*)node;
+}
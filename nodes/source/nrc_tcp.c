@@ -0,0 +1,548 @@
+/**
+ * Copyright 2017 Tomas Frisberg & Ola Bjorsne
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http ://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "nrc_tcp.h"
+#include "nrc_os.h"
+#include "nrc_cfg.h"
+#include "nrc_port.h"
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#define NRC_TCP_PRIO            (0)
+#define NRC_TCP_EVT_ACCEPT      (1)
+#define NRC_TCP_EVT_READ        (2)     // A connection was put on the ready list
+#define NRC_TCP_EVT_RETRY       (4)     // Retry timer, after running out of messages or fds
+#define NRC_TCP_RETRY_MS        (10)
+#define NRC_TCP_READS_PER_TURN  (64)    // Messages sent per turn before other nodes get to run
+#define NRC_TCP_BACKLOG         (128)
+#define NRC_TCP_MAX_SIZE        (1024 * 1024)
+
+// Room for the read and the terminator of a string
+#define NRC_TCP_MSG_SIZE(size)  ((u32_t)offsetof(struct nrc_msg_buf, buf) + (size) + 1)
+
+struct nrc_tcp_in_node;
+
+// Fits in NRC_TCP_CONN_SIZE
+struct nrc_tcp_conn {
+    struct nrc_tcp_conn     *ready_next;
+    struct nrc_tcp_conn     *next;          // All open connections, or the free ones
+    struct nrc_tcp_conn     *prev;
+    struct nrc_tcp_in_node  *node;
+    s32_t                   fd;
+    nrc_port_io_t           io;
+    volatile u32_t          ready;          // On the ready list, set by the reactor
+    bool_t                  closed;         // Put back when taken off the ready list
+};
+
+struct nrc_tcp_in_node {
+    struct nrc_node_hdr     hdr;
+    nrc_node_id_t           id;
+    s8_t                    cfg_type[NRC_MAX_CFG_NAME_LEN];
+    s8_t                    cfg_id[NRC_MAX_CFG_NAME_LEN];
+    s8_t                    cfg_name[NRC_MAX_CFG_NAME_LEN];
+    s32_t                   fd;
+    struct nrc_os_io        io;
+    u16_t                   port;
+    bool_t                  utf8;
+    u32_t                   size;
+    u32_t                   max_conn;
+    u32_t                   conn_count;
+    struct nrc_tcp_conn     *conn;
+    struct nrc_tcp_conn     *pool;              // max_conn of them, taken at init
+    struct nrc_tcp_conn     *conn_free;
+    struct nrc_tcp_conn     *volatile ready;    // Pushed by the reactor, taken whole by the node
+    struct nrc_msg_hdr      *spare;             // The next read goes into it
+    struct nrc_os_timer     retry;
+    bool_t                  retry_started;
+    bool_t                  starved;            // No message for a read this turn
+    bool_t                  accept_paused;      // Out of fds, accept again on the retry timer
+    struct nrc_tcp_stats    stats;
+};
+
+// Puts a connection on the ready list once until the node takes it off. Gives TRUE if it was put.
+static bool_t nrc_tcp_conn_push(struct nrc_tcp_in_node *node, struct nrc_tcp_conn *conn)
+{
+    struct nrc_tcp_conn *head;
+    bool_t              pushed = FALSE;
+
+    if (nrc_port_atomic_xchg(&conn->ready, 1) == 0) {
+        do {
+            head = (struct nrc_tcp_conn*)nrc_port_atomic_load_ptr((void *volatile *)&node->ready);
+            conn->ready_next = head;
+        } while (!nrc_port_atomic_cas_ptr((void *volatile *)&node->ready, head, conn));
+
+        pushed = TRUE;
+    }
+
+    return pushed;
+}
+
+// Reactor thread
+static void nrc_tcp_conn_ready(void *context, u32_t ready)
+{
+    struct nrc_tcp_conn *conn = (struct nrc_tcp_conn*)context;
+
+    if (nrc_tcp_conn_push(conn->node, conn)) {
+        nrc_os_set_evt(conn->node->id, NRC_TCP_EVT_READ, NRC_TCP_PRIO);
+    }
+}
+
+// Puts a connection the node could not finish back on the list. It goes on in the next turn, or
+// when the retry timer fires if there was no message to read into.
+static void nrc_tcp_conn_later(struct nrc_tcp_in_node *node, struct nrc_tcp_conn *conn)
+{
+    if (node->starved) {
+        (void)nrc_tcp_conn_push(node, conn);
+    }
+    else {
+        nrc_tcp_conn_ready(conn, NRC_PORT_IO_IN);
+    }
+}
+
+static void nrc_tcp_retry(struct nrc_tcp_in_node *node)
+{
+    if ((node->retry_started == FALSE) && (nrc_os_timer_start(&node->retry, NRC_TCP_RETRY_MS, 0, 0) == NRC_PORT_RES_OK)) {
+        node->retry_started = TRUE;
+    }
+}
+
+static void nrc_tcp_conn_put(struct nrc_tcp_in_node *node, struct nrc_tcp_conn *conn)
+{
+    conn->next = node->conn_free;
+    node->conn_free = conn;
+}
+
+static void nrc_tcp_conn_open(struct nrc_tcp_in_node *node, s32_t fd)
+{
+    // A closed one still on the ready list is not back yet, the count is not enough
+    struct nrc_tcp_conn *conn = node->conn_free;
+
+    if (conn != 0) {
+        node->conn_free = conn->next;
+
+        memset(conn, 0, sizeof(struct nrc_tcp_conn));
+        conn->node = node;
+        conn->fd = fd;
+
+        // Data already there is reported at once
+        if (nrc_port_io_add(fd, NRC_PORT_IO_IN, nrc_tcp_conn_ready, conn, &conn->io) != NRC_PORT_RES_OK) {
+            nrc_tcp_conn_put(node, conn);
+            conn = 0;
+        }
+    }
+
+    if (conn != 0) {
+        conn->next = node->conn;
+        if (node->conn != 0) {
+            node->conn->prev = conn;
+        }
+        node->conn = conn;
+        node->conn_count++;
+        node->stats.accepted++;
+    }
+    else {
+        close(fd);
+        node->stats.refused++;
+    }
+}
+
+static void nrc_tcp_conn_close(struct nrc_tcp_in_node *node, struct nrc_tcp_conn *conn)
+{
+    // No more calls from the reactor once removed
+    nrc_port_io_remove(conn->io);
+    close(conn->fd);
+    conn->fd = -1;
+
+    if (conn->prev != 0) {
+        conn->prev->next = conn->next;
+    }
+    else {
+        node->conn = conn->next;
+    }
+    if (conn->next != 0) {
+        conn->next->prev = conn->prev;
+    }
+    node->conn_count--;
+
+    // Still on the ready list, it is put back when taken off
+    if (nrc_port_atomic_xchg(&conn->ready, 1) == 0) {
+        nrc_tcp_conn_put(node, conn);
+    }
+    else {
+        conn->closed = TRUE;
+    }
+}
+
+// Ready connections in the order they became ready, the list is empty after
+static struct nrc_tcp_conn* nrc_tcp_ready_take(struct nrc_tcp_in_node *node)
+{
+    struct nrc_tcp_conn *conn;
+    struct nrc_tcp_conn *next;
+    struct nrc_tcp_conn *ordered = 0;
+
+    conn = (struct nrc_tcp_conn*)nrc_port_atomic_xchg_ptr((void *volatile *)&node->ready, 0);
+
+    while (conn != 0) {
+        next = conn->ready_next;
+        conn->ready_next = ordered;
+        ordered = conn;
+        conn = next;
+    }
+
+    return ordered;
+}
+
+static void nrc_tcp_accept(struct nrc_tcp_in_node *node)
+{
+    s32_t fd;
+
+    node->accept_paused = FALSE;
+
+    for (;;) {
+        fd = accept4(node->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+        if (fd >= 0) {
+            nrc_tcp_conn_open(node, fd);
+        }
+        else if ((errno != EINTR) && (errno != ECONNABORTED)) {
+            break;
+        }
+    }
+
+    if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+        nrc_os_io_again(&node->io, NRC_PORT_IO_IN);
+    }
+    else {
+        // Out of fds or memory, the connections wait in the backlog for the retry timer
+        node->accept_paused = TRUE;
+        nrc_tcp_retry(node);
+    }
+}
+
+// Reads the connection into messages until it is empty or the turn's reads are used up.
+// Returns FALSE if it has to go on in the next turn.
+static bool_t nrc_tcp_read(struct nrc_tcp_in_node *node, struct nrc_tcp_conn *conn, u32_t *reads,
+                           struct nrc_msg_hdr ***tail)
+{
+    struct nrc_msg_hdr  *msg;
+    ssize_t             len;
+    bool_t              done = FALSE;
+
+    while ((done == FALSE) && (*reads < NRC_TCP_READS_PER_TURN)) {
+        if (node->spare == 0) {
+            node->spare = nrc_os_msg_alloc(NRC_TCP_MSG_SIZE(node->size));
+            if (node->spare == 0) {
+                node->starved = TRUE;
+                break;
+            }
+        }
+        msg = node->spare;
+
+        len = read(conn->fd, node->utf8 ? (void*)((struct nrc_msg_str*)msg)->str : (void*)((struct nrc_msg_buf*)msg)->buf,
+                   node->size);
+
+        if (len > 0) {
+            msg->next = 0;
+            msg->topic = 0;
+            if (node->utf8) {
+                msg->type = NRC_MSG_TYPE_STRING;
+                ((struct nrc_msg_str*)msg)->str[len] = 0;
+            }
+            else {
+                msg->type = NRC_MSG_TYPE_BUF;
+                ((struct nrc_msg_buf*)msg)->len = (u32_t)len;
+            }
+            **tail = msg;
+            *tail = &msg->next;
+            node->spare = 0;
+
+            (*reads)++;
+            node->stats.reads++;
+            node->stats.bytes += (u64_t)len;
+        }
+        else if ((len < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+            nrc_port_io_again(conn->io, NRC_PORT_IO_IN);
+            done = TRUE;
+        }
+        else if ((len < 0) && (errno == EINTR)) {
+            continue;
+        }
+        else {
+            // Closed by the peer or failed
+            nrc_tcp_conn_close(node, conn);
+            done = TRUE;
+        }
+    }
+
+    return done;
+}
+
+static s32_t nrc_tcp_in_node_init(struct nrc_node_hdr *self, nrc_node_id_t id)
+{
+    struct nrc_tcp_in_node  *node = (struct nrc_tcp_in_node*)self;
+    s8_t                    value_str[NRC_MAX_CFG_NAME_LEN];
+    s32_t                   value;
+    s32_t                   result;
+    u32_t                   i;
+
+    node->id = id;
+    node->fd = -1;
+    memset(&node->stats, 0, sizeof(struct nrc_tcp_stats));
+
+    result = nrc_cfg_get_int(node->cfg_type, node->cfg_id, "port", &value);
+    if ((result == NRC_PORT_RES_OK) && ((value <= 0) || (value > 65535))) {
+        result = NRC_PORT_RES_ERROR;
+    }
+    node->port = (u16_t)value;
+
+    if ((nrc_cfg_get_str(node->cfg_type, node->cfg_id, "server", value_str, NRC_MAX_CFG_NAME_LEN) == NRC_PORT_RES_OK) &&
+        (strcmp(value_str, "server") != 0)) {
+        result = NRC_PORT_RES_NOT_SUPPORTED;
+    }
+    if ((nrc_cfg_get_str(node->cfg_type, node->cfg_id, "datamode", value_str, NRC_MAX_CFG_NAME_LEN) == NRC_PORT_RES_OK) &&
+        (strcmp(value_str, "stream") != 0)) {
+        result = NRC_PORT_RES_NOT_SUPPORTED;
+    }
+
+    node->utf8 = FALSE;
+    if ((nrc_cfg_get_str(node->cfg_type, node->cfg_id, "datatype", value_str, NRC_MAX_CFG_NAME_LEN) == NRC_PORT_RES_OK) &&
+        (strcmp(value_str, "buffer") != 0)) {
+        if (strcmp(value_str, "utf8") == 0) {
+            node->utf8 = TRUE;
+        }
+        else {
+            result = NRC_PORT_RES_NOT_SUPPORTED;
+        }
+    }
+
+    node->size = NRC_TCP_DEFAULT_SIZE;
+    if ((nrc_cfg_get_int(node->cfg_type, node->cfg_id, "size", &value) == NRC_PORT_RES_OK) &&
+        (value > 0) && (value <= NRC_TCP_MAX_SIZE)) {
+        node->size = (u32_t)value;
+    }
+
+    node->max_conn = NRC_TCP_DEFAULT_CONNECTIONS;
+    if ((nrc_cfg_get_int(node->cfg_type, node->cfg_id, "connections", &value) == NRC_PORT_RES_OK) &&
+        (value > 0) && ((u32_t)value <= NRC_TCP_MAX_CONNECTIONS)) {
+        node->max_conn = (u32_t)value;
+    }
+
+    // All connections up front, none is allocated when accepted
+    node->conn_free = 0;
+    node->pool = (struct nrc_tcp_conn*)nrc_os_node_mem_alloc(node->max_conn * sizeof(struct nrc_tcp_conn));
+    if (node->pool != 0) {
+        for (i = node->max_conn; i > 0; i--) {
+            nrc_tcp_conn_put(node, &node->pool[i - 1]);
+        }
+    }
+    else {
+        result = NRC_PORT_RES_ERROR;
+    }
+
+    if (result == NRC_PORT_RES_OK) {
+        result = nrc_os_io_init(&node->io, id, NRC_TCP_EVT_ACCEPT, 0, NRC_TCP_PRIO);
+    }
+    if (result == NRC_PORT_RES_OK) {
+        result = nrc_os_timer_init(&node->retry, id, NRC_TCP_EVT_RETRY, NRC_TCP_PRIO);
+    }
+
+    return result;
+}
+
+static s32_t nrc_tcp_in_node_deinit(struct nrc_node_hdr *self)
+{
+    struct nrc_tcp_in_node *node = (struct nrc_tcp_in_node*)self;
+
+    if (node->spare != 0) {
+        nrc_os_msg_free(node->spare);
+        node->spare = 0;
+    }
+    nrc_os_node_mem_free(node->pool);
+    node->pool = 0;
+    node->conn_free = 0;
+
+    return NRC_PORT_RES_OK;
+}
+
+static s32_t nrc_tcp_in_node_start(struct nrc_node_hdr *self)
+{
+    struct nrc_tcp_in_node  *node = (struct nrc_tcp_in_node*)self;
+    struct sockaddr_in      addr;
+    s32_t                   on = 1;
+    s32_t                   result = NRC_PORT_RES_ERROR;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(node->port);
+
+    node->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+    if (node->fd >= 0) {
+        setsockopt(node->fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+        if ((bind(node->fd, (struct sockaddr*)&addr, sizeof(addr)) == 0) && (listen(node->fd, NRC_TCP_BACKLOG) == 0)) {
+            result = nrc_os_io_add(&node->io, node->fd, NRC_PORT_IO_IN);
+        }
+        if (result != NRC_PORT_RES_OK) {
+            close(node->fd);
+            node->fd = -1;
+        }
+    }
+
+    return result;
+}
+
+static s32_t nrc_tcp_in_node_stop(struct nrc_node_hdr *self)
+{
+    struct nrc_tcp_in_node  *node = (struct nrc_tcp_in_node*)self;
+    struct nrc_tcp_conn     *conn;
+    struct nrc_tcp_conn     *next;
+
+    if (node->fd >= 0) {
+        nrc_os_io_remove(&node->io);
+        close(node->fd);
+        node->fd = -1;
+    }
+    nrc_os_timer_stop(&node->retry);
+    node->retry_started = FALSE;
+    node->accept_paused = FALSE;
+
+    while (node->conn != 0) {
+        nrc_tcp_conn_close(node, node->conn);
+    }
+
+    // Closed ones that were still on the list
+    for (conn = nrc_tcp_ready_take(node); conn != 0; conn = next) {
+        next = conn->ready_next;
+        nrc_tcp_conn_put(node, conn);
+    }
+
+    return NRC_PORT_RES_OK;
+}
+
+static s32_t nrc_tcp_in_node_recv_msg(struct nrc_node_hdr *self, struct nrc_msg_hdr *msg)
+{
+    nrc_os_msg_free(msg);
+
+    return NRC_PORT_RES_OK;
+}
+
+static s32_t nrc_tcp_in_node_recv_evt(struct nrc_node_hdr *self, u32_t event_mask)
+{
+    struct nrc_tcp_in_node  *node = (struct nrc_tcp_in_node*)self;
+    struct nrc_msg_hdr      *chain = 0;
+    struct nrc_msg_hdr      **tail = &chain;
+    struct nrc_msg_hdr      *msg;
+    struct nrc_tcp_conn     *conn;
+    struct nrc_tcp_conn     *next;
+    u32_t                   reads = 0;
+
+    if (node->fd < 0) {
+        return NRC_PORT_RES_OK;
+    }
+
+    if ((event_mask & NRC_TCP_EVT_RETRY) != 0) {
+        node->retry_started = FALSE;
+    }
+    if (((event_mask & NRC_TCP_EVT_ACCEPT) != 0) || (((event_mask & NRC_TCP_EVT_RETRY) != 0) && node->accept_paused)) {
+        nrc_tcp_accept(node);
+    }
+
+    for (conn = nrc_tcp_ready_take(node); conn != 0; conn = next) {
+        next = conn->ready_next;
+
+        if (conn->closed) {
+            nrc_tcp_conn_put(node, conn);
+        }
+        else {
+            // A read that ends in EAGAIN may race with new data, the reactor then puts it back
+            nrc_port_atomic_store(&conn->ready, 0);
+
+            if (!nrc_tcp_read(node, conn, &reads, &tail)) {
+                nrc_tcp_conn_later(node, conn);
+            }
+        }
+    }
+
+    // Out of messages, waiting for the timer instead of running again at once
+    if (node->starved) {
+        node->starved = FALSE;
+        nrc_tcp_retry(node);
+    }
+
+    // A full receiver drops the reads, the chain is still ours then
+    if ((chain != 0) && (nrc_os_send_port_chain(self, 0, chain, NRC_TCP_PRIO) != NRC_PORT_RES_OK)) {
+        while (chain != 0) {
+            msg = chain;
+            chain = msg->next;
+            nrc_os_msg_free(msg);
+        }
+    }
+
+    return NRC_PORT_RES_OK;
+}
+
+struct nrc_node_api nrc_tcp_in_node_api = {
+    nrc_tcp_in_node_init,
+    nrc_tcp_in_node_deinit,
+    nrc_tcp_in_node_start,
+    nrc_tcp_in_node_stop,
+    nrc_tcp_in_node_recv_msg,
+    nrc_tcp_in_node_recv_evt,
+    0
+};
+
+struct nrc_node_hdr* nrc_tcp_in_node_alloc(const s8_t *cfg_type, const s8_t *cfg_id, const s8_t *cfg_name)
+{
+    struct nrc_tcp_in_node *node = (struct nrc_tcp_in_node*)nrc_os_node_alloc(sizeof(struct nrc_tcp_in_node));
+
+    if (node != 0) {
+        memset((u8_t*)node + sizeof(struct nrc_node_hdr), 0, sizeof(struct nrc_tcp_in_node) - sizeof(struct nrc_node_hdr));
+
+        strncpy(node->cfg_type, cfg_type, NRC_MAX_CFG_NAME_LEN - 1);
+        strncpy(node->cfg_id, cfg_id, NRC_MAX_CFG_NAME_LEN - 1);
+        if (cfg_name != 0) {
+            strncpy(node->cfg_name, cfg_name, NRC_MAX_CFG_NAME_LEN - 1);
+        }
+
+        node->hdr.cfg_type = node->cfg_type;
+        node->hdr.cfg_id = node->cfg_id;
+        node->hdr.cfg_name = node->cfg_name;
+        node->fd = -1;
+    }
+
+    return (struct nrc_node_hdr*)node;
+}
+
+s32_t nrc_tcp_get_stats(struct nrc_node_hdr *node, struct nrc_tcp_stats *stats)
+{
+    s32_t result = NRC_PORT_RES_INVALID_IN_PARAM;
+
+    if ((node != 0) && (stats != 0)) {
+        *stats = ((struct nrc_tcp_in_node*)node)->stats;
+        result = NRC_PORT_RES_OK;
+    }
+
+    return result;
+}
@@ -0,0 +1,703 @@
+/**
+ * Copyright 2017 Tomas Frisberg & Ola Bjorsne
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http ://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "nrc_udp.h"
+#include "nrc_os.h"
+#include "nrc_cfg.h"
+#include "nrc_port.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+
+#ifndef UDP_GRO
+#define UDP_GRO                 (104)
+#endif
+
+#define NRC_UDP_PRIO            (0)
+#define NRC_UDP_EVT_IN          (1)
+#define NRC_UDP_EVT_MORE        (2)         // Set by the node itself to go on in its next turn
+#define NRC_UDP_CALLS_PER_TURN  (4)         // recvmmsg calls before other nodes get to run
+#define NRC_UDP_RCVBUF          (4 * 1024 * 1024)
+#define NRC_UDP_GRO_SIZE        (65536)     // Largest coalesced buffer
+#define NRC_UDP_GRO_BATCH       (NRC_UDP_GRO_KEEP_SIZE / NRC_UDP_GRO_SIZE)
+#define NRC_UDP_MAX_SIZE        (65507)     // Largest IPv4 datagram payload
+
+// Room for the datagram and the terminator of a string
+#define NRC_UDP_MSG_SIZE(size)  ((u32_t)offsetof(struct nrc_msg_buf, buf) + (size) + 1)
+
+struct nrc_udp_node {
+    struct nrc_node_hdr     hdr;
+    nrc_node_id_t           id;
+    s8_t                    cfg_type[NRC_MAX_CFG_NAME_LEN];
+    s8_t                    cfg_id[NRC_MAX_CFG_NAME_LEN];
+    s8_t                    cfg_name[NRC_MAX_CFG_NAME_LEN];
+    s32_t                   fd;
+    s32_t                   family;
+    u32_t                   batch;
+    struct nrc_udp_stats    stats;
+    struct mmsghdr          mmsg[NRC_UDP_BATCH_MAX];
+    struct iovec            iov[NRC_UDP_BATCH_MAX];
+};
+
+struct nrc_udp_in_node {
+    struct nrc_udp_node     udp;
+    struct nrc_os_io        io;
+    u16_t                   port;
+    bool_t                  utf8;
+    bool_t                  gro;
+    u32_t                   size;
+    struct nrc_msg_hdr      *slot[NRC_UDP_BATCH_MAX];  // Messages the next datagrams go into
+    u8_t                    *gro_buf;
+    union {
+        struct cmsghdr      align;
+        u8_t                buf[CMSG_SPACE(sizeof(int))];
+    } control[NRC_UDP_GRO_BATCH];
+};
+
+struct nrc_udp_out_node {
+    struct nrc_udp_node     udp;
+    struct sockaddr_storage to;
+    socklen_t               to_len;
+    u16_t                   outport;
+};
+
+static void nrc_udp_node_init(struct nrc_udp_node *node, nrc_node_id_t id)
+{
+    s8_t    ipv[NRC_MAX_CFG_NAME_LEN];
+    s32_t   batch;
+
+    node->id = id;
+    node->fd = -1;
+    memset(&node->stats, 0, sizeof(struct nrc_udp_stats));
+
+    node->family = AF_INET;
+    if ((nrc_cfg_get_str(node->cfg_type, node->cfg_id, "ipv", ipv, NRC_MAX_CFG_NAME_LEN) == NRC_PORT_RES_OK) &&
+        (strcmp(ipv, "udp6") == 0)) {
+        node->family = AF_INET6;
+    }
+
+    node->batch = NRC_UDP_BATCH_MAX;
+    if ((nrc_cfg_get_int(node->cfg_type, node->cfg_id, "batch", &batch) == NRC_PORT_RES_OK) &&
+        (batch >= 1) && (batch <= NRC_UDP_BATCH_MAX)) {
+        node->batch = (u32_t)batch;
+    }
+}
+
+static s32_t nrc_udp_get_port(struct nrc_udp_node *node, s8_t *name, u16_t *port)
+{
+    s32_t result;
+    s32_t value;
+
+    result = nrc_cfg_get_int(node->cfg_type, node->cfg_id, name, &value);
+
+    if ((result == NRC_PORT_RES_OK) && ((value < 0) || (value > 65535))) {
+        result = NRC_PORT_RES_ERROR;
+    }
+    if (result == NRC_PORT_RES_OK) {
+        *port = (u16_t)value;
+    }
+
+    return result;
+}
+
+// Non-blocking socket bound to port of any address, port 0 for one the system picks
+static s32_t nrc_udp_socket(struct nrc_udp_node *node, u16_t port)
+{
+    s32_t               result = NRC_PORT_RES_ERROR;
+    struct sockaddr_in  addr4;
+    struct sockaddr_in6 addr6;
+    struct sockaddr     *addr = (struct sockaddr*)&addr4;
+    socklen_t           addr_len = sizeof(addr4);
+
+    memset(&addr4, 0, sizeof(addr4));
+    memset(&addr6, 0, sizeof(addr6));
+    addr4.sin_family = AF_INET;
+    addr4.sin_port = htons(port);
+    addr6.sin6_family = AF_INET6;
+    addr6.sin6_port = htons(port);
+    if (node->family == AF_INET6) {
+        addr = (struct sockaddr*)&addr6;
+        addr_len = sizeof(addr6);
+    }
+
+    node->fd = socket(node->family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+    if ((node->fd >= 0) && ((port == 0) || (bind(node->fd, addr, addr_len) == 0))) {
+        result = NRC_PORT_RES_OK;
+    }
+    else if (node->fd >= 0) {
+        close(node->fd);
+        node->fd = -1;
+    }
+
+    return result;
+}
+
+static void nrc_udp_close(struct nrc_udp_node *node)
+{
+    if (node->fd >= 0) {
+        close(node->fd);
+        node->fd = -1;
+    }
+}
+
+static void nrc_udp_node_strings(struct nrc_udp_node *node, const s8_t *cfg_type, const s8_t *cfg_id,
+                                 const s8_t *cfg_name)
+{
+    strncpy(node->cfg_type, cfg_type, NRC_MAX_CFG_NAME_LEN - 1);
+    strncpy(node->cfg_id, cfg_id, NRC_MAX_CFG_NAME_LEN - 1);
+    if (cfg_name != 0) {
+        strncpy(node->cfg_name, cfg_name, NRC_MAX_CFG_NAME_LEN - 1);
+    }
+
+    node->hdr.cfg_type = node->cfg_type;
+    node->hdr.cfg_id = node->cfg_id;
+    node->hdr.cfg_name = node->cfg_name;
+}
+
+s32_t nrc_udp_get_stats(struct nrc_node_hdr *node, struct nrc_udp_stats *stats)
+{
+    s32_t result = NRC_PORT_RES_INVALID_IN_PARAM;
+
+    if ((node != 0) && (stats != 0)) {
+        *stats = ((struct nrc_udp_node*)node)->stats;
+        result = NRC_PORT_RES_OK;
+    }
+
+    return result;
+}
+
+/**
+ * udp in
+ */
+
+// Messages for the free slots from the first one, the datagrams of the next call go in them.
+// Returns how many slots in a row have one.
+static u32_t nrc_udp_in_fill(struct nrc_udp_in_node *node)
+{
+    struct nrc_msg_hdr  *msg;
+    u32_t               i;
+
+    for (i = 0; i < node->udp.batch; i++) {
+        if (node->slot[i] == 0) {
+            msg = nrc_os_msg_alloc(NRC_UDP_MSG_SIZE(node->size));
+            if (msg == 0) {
+                break;
+            }
+            node->slot[i] = msg;
+        }
+
+        msg = node->slot[i];
+        node->udp.iov[i].iov_base = node->utf8 ? (void*)((struct nrc_msg_str*)msg)->str :
+                                                 (void*)((struct nrc_msg_buf*)msg)->buf;
+        node->udp.iov[i].iov_len = node->size;
+    }
+
+    return i;
+}
+
+static void nrc_udp_in_done(struct nrc_udp_in_node *node, struct nrc_msg_hdr *msg, u32_t len)
+{
+    msg->next = 0;
+    msg->topic = 0;
+
+    if (node->utf8) {
+        msg->type = NRC_MSG_TYPE_STRING;
+        ((struct nrc_msg_str*)msg)->str[len] = 0;
+    }
+    else {
+        msg->type = NRC_MSG_TYPE_BUF;
+        ((struct nrc_msg_buf*)msg)->len = len;
+    }
+}
+
+// One recvmmsg call into the messages of the slots. Gives what recvmmsg gives.
+static s32_t nrc_udp_in_recv(struct nrc_udp_in_node *node, u32_t count, struct nrc_msg_hdr ***tail)
+{
+    struct mmsghdr  *mmsg = node->udp.mmsg;
+    s32_t           received;
+    s32_t           i;
+
+    received = recvmmsg(node->udp.fd, mmsg, count, MSG_DONTWAIT, NULL);
+
+    for (i = 0; i < received; i++) {
+        if ((mmsg[i].msg_hdr.msg_flags & MSG_TRUNC) != 0) {
+            node->udp.stats.dropped++;
+        }
+        else {
+            nrc_udp_in_done(node, node->slot[i], mmsg[i].msg_len);
+            **tail = node->slot[i];
+            *tail = &node->slot[i]->next;
+            node->slot[i] = 0;
+            node->udp.stats.packets++;
+        }
+    }
+
+    return received;
+}
+
+// Size of the datagrams coalesced in entry i, all but the last are that long
+static u32_t nrc_udp_in_gro_size(struct nrc_udp_in_node *node, u32_t i)
+{
+    struct msghdr   *hdr = &node->udp.mmsg[i].msg_hdr;
+    struct cmsghdr  *cmsg;
+    u32_t           size = node->udp.mmsg[i].msg_len;
+    int             gso_size;
+
+    for (cmsg = CMSG_FIRSTHDR(hdr); cmsg != NULL; cmsg = CMSG_NXTHDR(hdr, cmsg)) {
+        if ((cmsg->cmsg_level == SOL_UDP) && (cmsg->cmsg_type == UDP_GRO)) {
+            memcpy(&gso_size, CMSG_DATA(cmsg), sizeof(int));
+            if (gso_size > 0) {
+                size = (u32_t)gso_size;
+            }
+        }
+    }
+
+    return size;
+}
+
+// One recvmmsg call of coalesced buffers, split into a message per datagram
+static s32_t nrc_udp_in_recv_gro(struct nrc_udp_in_node *node, u32_t count, struct nrc_msg_hdr ***tail)
+{
+    struct mmsghdr      *mmsg = node->udp.mmsg;
+    struct nrc_msg_hdr  *msg;
+    u8_t                *data;
+    s32_t               received;
+    s32_t               i;
+    u32_t               offset;
+    u32_t               size;
+    u32_t               len;
+
+    for (i = 0; i < (s32_t)count; i++) {
+        mmsg[i].msg_hdr.msg_control = node->control[i].buf;
+        mmsg[i].msg_hdr.msg_controllen = sizeof(node->control[i].buf);
+    }
+
+    received = recvmmsg(node->udp.fd, mmsg, count, MSG_DONTWAIT, NULL);
+
+    for (i = 0; i < received; i++) {
+        data = &node->gro_buf[i * NRC_UDP_GRO_SIZE];
+        size = nrc_udp_in_gro_size(node, i);
+
+        for (offset = 0; offset < mmsg[i].msg_len; offset += size) {
+            len = ((mmsg[i].msg_len - offset) < size) ? (mmsg[i].msg_len - offset) : size;
+            msg = (len <= node->size) ? nrc_os_msg_alloc(NRC_UDP_MSG_SIZE(len)) : 0;
+
+            if (msg != 0) {
+                memcpy(node->utf8 ? (u8_t*)((struct nrc_msg_str*)msg)->str : ((struct nrc_msg_buf*)msg)->buf,
+                       &data[offset], len);
+                nrc_udp_in_done(node, msg, len);
+                **tail = msg;
+                *tail = &msg->next;
+                node->udp.stats.packets++;
+            }
+            else {
+                node->udp.stats.dropped++;
+            }
+        }
+    }
+
+    return received;
+}
+
+static s32_t nrc_udp_in_node_init(struct nrc_node_hdr *self, nrc_node_id_t id)
+{
+    struct nrc_udp_in_node  *node = (struct nrc_udp_in_node*)self;
+    s8_t                    datatype[NRC_MAX_CFG_NAME_LEN];
+    s32_t                   value;
+    u32_t                   i;
+    s32_t                   result;
+
+    nrc_udp_node_init(&node->udp, id);
+    result = nrc_udp_get_port(&node->udp, "port", &node->port);
+
+    node->utf8 = FALSE;
+    if ((nrc_cfg_get_str(node->udp.cfg_type, node->udp.cfg_id, "datatype", datatype, NRC_MAX_CFG_NAME_LEN) ==
+         NRC_PORT_RES_OK) && (strcmp(datatype, "buffer") != 0)) {
+        if (strcmp(datatype, "utf8") == 0) {
+            node->utf8 = TRUE;
+        }
+        else {
+            result = NRC_PORT_RES_NOT_SUPPORTED;
+        }
+    }
+
+    node->size = NRC_UDP_DEFAULT_SIZE;
+    if ((nrc_cfg_get_int(node->udp.cfg_type, node->udp.cfg_id, "size", &value) == NRC_PORT_RES_OK) &&
+        (value > 0) && (value <= NRC_UDP_MAX_SIZE)) {
+        node->size = (u32_t)value;
+    }
+
+    node->gro = FALSE;
+    if ((nrc_cfg_get_int(node->udp.cfg_type, node->udp.cfg_id, "gro", &value) == NRC_PORT_RES_OK) && (value != 0)) {
+        node->gro = TRUE;
+        if (node->udp.batch > NRC_UDP_GRO_BATCH) {
+            node->udp.batch = NRC_UDP_GRO_BATCH;
+        }
+    }
+
+    memset(node->udp.mmsg, 0, sizeof(node->udp.mmsg));
+    for (i = 0; i < NRC_UDP_BATCH_MAX; i++) {
+        node->udp.mmsg[i].msg_hdr.msg_iov = &node->udp.iov[i];
+        node->udp.mmsg[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    if ((result == NRC_PORT_RES_OK) && node->gro) {
+        node->gro_buf = (u8_t*)nrc_os_node_mem_alloc(NRC_UDP_GRO_KEEP_SIZE);
+
+        if (node->gro_buf == 0) {
+            result = NRC_PORT_RES_ERROR;
+        }
+        for (i = 0; (i < NRC_UDP_GRO_BATCH) && (result == NRC_PORT_RES_OK); i++) {
+            node->udp.iov[i].iov_base = &node->gro_buf[i * NRC_UDP_GRO_SIZE];
+            node->udp.iov[i].iov_len = NRC_UDP_GRO_SIZE;
+        }
+    }
+    else if ((result == NRC_PORT_RES_OK) && (nrc_udp_in_fill(node) == 0)) {
+        result = NRC_PORT_RES_ERROR;
+    }
+
+    if (result == NRC_PORT_RES_OK) {
+        result = nrc_os_io_init(&node->io, id, NRC_UDP_EVT_IN, 0, NRC_UDP_PRIO);
+    }
+
+    return result;
+}
+
+static s32_t nrc_udp_in_node_deinit(struct nrc_node_hdr *self)
+{
+    struct nrc_udp_in_node  *node = (struct nrc_udp_in_node*)self;
+    u32_t                   i;
+
+    for (i = 0; i < NRC_UDP_BATCH_MAX; i++) {
+        if (node->slot[i] != 0) {
+            nrc_os_msg_free(node->slot[i]);
+            node->slot[i] = 0;
+        }
+    }
+    if (node->gro_buf != 0) {
+        nrc_os_node_mem_free(node->gro_buf);
+        node->gro_buf = 0;
+    }
+
+    return NRC_PORT_RES_OK;
+}
+
+static s32_t nrc_udp_in_node_start(struct nrc_node_hdr *self)
+{
+    struct nrc_udp_in_node  *node = (struct nrc_udp_in_node*)self;
+    s32_t                   rcvbuf = NRC_UDP_RCVBUF;
+    s32_t                   on = 1;
+    s32_t                   result;
+
+    result = nrc_udp_socket(&node->udp, node->port);
+
+    if (result == NRC_PORT_RES_OK) {
+        // Bursts wait in the socket while the node is behind, a failure only makes it smaller
+        setsockopt(node->udp.fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+        if (node->gro && (setsockopt(node->udp.fd, SOL_UDP, UDP_GRO, &on, sizeof(on)) != 0)) {
+            result = NRC_PORT_RES_NOT_SUPPORTED;
+        }
+    }
+    if (result == NRC_PORT_RES_OK) {
+        result = nrc_os_io_add(&node->io, node->udp.fd, NRC_PORT_IO_IN);
+    }
+    if (result != NRC_PORT_RES_OK) {
+        nrc_udp_close(&node->udp);
+    }
+
+    return result;
+}
+
+static s32_t nrc_udp_in_node_stop(struct nrc_node_hdr *self)
+{
+    struct nrc_udp_in_node *node = (struct nrc_udp_in_node*)self;
+
+    nrc_os_io_remove(&node->io);
+    nrc_udp_close(&node->udp);
+
+    return NRC_PORT_RES_OK;
+}
+
+static s32_t nrc_udp_in_node_recv_msg(struct nrc_node_hdr *self, struct nrc_msg_hdr *msg)
+{
+    nrc_os_msg_free(msg);
+
+    return NRC_PORT_RES_OK;
+}
+
+// Reads until the socket is empty or the turn is used up, then goes on in its next turn.
+// recvmmsg only gives fewer than asked for when the socket ran empty.
+static s32_t nrc_udp_in_node_recv_evt(struct nrc_node_hdr *self, u32_t event_mask)
+{
+    struct nrc_udp_in_node  *node = (struct nrc_udp_in_node*)self;
+    struct nrc_msg_hdr      *chain = 0;
+    struct nrc_msg_hdr      **tail = &chain;
+    struct nrc_msg_hdr      *msg;
+    u32_t                   calls;
+    u32_t                   count = node->udp.batch;
+    s32_t                   received;
+    bool_t                  empty = FALSE;
+
+    if (node->udp.fd < 0) {
+        return NRC_PORT_RES_OK;
+    }
+
+    for (calls = 0; (calls < NRC_UDP_CALLS_PER_TURN) && (count != 0) && (empty == FALSE); calls++) {
+        if (!node->gro) {
+            count = nrc_udp_in_fill(node);
+        }
+        if (count != 0) {
+            received = node->gro ? nrc_udp_in_recv_gro(node, count, &tail) : nrc_udp_in_recv(node, count, &tail);
+
+            if (received > 0) {
+                node->udp.stats.calls++;
+            }
+            empty = (received < (s32_t)count);
+        }
+    }
+
+    // A full receiver drops the datagrams, the chain is still ours then
+    if ((chain != 0) && (nrc_os_send_port_chain(self, 0, chain, NRC_UDP_PRIO) != NRC_PORT_RES_OK)) {
+        while (chain != 0) {
+            msg = chain;
+            chain = msg->next;
+            nrc_os_msg_free(msg);
+            node->udp.stats.dropped++;
+        }
+    }
+
+    // Out of messages the next datagram to arrive tries again
+    if (empty || (count == 0)) {
+        nrc_os_io_again(&node->io, NRC_PORT_IO_IN);
+    }
+    else {
+        nrc_os_set_evt(node->udp.id, NRC_UDP_EVT_MORE, NRC_UDP_PRIO);
+    }
+
+    return NRC_PORT_RES_OK;
+}
+
+struct nrc_node_api nrc_udp_in_node_api = {
+    nrc_udp_in_node_init,
+    nrc_udp_in_node_deinit,
+    nrc_udp_in_node_start,
+    nrc_udp_in_node_stop,
+    nrc_udp_in_node_recv_msg,
+    nrc_udp_in_node_recv_evt,
+    0
+};
+
+struct nrc_node_hdr* nrc_udp_in_node_alloc(const s8_t *cfg_type, const s8_t *cfg_id, const s8_t *cfg_name)
+{
+    struct nrc_udp_in_node *node = (struct nrc_udp_in_node*)nrc_os_node_alloc(sizeof(struct nrc_udp_in_node));
+
+    if (node != 0) {
+        memset((u8_t*)node + sizeof(struct nrc_node_hdr), 0, sizeof(struct nrc_udp_in_node) - sizeof(struct nrc_node_hdr));
+        nrc_udp_node_strings(&node->udp, cfg_type, cfg_id, cfg_name);
+        node->udp.fd = -1;
+    }
+
+    return (struct nrc_node_hdr*)node;
+}
+
+/**
+ * udp out
+ */
+
+static s32_t nrc_udp_out_node_init(struct nrc_node_hdr *self, nrc_node_id_t id)
+{
+    struct nrc_udp_out_node *node = (struct nrc_udp_out_node*)self;
+    s8_t                    addr[NRC_MAX_CFG_NAME_LEN];
+    s8_t                    port[NRC_MAX_CFG_NAME_LEN];
+    struct addrinfo         hints;
+    struct addrinfo         *info = 0;
+    u16_t                   port_value;
+    s32_t                   result;
+
+    nrc_udp_node_init(&node->udp, id);
+
+    // Empty in Node-RED when the system picks one
+    if (nrc_udp_get_port(&node->udp, "outport", &node->outport) != NRC_PORT_RES_OK) {
+        node->outport = 0;
+    }
+
+    result = nrc_cfg_get_str(node->udp.cfg_type, node->udp.cfg_id, "addr", addr, NRC_MAX_CFG_NAME_LEN);
+    if (result == NRC_PORT_RES_OK) {
+        result = nrc_udp_get_port(&node->udp, "port", &port_value);
+    }
+
+    if (result == NRC_PORT_RES_OK) {
+        snprintf(port, sizeof(port), "%u", port_value);
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = node->udp.family;
+        hints.ai_socktype = SOCK_DGRAM;
+        hints.ai_flags = AI_NUMERICSERV;
+
+        result = NRC_PORT_RES_NOT_FOUND;
+        if ((getaddrinfo(addr, port, &hints, &info) == 0) && (info->ai_addrlen <= sizeof(node->to))) {
+            memcpy(&node->to, info->ai_addr, info->ai_addrlen);
+            node->to_len = info->ai_addrlen;
+            result = NRC_PORT_RES_OK;
+        }
+        if (info != 0) {
+            freeaddrinfo(info);
+        }
+    }
+
+    return result;
+}
+
+static s32_t nrc_udp_out_node_deinit(struct nrc_node_hdr *self)
+{
+    return NRC_PORT_RES_OK;
+}
+
+// Connected, so the kernel looks up the route once and not per datagram
+static s32_t nrc_udp_out_node_start(struct nrc_node_hdr *self)
+{
+    struct nrc_udp_out_node *node = (struct nrc_udp_out_node*)self;
+    s32_t                   result;
+
+    result = nrc_udp_socket(&node->udp, node->outport);
+
+    if ((result == NRC_PORT_RES_OK) && (connect(node->udp.fd, (struct sockaddr*)&node->to, node->to_len) != 0)) {
+        result = NRC_PORT_RES_ERROR;
+        nrc_udp_close(&node->udp);
+    }
+
+    return result;
+}
+
+static s32_t nrc_udp_out_node_stop(struct nrc_node_hdr *self)
+{
+    nrc_udp_close(&((struct nrc_udp_out_node*)self)->udp);
+
+    return NRC_PORT_RES_OK;
+}
+
+// Sends the datagrams set up in the first count entries, a refused or full one is dropped
+static void nrc_udp_out_send(struct nrc_udp_out_node *node, u32_t count)
+{
+    u32_t   done = 0;
+    s32_t   sent;
+
+    while (done < count) {
+        sent = sendmmsg(node->udp.fd, &node->udp.mmsg[done], count - done, MSG_DONTWAIT);
+
+        if (sent > 0) {
+            done += (u32_t)sent;
+            node->udp.stats.packets += (u32_t)sent;
+            node->udp.stats.calls++;
+        }
+        else if ((sent < 0) && (errno == EINTR)) {
+            continue;
+        }
+        else {
+            // The first one failed, e.g. refused by the peer or no room in the socket
+            done++;
+            node->udp.stats.dropped++;
+        }
+    }
+}
+
+static s32_t nrc_udp_out_node_recv_msg_batch(struct nrc_node_hdr *self, struct nrc_msg_hdr **msgs, u32_t count)
+{
+    struct nrc_udp_out_node *node = (struct nrc_udp_out_node*)self;
+    struct nrc_msg_hdr      *msg;
+    u32_t                   entries = 0;
+    u32_t                   i;
+
+    for (i = 0; i < count; i++) {
+        msg = msgs[i];
+
+        if ((node->udp.fd < 0) || ((msg->type != NRC_MSG_TYPE_BUF) && (msg->type != NRC_MSG_TYPE_STRING))) {
+            node->udp.stats.dropped++;
+            continue;
+        }
+
+        if (msg->type == NRC_MSG_TYPE_BUF) {
+            node->udp.iov[entries].iov_base = ((struct nrc_msg_buf*)msg)->buf;
+            node->udp.iov[entries].iov_len = ((struct nrc_msg_buf*)msg)->len;
+        }
+        else {
+            node->udp.iov[entries].iov_base = ((struct nrc_msg_str*)msg)->str;
+            node->udp.iov[entries].iov_len = strlen(((struct nrc_msg_str*)msg)->str);
+        }
+        memset(&node->udp.mmsg[entries], 0, sizeof(struct mmsghdr));
+        node->udp.mmsg[entries].msg_hdr.msg_iov = &node->udp.iov[entries];
+        node->udp.mmsg[entries].msg_hdr.msg_iovlen = 1;
+        entries++;
+
+        if (entries == node->udp.batch) {
+            nrc_udp_out_send(node, entries);
+            entries = 0;
+        }
+    }
+    if (entries != 0) {
+        nrc_udp_out_send(node, entries);
+    }
+
+    for (i = 0; i < count; i++) {
+        nrc_os_msg_free(msgs[i]);
+    }
+
+    return NRC_PORT_RES_OK;
+}
+
+static s32_t nrc_udp_out_node_recv_msg(struct nrc_node_hdr *self, struct nrc_msg_hdr *msg)
+{
+    return nrc_udp_out_node_recv_msg_batch(self, &msg, 1);
+}
+
+static s32_t nrc_udp_out_node_recv_evt(struct nrc_node_hdr *self, u32_t event_mask)
+{
+    return NRC_PORT_RES_OK;
+}
+
+struct nrc_node_api nrc_udp_out_node_api = {
+    nrc_udp_out_node_init,
+    nrc_udp_out_node_deinit,
+    nrc_udp_out_node_start,
+    nrc_udp_out_node_stop,
+    nrc_udp_out_node_recv_msg,
+    nrc_udp_out_node_recv_evt,
+    nrc_udp_out_node_recv_msg_batch
+};
+
+struct nrc_node_hdr* nrc_udp_out_node_alloc(const s8_t *cfg_type, const s8_t *cfg_id, const s8_t *cfg_name)
+{
+    struct nrc_udp_out_node *node = (struct nrc_udp_out_node*)nrc_os_node_alloc(sizeof(struct nrc_udp_out_node));
+
+    if (node != 0) {
+        memset((u8_t*)node + sizeof(struct nrc_node_hdr), 0, sizeof(struct nrc_udp_out_node) - sizeof(struct nrc_node_hdr));
+        nrc_udp_node_strings(&node->udp, cfg_type, cfg_id, cfg_name);
+        node->udp.fd = -1;
+    }
+
+    return (struct nrc_node_hdr*)node;
+}
@@ -0,0 +1,282 @@
+/**
+ * Copyright 2017 Tomas Frisberg & Ola Bjorsne
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http ://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _NRC_PORT_H_
+#define _NRC_PORT_H_
+
+#include "nrc_types.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define NRC_PORT_RES_OK                 (0)
+#define NRC_PORT_RES_ERROR              (-1)
+#define NRC_PORT_RES_TIMEOUT            (-2)
+#define NRC_PORT_RES_NOT_SUPPORTED      (-3)
+#define NRC_PORT_RES_INVALID_IN_PARAM   (-4)
+#define NRC_PORT_RES_NOT_FOUND          (-5)
+#define NRC_PORT_RES_BUSY               (-6)
+
+#ifndef NRC_PORT_HEAP_FAST_SIZE
+#define NRC_PORT_HEAP_FAST_SIZE         (64 * 1024 * 1024) // Hard cap for nrc_port_heap_fast_alloc
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum nrc_port_thread_prio {
+    NRC_PORT_THREAD_PRIO_CRITICAL = 1,  // For time critical drivers
+    NRC_PORT_THREAD_PRIO_HIGH,          // For kernel
+    NRC_PORT_THREAD_PRIO_NORMAL,        // For application
+    NRC_PORT_THREAD_PRIO_LOW            // For background tasks
+};
+
+typedef void(*nrc_port_thread_fcn_t)(void);
+
+#define NRC_PORT_THREAD_LOCAL __thread
+
+#ifdef _LONG_HANDLES_
+typedef s64_t nrc_port_thread_t;
+typedef s64_t nrc_port_sema_t;
+typedef s64_t nrc_port_mutex_t;
+#else
+typedef s32_t nrc_port_thread_t;
+typedef s32_t nrc_port_sema_t;
+typedef s32_t nrc_port_mutex_t;
+#endif
+
+s32_t nrc_port_init(void);
+
+/**
+ * Memory and Heap
+ */
+u8_t* nrc_port_heap_alloc(u32_t size);
+void nrc_port_heap_free(void *buf);
+
+u8_t* nrc_port_heap_fast_alloc(u32_t size);
+void nrc_port_heap_fast_free(void *buf);
+
+struct nrc_port_heap_stats {
+    u32_t   block_size;     // 0 for allocations larger than the biggest size class
+    u64_t   alloc_count;
+    u64_t   free_count;
+    u64_t   in_use_bytes;
+    u64_t   failed_count;
+};
+
+// Counters for one fast heap size class. NRC_PORT_RES_NOT_FOUND when size_class is past the last one.
+s32_t nrc_port_heap_fast_stats(u32_t size_class, struct nrc_port_heap_stats *stats);
+
+/**
+ * File mapping
+ *
+ * Maps a whole file read-only into memory
+ */
+s32_t nrc_port_file_map(const s8_t *path, const u8_t **data, u32_t *size);
+s32_t nrc_port_file_unmap(const u8_t *data, u32_t size);
+
+/**
+ * Time
+ *
+ * Monotonic clock in nanoseconds from an arbitrary start, cheap enough to read per dispatch
+ */
+u64_t nrc_port_time_ns(void);
+
+// Free running counter at a constant but unspecified rate, the cheapest time source.
+// Scale against nrc_port_time_ns over an interval.
+static inline u64_t nrc_port_ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    u64_t ticks;
+
+    __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(ticks));
+    return ticks;
+#else
+    return nrc_port_time_ns();
+#endif
+}
+
+/**
+ * Thread
+ */
+s32_t nrc_port_thread_init(
+    enum nrc_port_thread_prio   priority,
+    u32_t                       stack_size,
+    nrc_port_thread_fcn_t       thread_fcn,
+    nrc_port_thread_t           *thread_id);
+
+// A thread whose start fails is freed, there is nothing to join
+s32_t nrc_port_thread_start(nrc_port_thread_t thread_id);
+
+// Waits for a started thread's fcn to return and frees the thread
+s32_t nrc_port_thread_join(nrc_port_thread_t thread_id);
+
+/**
+ * Queue
+ */
+
+/**
+typedef u32_t nrc_port_queue_t;
+
+s32_t nrc_port_queue_init(u32_t size, nrc_port_queue_t *queue);
+s32_t nrc_port_queue_put(nrc_port_queue_t queue, void *item);
+void* nrc_port_queue_get(nrc_port_queue_t queue, u32_t timeout);
+*/
+
+/**
+ * Mutex
+ */
+s32_t nrc_port_mutex_init(nrc_port_mutex_t *mutex);
+s32_t nrc_port_mutex_deinit(nrc_port_mutex_t mutex);
+s32_t nrc_port_mutex_lock(nrc_port_mutex_t mutex, u32_t timeout);
+s32_t nrc_port_mutex_unlock(nrc_port_mutex_t mutex);
+
+/**
+ * Semaphore
+ */
+s32_t nrc_port_sema_init(u32_t count, nrc_port_sema_t *sema);
+s32_t nrc_port_sema_deinit(nrc_port_sema_t sema);
+s32_t nrc_port_sema_signal(nrc_port_sema_t sema);
+s32_t nrc_port_sema_wait(nrc_port_sema_t sema, u32_t timeout);
+
+/**
+ * I/O reactor
+ *
+ * One reactor thread, started by the first add, waits for all registered file
+ * descriptors and calls fcn with the ready bits when one becomes ready. fcn runs on the reactor thread,
+ * it shall be short and not call nrc_port_io functions. Once remove returns fcn
+ * is not called again for io. Remove the fd before closing it.
+ *
+ * Readiness is edge-triggered: an fd is reported when it becomes ready, then not
+ * again until the owner has read or written it until EAGAIN and called again.
+ * An error or hang up is reported as the bits of interest, a read or write then
+ * tells what happened. So is an fd closed before it was removed, once.
+ *
+ * Linux uses epoll. With NRC_PORT_IO_POLL, or where there is no epoll, a poll
+ * stand-in is used. It does the same but costs a wake up of the reactor per
+ * again, it is for testing and small numbers of fds.
+ */
+#ifndef NRC_PORT_IO_MAX
+#define NRC_PORT_IO_MAX                 (4096)  // Registered fds at a time
+#endif
+
+#define NRC_PORT_IO_IN                  (1)
+#define NRC_PORT_IO_OUT                 (2)
+
+typedef u32_t nrc_port_io_t;
+
+typedef void(*nrc_port_io_fcn_t)(void *context, u32_t ready);
+
+s32_t nrc_port_io_add(s32_t fd, u32_t interest, nrc_port_io_fcn_t fcn, void *context, nrc_port_io_t *io);
+s32_t nrc_port_io_modify(nrc_port_io_t io, u32_t interest);
+s32_t nrc_port_io_again(nrc_port_io_t io, u32_t ready);
+s32_t nrc_port_io_remove(nrc_port_io_t io);
+
+// Stops and joins the reactor thread, not alongside an add. Registrations stay, the
+// next add starts it again.
+s32_t nrc_port_io_stop(void);
+
+/**
+ * Atomics
+ *
+ * Sequentially consistent, safe to use from any thread and from interrupts.
+ * All read-modify-write operations return the previous value.
+ */
+static inline u32_t nrc_port_atomic_load(volatile u32_t *value)
+{
+    return __atomic_load_n(value, __ATOMIC_SEQ_CST);
+}
+static inline void nrc_port_atomic_store(volatile u32_t *value, u32_t new_value)
+{
+    __atomic_store_n(value, new_value, __ATOMIC_SEQ_CST);
+}
+static inline u32_t nrc_port_atomic_add(volatile u32_t *value, u32_t addend)
+{
+    return __atomic_fetch_add(value, addend, __ATOMIC_SEQ_CST);
+}
+static inline u32_t nrc_port_atomic_or(volatile u32_t *value, u32_t mask)
+{
+    return __atomic_fetch_or(value, mask, __ATOMIC_SEQ_CST);
+}
+static inline u32_t nrc_port_atomic_and(volatile u32_t *value, u32_t mask)
+{
+    return __atomic_fetch_and(value, mask, __ATOMIC_SEQ_CST);
+}
+static inline u32_t nrc_port_atomic_xchg(volatile u32_t *value, u32_t new_value)
+{
+    return __atomic_exchange_n(value, new_value, __ATOMIC_SEQ_CST);
+}
+static inline bool_t nrc_port_atomic_cas(volatile u32_t *value, u32_t expected, u32_t new_value)
+{
+    return __atomic_compare_exchange_n(value, &expected, new_value, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+// Publish and read by a single writer, only ordered against the writer's earlier
+// writes and the reader's later reads. No locked instruction on x86.
+static inline void nrc_port_atomic_store_release(volatile u32_t *value, u32_t new_value)
+{
+    __atomic_store_n(value, new_value, __ATOMIC_RELEASE);
+}
+static inline u32_t nrc_port_atomic_load_acquire(volatile u32_t *value)
+{
+    return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+}
+
+// Counters with a single writer, read whole from any thread. No ordering.
+static inline u64_t nrc_port_atomic_load64(volatile u64_t *value)
+{
+    return __atomic_load_n(value, __ATOMIC_RELAXED);
+}
+static inline void nrc_port_atomic_store64(volatile u64_t *value, u64_t new_value)
+{
+    __atomic_store_n(value, new_value, __ATOMIC_RELAXED);
+}
+
+static inline void* nrc_port_atomic_load_ptr(void *volatile *ptr)
+{
+    return __atomic_load_n(ptr, __ATOMIC_SEQ_CST);
+}
+static inline void nrc_port_atomic_store_ptr_release(void *volatile *ptr, void *new_value)
+{
+    __atomic_store_n(ptr, new_value, __ATOMIC_RELEASE);
+}
+static inline void* nrc_port_atomic_xchg_ptr(void *volatile *ptr, void *new_value)
+{
+    return __atomic_exchange_n(ptr, new_value, __ATOMIC_SEQ_CST);
+}
+static inline bool_t nrc_port_atomic_cas_ptr(void *volatile *ptr, void *expected, void *new_value)
+{
+    return __atomic_compare_exchange_n(ptr, &expected, new_value, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * IRQ Disable/Enable
+ * 
+ * Only for interrupts
+ */
+s32_t nrc_port_irq_disable(void);
+s32_t nrc_port_irq_enable(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
\ No newline at end of file
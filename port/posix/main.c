@@ -0,0 +1,83 @@
+/**
+ * Copyright 2017 Tomas Frisberg & Ola Bjorsne
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http ://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <signal.h>
+
+#include "nrc_port.h"
+#include "nrc_os.h"
+#include "nrc_cfg.h"
+#include "nrc_trace.h"
+
+#define NRC_TRACE_FILE  "nrc_trace.bin"
+
+static volatile sig_atomic_t trace_requested;
+
+static void on_trace_signal(int sig)
+{
+    trace_requested = 1;
+}
+
+// Writes the trace rings, convert with nrc_trace_json
+static void write_trace(void)
+{
+    u8_t    *image;
+    u32_t   size;
+    FILE    *file;
+
+    if (nrc_trace_snapshot(&image, &size) == NRC_PORT_RES_OK) {
+        file = fopen(NRC_TRACE_FILE, "wb");
+        if ((file != NULL) && (fwrite(image, 1, size, file) == size) && (fclose(file) == 0)) {
+            printf("trace written to %s\n", NRC_TRACE_FILE);
+        }
+        else {
+            printf("failed to write %s\n", NRC_TRACE_FILE);
+        }
+        nrc_port_heap_free(image);
+    }
+    else {
+        printf("no trace, build with NRC_OS_TRACE\n");
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    printf("nrc is about to start\n");
+
+    nrc_port_init();
+
+    // Optional Node-RED flows file
+    if ((argc > 1) && (nrc_cfg_init_file((const s8_t*)argv[1]) != NRC_PORT_RES_OK)) {
+        printf("failed to load %s\n", argv[1]);
+        return 1;
+    }
+
+    nrc_os_init();
+    nrc_os_start();
+
+    // kill -USR1 <pid> takes a trace snapshot
+    signal(SIGUSR1, on_trace_signal);
+
+    while (1) {
+        sleep(1);
+
+        if (trace_requested) {
+            trace_requested = 0;
+            write_trace();
+        }
+    }
+}
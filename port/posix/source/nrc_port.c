@@ -0,0 +1,548 @@
+/**
+ * Copyright 2017 Tomas Frisberg & Ola Bjorsne
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http ://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "nrc_port.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <assert.h>
+
+// Number of spins before a contended mutex or empty semaphore goes to the kernel
+#define NRC_PORT_SPIN_COUNT     (100)
+
+#define NRC_PORT_MIN_STACK_SIZE (16 * 1024)
+
+// Nice value of LOW priority threads, they yield to NORMAL ones on the normal scheduler
+#define NRC_PORT_LOW_NICE       (10)
+
+enum nrc_port_state {
+    NRC_PORT_S_INVALID = 0,
+    NRC_PORT_S_INITIALISED
+};
+
+struct nrc_port {
+    enum nrc_port_state state;
+    nrc_port_mutex_t    irq_mutex;
+};
+
+struct posix_thread {
+    pthread_t                   handle;
+    enum nrc_port_thread_prio   priority;
+    u32_t                       stack_size;
+    nrc_port_thread_fcn_t       thread_fcn;
+};
+
+// Futex word is 0 when unlocked, 1 when locked and 2 when locked with (possible) waiters
+struct posix_mutex {
+    u32_t   futex;
+};
+
+struct posix_sema {
+    u32_t   count;
+    u32_t   waiters;
+};
+
+static struct nrc_port port = { NRC_PORT_S_INVALID, 0 };
+
+static inline void posix_cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+static s32_t posix_futex_wait(u32_t *addr, u32_t value, const struct timespec *timeout)
+{
+    return (s32_t)syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, value, timeout, NULL, 0);
+}
+
+static void posix_futex_wake(u32_t *addr, s32_t count)
+{
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+static void posix_deadline_init(u32_t timeout, struct timespec *deadline)
+{
+    clock_gettime(CLOCK_MONOTONIC, deadline);
+
+    deadline->tv_sec += timeout / 1000;
+    deadline->tv_nsec += (long)(timeout % 1000) * 1000000L;
+
+    if (deadline->tv_nsec >= 1000000000L) {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000L;
+    }
+}
+
+// Returns FALSE when the deadline has passed, else the relative time left in remaining
+static bool_t posix_deadline_remaining(const struct timespec *deadline, struct timespec *remaining)
+{
+    struct timespec now;
+    bool_t          ok = TRUE;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    remaining->tv_sec = deadline->tv_sec - now.tv_sec;
+    remaining->tv_nsec = deadline->tv_nsec - now.tv_nsec;
+
+    if (remaining->tv_nsec < 0) {
+        remaining->tv_sec--;
+        remaining->tv_nsec += 1000000000L;
+    }
+    if ((remaining->tv_sec < 0) || ((remaining->tv_sec == 0) && (remaining->tv_nsec == 0))) {
+        ok = FALSE;
+    }
+
+    return ok;
+}
+
+s32_t nrc_port_init(void)
+{
+    s32_t result = NRC_PORT_RES_OK;
+
+    assert(port.state == NRC_PORT_S_INVALID);
+
+    result = nrc_port_mutex_init(&(port.irq_mutex));
+
+    if (result == NRC_PORT_RES_OK) {
+        port.state = NRC_PORT_S_INITIALISED;
+    }
+
+    return result;
+}
+
+u8_t* nrc_port_heap_alloc(u32_t size)
+{
+    return (u8_t*)malloc(size);
+}
+void nrc_port_heap_free(void *buf)
+{
+    free(buf);
+}
+
+s32_t nrc_port_file_map(const s8_t *path, const u8_t **data, u32_t *size)
+{
+    s32_t       result = NRC_PORT_RES_INVALID_IN_PARAM;
+    struct stat st;
+    void        *mem;
+    int         fd;
+
+    if ((path != NULL) && (data != NULL) && (size != NULL)) {
+        result = NRC_PORT_RES_NOT_FOUND;
+        *data = NULL;
+        *size = 0;
+
+        fd = open((const char*)path, O_RDONLY);
+
+        if (fd >= 0) {
+            result = NRC_PORT_RES_ERROR;
+
+            if ((fstat(fd, &st) == 0) && (st.st_size > 0) && ((u64_t)st.st_size <= U32_MAX_VALUE)) {
+                mem = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+                if (mem != MAP_FAILED) {
+                    *data = (const u8_t*)mem;
+                    *size = (u32_t)st.st_size;
+                    result = NRC_PORT_RES_OK;
+                }
+            }
+            close(fd);
+        }
+    }
+
+    return result;
+}
+s32_t nrc_port_file_unmap(const u8_t *data, u32_t size)
+{
+    s32_t result = NRC_PORT_RES_OK;
+
+    if (munmap((void*)data, size) != 0) {
+        result = NRC_PORT_RES_ERROR;
+    }
+
+    return result;
+}
+
+u64_t nrc_port_time_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ((u64_t)now.tv_sec * 1000000000ULL) + (u64_t)now.tv_nsec;
+}
+
+static void* posix_thread_fcn(void *arg)
+{
+    struct posix_thread *thread = (struct posix_thread*)arg;
+
+    // Nice is per thread on Linux, a failure leaves it at the creator's
+    if (thread->priority == NRC_PORT_THREAD_PRIO_LOW) {
+        (void)setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), NRC_PORT_LOW_NICE);
+    }
+
+    thread->thread_fcn();
+
+    return NULL;
+}
+
+// Maps the nrc priority onto a policy, real-time only for HIGH and CRITICAL. NORMAL and LOW
+// are the normal scheduler also when the creator runs real-time, workers busy with a flow
+// must not starve the rest of the system. LOW is niced as well, see posix_thread_fcn.
+// Returns FALSE if the creator's policy shall be inherited.
+static bool_t posix_thread_sched(enum nrc_port_thread_prio priority, s32_t *policy, struct sched_param *param)
+{
+    bool_t  explicit_sched = TRUE;
+    s32_t   max_prio;
+    s32_t   min_prio;
+
+    switch (priority) {
+    case NRC_PORT_THREAD_PRIO_CRITICAL:
+        *policy = SCHED_FIFO;
+        max_prio = sched_get_priority_max(SCHED_FIFO);
+        param->sched_priority = max_prio - 1;
+        break;
+    case NRC_PORT_THREAD_PRIO_HIGH:
+        *policy = SCHED_FIFO;
+        max_prio = sched_get_priority_max(SCHED_FIFO);
+        min_prio = sched_get_priority_min(SCHED_FIFO);
+        param->sched_priority = min_prio + (max_prio - min_prio) / 2;
+        break;
+    case NRC_PORT_THREAD_PRIO_NORMAL:
+    case NRC_PORT_THREAD_PRIO_LOW:
+        *policy = SCHED_OTHER;
+        param->sched_priority = 0;
+        break;
+    default:
+        explicit_sched = FALSE;
+        break;
+    }
+
+    return explicit_sched;
+}
+
+s32_t nrc_port_thread_init(
+    enum nrc_port_thread_prio   priority,
+    u32_t                       stack_size,
+    nrc_port_thread_fcn_t       thread_fcn,
+    nrc_port_thread_t           *thread_id)
+{
+    struct posix_thread *thread;
+    s32_t               result = NRC_PORT_RES_OK;
+
+    assert(thread_id != NULL);
+
+    if (stack_size < NRC_PORT_MIN_STACK_SIZE) {
+        stack_size = NRC_PORT_MIN_STACK_SIZE;
+    }
+    if (stack_size < PTHREAD_STACK_MIN) {
+        stack_size = PTHREAD_STACK_MIN;
+    }
+
+    // pthreads cannot be created suspended, so the thread is created in nrc_port_thread_start
+    thread = (struct posix_thread*)malloc(sizeof(struct posix_thread));
+
+    if (thread != NULL) {
+        thread->priority = priority;
+        thread->stack_size = stack_size;
+        thread->thread_fcn = thread_fcn;
+
+        *thread_id = (nrc_port_thread_t)(intptr_t)thread;
+    }
+    else {
+        result = NRC_PORT_RES_ERROR;
+        *thread_id = 0;
+    }
+
+    return result;
+}
+s32_t nrc_port_thread_start(nrc_port_thread_t thread_id)
+{
+    struct posix_thread *thread = (struct posix_thread*)(intptr_t)thread_id;
+    pthread_attr_t      attr;
+    struct sched_param  param;
+    s32_t               policy;
+    s32_t               posix_result = EPERM;
+    s32_t               result = NRC_PORT_RES_OK;
+
+    assert(thread != NULL);
+
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, thread->stack_size);
+
+    if (posix_thread_sched(thread->priority, &policy, &param)) {
+        pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+        pthread_attr_setschedpolicy(&attr, policy);
+        pthread_attr_setschedparam(&attr, &param);
+
+        posix_result = pthread_create(&(thread->handle), &attr, posix_thread_fcn, thread);
+
+        // Real-time policies need privileges, fall back to the normal scheduler
+        if (posix_result == EPERM) {
+            pthread_attr_setinheritsched(&attr, PTHREAD_INHERIT_SCHED);
+        }
+    }
+    if (posix_result == EPERM) {
+        posix_result = pthread_create(&(thread->handle), &attr, posix_thread_fcn, thread);
+    }
+
+    pthread_attr_destroy(&attr);
+
+    // No thread to join, it is freed here
+    if (posix_result != 0) {
+        free(thread);
+        result = NRC_PORT_RES_ERROR;
+    }
+
+    return result;
+}
+
+s32_t nrc_port_thread_join(nrc_port_thread_t thread_id)
+{
+    struct posix_thread *thread = (struct posix_thread*)(intptr_t)thread_id;
+    s32_t               result = NRC_PORT_RES_OK;
+
+    assert(thread != NULL);
+
+    if (pthread_join(thread->handle, NULL) != 0) {
+        result = NRC_PORT_RES_ERROR;
+    }
+    free(thread);
+
+    return result;
+}
+
+/*
+s32_t nrc_port_queue_init(u32_t size, nrc_port_queue_t *queue)
+{
+	return 0;
+}
+s32_t nrc_port_queue_put(nrc_port_queue_t queue, void *item)
+{
+	return 0;
+}
+void* nrc_port_queue_get(nrc_port_queue_t queue, u32_t timeout)
+{
+	return 0;
+}
+*/
+
+s32_t nrc_port_mutex_init(nrc_port_mutex_t *mutex)
+{
+    s32_t               result = NRC_PORT_RES_OK;
+    struct posix_mutex  *m;
+
+    assert(mutex != NULL);
+
+    m = (struct posix_mutex*)malloc(sizeof(struct posix_mutex));
+
+    if (m != NULL) {
+        m->futex = 0;
+        *mutex = (nrc_port_mutex_t)(intptr_t)m;
+    }
+    else {
+        result = NRC_PORT_RES_ERROR;
+        *mutex = 0;
+    }
+
+    return result;
+}
+s32_t nrc_port_mutex_deinit(nrc_port_mutex_t mutex)
+{
+    free((struct posix_mutex*)(intptr_t)mutex);
+
+    return NRC_PORT_RES_OK;
+}
+s32_t nrc_port_mutex_lock(nrc_port_mutex_t mutex, u32_t timeout)
+{
+    struct posix_mutex  *m = (struct posix_mutex*)(intptr_t)mutex;
+    struct timespec     deadline;
+    struct timespec     remaining;
+    u32_t               expected;
+    u32_t               spin;
+    s32_t               result = NRC_PORT_RES_OK;
+
+    assert(m != NULL);
+
+    // Uncontended path, no system call
+    for (spin = 0; spin < NRC_PORT_SPIN_COUNT; spin++) {
+        expected = 0;
+        if (__atomic_compare_exchange_n(&m->futex, &expected, 1, FALSE, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return result;
+        }
+        posix_cpu_relax();
+    }
+
+    if (timeout != 0) {
+        posix_deadline_init(timeout, &deadline);
+    }
+
+    // Mark as contended and sleep until the owner hands over
+    while (__atomic_exchange_n(&m->futex, 2, __ATOMIC_ACQUIRE) != 0) {
+        if (timeout == 0) {
+            posix_futex_wait(&m->futex, 2, NULL);
+        }
+        else if (posix_deadline_remaining(&deadline, &remaining)) {
+            posix_futex_wait(&m->futex, 2, &remaining);
+        }
+        else {
+            result = NRC_PORT_RES_TIMEOUT;
+            break;
+        }
+    }
+
+    return result;
+}
+s32_t nrc_port_mutex_unlock(nrc_port_mutex_t mutex)
+{
+    struct posix_mutex *m = (struct posix_mutex*)(intptr_t)mutex;
+
+    assert(m != NULL);
+
+    if (__atomic_exchange_n(&m->futex, 0, __ATOMIC_RELEASE) == 2) {
+        posix_futex_wake(&m->futex, 1);
+    }
+
+    return NRC_PORT_RES_OK;
+}
+
+s32_t nrc_port_sema_init(u32_t count, nrc_port_sema_t *sema)
+{
+    s32_t               result = NRC_PORT_RES_OK;
+    struct posix_sema   *s;
+
+    assert(sema != NULL);
+
+    s = (struct posix_sema*)malloc(sizeof(struct posix_sema));
+
+    if (s != NULL) {
+        s->count = count;
+        s->waiters = 0;
+        *sema = (nrc_port_sema_t)(intptr_t)s;
+    }
+    else {
+        result = NRC_PORT_RES_ERROR;
+        *sema = 0;
+    }
+
+    return result;
+}
+s32_t nrc_port_sema_deinit(nrc_port_sema_t sema)
+{
+    free((struct posix_sema*)(intptr_t)sema);
+
+    return NRC_PORT_RES_OK;
+}
+s32_t nrc_port_sema_signal(nrc_port_sema_t sema)
+{
+    struct posix_sema *s = (struct posix_sema*)(intptr_t)sema;
+
+    assert(s != NULL);
+
+    __atomic_fetch_add(&s->count, 1, __ATOMIC_SEQ_CST);
+
+    // Only enter the kernel if someone is (about to go) sleeping
+    if (__atomic_load_n(&s->waiters, __ATOMIC_SEQ_CST) != 0) {
+        posix_futex_wake(&s->count, 1);
+    }
+
+    return NRC_PORT_RES_OK;
+}
+
+static bool_t posix_sema_try_take(struct posix_sema *s)
+{
+    u32_t count = __atomic_load_n(&s->count, __ATOMIC_RELAXED);
+
+    while (count != 0) {
+        if (__atomic_compare_exchange_n(&s->count, &count, count - 1, TRUE, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+s32_t nrc_port_sema_wait(nrc_port_sema_t sema, u32_t timeout)
+{
+    struct posix_sema   *s = (struct posix_sema*)(intptr_t)sema;
+    struct timespec     deadline;
+    struct timespec     remaining;
+    u32_t               spin;
+    s32_t               result = NRC_PORT_RES_OK;
+
+    assert(s != NULL);
+
+    for (spin = 0; spin < NRC_PORT_SPIN_COUNT; spin++) {
+        if (posix_sema_try_take(s)) {
+            return result;
+        }
+        posix_cpu_relax();
+    }
+
+    if (timeout != 0) {
+        posix_deadline_init(timeout, &deadline);
+    }
+
+    __atomic_fetch_add(&s->waiters, 1, __ATOMIC_SEQ_CST);
+
+    while (!posix_sema_try_take(s)) {
+        if (timeout == 0) {
+            posix_futex_wait(&s->count, 0, NULL);
+        }
+        else if (posix_deadline_remaining(&deadline, &remaining)) {
+            posix_futex_wait(&s->count, 0, &remaining);
+        }
+        else {
+            result = NRC_PORT_RES_TIMEOUT;
+            break;
+        }
+    }
+
+    __atomic_fetch_sub(&s->waiters, 1, __ATOMIC_SEQ_CST);
+
+    return result;
+}
+
+s32_t nrc_port_irq_disable(void)
+{
+    assert(port.state == NRC_PORT_S_INITIALISED);
+
+    return nrc_port_mutex_lock(port.irq_mutex, 0);
+}
+
+s32_t nrc_port_irq_enable(void)
+{
+    assert(port.state == NRC_PORT_S_INITIALISED);
+
+    return nrc_port_mutex_unlock(port.irq_mutex);
+}
@@ -0,0 +1,527 @@
+/**
+ * Copyright 2017 Tomas Frisberg & Ola Bjorsne
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http ://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Fast heap for short lived objects like messages.
+ *
+ * Memory is reserved once as one region of NRC_PORT_HEAP_FAST_SIZE bytes and
+ * carved into slabs. Each slab serves one size class, is owned by one thread
+ * cache and keeps its own free list and count of blocks in use. A cache
+ * allocates from its current slab per class. Allocations and frees from the
+ * owning thread are plain list operations. A free from another thread is
+ * pushed lock-free onto the owner's remote list, which the owner takes in one
+ * exchange when its current slab runs empty.
+ *
+ * A slab other than a current one that gets all its blocks back is returned
+ * to a global list of free slabs, which any cache takes from for any size
+ * class. Memory freed after a burst in one class so serves the others. A slab
+ * with a single block in use is still held by its class.
+ *
+ * Requests larger than the biggest size class go to malloc but are still
+ * charged against the hard cap.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "nrc_port.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <assert.h>
+
+#define HEAP_SLAB_SIZE      (64 * 1024)
+#define HEAP_SLAB_HDR_SIZE  (64)
+#define HEAP_GRANULE        (16)
+#define HEAP_MAX_CLASS_SIZE (16 * 1024)
+#define HEAP_LARGE_HDR_SIZE (16)
+
+static const u32_t heap_class_size[] = {
+    16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024,
+    1536, 2048, 3072, 4096, 6144, 8192, 12288, 16384
+};
+
+#define HEAP_CLASSES        (sizeof(heap_class_size) / sizeof(heap_class_size[0]))
+
+struct heap_block {
+    struct heap_block       *next;
+};
+
+// Counters are only written by the owning thread, read by anyone
+struct heap_counters {
+    u64_t                   alloc_count;
+    u64_t                   free_count;
+    u64_t                   alloc_bytes;
+    u64_t                   free_bytes;
+    u64_t                   failed_count;
+};
+
+struct heap_slab;
+
+struct heap_cache {
+    struct heap_cache       *all_next;                  // List of all caches, never unlinked
+    struct heap_cache       *orphan_next;               // List of caches whose thread has exited
+
+    struct heap_slab        *current[HEAP_CLASSES];     // Owner only, allocated from
+    struct heap_slab        *partial[HEAP_CLASSES];     // Owner only, other slabs with free blocks
+    struct heap_block       *remote[HEAP_CLASSES];      // Pushed by other threads
+
+    struct heap_counters    counters[HEAP_CLASSES + 1]; // Last entry counts large allocations
+};
+
+// At the start of each slab, written by the owner only
+struct heap_slab {
+    struct heap_cache       *owner;
+    struct heap_slab        *next;          // In the owner's partial list or the free slab list
+    struct heap_slab        *prev;
+    struct heap_block       *free;
+    u8_t                    *bump;          // Uncarved part
+    u32_t                   size_class;
+    u32_t                   used;           // Blocks not freed back to the owner, remote ones included
+    bool_t                  partial;        // In the owner's partial list
+};
+
+struct heap {
+    pthread_once_t          once;
+    pthread_key_t           key;
+    pthread_mutex_t         orphan_mutex;
+    pthread_mutex_t         slab_mutex;
+
+    u8_t                    *region;
+    u8_t                    *region_end;
+    u64_t                   region_used;    // Atomic, bytes of region carved into slabs
+    u64_t                   committed;      // Atomic, slabs owned by caches plus large allocations
+
+    struct heap_slab        *free_slabs;    // Protected by slab_mutex
+
+    struct heap_cache       *all_caches;    // Atomic
+    struct heap_cache       *orphans;       // Protected by orphan_mutex
+
+    u8_t                    class_index[(HEAP_MAX_CLASS_SIZE / HEAP_GRANULE) + 1];
+};
+
+static struct heap heap = { PTHREAD_ONCE_INIT };
+
+static __thread struct heap_cache *heap_tls_cache;
+
+static void heap_counter_add(u64_t *counter, u64_t value)
+{
+    __atomic_store_n(counter, *counter + value, __ATOMIC_RELAXED);
+}
+
+static void heap_thread_exit(void *arg)
+{
+    struct heap_cache *cache = (struct heap_cache*)arg;
+
+    heap_tls_cache = 0;
+
+    // The cache keeps its slabs and is handed to the next new thread
+    pthread_mutex_lock(&heap.orphan_mutex);
+    cache->orphan_next = heap.orphans;
+    heap.orphans = cache;
+    pthread_mutex_unlock(&heap.orphan_mutex);
+}
+
+static void heap_init(void)
+{
+    u32_t   size_class = 0;
+    u32_t   granule;
+    size_t  reserve = (size_t)NRC_PORT_HEAP_FAST_SIZE + HEAP_SLAB_SIZE;
+    void    *mem;
+
+    for (granule = 0; granule <= HEAP_MAX_CLASS_SIZE / HEAP_GRANULE; granule++) {
+        while (heap_class_size[size_class] < granule * HEAP_GRANULE) {
+            size_class++;
+        }
+        heap.class_index[granule] = (u8_t)size_class;
+    }
+
+    assert(sizeof(struct heap_slab) <= HEAP_SLAB_HDR_SIZE);
+
+    pthread_key_create(&heap.key, heap_thread_exit);
+    pthread_mutex_init(&heap.orphan_mutex, NULL);
+    pthread_mutex_init(&heap.slab_mutex, NULL);
+
+    // Reserve address space only, pages are committed on first touch
+    mem = mmap(NULL, reserve, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+    if (mem != MAP_FAILED) {
+        uintptr_t aligned = ((uintptr_t)mem + HEAP_SLAB_SIZE - 1) & ~((uintptr_t)HEAP_SLAB_SIZE - 1);
+
+        heap.region = (u8_t*)aligned;
+        heap.region_end = heap.region + NRC_PORT_HEAP_FAST_SIZE;
+    }
+}
+
+static struct heap_cache* heap_cache_get(void)
+{
+    struct heap_cache *cache;
+
+    pthread_once(&heap.once, heap_init);
+
+    pthread_mutex_lock(&heap.orphan_mutex);
+    cache = heap.orphans;
+    if (cache != 0) {
+        heap.orphans = cache->orphan_next;
+    }
+    pthread_mutex_unlock(&heap.orphan_mutex);
+
+    if (cache == 0) {
+        cache = (struct heap_cache*)calloc(1, sizeof(struct heap_cache));
+
+        if (cache != 0) {
+            struct heap_cache *head = __atomic_load_n(&heap.all_caches, __ATOMIC_RELAXED);
+
+            do {
+                cache->all_next = head;
+            } while (!__atomic_compare_exchange_n(&heap.all_caches, &head, cache, TRUE, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+        }
+    }
+
+    if (cache != 0) {
+        pthread_setspecific(heap.key, cache);
+        heap_tls_cache = cache;
+    }
+
+    return cache;
+}
+
+static bool_t heap_commit(u64_t size)
+{
+    u64_t committed = __atomic_load_n(&heap.committed, __ATOMIC_RELAXED);
+
+    do {
+        if (committed + size > (u64_t)NRC_PORT_HEAP_FAST_SIZE) {
+            return FALSE;
+        }
+    } while (!__atomic_compare_exchange_n(&heap.committed, &committed, committed + size, TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    return TRUE;
+}
+
+#define heap_slab_of(block)     ((struct heap_slab*)((uintptr_t)(block) & ~((uintptr_t)HEAP_SLAB_SIZE - 1)))
+
+// A free slab, or a new one from the region, for size_class of cache
+static struct heap_slab* heap_slab_get(struct heap_cache *cache, u32_t size_class)
+{
+    struct heap_slab    *slab;
+    u64_t               offset;
+
+    if ((heap.region == 0) || !heap_commit(HEAP_SLAB_SIZE)) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&heap.slab_mutex);
+    slab = heap.free_slabs;
+    if (slab != 0) {
+        heap.free_slabs = slab->next;
+    }
+    pthread_mutex_unlock(&heap.slab_mutex);
+
+    // Slabs in use are all committed, so the region has room when none is free
+    if (slab == 0) {
+        offset = __atomic_fetch_add(&heap.region_used, HEAP_SLAB_SIZE, __ATOMIC_RELAXED);
+        assert(heap.region + offset + HEAP_SLAB_SIZE <= heap.region_end);
+
+        slab = (struct heap_slab*)(heap.region + offset);
+    }
+
+    slab->owner = cache;
+    slab->next = 0;
+    slab->prev = 0;
+    slab->free = 0;
+    slab->bump = (u8_t*)slab + HEAP_SLAB_HDR_SIZE;
+    slab->size_class = size_class;
+    slab->used = 0;
+    slab->partial = FALSE;
+
+    return slab;
+}
+
+static void heap_slab_release(struct heap_slab *slab)
+{
+    slab->owner = 0;
+
+    pthread_mutex_lock(&heap.slab_mutex);
+    slab->next = heap.free_slabs;
+    heap.free_slabs = slab;
+    pthread_mutex_unlock(&heap.slab_mutex);
+
+    // Uncommitted once listed, see heap_slab_get
+    __atomic_fetch_sub(&heap.committed, HEAP_SLAB_SIZE, __ATOMIC_RELAXED);
+}
+
+static void heap_partial_unlink(struct heap_cache *cache, struct heap_slab *slab)
+{
+    if (slab->prev != 0) {
+        slab->prev->next = slab->next;
+    }
+    else {
+        cache->partial[slab->size_class] = slab->next;
+    }
+    if (slab->next != 0) {
+        slab->next->prev = slab->prev;
+    }
+    slab->partial = FALSE;
+}
+
+// Block back to its slab, owner only
+static void heap_slab_put(struct heap_cache *cache, struct heap_slab *slab, struct heap_block *block)
+{
+    u32_t size_class = slab->size_class;
+
+    block->next = slab->free;
+    slab->free = block;
+    slab->used--;
+
+    if (slab != cache->current[size_class]) {
+        if (slab->used == 0) {
+            if (slab->partial) {
+                heap_partial_unlink(cache, slab);
+            }
+            heap_slab_release(slab);
+        }
+        else if (!slab->partial) {
+            slab->next = cache->partial[size_class];
+            slab->prev = 0;
+            if (slab->next != 0) {
+                slab->next->prev = slab;
+            }
+            cache->partial[size_class] = slab;
+            slab->partial = TRUE;
+        }
+    }
+}
+
+static struct heap_block* heap_refill(struct heap_cache *cache, u32_t size_class)
+{
+    struct heap_slab    *slab;
+    struct heap_block   *block;
+    struct heap_block   *next;
+    u32_t               size = heap_class_size[size_class];
+
+    // Blocks freed by other threads go back to their slabs first
+    block = __atomic_exchange_n(&cache->remote[size_class], 0, __ATOMIC_ACQUIRE);
+
+    while (block != 0) {
+        next = block->next;
+        heap_slab_put(cache, heap_slab_of(block), block);
+        block = next;
+    }
+
+    slab = cache->current[size_class];
+
+    // A full current slab joins no list until one of its blocks is freed
+    if ((slab == 0) || ((slab->free == 0) && (slab->bump + size > (u8_t*)slab + HEAP_SLAB_SIZE))) {
+        slab = cache->partial[size_class];
+
+        if (slab != 0) {
+            heap_partial_unlink(cache, slab);
+        }
+        else {
+            slab = heap_slab_get(cache, size_class);
+        }
+        cache->current[size_class] = slab;
+    }
+
+    if (slab == 0) {
+        return 0;
+    }
+
+    block = slab->free;
+
+    if (block != 0) {
+        slab->free = block->next;
+    }
+    else {
+        block = (struct heap_block*)slab->bump;
+        slab->bump += size;
+    }
+    slab->used++;
+
+    return block;
+}
+
+static u8_t* heap_large_alloc(struct heap_cache *cache, u32_t size)
+{
+    u64_t   total = (u64_t)size + HEAP_LARGE_HDR_SIZE;
+    u8_t    *buf = 0;
+
+    if (heap_commit(total)) {
+        buf = (u8_t*)malloc((size_t)total);
+
+        if (buf != 0) {
+            *(u64_t*)buf = total;
+            buf += HEAP_LARGE_HDR_SIZE;
+        }
+        else {
+            __atomic_fetch_sub(&heap.committed, total, __ATOMIC_RELAXED);
+        }
+    }
+
+    if (cache != 0) {
+        struct heap_counters *counters = &cache->counters[HEAP_CLASSES];
+
+        if (buf != 0) {
+            heap_counter_add(&counters->alloc_count, 1);
+            heap_counter_add(&counters->alloc_bytes, size);
+        }
+        else {
+            heap_counter_add(&counters->failed_count, 1);
+        }
+    }
+
+    return buf;
+}
+
+static void heap_large_free(struct heap_cache *cache, u8_t *buf)
+{
+    u64_t total;
+
+    buf -= HEAP_LARGE_HDR_SIZE;
+    total = *(u64_t*)buf;
+
+    free(buf);
+
+    __atomic_fetch_sub(&heap.committed, total, __ATOMIC_RELAXED);
+
+    if (cache != 0) {
+        heap_counter_add(&cache->counters[HEAP_CLASSES].free_count, 1);
+        heap_counter_add(&cache->counters[HEAP_CLASSES].free_bytes, total - HEAP_LARGE_HDR_SIZE);
+    }
+}
+
+u8_t* nrc_port_heap_fast_alloc(u32_t size)
+{
+    struct heap_cache   *cache = heap_tls_cache;
+    struct heap_slab    *slab;
+    struct heap_block   *block;
+    u32_t               size_class;
+
+    if (cache == 0) {
+        cache = heap_cache_get();
+    }
+
+    if (size > HEAP_MAX_CLASS_SIZE) {
+        return heap_large_alloc(cache, size);
+    }
+    if (cache == 0) {
+        return 0;
+    }
+
+    size_class = heap.class_index[(size + HEAP_GRANULE - 1) / HEAP_GRANULE];
+    slab = cache->current[size_class];
+    block = (slab != 0) ? slab->free : 0;
+
+    if (block != 0) {
+        slab->free = block->next;
+        slab->used++;
+    }
+    else {
+        block = heap_refill(cache, size_class);
+    }
+
+    if (block != 0) {
+        heap_counter_add(&cache->counters[size_class].alloc_count, 1);
+        heap_counter_add(&cache->counters[size_class].alloc_bytes, heap_class_size[size_class]);
+    }
+    else {
+        heap_counter_add(&cache->counters[size_class].failed_count, 1);
+    }
+
+    return (u8_t*)block;
+}
+
+void nrc_port_heap_fast_free(void *buf)
+{
+    struct heap_cache   *cache = heap_tls_cache;
+    struct heap_block   *block = (struct heap_block*)buf;
+    struct heap_slab    *slab;
+    u32_t               size_class;
+
+    if (buf == 0) {
+        return;
+    }
+    if (cache == 0) {
+        cache = heap_cache_get();
+    }
+
+    if (((u8_t*)buf < heap.region) || ((u8_t*)buf >= heap.region_end)) {
+        heap_large_free(cache, (u8_t*)buf);
+        return;
+    }
+
+    slab = heap_slab_of(buf);
+    size_class = slab->size_class;
+
+    if (slab->owner == cache) {
+        heap_slab_put(cache, slab, block);
+    }
+    else {
+        struct heap_block **remote = &(slab->owner->remote[size_class]);
+        struct heap_block *head = __atomic_load_n(remote, __ATOMIC_RELAXED);
+
+        do {
+            block->next = head;
+        } while (!__atomic_compare_exchange_n(remote, &head, block, TRUE, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    }
+
+    if (cache != 0) {
+        heap_counter_add(&cache->counters[size_class].free_count, 1);
+        heap_counter_add(&cache->counters[size_class].free_bytes, heap_class_size[size_class]);
+    }
+}
+
+s32_t nrc_port_heap_fast_stats(u32_t size_class, struct nrc_port_heap_stats *stats)
+{
+    s32_t               result = NRC_PORT_RES_INVALID_IN_PARAM;
+    struct heap_cache   *cache;
+
+    if ((stats != 0) && (size_class <= HEAP_CLASSES)) {
+        u64_t alloc_bytes = 0;
+        u64_t free_bytes = 0;
+
+        memset(stats, 0, sizeof(struct nrc_port_heap_stats));
+        stats->block_size = (size_class < HEAP_CLASSES) ? heap_class_size[size_class] : 0;
+
+        cache = __atomic_load_n(&heap.all_caches, __ATOMIC_ACQUIRE);
+
+        while (cache != 0) {
+            struct heap_counters *counters = &cache->counters[size_class];
+
+            stats->alloc_count += __atomic_load_n(&counters->alloc_count, __ATOMIC_RELAXED);
+            stats->free_count += __atomic_load_n(&counters->free_count, __ATOMIC_RELAXED);
+            stats->failed_count += __atomic_load_n(&counters->failed_count, __ATOMIC_RELAXED);
+            alloc_bytes += __atomic_load_n(&counters->alloc_bytes, __ATOMIC_RELAXED);
+            free_bytes += __atomic_load_n(&counters->free_bytes, __ATOMIC_RELAXED);
+
+            cache = cache->all_next;
+        }
+
+        // Counters of different threads are read at slightly different times
+        stats->in_use_bytes = (alloc_bytes > free_bytes) ? (alloc_bytes - free_bytes) : 0;
+
+        result = NRC_PORT_RES_OK;
+    }
+    else if (stats != 0) {
+        result = NRC_PORT_RES_NOT_FOUND;
+    }
+
+    return result;
+}
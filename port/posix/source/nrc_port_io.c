@@ -0,0 +1,541 @@
+/**
+ * Copyright 2017 Tomas Frisberg & Ola Bjorsne
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http ://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * I/O reactor.
+ *
+ * Registrations are slots in a fixed table. A handle is the slot and the slot's
+ * generation, which remove bumps, so an event taken from the kernel just before
+ * a remove, or a handle kept after it, finds no registration. The reactor thread
+ * holds the table lock while it calls fcn for a batch of events.
+ *
+ * With epoll every fd is added edge-triggered and the kernel keeps the state,
+ * again has nothing to do. The poll stand-in keeps the edge itself: a reported
+ * bit is left out of the poll set until again, and the reactor is woken through
+ * a pipe to build a new set. Error and hangup report all interest, as with
+ * epoll, and an fd closed while registered is reported once and then left out.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "nrc_port.h"
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <assert.h>
+
+#if defined(__linux__) && !defined(NRC_PORT_IO_POLL)
+#define IO_EPOLL
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#define IO_CTL_ADD          EPOLL_CTL_ADD
+#define IO_CTL_MOD          EPOLL_CTL_MOD
+#define IO_CTL_DEL          EPOLL_CTL_DEL
+#else
+#include <poll.h>
+#define IO_CTL_ADD          (1)
+#define IO_CTL_MOD          (2)
+#define IO_CTL_DEL          (3)
+#endif
+
+#define IO_BATCH            (64)    // Events taken per epoll_wait
+#define IO_GEN_SHIFT        (16)
+#define IO_SLOT_MASK        ((1U << IO_GEN_SHIFT) - 1)
+#define IO_ALL              (NRC_PORT_IO_IN | NRC_PORT_IO_OUT)
+
+#if (NRC_PORT_IO_MAX >= IO_SLOT_MASK)
+#error "NRC_PORT_IO_MAX does not fit in a handle"
+#endif
+
+struct io_entry {
+    s32_t               fd;         // -1 when free
+    u32_t               gen;
+    u32_t               interest;
+    u32_t               armed;      // Interest not reported since the last again, poll only
+    bool_t              closed;     // Fd closed while registered, out of the poll set until removed, poll only
+    nrc_port_io_fcn_t   fcn;
+    void                *context;
+    u32_t               free_next;  // Slot + 1, 0 ends the list
+};
+
+struct io_reactor {
+    pthread_once_t      once;
+    s32_t               result;     // Of the first use, the reactor is not retried
+    nrc_port_mutex_t    lock;
+    nrc_port_thread_t   thread;
+    bool_t              running;    // Thread started by an add, until nrc_port_io_stop
+    volatile u32_t      stop;
+    u32_t               free_head;
+    u32_t               used;       // Slots ever taken, the rest are unused
+    struct io_entry     entry[NRC_PORT_IO_MAX];
+#ifdef IO_EPOLL
+    s32_t               epoll_fd;
+    s32_t               wake_fd;    // Eventfd in the epoll set as handle 0, for nrc_port_io_stop
+#else
+    s32_t               wake_fd[2];
+    struct pollfd       fds[NRC_PORT_IO_MAX + 1];
+    nrc_port_io_t       fds_io[NRC_PORT_IO_MAX + 1];
+#endif
+};
+
+static struct io_reactor reactor = { PTHREAD_ONCE_INIT, NRC_PORT_RES_ERROR };
+
+static nrc_port_io_t io_handle(u32_t slot)
+{
+    return ((reactor.entry[slot].gen & IO_SLOT_MASK) << IO_GEN_SHIFT) | (slot + 1);
+}
+
+// Registration of a handle, 0 if it was removed. Table lock held.
+static struct io_entry* io_lookup(nrc_port_io_t io)
+{
+    struct io_entry *entry = NULL;
+    u32_t           slot = (io & IO_SLOT_MASK) - 1;
+
+    if ((slot < reactor.used) && (reactor.entry[slot].fd >= 0) && (io_handle(slot) == io)) {
+        entry = &reactor.entry[slot];
+    }
+
+    return entry;
+}
+
+#ifdef IO_EPOLL
+
+static u32_t io_ready(u32_t interest, u32_t events)
+{
+    u32_t ready = 0;
+
+    if ((events & (EPOLLIN | EPOLLRDHUP | EPOLLPRI)) != 0) {
+        ready |= NRC_PORT_IO_IN;
+    }
+    if ((events & EPOLLOUT) != 0) {
+        ready |= NRC_PORT_IO_OUT;
+    }
+    if ((events & (EPOLLERR | EPOLLHUP)) != 0) {
+        ready |= IO_ALL;
+    }
+
+    return ready & interest;
+}
+
+static s32_t io_ctl(s32_t op, struct io_entry *entry, nrc_port_io_t io)
+{
+    struct epoll_event  event;
+    s32_t               result = NRC_PORT_RES_OK;
+
+    event.events = EPOLLET | EPOLLRDHUP;
+    event.data.u64 = io;
+
+    if ((entry->interest & NRC_PORT_IO_IN) != 0) {
+        event.events |= EPOLLIN;
+    }
+    if ((entry->interest & NRC_PORT_IO_OUT) != 0) {
+        event.events |= EPOLLOUT;
+    }
+
+    if (epoll_ctl(reactor.epoll_fd, op, entry->fd, &event) != 0) {
+        result = NRC_PORT_RES_ERROR;
+    }
+
+    return result;
+}
+
+static void io_thread_fcn(void)
+{
+    struct epoll_event  events[IO_BATCH];
+    struct io_entry     *entry;
+    s32_t               count;
+    s32_t               i;
+    u32_t               ready;
+
+    while (nrc_port_atomic_load(&reactor.stop) == 0) {
+        count = epoll_wait(reactor.epoll_fd, events, IO_BATCH, -1);
+
+        if (count > 0) {
+            nrc_port_mutex_lock(reactor.lock, 0);
+            for (i = 0; i < count; i++) {
+                // Handle 0 is the wake up, found by no lookup
+                entry = io_lookup((nrc_port_io_t)events[i].data.u64);
+
+                if (entry != NULL) {
+                    ready = io_ready(entry->interest, events[i].events);
+                    if (ready != 0) {
+                        entry->fcn(entry->context, ready);
+                    }
+                }
+            }
+            nrc_port_mutex_unlock(reactor.lock);
+        }
+    }
+}
+
+// Level-triggered, reported until read by the stopping thread
+static void io_wake(void)
+{
+    u64_t   one = 1;
+    ssize_t written;
+
+    written = write(reactor.wake_fd, &one, sizeof(one));
+    (void)written;
+}
+
+static void io_wake_drain(void)
+{
+    u64_t   count;
+    ssize_t got;
+
+    got = read(reactor.wake_fd, &count, sizeof(count));
+    (void)got;
+}
+
+static s32_t io_backend_init(void)
+{
+    struct epoll_event  event;
+    s32_t               result = NRC_PORT_RES_ERROR;
+
+    reactor.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    reactor.wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    event.events = EPOLLIN;
+    event.data.u64 = 0;
+
+    if ((reactor.epoll_fd >= 0) && (reactor.wake_fd >= 0) &&
+        (epoll_ctl(reactor.epoll_fd, EPOLL_CTL_ADD, reactor.wake_fd, &event) == 0)) {
+        result = NRC_PORT_RES_OK;
+    }
+
+    return result;
+}
+
+#else
+
+// Error, hangup and a closed fd are reported for all interest, also bits not armed
+static u32_t io_ready(const struct io_entry *entry, u32_t events)
+{
+    u32_t ready = 0;
+
+    if ((events & (POLLIN | POLLPRI)) != 0) {
+        ready |= NRC_PORT_IO_IN;
+    }
+    if ((events & POLLOUT) != 0) {
+        ready |= NRC_PORT_IO_OUT;
+    }
+    ready &= entry->armed;
+
+    if ((events & (POLLERR | POLLHUP | POLLNVAL)) != 0) {
+        ready |= entry->interest;
+    }
+
+    return ready;
+}
+
+// The reactor builds a new poll set, one byte in the pipe is enough
+static void io_wake(void)
+{
+    u8_t    byte = 0;
+    ssize_t written;
+
+    written = write(reactor.wake_fd[1], &byte, 1);
+    (void)written;
+}
+
+static s32_t io_ctl(s32_t op, struct io_entry *entry, nrc_port_io_t io)
+{
+    if (op == IO_CTL_ADD) {
+        entry->closed = FALSE;
+    }
+    entry->armed = entry->closed ? 0 : entry->interest;
+    io_wake();
+
+    return NRC_PORT_RES_OK;
+}
+
+static void io_thread_fcn(void)
+{
+    struct io_entry *entry;
+    u8_t            drain[64];
+    u32_t           count;
+    u32_t           slot;
+    u32_t           i;
+    u32_t           ready;
+
+    while (nrc_port_atomic_load(&reactor.stop) == 0) {
+        reactor.fds[0].fd = reactor.wake_fd[0];
+        reactor.fds[0].events = POLLIN;
+        count = 1;
+
+        nrc_port_mutex_lock(reactor.lock, 0);
+        for (slot = 0; slot < reactor.used; slot++) {
+            entry = &reactor.entry[slot];
+
+            if ((entry->fd >= 0) && (entry->armed != 0)) {
+                reactor.fds[count].fd = entry->fd;
+                reactor.fds[count].events = (((entry->armed & NRC_PORT_IO_IN) != 0) ? POLLIN : 0) |
+                                            (((entry->armed & NRC_PORT_IO_OUT) != 0) ? POLLOUT : 0);
+                reactor.fds_io[count] = io_handle(slot);
+                count++;
+            }
+        }
+        nrc_port_mutex_unlock(reactor.lock);
+
+        if (poll(reactor.fds, count, -1) > 0) {
+            if (reactor.fds[0].revents != 0) {
+                while (read(reactor.wake_fd[0], drain, sizeof(drain)) > 0) {
+                }
+            }
+
+            nrc_port_mutex_lock(reactor.lock, 0);
+            for (i = 1; i < count; i++) {
+                entry = (reactor.fds[i].revents != 0) ? io_lookup(reactor.fds_io[i]) : NULL;
+
+                if (entry != NULL) {
+                    ready = io_ready(entry, reactor.fds[i].revents);
+
+                    // poll gives POLLNVAL at once for as long as the fd is in the set
+                    if ((reactor.fds[i].revents & POLLNVAL) != 0) {
+                        entry->closed = TRUE;
+                        entry->armed = 0;
+                    }
+                    if (ready != 0) {
+                        entry->armed &= ~ready;
+                        entry->fcn(entry->context, ready);
+                    }
+                }
+            }
+            nrc_port_mutex_unlock(reactor.lock);
+        }
+    }
+}
+
+static void io_wake_drain(void)
+{
+    u8_t drain[64];
+
+    while (read(reactor.wake_fd[0], drain, sizeof(drain)) > 0) {
+    }
+}
+
+static s32_t io_backend_init(void)
+{
+    s32_t result = NRC_PORT_RES_ERROR;
+
+    if (pipe(reactor.wake_fd) == 0) {
+        fcntl(reactor.wake_fd[0], F_SETFL, O_NONBLOCK);
+        fcntl(reactor.wake_fd[1], F_SETFL, O_NONBLOCK);
+        fcntl(reactor.wake_fd[0], F_SETFD, FD_CLOEXEC);
+        fcntl(reactor.wake_fd[1], F_SETFD, FD_CLOEXEC);
+        result = NRC_PORT_RES_OK;
+    }
+
+    return result;
+}
+
+#endif
+
+static void io_init(void)
+{
+    s32_t result;
+
+    result = nrc_port_mutex_init(&reactor.lock);
+
+    if (result == NRC_PORT_RES_OK) {
+        result = io_backend_init();
+    }
+
+    reactor.result = result;
+}
+
+// Starts the thread unless it runs, table lock held
+static s32_t io_run(void)
+{
+    s32_t result = NRC_PORT_RES_OK;
+
+    if (reactor.running == FALSE) {
+        result = nrc_port_thread_init(NRC_PORT_THREAD_PRIO_HIGH, 0, io_thread_fcn, &reactor.thread);
+
+        if (result == NRC_PORT_RES_OK) {
+            result = nrc_port_thread_start(reactor.thread);
+        }
+        reactor.running = (result == NRC_PORT_RES_OK);
+    }
+
+    return result;
+}
+
+s32_t nrc_port_io_add(s32_t fd, u32_t interest, nrc_port_io_fcn_t fcn, void *context, nrc_port_io_t *io)
+{
+    s32_t           result = NRC_PORT_RES_INVALID_IN_PARAM;
+    struct io_entry *entry;
+    u32_t           slot;
+
+    if ((fd < 0) || ((interest & ~IO_ALL) != 0) || (fcn == NULL) || (io == NULL)) {
+        return result;
+    }
+
+    pthread_once(&reactor.once, io_init);
+    result = reactor.result;
+
+    if (result == NRC_PORT_RES_OK) {
+        nrc_port_mutex_lock(reactor.lock, 0);
+
+        result = io_run();
+
+        if (result != NRC_PORT_RES_OK) {
+            slot = NRC_PORT_IO_MAX;
+        }
+        else if (reactor.free_head != 0) {
+            slot = reactor.free_head - 1;
+            reactor.free_head = reactor.entry[slot].free_next;
+        }
+        else if (reactor.used < NRC_PORT_IO_MAX) {
+            slot = reactor.used++;
+        }
+        else {
+            slot = NRC_PORT_IO_MAX;
+            result = NRC_PORT_RES_ERROR;
+        }
+
+        if (slot < NRC_PORT_IO_MAX) {
+            entry = &reactor.entry[slot];
+            entry->fd = fd;
+            entry->interest = interest;
+            entry->fcn = fcn;
+            entry->context = context;
+            *io = io_handle(slot);
+
+            result = io_ctl(IO_CTL_ADD, entry, *io);
+
+            if (result != NRC_PORT_RES_OK) {
+                entry->fd = -1;
+                entry->gen++;
+                entry->free_next = reactor.free_head;
+                reactor.free_head = slot + 1;
+                *io = 0;
+            }
+        }
+
+        nrc_port_mutex_unlock(reactor.lock);
+    }
+
+    return result;
+}
+
+s32_t nrc_port_io_modify(nrc_port_io_t io, u32_t interest)
+{
+    s32_t           result = NRC_PORT_RES_INVALID_IN_PARAM;
+    struct io_entry *entry;
+
+    if (((interest & ~IO_ALL) == 0) && (reactor.result == NRC_PORT_RES_OK)) {
+        result = NRC_PORT_RES_NOT_FOUND;
+
+        nrc_port_mutex_lock(reactor.lock, 0);
+        entry = io_lookup(io);
+        if (entry != NULL) {
+            entry->interest = interest;
+            result = io_ctl(IO_CTL_MOD, entry, io);
+        }
+        nrc_port_mutex_unlock(reactor.lock);
+    }
+
+    return result;
+}
+
+s32_t nrc_port_io_again(nrc_port_io_t io, u32_t ready)
+{
+#ifdef IO_EPOLL
+    // The kernel reports the next edge by itself
+    return ((ready & ~IO_ALL) == 0) ? NRC_PORT_RES_OK : NRC_PORT_RES_INVALID_IN_PARAM;
+#else
+    s32_t           result = NRC_PORT_RES_INVALID_IN_PARAM;
+    struct io_entry *entry;
+
+    if (((ready & ~IO_ALL) == 0) && (reactor.result == NRC_PORT_RES_OK)) {
+        result = NRC_PORT_RES_NOT_FOUND;
+
+        nrc_port_mutex_lock(reactor.lock, 0);
+        entry = io_lookup(io);
+        if (entry != NULL) {
+            if (entry->closed == FALSE) {
+                entry->armed |= ready & entry->interest;
+            }
+            result = NRC_PORT_RES_OK;
+        }
+        nrc_port_mutex_unlock(reactor.lock);
+
+        if (result == NRC_PORT_RES_OK) {
+            io_wake();
+        }
+    }
+
+    return result;
+#endif
+}
+
+s32_t nrc_port_io_remove(nrc_port_io_t io)
+{
+    s32_t           result = NRC_PORT_RES_NOT_FOUND;
+    struct io_entry *entry;
+    u32_t           slot;
+
+    if (reactor.result == NRC_PORT_RES_OK) {
+        nrc_port_mutex_lock(reactor.lock, 0);
+        entry = io_lookup(io);
+        if (entry != NULL) {
+            // A closed fd has already left the epoll set
+            (void)io_ctl(IO_CTL_DEL, entry, io);
+
+            slot = (u32_t)(entry - reactor.entry);
+            entry->fd = -1;
+            entry->gen++;
+            entry->free_next = reactor.free_head;
+            reactor.free_head = slot + 1;
+            result = NRC_PORT_RES_OK;
+        }
+        nrc_port_mutex_unlock(reactor.lock);
+    }
+
+    return result;
+}
+
+s32_t nrc_port_io_stop(void)
+{
+    bool_t running = FALSE;
+
+    if (reactor.result == NRC_PORT_RES_OK) {
+        nrc_port_mutex_lock(reactor.lock, 0);
+        running = reactor.running;
+        nrc_port_mutex_unlock(reactor.lock);
+    }
+
+    // The thread takes the lock for its events, it is not held while waiting for it
+    if (running) {
+        nrc_port_atomic_store(&reactor.stop, 1);
+        io_wake();
+        nrc_port_thread_join(reactor.thread);
+
+        io_wake_drain();
+        nrc_port_atomic_store(&reactor.stop, 0);
+
+        nrc_port_mutex_lock(reactor.lock, 0);
+        reactor.running = FALSE;
+        nrc_port_mutex_unlock(reactor.lock);
+    }
+
+    return NRC_PORT_RES_OK;
+}
@@ -19,6 +19,7 @@
 #define _NRC_PORT_H_
 
 #include "nrc_types.h"
+#include <intrin.h>
 
 #define NRC_PORT_RES_OK                 (0)
 #define NRC_PORT_RES_ERROR              (-1)
@@ -26,6 +27,7 @@
 #define NRC_PORT_RES_NOT_SUPPORTED      (-3)
 #define NRC_PORT_RES_INVALID_IN_PARAM   (-4)
 #define NRC_PORT_RES_NOT_FOUND          (-5)
+#define NRC_PORT_RES_BUSY               (-6)
 
 #ifdef __cplusplus
 extern "C" {
@@ -40,6 +42,8 @@ enum nrc_port_thread_prio {
 
 typedef void(*nrc_port_thread_fcn_t)(void);
 
+#define NRC_PORT_THREAD_LOCAL __declspec(thread)
+
 #ifdef _LONG_HANDLES_
 typedef s64_t nrc_port_thread_t;
 typedef s64_t nrc_port_sema_t;
@@ -61,6 +65,39 @@ void nrc_port_heap_free(void *buf);
 u8_t* nrc_port_heap_fast_alloc(u32_t size);
 void nrc_port_heap_fast_free(void *buf);
 
+struct nrc_port_heap_stats {
+    u32_t   block_size;     // 0 for allocations larger than the biggest size class
+    u64_t   alloc_count;
+    u64_t   free_count;
+    u64_t   in_use_bytes;
+    u64_t   failed_count;
+};
+
+// Counters for one fast heap size class. NRC_PORT_RES_NOT_FOUND when size_class is past the last one.
+s32_t nrc_port_heap_fast_stats(u32_t size_class, struct nrc_port_heap_stats *stats);
+
+/**
+ * File mapping
+ *
+ * Maps a whole file read-only into memory
+ */
+s32_t nrc_port_file_map(const s8_t *path, const u8_t **data, u32_t *size);
+s32_t nrc_port_file_unmap(const u8_t *data, u32_t size);
+
+/**
+ * Time
+ *
+ * Monotonic clock in nanoseconds from an arbitrary start, cheap enough to read per dispatch
+ */
+u64_t nrc_port_time_ns(void);
+
+// Free running counter at a constant but unspecified rate, the cheapest time source.
+// Scale against nrc_port_time_ns over an interval.
+static __inline u64_t nrc_port_ticks(void)
+{
+    return __rdtsc();
+}
+
 /**
  * Thread
  */
@@ -70,8 +107,12 @@ s32_t nrc_port_thread_init(
     nrc_port_thread_fcn_t       thread_fcn,
     nrc_port_thread_t           *thread_id);
 
+// A thread whose start fails is freed, there is nothing to join
 s32_t nrc_port_thread_start(nrc_port_thread_t thread_id);
 
+// Waits for a started thread's fcn to return and frees the thread
+s32_t nrc_port_thread_join(nrc_port_thread_t thread_id);
+
 /**
  * Queue
  */
@@ -88,6 +129,7 @@ void* nrc_port_queue_get(nrc_port_queue_t queue, u32_t timeout);
  * Mutex
  */
 s32_t nrc_port_mutex_init(nrc_port_mutex_t *mutex);
+s32_t nrc_port_mutex_deinit(nrc_port_mutex_t mutex);
 s32_t nrc_port_mutex_lock(nrc_port_mutex_t mutex, u32_t timeout);
 s32_t nrc_port_mutex_unlock(nrc_port_mutex_t mutex);
 
@@ -95,9 +137,126 @@ s32_t nrc_port_mutex_unlock(nrc_port_mutex_t mutex);
  * Semaphore
  */
 s32_t nrc_port_sema_init(u32_t count, nrc_port_sema_t *sema);
+s32_t nrc_port_sema_deinit(nrc_port_sema_t sema);
 s32_t nrc_port_sema_signal(nrc_port_sema_t sema);
 s32_t nrc_port_sema_wait(nrc_port_sema_t sema, u32_t timeout);
 
+/**
+ * I/O reactor
+ *
+ * See the posix port, not supported here.
+ */
+#ifndef NRC_PORT_IO_MAX
+#define NRC_PORT_IO_MAX                 (4096)  // Registered fds at a time
+#endif
+
+#define NRC_PORT_IO_IN                  (1)
+#define NRC_PORT_IO_OUT                 (2)
+
+typedef u32_t nrc_port_io_t;
+
+typedef void(*nrc_port_io_fcn_t)(void *context, u32_t ready);
+
+s32_t nrc_port_io_add(s32_t fd, u32_t interest, nrc_port_io_fcn_t fcn, void *context, nrc_port_io_t *io);
+s32_t nrc_port_io_modify(nrc_port_io_t io, u32_t interest);
+s32_t nrc_port_io_again(nrc_port_io_t io, u32_t ready);
+s32_t nrc_port_io_remove(nrc_port_io_t io);
+
+// Stops and joins the reactor thread, not alongside an add. Registrations stay, the
+// next add starts it again.
+s32_t nrc_port_io_stop(void);
+
+/**
+ * Atomics
+ *
+ * Sequentially consistent, safe to use from any thread and from interrupts.
+ * All read-modify-write operations return the previous value.
+ */
+static __inline u32_t nrc_port_atomic_load(volatile u32_t *value)
+{
+    return (u32_t)_InterlockedOr((volatile long*)value, 0);
+}
+static __inline void nrc_port_atomic_store(volatile u32_t *value, u32_t new_value)
+{
+    _InterlockedExchange((volatile long*)value, (long)new_value);
+}
+static __inline u32_t nrc_port_atomic_add(volatile u32_t *value, u32_t addend)
+{
+    return (u32_t)_InterlockedExchangeAdd((volatile long*)value, (long)addend);
+}
+static __inline u32_t nrc_port_atomic_or(volatile u32_t *value, u32_t mask)
+{
+    return (u32_t)_InterlockedOr((volatile long*)value, (long)mask);
+}
+static __inline u32_t nrc_port_atomic_and(volatile u32_t *value, u32_t mask)
+{
+    return (u32_t)_InterlockedAnd((volatile long*)value, (long)mask);
+}
+static __inline u32_t nrc_port_atomic_xchg(volatile u32_t *value, u32_t new_value)
+{
+    return (u32_t)_InterlockedExchange((volatile long*)value, (long)new_value);
+}
+static __inline bool_t nrc_port_atomic_cas(volatile u32_t *value, u32_t expected, u32_t new_value)
+{
+    return ((u32_t)_InterlockedCompareExchange((volatile long*)value, (long)new_value, (long)expected) == expected);
+}
+
+// Publish and read by a single writer, only ordered against the writer's earlier
+// writes and the reader's later reads. x86 and x64 keep that order in hardware.
+static __inline void nrc_port_atomic_store_release(volatile u32_t *value, u32_t new_value)
+{
+    _ReadWriteBarrier();
+    *value = new_value;
+}
+static __inline u32_t nrc_port_atomic_load_acquire(volatile u32_t *value)
+{
+    u32_t result = *value;
+
+    _ReadWriteBarrier();
+    return result;
+}
+
+// Counters with a single writer, read whole from any thread. No ordering.
+// Aligned 64 bit moves are whole on x64, x86 needs cmpxchg8b.
+static __inline u64_t nrc_port_atomic_load64(volatile u64_t *value)
+{
+#if defined(_M_X64) || defined(_M_ARM64)
+    return *value;
+#else
+    return (u64_t)_InterlockedCompareExchange64((volatile __int64*)value, 0, 0);
+#endif
+}
+static __inline void nrc_port_atomic_store64(volatile u64_t *value, u64_t new_value)
+{
+#if defined(_M_X64) || defined(_M_ARM64)
+    *value = new_value;
+#else
+    __int64 old;
+
+    do {
+        old = *(volatile __int64*)value;
+    } while (_InterlockedCompareExchange64((volatile __int64*)value, (__int64)new_value, old) != old);
+#endif
+}
+
+static __inline void* nrc_port_atomic_load_ptr(void *volatile *ptr)
+{
+    return _InterlockedCompareExchangePointer(ptr, 0, 0);
+}
+static __inline void nrc_port_atomic_store_ptr_release(void *volatile *ptr, void *new_value)
+{
+    _ReadWriteBarrier();
+    *ptr = new_value;
+}
+static __inline void* nrc_port_atomic_xchg_ptr(void *volatile *ptr, void *new_value)
+{
+    return _InterlockedExchangePointer(ptr, new_value);
+}
+static __inline bool_t nrc_port_atomic_cas_ptr(void *volatile *ptr, void *expected, void *new_value)
+{
+    return (_InterlockedCompareExchangePointer(ptr, new_value, expected) == expected);
+}
+
 /**
  * IRQ Disable/Enable
  * 
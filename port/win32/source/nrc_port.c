@@ -40,6 +40,10 @@ s32_t nrc_port_init(void)
 
     result = nrc_port_mutex_init(&(port.irq_mutex));
 
+    if (result == NRC_PORT_RES_OK) {
+        port.state = NRC_PORT_S_INITIALISED;
+    }
+
     return result;
 }
 
@@ -60,6 +64,76 @@ void nrc_port_heap_fast_free(void *buf)
 {
     free(buf);
 }
+s32_t nrc_port_heap_fast_stats(u32_t size_class, struct nrc_port_heap_stats *stats)
+{
+    return NRC_PORT_RES_NOT_SUPPORTED;
+}
+
+s32_t nrc_port_file_map(const s8_t *path, const u8_t **data, u32_t *size)
+{
+    s32_t           result = NRC_PORT_RES_INVALID_IN_PARAM;
+    HANDLE          file;
+    HANDLE          mapping;
+    LARGE_INTEGER   file_size;
+    LPVOID          view;
+
+    if ((path != NULL) && (data != NULL) && (size != NULL)) {
+        result = NRC_PORT_RES_NOT_FOUND;
+        *data = NULL;
+        *size = 0;
+
+        file = CreateFileA((LPCSTR)path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+        if (file != INVALID_HANDLE_VALUE) {
+            result = NRC_PORT_RES_ERROR;
+
+            if (GetFileSizeEx(file, &file_size) && (file_size.QuadPart > 0) && (file_size.QuadPart <= U32_MAX_VALUE)) {
+                mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+
+                if (mapping != NULL) {
+                    view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+
+                    // The view keeps the mapping alive
+                    CloseHandle(mapping);
+
+                    if (view != NULL) {
+                        *data = (const u8_t*)view;
+                        *size = (u32_t)file_size.QuadPart;
+                        result = NRC_PORT_RES_OK;
+                    }
+                }
+            }
+            CloseHandle(file);
+        }
+    }
+
+    return result;
+}
+s32_t nrc_port_file_unmap(const u8_t *data, u32_t size)
+{
+    s32_t result = NRC_PORT_RES_OK;
+
+    if (!UnmapViewOfFile(data)) {
+        result = NRC_PORT_RES_ERROR;
+    }
+
+    return result;
+}
+
+u64_t nrc_port_time_ns(void)
+{
+    static LARGE_INTEGER    frequency;
+    LARGE_INTEGER           now;
+
+    if (frequency.QuadPart == 0) {
+        QueryPerformanceFrequency(&frequency);
+    }
+    QueryPerformanceCounter(&now);
+
+    // Split to keep the multiplication from overflowing
+    return ((u64_t)(now.QuadPart / frequency.QuadPart) * 1000000000ULL) +
+           ((u64_t)(now.QuadPart % frequency.QuadPart) * 1000000000ULL / (u64_t)frequency.QuadPart);
+}
 
 static DWORD WINAPI win32_thread_fcn(LPVOID lpParam)
 {
@@ -110,13 +184,28 @@ s32_t nrc_port_thread_start(nrc_port_thread_t thread_id)
     
     win_result = ResumeThread((HANDLE)thread_id);
 
+    // No thread to join, it is freed here
     if (win_result == -1) {
+        TerminateThread((HANDLE)thread_id, 0);
+        CloseHandle((HANDLE)thread_id);
         result = NRC_PORT_RES_ERROR;
     }
 
 	return result;
 }
 
+s32_t nrc_port_thread_join(nrc_port_thread_t thread_id)
+{
+    s32_t result = NRC_PORT_RES_OK;
+
+    if (WaitForSingleObject((HANDLE)thread_id, INFINITE) != WAIT_OBJECT_0) {
+        result = NRC_PORT_RES_ERROR;
+    }
+    CloseHandle((HANDLE)thread_id);
+
+    return result;
+}
+
 /*
 s32_t nrc_port_queue_init(u32_t size, nrc_port_queue_t *queue)
 {
@@ -151,6 +240,12 @@ s32_t nrc_port_mutex_init(nrc_port_mutex_t *mutex)
 
 	return result;
 }
+s32_t nrc_port_mutex_deinit(nrc_port_mutex_t mutex)
+{
+    CloseHandle((HANDLE)mutex);
+
+    return NRC_PORT_RES_OK;
+}
 s32_t nrc_port_mutex_lock(nrc_port_mutex_t mutex, u32_t timeout)
 {
     s32_t   result;
@@ -211,6 +306,12 @@ s32_t nrc_port_sema_init(u32_t count, nrc_port_sema_t *sema)
 
 	return result;
 }
+s32_t nrc_port_sema_deinit(nrc_port_sema_t sema)
+{
+    CloseHandle((HANDLE)sema);
+
+    return NRC_PORT_RES_OK;
+}
 s32_t nrc_port_sema_signal(nrc_port_sema_t sema)
 {
     s32_t   result = NRC_PORT_RES_OK;
@@ -249,6 +350,27 @@ s32_t nrc_port_sema_wait(nrc_port_sema_t sema, u32_t timeout)
 	return result;
 }
 
+s32_t nrc_port_io_add(s32_t fd, u32_t interest, nrc_port_io_fcn_t fcn, void *context, nrc_port_io_t *io)
+{
+    return NRC_PORT_RES_NOT_SUPPORTED;
+}
+s32_t nrc_port_io_modify(nrc_port_io_t io, u32_t interest)
+{
+    return NRC_PORT_RES_NOT_SUPPORTED;
+}
+s32_t nrc_port_io_again(nrc_port_io_t io, u32_t ready)
+{
+    return NRC_PORT_RES_NOT_SUPPORTED;
+}
+s32_t nrc_port_io_remove(nrc_port_io_t io)
+{
+    return NRC_PORT_RES_NOT_SUPPORTED;
+}
+s32_t nrc_port_io_stop(void)
+{
+    return NRC_PORT_RES_OK;
+}
+
 s32_t nrc_port_irq_disable(void)
 {
     assert(port.state == NRC_PORT_S_INITIALISED);
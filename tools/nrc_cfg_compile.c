@@ -0,0 +1,67 @@
+/**
+ * Copyright 2017 Tomas Frisberg & Ola Bjorsne
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http ://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Compiles a Node-RED flows.json into a binary config image that nrc_cfg_init
+ * reads in place, from a mapped file or a flash address.
+ *
+ * usage: nrc_cfg_compile <flows.json> <image>
+ */
+
+#include <stdio.h>
+
+#include "nrc_port.h"
+#include "nrc_cfg.h"
+
+int main(int argc, char *argv[])
+{
+    u8_t    *image;
+    u32_t   size;
+    FILE    *file;
+    int     result = 1;
+
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s <flows.json> <image>\n", argv[0]);
+        return 1;
+    }
+
+    nrc_port_init();
+
+    if (nrc_cfg_init_file((const s8_t*)argv[1]) != NRC_PORT_RES_OK) {
+        fprintf(stderr, "failed to load %s\n", argv[1]);
+        return 1;
+    }
+
+    if (nrc_cfg_build_image(&image, &size) != NRC_PORT_RES_OK) {
+        fprintf(stderr, "failed to compile %s\n", argv[1]);
+        nrc_cfg_deinit();
+        return 1;
+    }
+
+    file = fopen(argv[2], "wb");
+    if ((file != NULL) && (fwrite(image, 1, size, file) == size) && (fclose(file) == 0)) {
+        printf("%s: %u bytes\n", argv[2], size);
+        result = 0;
+    }
+    else {
+        fprintf(stderr, "failed to write %s\n", argv[2]);
+    }
+
+    nrc_port_heap_free(image);
+    nrc_cfg_deinit();
+
+    return result;
+}
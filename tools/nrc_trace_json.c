@@ -0,0 +1,256 @@
+/**
+ * Copyright 2017 Tomas Frisberg & Ola Bjorsne
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http ://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Converts a trace snapshot from nrc_trace_snapshot into Chrome trace JSON,
+ * for chrome://tracing or ui.perfetto.dev.
+ *
+ * Each thread is a track, a node turn is a slice named after the node and
+ * sends are joined to the receiving recv_msg by flow arrows.
+ *
+ * usage: nrc_trace_json <snapshot> <trace.json>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nrc_port.h"
+#include "nrc_trace.h"
+
+struct trace_json {
+    const struct nrc_trace_snapshot_hdr *hdr;
+    const struct nrc_trace_rec          *rec;
+    struct nrc_trace_name               *name;
+    double                              ns_per_tick;
+    FILE                                *out;
+    bool_t                              first;
+};
+
+static int trace_name_cmp(const void *a, const void *b)
+{
+    u64_t node_a = ((const struct nrc_trace_name*)a)->node;
+    u64_t node_b = ((const struct nrc_trace_name*)b)->node;
+
+    return (node_a < node_b) ? -1 : ((node_a > node_b) ? 1 : 0);
+}
+
+static void trace_write_node(struct trace_json *trace, u64_t node)
+{
+    struct nrc_trace_name   key;
+    struct nrc_trace_name   *name = 0;
+    u32_t                   i;
+
+    key.node = node;
+    if (trace->name != 0) {
+        name = (struct nrc_trace_name*)bsearch(&key, trace->name, trace->hdr->name_count,
+            sizeof(struct nrc_trace_name), trace_name_cmp);
+    }
+
+    if (name == 0) {
+        fprintf(trace->out, "0x%llx", (unsigned long long)node);
+    }
+    else {
+        for (i = 0; (i < NRC_MAX_CFG_NAME_LEN) && (name->cfg_id[i] != 0); i++) {
+            u8_t c = (u8_t)name->cfg_id[i];
+
+            if ((c == '"') || (c == '\\')) {
+                fputc('\\', trace->out);
+            }
+            if (c >= 0x20) {
+                fputc(c, trace->out);
+            }
+        }
+    }
+}
+
+// Common fields of one event, the caller adds the rest and the closing brace
+static void trace_write_event(struct trace_json *trace, const struct nrc_trace_rec *rec, const char *ph)
+{
+    double us = (double)(rec->ticks - trace->hdr->ticks_start) * trace->ns_per_tick / 1000.0;
+
+    fprintf(trace->out, "%s\n{\"ph\":\"%s\",\"pid\":1,\"tid\":%u,\"ts\":%.3f",
+        trace->first ? "" : ",", ph, rec->thread, us);
+    trace->first = FALSE;
+}
+
+static void trace_write_record(struct trace_json *trace, const struct nrc_trace_rec *rec)
+{
+    FILE *out = trace->out;
+
+    switch (rec->kind) {
+    case NRC_TRACE_K_TURN_BEGIN:
+        trace_write_event(trace, rec, "B");
+        fprintf(out, ",\"cat\":\"turn\",\"name\":\"");
+        trace_write_node(trace, rec->node);
+        fprintf(out, "\"}");
+        break;
+
+    case NRC_TRACE_K_TURN_END:
+        trace_write_event(trace, rec, "E");
+        fprintf(out, ",\"args\":{\"msgs\":%u}}", rec->arg);
+        break;
+
+    case NRC_TRACE_K_SEND:
+        trace_write_event(trace, rec, "i");
+        fprintf(out, ",\"s\":\"t\",\"cat\":\"msg\",\"name\":\"send\",\"args\":{\"to\":\"");
+        trace_write_node(trace, rec->node);
+        fprintf(out, "\",\"msg\":\"0x%llx\",\"prio\":%d}}", (unsigned long long)rec->msg, (s8_t)rec->arg);
+        trace_write_event(trace, rec, "s");
+        fprintf(out, ",\"cat\":\"msg\",\"name\":\"msg\",\"id\":\"0x%llx\"}", (unsigned long long)rec->msg);
+        break;
+
+    case NRC_TRACE_K_RECV_MSG:
+        trace_write_event(trace, rec, "i");
+        fprintf(out, ",\"s\":\"t\",\"cat\":\"msg\",\"name\":\"recv_msg\",\"args\":{\"msg\":\"0x%llx\"}}",
+            (unsigned long long)rec->msg);
+        trace_write_event(trace, rec, "f");
+        fprintf(out, ",\"bp\":\"e\",\"cat\":\"msg\",\"name\":\"msg\",\"id\":\"0x%llx\"}", (unsigned long long)rec->msg);
+        break;
+
+    case NRC_TRACE_K_RECV_EVT:
+        trace_write_event(trace, rec, "i");
+        fprintf(out, ",\"s\":\"t\",\"cat\":\"evt\",\"name\":\"recv_evt\",\"args\":{\"mask\":\"0x%x\"}}", rec->arg);
+        break;
+
+    case NRC_TRACE_K_SET_EVT:
+        trace_write_event(trace, rec, "i");
+        fprintf(out, ",\"s\":\"t\",\"cat\":\"evt\",\"name\":\"set_evt\",\"args\":{\"to\":\"");
+        trace_write_node(trace, rec->node);
+        fprintf(out, "\",\"mask\":\"0x%x\"}}", rec->arg);
+        break;
+
+    case NRC_TRACE_K_MSG_ALLOC:
+        trace_write_event(trace, rec, "i");
+        fprintf(out, ",\"s\":\"t\",\"cat\":\"heap\",\"name\":\"msg_alloc\",\"args\":{\"msg\":\"0x%llx\",\"size\":%u}}",
+            (unsigned long long)rec->msg, rec->arg);
+        break;
+
+    case NRC_TRACE_K_MSG_FREE:
+        trace_write_event(trace, rec, "i");
+        fprintf(out, ",\"s\":\"t\",\"cat\":\"heap\",\"name\":\"msg_free\",\"args\":{\"msg\":\"0x%llx\"}}",
+            (unsigned long long)rec->msg);
+        break;
+
+    case NRC_TRACE_K_IDLE:
+        trace_write_event(trace, rec, "i");
+        fprintf(out, ",\"s\":\"t\",\"cat\":\"turn\",\"name\":\"idle\"}");
+        break;
+
+    default:
+        break;
+    }
+}
+
+static bool_t trace_valid(const u8_t *data, u32_t size)
+{
+    const struct nrc_trace_snapshot_hdr *hdr = (const struct nrc_trace_snapshot_hdr*)data;
+    bool_t                              valid = FALSE;
+
+    if ((size >= sizeof(struct nrc_trace_snapshot_hdr)) &&
+        (hdr->magic == NRC_TRACE_SNAPSHOT_MAGIC) &&
+        (hdr->version == NRC_TRACE_SNAPSHOT_VERSION) &&
+        (hdr->record_size == sizeof(struct nrc_trace_rec)) &&
+        (hdr->image_size <= size) &&
+        (hdr->record_offset <= hdr->image_size) &&
+        (hdr->record_count <= (hdr->image_size - hdr->record_offset) / sizeof(struct nrc_trace_rec)) &&
+        (hdr->name_offset <= hdr->image_size) &&
+        (hdr->name_count <= (hdr->image_size - hdr->name_offset) / sizeof(struct nrc_trace_name))) {
+        valid = TRUE;
+    }
+
+    return valid;
+}
+
+int main(int argc, char *argv[])
+{
+    struct trace_json   trace;
+    const u8_t          *data;
+    u32_t               size;
+    u32_t               threads = 0;
+    u32_t               i;
+    int                 result = 1;
+
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s <snapshot> <trace.json>\n", argv[0]);
+        return 1;
+    }
+
+    nrc_port_init();
+
+    if (nrc_port_file_map((const s8_t*)argv[1], &data, &size) != NRC_PORT_RES_OK) {
+        fprintf(stderr, "failed to read %s\n", argv[1]);
+        return 1;
+    }
+    if (!trace_valid(data, size)) {
+        fprintf(stderr, "%s is not a trace snapshot\n", argv[1]);
+        nrc_port_file_unmap(data, size);
+        return 1;
+    }
+
+    memset(&trace, 0, sizeof(trace));
+    trace.hdr = (const struct nrc_trace_snapshot_hdr*)data;
+    trace.rec = (const struct nrc_trace_rec*)(data + trace.hdr->record_offset);
+    trace.first = TRUE;
+
+    // Ticks run at a constant rate, the two points in the header give it
+    trace.ns_per_tick = 1.0;
+    if (trace.hdr->ticks_end > trace.hdr->ticks_start) {
+        trace.ns_per_tick = (double)(trace.hdr->ns_end - trace.hdr->ns_start) /
+                            (double)(trace.hdr->ticks_end - trace.hdr->ticks_start);
+    }
+
+    if (trace.hdr->name_count != 0) {
+        trace.name = (struct nrc_trace_name*)malloc(trace.hdr->name_count * sizeof(struct nrc_trace_name));
+        if (trace.name != 0) {
+            memcpy(trace.name, data + trace.hdr->name_offset, trace.hdr->name_count * sizeof(struct nrc_trace_name));
+            qsort(trace.name, trace.hdr->name_count, sizeof(struct nrc_trace_name), trace_name_cmp);
+        }
+    }
+
+    trace.out = fopen(argv[2], "w");
+    if (trace.out != NULL) {
+        fprintf(trace.out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+
+        for (i = 0; i < trace.hdr->record_count; i++) {
+            trace_write_record(&trace, &trace.rec[i]);
+
+            if (trace.rec[i].thread >= threads) {
+                threads = trace.rec[i].thread + 1u;
+            }
+        }
+        for (i = 0; i < threads; i++) {
+            fprintf(trace.out, "%s\n{\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"name\":\"thread_name\",\"args\":{\"name\":\"thread %u\"}}",
+                trace.first ? "" : ",", i, i);
+            trace.first = FALSE;
+        }
+
+        fprintf(trace.out, "\n]}\n");
+
+        if (fclose(trace.out) == 0) {
+            printf("%s: %u records\n", argv[2], trace.hdr->record_count);
+            result = 0;
+        }
+    }
+    if (result != 0) {
+        fprintf(stderr, "failed to write %s\n", argv[2]);
+    }
+
+    free(trace.name);
+    nrc_port_file_unmap(data, size);
+
+    return result;
+}